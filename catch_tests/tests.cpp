@@ -6,15 +6,29 @@
 #include "../graph/tarjansSCC.cpp"
 #include "../dataset/parsing.cpp"
 #include "../storage/btree_db_v2.hpp"
+#include "../storage/bloom_filter.hpp"
+#include "../storage/record_cache.hpp"
+#include "../storage/latency_histogram.hpp"
+#include "../storage/page_table.hpp"
+#include "../storage/page_arena.hpp"
+#include "../storage/sharded_btree_db.hpp"
 #include "../storage/btree_types.cpp"
+#include "../storage/posting_index.hpp"
+#include "../storage/external_sort.hpp"
+#include "../storage/title_index.hpp"
+#include "../storage/paper_columns.hpp"
 #include "../graph/dijkstrasSP.cpp"
 #include "time.h"
 
 #include <algorithm>
 #include <unordered_set>
 #include <unordered_map>
+#include <map>
+#include <set>
 #include <random>
 #include <climits>
+#include <thread>
+#include <atomic>
 
 std::string gen_random(const int len) {
     static const char alphanum[] =
@@ -313,6 +327,1844 @@ TEST_CASE("BTree - find_id, splitting") {
     }
 }
 
+TEST_CASE("BTree - mmap read only") {
+    std::unordered_map<long, test::Entry> record;
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+        for (unsigned int i = 0; i < 10000; ++i) {
+            int curr = rand() % INT_MAX;
+            record[curr] = test::Entry(rand() % INT_MAX, gen_random(10), curr);
+            db.insert(record[curr].id, record[curr]);
+        }
+    }
+
+    BTreeConfig no_mmap;
+    no_mmap.use_mmap = false;
+
+    BTreeDB<test::Entry> mapped_db("test_db_keys.db", "test_db_values.db", false, true);
+    BTreeDB<test::Entry> cached_db("test_db_keys.db", "test_db_values.db", false, true, no_mmap);
+
+    for (const auto& pair : record) {
+        REQUIRE(mapped_db.find(pair.first).x == record[pair.first].x);
+        REQUIRE(mapped_db.find(pair.first).id == cached_db.find(pair.first).id);
+        REQUIRE(std::string(mapped_db.find(pair.first).str.data()) == std::string(record[pair.first].str.data()));
+    }
+
+    REQUIRE(mapped_db.find(-1).id == -1);
+
+    // inserting is a no-op on read only instances, mapped or not
+    test::Entry extra(1, "extra", 5);
+    mapped_db.insert(extra.id, extra);
+    REQUIRE(mapped_db.find(extra.id).id == (record.count(5) ? 5 : -1));
+}
+
+TEST_CASE("BTree - bounded cache with eviction") {
+    std::unordered_map<long, test::Entry> record;
+
+    // the minimum budget (64 pages) is far smaller than the tree, so pages are constantly evicted and written back
+    BTreeConfig small_cache;
+    small_cache.cache_bytes = 0;
+    small_cache.use_mmap = false;
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, small_cache);
+        for (unsigned int i = 0; i < 50000; ++i) {
+            int curr = rand() % INT_MAX;
+            record[curr] = test::Entry(rand() % INT_MAX, gen_random(10), curr);
+            db.insert(record[curr].id, record[curr]);
+        }
+
+        for (const auto& pair : record) {
+            REQUIRE(db.find(pair.first).x == record[pair.first].x);
+        }
+    }
+
+    BTreeDB<test::Entry> new_db("test_db_keys.db", "test_db_values.db", false, true, small_cache);
+
+    for (const auto& pair : record) {
+        REQUIRE(new_db.find(pair.first).x == record[pair.first].x);
+        REQUIRE(new_db.find(pair.first).id == record[pair.first].id);
+        REQUIRE(std::string(new_db.find(pair.first).str.data()) == std::string(record[pair.first].str.data()));
+    }
+}
+
+TEST_CASE("BTree - bulk load") {
+    std::map<long, test::Entry> record;
+    std::vector<std::pair<long, test::Entry>> sorted;
+
+    for (unsigned int i = 0; i < 20000; ++i) {
+        int curr = rand() % INT_MAX;
+        record[curr] = test::Entry(rand() % INT_MAX, gen_random(10), curr);
+    }
+    for (const auto& pair : record) {
+        // repeated keys collapse into the last value
+        if (pair.first % 7 == 0) {
+            sorted.emplace_back(pair.first, test::Entry(-1, "stale", pair.first));
+        }
+        sorted.emplace_back(pair.first, pair.second);
+    }
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+        db.bulk_load(sorted.begin(), sorted.end());
+
+        for (const auto& pair : record) {
+            REQUIRE(db.find(pair.first).x == pair.second.x);
+        }
+
+        // the bulk loaded tree should still handle splits from normal inserts
+        for (unsigned int i = 0; i < 5000; ++i) {
+            int curr = rand() % INT_MAX;
+            record[curr] = test::Entry(rand() % INT_MAX, gen_random(10), curr);
+            db.insert(record[curr].id, record[curr]);
+        }
+    }
+
+    BTreeDB<test::Entry> new_db("test_db_keys.db", "test_db_values.db", false, true);
+    for (const auto& pair : record) {
+        REQUIRE(new_db.find(pair.first).x == pair.second.x);
+        REQUIRE(std::string(new_db.find(pair.first).str.data()) == std::string(pair.second.str.data()));
+    }
+}
+
+TEST_CASE("BTree - bulk load fill factor and unsorted input") {
+    std::vector<std::pair<long, test::Entry>> sorted;
+    for (long i = 0; i < 3000; ++i) {
+        sorted.emplace_back(i * 3, test::Entry(static_cast<int>(i), gen_random(10), i * 3));
+    }
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+        db.bulk_load(sorted.begin(), sorted.end(), 0.5);
+
+        for (const auto& pair : sorted) {
+            REQUIRE(db.find(pair.first).x == pair.second.x);
+            REQUIRE(db.find(pair.first + 1).id == -1);
+        }
+
+        // only empty databases can be bulk loaded
+        REQUIRE_THROWS(db.bulk_load(sorted.begin(), sorted.end()));
+    }
+
+    std::swap(sorted[10], sorted[20]);
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+    REQUIRE_THROWS(db.bulk_load(sorted.begin(), sorted.end()));
+}
+
+TEST_CASE("BTree - cursors and range scans") {
+    std::map<long, test::Entry> record;
+
+    // the old database simulated below has to be in the layout databases had back then
+    BTreeConfig interleaved;
+    interleaved.key_format = Interleaved;
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, interleaved);
+        for (unsigned int i = 0; i < 10000; ++i) {
+            int curr = rand() % INT_MAX;
+            record[curr] = test::Entry(rand() % INT_MAX, gen_random(10), curr);
+            db.insert(record[curr].id, record[curr]);
+        }
+
+        // forward over everything
+        auto expected = record.begin();
+        for (auto iter = db.first(); iter.valid(); iter.next()) {
+            REQUIRE(expected != record.end());
+            REQUIRE(iter.key() == expected->first);
+            REQUIRE(iter.value().x == expected->second.x);
+            ++expected;
+        }
+        REQUIRE(expected == record.end());
+
+        // backward over everything
+        auto rexpected = record.rbegin();
+        for (auto iter = db.last(); iter.valid(); iter.prev()) {
+            REQUIRE(iter.key() == rexpected->first);
+            ++rexpected;
+        }
+        REQUIRE(rexpected == record.rend());
+
+        // half open range [lo, hi)
+        long lo = INT_MAX / 4;
+        long hi = INT_MAX / 2;
+        std::vector<long> scanned;
+        db.scan(lo, hi, [&](long key, const test::Entry& value) {
+            REQUIRE(value.id == key);
+            scanned.push_back(key);
+        });
+
+        std::vector<long> in_range;
+        for (auto iter = record.lower_bound(lo); iter != record.end() && iter->first < hi; ++iter) {
+            in_range.push_back(iter->first);
+        }
+        REQUIRE(scanned == in_range);
+
+        REQUIRE(db.lower_bound(record.rbegin()->first + 1).valid() == false);
+        REQUIRE(db.lower_bound(LONG_MIN).key() == record.begin()->first);
+    }
+
+    // drop the leaf_links line from the metadata to simulate a database from before the links existed
+    {
+        std::ifstream ifs("test_db_keystest_db_values.txt");
+        std::string lines[4];
+        for (std::string& line : lines) {
+            std::getline(ifs, line);
+        }
+        ifs.close();
+
+        std::ofstream ofs("test_db_keystest_db_values.txt", std::ios::trunc);
+        for (std::string& line : lines) {
+            ofs << line << std::endl;
+        }
+    }
+
+    BTreeDB<test::Entry> old_db("test_db_keys.db", "test_db_values.db", false, true);
+    auto expected = record.begin();
+    for (auto iter = old_db.first(); iter.valid(); iter.next()) {
+        REQUIRE(iter.key() == expected->first);
+        ++expected;
+    }
+    REQUIRE(expected == record.end());
+
+    auto rexpected = record.rbegin();
+    for (auto iter = old_db.last(); iter.valid(); iter.prev()) {
+        REQUIRE(iter.key() == rexpected->first);
+        ++rexpected;
+    }
+    REQUIRE(rexpected == record.rend());
+}
+
+TEST_CASE("BTree - cursors over a bulk loaded tree") {
+    std::vector<std::pair<long, test::Entry>> sorted;
+    for (long i = 0; i < 5000; ++i) {
+        sorted.emplace_back(i * 2, test::Entry(static_cast<int>(i), gen_random(10), i * 2));
+    }
+
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+    db.bulk_load(sorted.begin(), sorted.end(), 0.7);
+
+    long count = 0;
+    db.scan(1000, 3001, [&](long key, const test::Entry& value) {
+        REQUIRE(key == 1000 + count * 2);
+        REQUIRE(value.x == key / 2);
+        ++count;
+    });
+    REQUIRE(count == 1001);
+
+    auto iter = db.lower_bound(3);
+    REQUIRE(iter.key() == 4);
+    REQUIRE(iter.prev());
+    REQUIRE(iter.key() == 2);
+}
+
+TEST_CASE("BTree - batched find and insert") {
+    std::map<long, int> expected;
+    std::vector<std::pair<long, test::Entry>> batch;
+    for (int i = 0; i < 20000; ++i) {
+        long key = rand() % 15000;
+        batch.emplace_back(key, test::Entry(i, gen_random(10), key));
+        expected[key] = i;
+    }
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+        db.insert_many(batch);
+
+        // overwrite some keys and add some new ones in a second batch
+        std::vector<std::pair<long, test::Entry>> second;
+        for (int i = 0; i < 5000; ++i) {
+            long key = rand() % 20000;
+            second.emplace_back(key, test::Entry(-i, gen_random(10), key));
+            expected[key] = -i;
+        }
+        db.insert_many(second);
+    }
+
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+
+    long count = 0;
+    db.scan(LONG_MIN, LONG_MAX, [&](long key, const test::Entry& value) {
+        REQUIRE(expected.count(key) == 1);
+        REQUIRE(value.x == expected[key]);
+        ++count;
+    });
+    REQUIRE(count == static_cast<long>(expected.size()));
+
+    // unsorted keys with duplicates and misses come back in input order
+    std::vector<long> keys;
+    for (int i = 0; i < 3000; ++i) {
+        keys.push_back(rand() % 25000 - 1000);
+    }
+    std::vector<test::Entry> found = db.find_many(keys);
+    REQUIRE(found.size() == keys.size());
+    for (unsigned int i = 0; i < keys.size(); ++i) {
+        if (expected.count(keys[i]) == 1) {
+            REQUIRE(found[i].id == keys[i]);
+            REQUIRE(found[i].x == expected[keys[i]]);
+        } else {
+            REQUIRE(found[i].id == NULL_VAL);
+        }
+    }
+
+    REQUIRE(db.find_many(std::vector<long>()).empty());
+}
+
+TEST_CASE("BTree - name index") {
+    // the old database simulated below has to be in the layout databases had back then
+    BTreeConfig interleaved;
+    interleaved.key_format = Interleaved;
+
+    {
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", true, false, interleaved);
+        for (long i = 0; i < 3000; ++i) {
+            author::Entry entry("author " + std::to_string(i % 1000), "org", i);
+            db.insert(entry.id, entry);
+        }
+
+        // every name is shared by three ids
+        std::vector<long> ids = db.get_ids_from_name(author::Entry("author 42"));
+        REQUIRE(ids == std::vector<long>({42, 1042, 2042}));
+        REQUIRE(db.get_id_from_name(author::Entry("author 42")) == 42);
+        REQUIRE(db.get_id_from_name(author::Entry("nobody")) == -1);
+
+        // renaming moves the id to the new name
+        author::Entry renamed("someone else", "org", 1042);
+        db.insert(renamed.id, renamed);
+        REQUIRE(db.get_ids_from_name(author::Entry("author 42")) == std::vector<long>({42, 2042}));
+        REQUIRE(db.get_ids_from_name(author::Entry("someone else")) == std::vector<long>({1042}));
+
+        // the freed slot is reused
+        author::Entry back("author 42", "org", 5000);
+        db.insert(back.id, back);
+        std::vector<long> back_ids = db.get_ids_from_name(author::Entry("author 42"));
+        std::sort(back_ids.begin(), back_ids.end());
+        REQUIRE(back_ids == std::vector<long>({42, 2042, 5000}));
+    }
+
+    // the index persists and is used by read only instances
+    {
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        REQUIRE(db.get_ids_from_name(author::Entry("author 999")) == std::vector<long>({999, 1999, 2999}));
+    }
+
+    // databases from before the index existed get one the first time they are opened as writable
+    {
+        std::ifstream meta_in("test_db_keystest_db_values.txt");
+        std::string line, old_meta;
+        for (int i = 0; i < 4 && std::getline(meta_in, line); ++i) {
+            old_meta += line + "\n";
+        }
+        meta_in.close();
+        std::ofstream meta_out("test_db_keystest_db_values.txt", std::ios::trunc);
+        meta_out << old_meta;
+    }
+    {
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        REQUIRE(db.get_id_from_name(author::Entry("author 7")) == 7);
+    }
+    {
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db");
+        REQUIRE(db.get_ids_from_name(author::Entry("author 7")) == std::vector<long>({7, 1007, 2007}));
+    }
+    {
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        REQUIRE(db.get_ids_from_name(author::Entry("someone else")) == std::vector<long>({1042}));
+    }
+}
+
+TEST_CASE("BTree - name index from bulk load") {
+    std::vector<std::pair<long, author::Entry>> sorted;
+    for (long i = 0; i < 5000; ++i) {
+        sorted.emplace_back(i, author::Entry("author " + std::to_string(i % 2500), "org", i));
+    }
+
+    BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", true);
+    db.bulk_load(sorted.begin(), sorted.end());
+
+    for (long i = 0; i < 2500; i += 97) {
+        REQUIRE(db.get_ids_from_name(author::Entry("author " + std::to_string(i))) == std::vector<long>({i, i + 2500}));
+    }
+}
+
+TEST_CASE("BTree - full name index") {
+    // every id with the same name, filling every slot of its hash
+    std::vector<std::pair<long, test::Entry>> sorted;
+    for (long i = 0; i < (1L << NAME_DUP_BITS); ++i) {
+        sorted.emplace_back(i, test::Entry(5, "a", i));
+    }
+
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+    db.bulk_load(sorted.begin(), sorted.end());
+
+    // the error comes out while the leaf is latched, and neither tree keeps the id
+    test::Entry extra(5, "a", 1L << NAME_DUP_BITS);
+    REQUIRE_THROWS_WITH(db.insert(extra.id, extra), "too many ids with the same name hash in the name index");
+    REQUIRE(db.find(extra.id).id == NULL_VAL);
+    REQUIRE(db.stats().entries == (1UL << NAME_DUP_BITS));
+    REQUIRE(db.get_ids_from_name(test::Entry(5)).size() == (1UL << NAME_DUP_BITS));
+
+    // the database is still usable afterwards
+    test::Entry other(6, "b", 1L << 20);
+    db.insert(other.id, other);
+    REQUIRE(db.get_id_from_name(test::Entry(6)) == other.id);
+}
+
+TEST_CASE("External sort") {
+    std::vector<long> keys;
+    for (long i = 0; i < 5000; ++i) {
+        keys.push_back(rand() % 2000);
+    }
+
+    {
+        // a tiny run size, so the records are spread over many runs
+        ExternalSorter<test::Entry> sorter("test_sort", 100 * sizeof(std::pair<long, test::Entry>));
+        for (size_t i = 0; i < keys.size(); ++i) {
+            sorter.add(keys[i], test::Entry(static_cast<int>(i), "abc", keys[i]));
+        }
+        REQUIRE(sorter.size() == keys.size());
+        REQUIRE(sorter.num_runs() >= 40);
+
+        // keys in order, and records with the same key in the order they were added
+        std::vector<std::pair<long, int>> expected;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            expected.push_back({keys[i], static_cast<int>(i)});
+        }
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<std::pair<long, int>> merged;
+        for (auto iter = sorter.begin(); iter != sorter.end(); ++iter) {
+            merged.push_back({iter->first, iter->second.x});
+            REQUIRE(std::string(iter->second.str.data()) == "abc");
+        }
+        REQUIRE(merged == expected);
+        REQUIRE_THROWS(sorter.begin());
+    }
+    // the runs are gone with the sorter
+    REQUIRE(!std::ifstream("test_sort.0.run").is_open());
+
+    // bulk loading through a sorter keeps the last copy of every key
+    ExternalSorter<test::Entry> sorter("test_sort", 100 * sizeof(std::pair<long, test::Entry>));
+    std::map<long, int> last;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        sorter.add(keys[i], test::Entry(static_cast<int>(i), "a", keys[i]));
+        last[keys[i]] = static_cast<int>(i);
+    }
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+    db.bulk_load(sorter.begin(), sorter.end());
+    long mismatches = 0;
+    for (const auto& entry : last) {
+        if (db.find(entry.first).x != entry.second) {
+            ++mismatches;
+        }
+    }
+    REQUIRE(mismatches == 0);
+}
+
+TEST_CASE("Posting index") {
+    std::map<long, std::set<long>> expected;
+    std::vector<std::pair<long, long>> pairs;
+    for (int i = 0; i < 50000; ++i) {
+        long author = rand() % 2000;
+        // mix of small gaps and ids past 32 bits
+        long paper = (i % 3 == 0) ? 3000000000L + rand() % 1000000 : rand() % 100000;
+        pairs.push_back({author, paper});
+        pairs.push_back({author, paper});
+        expected[author].insert(paper);
+    }
+
+    PostingIndex::build("test_postings.idx", pairs);
+    PostingIndex index("test_postings.idx");
+
+    REQUIRE(index.size() == expected.size());
+    for (const auto& entry : expected) {
+        REQUIRE(index.get(entry.first) == std::vector<long>(entry.second.begin(), entry.second.end()));
+    }
+    REQUIRE(index.get(-5).empty());
+    REQUIRE(index.get(100000).empty());
+
+    std::vector<std::pair<long, long>> none;
+    PostingIndex::build("test_postings_empty.idx", none);
+    PostingIndex empty("test_postings_empty.idx");
+    REQUIRE(empty.size() == 0);
+    REQUIRE(empty.get(1).empty());
+}
+
+TEST_CASE("Paper columns") {
+    std::vector<paper::Entry> papers;
+    std::map<uint32_t, std::pair<uint64_t, uint64_t>> expected_years;
+    std::mt19937 gen(5);
+    for (long id = 10; papers.size() < 10000; id += 1 + gen() % 7) {
+        paper::Entry entry;
+        entry.id = id;
+        entry.pub_year = 1990 + gen() % 30;
+        entry.n_citations = gen() % 1000;
+        papers.push_back(entry);
+
+        ++expected_years[entry.pub_year].first;
+        expected_years[entry.pub_year].second += entry.n_citations;
+    }
+
+    {
+        PaperColumns::Builder builder;
+        for (const paper::Entry& entry : papers) {
+            builder.add(entry);
+        }
+        REQUIRE_THROWS(builder.add(papers[0]));
+        builder.write("test_");
+    }
+    PaperColumns columns("test_");
+    REQUIRE(columns.size() == papers.size());
+
+    long rows = 0;
+    columns.scan([&](const long* ids, const uint32_t* years, const uint32_t* citations, size_t n) {
+        REQUIRE(n <= COLUMN_BLOCK_ROWS);
+        for (size_t i = 0; i < n; ++i) {
+            REQUIRE(ids[i] == papers[rows].id);
+            REQUIRE(years[i] == papers[rows].pub_year);
+            REQUIRE(citations[i] == papers[rows].n_citations);
+            ++rows;
+        }
+    });
+    REQUIRE(rows == static_cast<long>(papers.size()));
+
+    std::vector<PaperColumns::YearTotals> years = columns.by_year();
+    REQUIRE(years.size() == expected_years.size());
+    uint64_t total = 0, from_2000 = 0;
+    for (const PaperColumns::YearTotals& totals : years) {
+        REQUIRE(expected_years[totals.year] == std::make_pair(totals.papers, totals.citations));
+        total += totals.citations;
+        from_2000 += totals.year >= 2000 && totals.year <= 2009 ? totals.citations : 0;
+    }
+    REQUIRE(columns.total_citations(0, UINT32_MAX) == total);
+    REQUIRE(columns.total_citations(2000, 2009) == from_2000);
+
+    // most cited first, ties broken by the smaller id
+    std::vector<paper::Entry> ranked;
+    std::copy_if(papers.begin(), papers.end(), std::back_inserter(ranked), [](const paper::Entry& entry) {
+        return entry.pub_year >= 2005 && entry.pub_year <= 2010;
+    });
+    std::sort(ranked.begin(), ranked.end(), [](const paper::Entry& a, const paper::Entry& b) {
+        return a.n_citations > b.n_citations || (a.n_citations == b.n_citations && a.id < b.id);
+    });
+    std::vector<long> top = columns.top_cited(25, 2005, 2010);
+    REQUIRE(top.size() == 25);
+    for (size_t i = 0; i < top.size(); ++i) {
+        REQUIRE(top[i] == ranked[i].id);
+    }
+    REQUIRE(columns.top_cited(0).empty());
+    REQUIRE(columns.top_cited(5, 2050, 2060).empty());
+    REQUIRE(columns.top_cited(20000).size() == papers.size());
+
+    REQUIRE_THROWS(PaperColumns("test_missing_"));
+}
+
+TEST_CASE("Title index") {
+    std::vector<std::string> words({"graph", "neural", "network", "learning", "database", "query", "b+tree", "index", "Parallel", "SEARCH"});
+    std::map<long, std::string> titles;
+
+    {
+        BTreeDB<paper::Entry> db("test_db_keys.db", "test_db_values.db", true);
+        PostingIndex::Builder builder;
+        for (long id = 1; id <= 3000; ++id) {
+            std::string title;
+            for (int i = 0; i < 4; ++i) {
+                title += words[rand() % words.size()] + (i == 3 ? "" : " ");
+            }
+            std::string keywords;
+            paper::Entry entry(title, keywords, 0, 2000, {}, id * 7);
+            db.insert(entry.id, entry);
+            TitleIndex::add_title(builder, entry.title.c_str(), entry.id);
+            titles[entry.id] = TitleIndex::normalize(title);
+        }
+        builder.write("test_titles.idx");
+    }
+
+    REQUIRE(TitleIndex::normalize("  Deep-Learning: a B+Tree SURVEY!! ") == "deep learning a b tree survey");
+
+    BTreeDB<paper::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+    TitleIndex index("test_titles.idx");
+
+    // substring search matches the brute force answer
+    std::vector<long> expected;
+    for (const auto& title : titles) {
+        if (title.second.find("network learning") != std::string::npos) {
+            expected.push_back(title.first);
+        }
+    }
+    REQUIRE(index.search(db, "Network-Learning", false, 0) == expected);
+
+    // keyword search needs every word, in any order
+    expected.clear();
+    for (const auto& title : titles) {
+        if (title.second.find("search") != std::string::npos && title.second.find("tree") != std::string::npos && title.second.find("graph") != std::string::npos) {
+            expected.push_back(title.first);
+        }
+    }
+    REQUIRE(index.search(db, "tree graph search", true, 0) == expected);
+
+    // limits are applied in id order
+    std::vector<long> limited = index.search(db, "tree graph search", true, 3);
+    REQUIRE(limited == std::vector<long>(expected.begin(), expected.begin() + std::min<size_t>(3, expected.size())));
+
+    REQUIRE(index.search(db, "quantum", false, 0).empty());
+    REQUIRE_THROWS(index.search(db, "b+", false, 0));
+}
+
+TEST_CASE("BTree - record views") {
+    std::unordered_map<long, test::Entry> record;
+    BTreeConfig config;
+    config.cache_bytes = 64 * PAGE_SIZE;
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        for (long i = 0; i < 20000; ++i) {
+            record[i * 3] = test::Entry(static_cast<int>(i), gen_random(10), i * 3);
+            db.insert(i * 3, record[i * 3]);
+        }
+
+        // views stay valid while other pages are read in and evicted
+        BTreeDB<test::Entry>::View first = db.find_view(0);
+        for (long i = 0; i < 20000; i += 7) {
+            BTreeDB<test::Entry>::View view = db.find_view(i * 3);
+            REQUIRE(view.valid());
+            REQUIRE(view.get<test::Entry::X>() == record[i * 3].x);
+            REQUIRE(view.get<test::Entry::Str>() == std::string(record[i * 3].str.data()));
+            REQUIRE(view.get<test::Entry::Id>() == i * 3);
+        }
+        REQUIRE(first.get<test::Entry::Str>() == std::string(record[0].str.data()));
+
+        BTreeDB<test::Entry>::View copy = first;
+        copy = db.find_view(3);
+        REQUIRE(copy.value().x == 1);
+        REQUIRE(!db.find_view(1).valid());
+    }
+
+    // mapped read only instances
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+    for (long i = 0; i < 20000; i += 11) {
+        BTreeDB<test::Entry>::View view = db.find_view(i * 3);
+        REQUIRE(view.get<test::Entry::X>() == record[i * 3].x);
+    }
+}
+
+TEST_CASE("BTree - entry layouts") {
+    REQUIRE(author::Entry::size == 96);
+    REQUIRE(paper::Entry::size == 216);
+    REQUIRE(test::Entry::size == 24);
+
+    std::string title = "a title";
+    std::string keywords = "some keywords";
+    paper::Entry entry(title, keywords, 12, 2003, {5, 6, 7}, 99);
+    char record[paper::Entry::size];
+    paper::Entry::serialize_value(&entry, record);
+
+    // the layout matches the original hand written offsets
+    long id;
+    unsigned int year;
+    memcpy(&id, record + 208, 8);
+    memcpy(&year, record + 204, 4);
+    REQUIRE(id == 99);
+    REQUIRE(year == 2003);
+    REQUIRE(std::string(record) == title);
+
+    paper::Entry copy;
+    paper::Entry::deserialize_value(record, &copy);
+    REQUIRE(copy.authors == entry.authors);
+    REQUIRE(copy.n_citations == 12);
+    REQUIRE(paper::Entry::Authors::view(record)[2] == 7);
+    REQUIRE(paper::Entry::Keywords::view(record) == keywords);
+}
+
+TEST_CASE("Page table") {
+    // churn against a reference map, so every path of the backward shift on erase is taken
+    PageTable table;
+    std::unordered_map<uint64_t, unsigned int> expected;
+    std::mt19937 gen(23);
+    for (unsigned int i = 0; i < 200000; ++i) {
+        uint64_t tag = (static_cast<uint64_t>(gen() % 2) << 32) | (gen() % 5000);
+        if (gen() % 3 == 0) {
+            table.erase(tag);
+            expected.erase(tag);
+        } else {
+            table.insert(tag, i);
+            expected[tag] = i;
+        }
+    }
+    REQUIRE(table.size() == expected.size());
+    for (uint64_t type = 0; type < 2; ++type) {
+        for (uint64_t page = 0; page < 5000; ++page) {
+            uint64_t tag = (type << 32) | page;
+            auto found = expected.find(tag);
+            REQUIRE(table.find(tag) == (found == expected.end() ? PageTable::NOT_FOUND : found->second));
+        }
+    }
+
+    table.clear();
+    REQUIRE(table.size() == 0);
+    REQUIRE(table.find(1) == PageTable::NOT_FOUND);
+
+    // arena pages are aligned, zero-filled, and come back zeroed after a release
+    PageArena arena(4096, 1000);
+    char* first = arena.page(0);
+    REQUIRE(reinterpret_cast<uintptr_t>(first) % ARENA_ALIGN_BYTES == 0);
+    REQUIRE(arena.page(999) == first + 999 * 4096);
+    REQUIRE(first[100] == 0);
+    first[100] = 'x';
+    arena.release();
+    REQUIRE(arena.page(0)[100] == 0);
+    REQUIRE_THROWS(arena.page(1000));
+}
+
+TEST_CASE("Key search") {
+    std::mt19937_64 gen(7);
+    for (unsigned int n : {0u, 1u, 3u, 31u, 32u, 33u, 100u, 337u}) {
+        std::vector<long> keys(n);
+        for (long& key : keys) {
+            key = static_cast<long>(gen() % 1000) - 500;
+        }
+        std::sort(keys.begin(), keys.end());
+        const char* data = reinterpret_cast<const char*>(keys.data());
+
+        for (long key = -502; key <= 502; ++key) {
+            unsigned int expected = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            REQUIRE(search_keys(data, n, key) == expected);
+            REQUIRE(count_less_scalar(data, n, key) == expected);
+        }
+    }
+
+    // extremes compare correctly as signed
+    std::vector<long> extremes = {LONG_MIN, -1, 0, 1, LONG_MAX};
+    const char* data = reinterpret_cast<const char*>(extremes.data());
+    REQUIRE(search_keys(data, 5, LONG_MIN) == 0);
+    REQUIRE(search_keys(data, 5, 0) == 2);
+    REQUIRE(search_keys(data, 5, LONG_MAX) == 4);
+    REQUIRE(pick_count_less()(data, 5, 1) == 3);
+
+    // deltas compare as unsigned
+    std::vector<unsigned int> deltas;
+    for (unsigned int i = 0; i < 100; ++i) {
+        deltas.push_back(i * 43000000u);
+    }
+    const char* delta_data = reinterpret_cast<const char*>(deltas.data());
+    for (unsigned int i = 0; i < 100; ++i) {
+        REQUIRE(search_deltas(delta_data, 100, i * 43000000u) == i);
+        REQUIRE(search_deltas(delta_data, 100, i * 43000000u + 1) == i + 1);
+        REQUIRE(pick_count_less_deltas()(delta_data, 100, i * 43000000u) == i);
+    }
+}
+
+TEST_CASE("BTree - key formats") {
+    for (KeyFormat format : {Interleaved, Split, Delta}) {
+        BTreeConfig config;
+        config.key_format = format;
+
+        std::map<long, test::Entry> record;
+        {
+            BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+            for (unsigned int i = 0; i < 20000; ++i) {
+                int curr = rand() % INT_MAX;
+                record[curr] = test::Entry(rand() % INT_MAX, gen_random(10), curr);
+                db.insert(record[curr].id, record[curr]);
+            }
+
+            for (const auto& pair : record) {
+                REQUIRE(db.find(pair.first).x == pair.second.x);
+            }
+        }
+
+        // the format comes from the metadata, not the config, once the database exists
+        BTreeConfig other;
+        other.key_format = format == Interleaved ? Split : Interleaved;
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true, other);
+
+        for (const auto& pair : record) {
+            REQUIRE(db.find(pair.first).x == pair.second.x);
+        }
+        REQUIRE(db.find(-1).id == NULL_VAL);
+
+        auto expected = record.begin();
+        for (auto iter = db.first(); iter.valid(); iter.next()) {
+            REQUIRE(iter.key() == expected->first);
+            ++expected;
+        }
+        REQUIRE(expected == record.end());
+    }
+}
+
+TEST_CASE("BTree - compressed keys") {
+    BTreeConfig compressed;
+    compressed.key_format = Delta;
+
+    // mostly dense ids, with some keys far away from everything else that can't be compressed with their neighbors
+    std::mt19937_64 gen(11);
+    std::map<long, test::Entry> record;
+    for (long i = 0; i < 30000; ++i) {
+        long key = i % 10 == 0 ? static_cast<long>(gen()) : 1000000000L + i * 3;
+        record[key] = test::Entry(i, gen_random(10), key);
+    }
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, compressed);
+        for (auto& pair : record) {
+            db.insert(pair.first, pair.second);
+        }
+        // inserting in a different order splits different pages
+        BTreeDB<test::Entry> shuffled("test_db_keys2.db", "test_db_values2.db", true, false, compressed);
+        std::vector<long> keys;
+        for (const auto& pair : record) {
+            keys.push_back(pair.first);
+        }
+        std::shuffle(keys.begin(), keys.end(), gen);
+        for (long key : keys) {
+            shuffled.insert(key, record[key]);
+        }
+        for (const auto& pair : record) {
+            REQUIRE(shuffled.find(pair.first).x == pair.second.x);
+        }
+    }
+
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+    for (const auto& pair : record) {
+        REQUIRE(db.find(pair.first).x == pair.second.x);
+    }
+    auto expected = record.begin();
+    for (auto iter = db.first(); iter.valid(); iter.next()) {
+        REQUIRE(iter.key() == expected->first);
+        ++expected;
+    }
+    REQUIRE(expected == record.end());
+
+    // a compressed page with more keys than an uncompressed page holds has to split before it can take a far away key
+    {
+        BTreeDB<test::Entry> full("test_db_keys2.db", "test_db_values2.db", true, false, compressed);
+        for (long i = 0; i < 400; ++i) {
+            test::Entry entry(i, "x", i);
+            full.insert(entry.id, entry);
+        }
+        test::Entry far(-1, "far", 1L << 40);
+        full.insert(far.id, far);
+        test::Entry below(-2, "below", -(1L << 40));
+        full.insert(below.id, below);
+
+        for (long i = 0; i < 400; ++i) {
+            REQUIRE(full.find(i).x == i);
+        }
+        REQUIRE(full.find(1L << 40).x == -1);
+        REQUIRE(full.find(-(1L << 40)).x == -2);
+        REQUIRE(full.first().key() == -(1L << 40));
+        REQUIRE(full.last().key() == 1L << 40);
+    }
+
+    // bulk loading starts new pages instead of giving up compression
+    std::vector<std::pair<long, test::Entry>> sorted(record.begin(), record.end());
+    {
+        BTreeDB<test::Entry> loaded("test_db_keys2.db", "test_db_values2.db", true, false, compressed);
+        loaded.bulk_load(sorted.begin(), sorted.end());
+        for (const auto& pair : record) {
+            REQUIRE(loaded.find(pair.first).x == pair.second.x);
+        }
+    }
+
+    // dense ids take far fewer key pages than uncompressed ones
+    std::vector<unsigned long> key_pages;
+    for (KeyFormat format : {Split, Delta}) {
+        BTreeConfig config;
+        config.key_format = format;
+        {
+            BTreeDB<test::Entry> dense("test_db_keys2.db", "test_db_values2.db", true, false, config);
+            for (long i = 0; i < 50000; ++i) {
+                test::Entry entry(i, "x", i * 7);
+                dense.insert(entry.id, entry);
+            }
+        }
+
+        std::ifstream meta("test_db_keys2test_db_values2.txt");
+        unsigned long entries, value_pages, pages;
+        meta >> entries >> value_pages >> pages;
+        key_pages.push_back(pages);
+    }
+    REQUIRE(key_pages[1] * 4 < key_pages[0] * 3);
+}
+
+TEST_CASE("BTree - slotted values") {
+    BTreeConfig slotted;
+    slotted.value_format = Slotted;
+
+    std::map<long, test::Entry> record;
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, slotted);
+        for (long i = 0; i < 20000; ++i) {
+            record[i * 5] = test::Entry(i, "a", i * 5);
+            db.insert(i * 5, record[i * 5]);
+        }
+
+        // growing every record fills the pages up, so most of them have to move
+        for (long i = 0; i < 20000; i += 2) {
+            record[i * 5] = test::Entry(-i, gen_random(11), i * 5);
+            db.insert(i * 5, record[i * 5]);
+        }
+        std::vector<std::pair<long, test::Entry>> batch;
+        for (long i = 1; i < 20000; i += 2) {
+            record[i * 5] = test::Entry(-i, gen_random(11), i * 5);
+            batch.push_back({i * 5, record[i * 5]});
+        }
+        db.insert_many(batch);
+
+        for (const auto& pair : record) {
+            test::Entry found = db.find(pair.first);
+            REQUIRE(found.x == pair.second.x);
+            REQUIRE(std::string(found.str.data()) == std::string(pair.second.str.data()));
+        }
+    }
+
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+    auto expected = record.begin();
+    for (auto iter = db.first(); iter.valid(); iter.next()) {
+        REQUIRE(iter.key() == expected->first);
+        REQUIRE(iter.value().x == expected->second.x);
+        ++expected;
+    }
+    REQUIRE(expected == record.end());
+
+    std::vector<long> keys = {5, 50, 99995, 3};
+    std::vector<test::Entry> found = db.find_many(keys);
+    REQUIRE(found[0].x == record[5].x);
+    REQUIRE(found[2].x == record[99995].x);
+    REQUIRE(found[3].id == NULL_VAL);
+
+    BTreeDB<test::Entry>::View view = db.find_view(50);
+    BTreeDB<test::Entry>::View copy = view;
+    view = db.find_view(55);
+    REQUIRE(copy.get<test::Entry::Str>() == std::string(record[50].str.data()));
+    REQUIRE(view.get<test::Entry::X>() == record[55].x);
+
+    // moved records leave empty slots behind that scans skip
+    REQUIRE(db.get_ids_from_name(test::Entry(-4)) == std::vector<long>({20}));
+
+    // papers mostly have short titles and few authors, so they take a fraction of the fixed size
+    std::string title = "A short title";
+    std::string keywords = "kw";
+    std::vector<paper::Entry> papers;
+    for (long i = 0; i < 5000; ++i) {
+        papers.push_back(paper::Entry(title, keywords, 3, 2020, {1000000000L + i, 2000000000L + i}, 3000000000L + i));
+    }
+    std::vector<size_t> sizes;
+    for (ValueFormat format : {Fixed, Slotted}) {
+        BTreeConfig config;
+        config.value_format = format;
+        {
+            BTreeDB<paper::Entry> paper_db("test_db_keys2.db", "test_db_values2.db", true, false, config);
+            for (paper::Entry& paper : papers) {
+                paper_db.insert(paper.id, paper);
+            }
+        }
+        std::ifstream values("test_db_values2.db", std::ios::binary | std::ios::ate);
+        sizes.push_back(values.tellg());
+
+        BTreeDB<paper::Entry> paper_db("test_db_keys2.db", "test_db_values2.db", false, true);
+        paper::Entry paper = paper_db.find(3000000042L);
+        REQUIRE(paper.title == title);
+        REQUIRE(paper.authors == std::vector<long>({1000000042L, 2000000042L}));
+        REQUIRE(paper_db.get_papers(1000000042L) == std::vector<long>({3000000042L}));
+    }
+    REQUIRE(sizes[1] * 4 < sizes[0]);
+
+    // slotted pages keep long titles and long author lists whole; fixed pages only have room for 95 characters and 8 authors
+    std::string long_title(300, 'x');
+    std::vector<long> many_authors;
+    for (long i = 1; i <= 20; ++i) {
+        many_authors.push_back(i * 11);
+    }
+    paper::Entry long_paper(long_title, keywords, 1, 2021, many_authors, 77);
+    for (ValueFormat format : {Fixed, Slotted}) {
+        BTreeConfig config;
+        config.value_format = format;
+        {
+            BTreeDB<paper::Entry> paper_db("test_db_keys2.db", "test_db_values2.db", true, false, config);
+            paper_db.insert(long_paper.id, long_paper);
+        }
+
+        BTreeDB<paper::Entry> paper_db("test_db_keys2.db", "test_db_values2.db", false, true);
+        size_t title_len = format == Slotted ? long_title.size() : 95;
+        size_t num_authors = format == Slotted ? many_authors.size() : 8;
+        paper::Entry paper = paper_db.find(77);
+        REQUIRE(paper.title == long_title.substr(0, title_len));
+        REQUIRE(paper.authors == std::vector<long>(many_authors.begin(), many_authors.begin() + num_authors));
+        REQUIRE(paper_db.get_papers(20 * 11) == (format == Slotted ? std::vector<long>({77}) : std::vector<long>()));
+
+        BTreeDB<paper::Entry>::View view = paper_db.find_view(77);
+        REQUIRE(view.get<paper::Entry::Title>().size() == title_len);
+        REQUIRE(view.get<paper::Entry::Authors>().size() == num_authors);
+        REQUIRE(view.value().title.size() == title_len);
+    }
+}
+
+TEST_CASE("BTree - background writeback") {
+    // neighboring pages are merged into single writes
+    std::vector<std::pair<unsigned int, size_t>> runs;
+    std::map<unsigned int, char> written;
+    bool only_keys = true;
+    {
+        Writeback writeback(PAGE_SIZE, 128, [&](FileType type, unsigned int first_page, const std::vector<const char*>& pages) {
+            // runs on the writeback thread, where REQUIRE can't be used
+            only_keys = only_keys && type == Key;
+            runs.push_back({first_page, pages.size()});
+            for (size_t i = 0; i < pages.size(); ++i) {
+                written[first_page + i] = pages[i][0];
+            }
+        });
+        std::vector<char> page(PAGE_SIZE);
+        for (unsigned int i = 0; i < 64; ++i) {
+            page[0] = static_cast<char>(i);
+            writeback.enqueue(Key, i, page.data());
+        }
+        page[0] = 100;
+        writeback.enqueue(Key, 3, page.data());
+        writeback.drain();
+
+        REQUIRE(!writeback.read_pending(Key, 3, page.data()));
+    }
+    REQUIRE(only_keys);
+    REQUIRE(written.size() == 64);
+    REQUIRE(written[3] == 100);
+    REQUIRE(written[63] == 63);
+    REQUIRE(runs.size() <= 3);
+
+    // a tiny cache and dirty budget make pages get written, evicted, and read back while they are still queued
+    BTreeConfig small;
+    small.cache_bytes = 0;
+    small.dirty_bytes = 4 * PAGE_SIZE;
+
+    std::vector<long> keys;
+    for (long i = 0; i < 30000; ++i) {
+        keys.push_back(i * 3);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, small);
+        for (long key : keys) {
+            test::Entry entry(key, "a", key);
+            db.insert(key, entry);
+        }
+        for (long key : keys) {
+            REQUIRE(db.find(key).x == key);
+        }
+
+        std::vector<std::pair<long, test::Entry>> batch;
+        for (long i = 0; i < 30000; i += 7) {
+            batch.push_back({i * 3, test::Entry(-i, "b", i * 3)});
+        }
+        db.insert_many(batch);
+    }
+
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+    for (long i = 0; i < 30000; ++i) {
+        REQUIRE(db.find(i * 3).x == (i % 7 == 0 ? -i : i * 3));
+    }
+}
+
+TEST_CASE("BTree - concurrent readers") {
+    const long count = 40000;
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false);
+        for (long i = 0; i < count; ++i) {
+            test::Entry entry(i, "a", i * 2);
+            db.insert(i * 2, entry);
+        }
+    }
+
+    // the cache is much smaller than the database, so the threads keep evicting each other's pages
+    BTreeConfig small;
+    small.use_mmap = false;
+    small.cache_bytes = 256 * PAGE_SIZE;
+
+    for (bool read_only : {false, true}) {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, read_only, small);
+
+        // REQUIRE can't be used on other threads, so they count what went wrong
+        std::atomic<long> errors(0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < 8; ++t) {
+            threads.emplace_back([&db, &errors, t, count]() {
+                std::mt19937 gen(t);
+                std::uniform_int_distribution<long> dist(0, count - 1);
+                for (unsigned int i = 0; i < 5000; ++i) {
+                    long x = dist(gen);
+                    if (db.find(x * 2).x != x || db.find(x * 2 + 1).id != NULL_VAL) {
+                        ++errors;
+                    }
+                }
+
+                std::vector<long> keys;
+                for (long i = 0; i < 200; ++i) {
+                    keys.push_back(dist(gen) * 2);
+                }
+                std::vector<test::Entry> found = db.find_many(keys);
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    if (found[i].x != keys[i] / 2) {
+                        ++errors;
+                    }
+                }
+
+                long expected = t * 1000;
+                for (auto iter = db.lower_bound(expected * 2); iter.valid() && expected < t * 1000 + 2000; iter.next(), ++expected) {
+                    if (iter.key() != expected * 2 || iter.value().x != expected) {
+                        ++errors;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(errors == 0);
+    }
+}
+
+TEST_CASE("BTree - concurrent inserts") {
+    const long per_thread = 6000;
+    const long num_threads = 6;
+
+    // a small cache and dirty budget, so pages are evicted and written back while the threads work
+    BTreeConfig config;
+    config.use_mmap = false;
+    config.cache_bytes = 512 * PAGE_SIZE;
+    config.dirty_bytes = 64 * PAGE_SIZE;
+
+    for (KeyFormat key_format : {Split, Delta}) {
+        config.key_format = key_format;
+        config.value_format = key_format == Delta ? Slotted : Fixed;
+        // the filter grows while the threads add keys to it
+        config.bloom_bits_per_key = key_format == Delta ? 10 : 0;
+
+        {
+            BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+            test::Entry first(-1, "a", -1);
+            db.insert(-1, first);
+
+            std::vector<std::thread> writers;
+            for (long t = 0; t < num_threads; ++t) {
+                writers.emplace_back([&db, t, per_thread, num_threads]() {
+                    // the threads' keys are interleaved, so they keep landing in the same leaves (and splitting them)
+                    std::vector<long> keys;
+                    for (long i = 0; i < per_thread; ++i) {
+                        keys.push_back(i * num_threads + t);
+                    }
+                    std::shuffle(keys.begin(), keys.end(), std::mt19937(t));
+
+                    for (size_t i = 0; i < keys.size(); ) {
+                        if (t % 2 == 0) {
+                            test::Entry entry(keys[i], "a", keys[i]);
+                            db.insert(keys[i], entry);
+                            ++i;
+                        } else {
+                            std::vector<std::pair<long, test::Entry>> batch;
+                            for (; i < keys.size() && batch.size() < 100; ++i) {
+                                batch.push_back({keys[i], test::Entry(keys[i], "a", keys[i])});
+                            }
+                            db.insert_many(batch);
+                        }
+                    }
+
+                    // every thread overwrites the same keys with the same values; slotted values grow and move
+                    for (long i = 0; i < 500; ++i) {
+                        test::Entry entry(i, "overwritten", i);
+                        db.insert(i, entry);
+                    }
+                });
+            }
+
+            // REQUIRE can't be used on other threads, so the reader counts what went wrong
+            std::atomic<long> errors(0);
+            std::atomic<bool> done(false);
+            std::thread reader([&db, &errors, &done, per_thread, num_threads]() {
+                std::mt19937 gen(42);
+                std::uniform_int_distribution<long> dist(0, per_thread * num_threads - 1);
+                while (!done) {
+                    // a key is either missing or has its value
+                    long key = dist(gen);
+                    test::Entry found = db.find(key);
+                    if (found.id != NULL_VAL && found.x != key) {
+                        ++errors;
+                    }
+
+                    // cursors only move forward, even while the leaves split under them
+                    long prev = LONG_MIN;
+                    unsigned int steps = 0;
+                    for (auto iter = db.lower_bound(key); iter.valid() && steps < 500; iter.next(), ++steps) {
+                        if (iter.key() <= prev || iter.value().x != iter.key()) {
+                            ++errors;
+                        }
+                        prev = iter.key();
+                    }
+                }
+            });
+
+            for (std::thread& writer : writers) {
+                writer.join();
+            }
+            done = true;
+            reader.join();
+            REQUIRE(errors == 0);
+
+            // every key is there exactly once
+            long expected = -1, mismatches = 0;
+            for (auto iter = db.first(); iter.valid(); iter.next(), ++expected) {
+                if (iter.key() != expected || iter.value().x != expected) {
+                    ++mismatches;
+                }
+            }
+            REQUIRE(mismatches == 0);
+            REQUIRE(expected == per_thread * num_threads);
+            REQUIRE(db.find(7).str == test::Entry(7, "overwritten", 7).str);
+            REQUIRE(db.get_ids_from_name(test::Entry(4321)) == std::vector<long>({4321}));
+            // the slots the overwrites took for the same name were given back
+            REQUIRE(db.get_ids_from_name(test::Entry(7)) == std::vector<long>({7}));
+        }
+
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        std::vector<long> keys;
+        for (long i = -1; i < per_thread * num_threads; i += 7) {
+            keys.push_back(i);
+        }
+        std::vector<test::Entry> found = db.find_many(keys);
+        long mismatches = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (found[i].x != keys[i]) {
+                ++mismatches;
+            }
+        }
+        REQUIRE(mismatches == 0);
+        REQUIRE(db.last().key() == per_thread * num_threads - 1);
+    }
+}
+
+TEST_CASE("BTree - batched reads") {
+    // a file of 8 pages, each filled with its page number; the last one is cut short
+    {
+        std::ofstream out("test_async_reader.bin", std::ios::binary | std::ios::trunc);
+        std::vector<char> page(PAGE_SIZE);
+        for (int i = 0; i < 8; ++i) {
+            std::fill(page.begin(), page.end(), static_cast<char>(i + 1));
+            out.write(page.data(), i == 7 ? PAGE_SIZE / 2 : PAGE_SIZE);
+        }
+    }
+    int fd = open("test_async_reader.bin", O_RDONLY);
+    REQUIRE(fd != -1);
+
+    for (IOBackend backend : {SyncIO, ThreadPoolIO, UringIO}) {
+        AsyncReader reader(backend, 4);
+        REQUIRE((reader.backend() == backend || (backend == UringIO && reader.backend() == ThreadPoolIO)));
+
+        // more reads than the depth, out of order, including one that is cut short and one past the end of the file
+        std::vector<std::vector<char>> pages(10, std::vector<char>(PAGE_SIZE, 'x'));
+        std::vector<ReadRequest> requests;
+        for (unsigned int i = 0; i < pages.size(); ++i) {
+            unsigned int page_num = (i * 3) % 10;
+            requests.push_back({fd, static_cast<off_t>(page_num) * PAGE_SIZE, pages[i].data(), PAGE_SIZE});
+        }
+        reader.read(requests);
+
+        for (unsigned int i = 0; i < pages.size(); ++i) {
+            unsigned int page_num = (i * 3) % 10;
+            char expected = page_num < 8 ? static_cast<char>(page_num + 1) : 0;
+            REQUIRE(pages[i][0] == expected);
+            REQUIRE(pages[i][PAGE_SIZE / 2 - 1] == expected);
+            REQUIRE(pages[i][PAGE_SIZE - 1] == (page_num == 7 ? 0 : expected));
+        }
+
+        // errors reach the caller once the rest of the batch is done
+        std::vector<ReadRequest> bad = requests;
+        bad[3].fd = -1;
+        REQUIRE_THROWS(reader.read(bad));
+    }
+    close(fd);
+
+    std::vector<long> keys;
+    for (long i = 0; i < 20000; ++i) {
+        keys.push_back(i * 2);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(3));
+
+    // a tiny cache, so the batches are read from the file (or from the writeback queue) instead of hitting
+    BTreeConfig config;
+    config.use_mmap = false;
+    config.cache_bytes = 0;
+    config.dirty_bytes = 16 * PAGE_SIZE;
+    config.io_depth = 8;
+
+    for (IOBackend backend : {SyncIO, ThreadPoolIO, UringIO}) {
+        config.io_backend = backend;
+        {
+            BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+            for (long key : keys) {
+                test::Entry entry(key, "a", key);
+                db.insert(key, entry);
+            }
+
+            std::vector<test::Entry> found = db.find_many(keys);
+            long mismatches = 0;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (found[i].x != keys[i]) {
+                    ++mismatches;
+                }
+            }
+            REQUIRE(mismatches == 0);
+        }
+
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true, config);
+        std::vector<long> lookups(keys.begin(), keys.begin() + 5000);
+        lookups.push_back(-5);
+        lookups.push_back(7);
+        std::vector<test::Entry> found = db.find_many(lookups);
+        long mismatches = 0;
+        for (size_t i = 0; i < lookups.size(); ++i) {
+            if (lookups[i] % 2 == 0 ? found[i].x != lookups[i] : found[i].id != NULL_VAL) {
+                ++mismatches;
+            }
+        }
+        REQUIRE(mismatches == 0);
+
+        long expected = 3000;
+        db.scan(2999, 31001, [&](long key, const test::Entry& value) {
+            if (key != expected || value.x != key) {
+                ++mismatches;
+            }
+            expected += 2;
+        });
+        REQUIRE(mismatches == 0);
+        REQUIRE(expected == 31002);
+    }
+
+    // readers are per instance, so only opting in starts any, and never for the name index
+    auto thread_count = []() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("Threads:", 0) == 0) {
+                return std::stoul(line.substr(8));
+            }
+        }
+        return 0UL;
+    };
+    unsigned long before = thread_count();
+    {
+        // a writeback thread each for the tree and its name index
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", true);
+        REQUIRE(thread_count() == before + 2);
+    }
+    {
+        BTreeConfig pool_config;
+        pool_config.io_backend = ThreadPoolIO;
+        pool_config.io_depth = 4;
+        BTreeDB<author::Entry> db("test_db_keys.db", "test_db_values.db", true, false, pool_config);
+        REQUIRE(thread_count() == before + 2 + 4);
+    }
+}
+
+/**
+    Fills a database with one page layout and checks that lookups and scans see every key, before and after reopening it.
+*/
+template <typename Layout>
+void check_layout(KeyFormat key_format, ValueFormat value_format) {
+    BTreeConfig config;
+    config.key_format = key_format;
+    config.value_format = value_format;
+
+    std::vector<long> keys;
+    for (long i = 0; i < 20000; ++i) {
+        keys.push_back(i * 3);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(17));
+    {
+        BTreeDB<test::Entry, Layout> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        for (long key : keys) {
+            test::Entry entry(key, gen_random(key % 20), key);
+            db.insert(key, entry);
+        }
+        REQUIRE(db.find(keys[0]).x == keys[0]);
+    }
+
+    BTreeDB<test::Entry, Layout> db("test_db_keys.db", "test_db_values.db", false, true, config);
+    long mismatches = 0;
+    for (long key : keys) {
+        if (db.find(key).x != key) {
+            ++mismatches;
+        }
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(db.find(1).id == NULL_VAL);
+
+    long expected = 0;
+    for (auto iter = db.first(); iter.valid(); iter.next()) {
+        if (iter.key() != expected || iter.value().x != expected) {
+            ++mismatches;
+        }
+        expected += 3;
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(expected == 60000);
+}
+
+TEST_CASE("BTree - page layouts") {
+    REQUIRE(DefaultLayout::page_size == PAGE_SIZE);
+    REQUIRE(DefaultLayout::order == ORDER);
+    REQUIRE(DefaultLayout::delta_order == 507);
+    REQUIRE(PageLayout<16384>::order > 4 * ORDER);
+
+    check_layout<PageLayout<16384>>(Split, Fixed);
+    check_layout<PageLayout<16384>>(Interleaved, Slotted);
+    check_layout<PageLayout<65536>>(Delta, Slotted);
+    check_layout<PageLayout<65536>>(Split, Fixed);
+
+    // the layout is part of the file format, so opening with another one fails instead of misreading pages
+    REQUIRE_THROWS(BTreeDB<test::Entry>("test_db_keys.db", "test_db_values.db", false, true));
+    REQUIRE_THROWS(BTreeDB<test::Entry, PageLayout<16384>>("test_db_keys.db", "test_db_values.db", false, true));
+    REQUIRE_NOTHROW(BTreeDB<test::Entry, PageLayout<65536>>("test_db_keys.db", "test_db_values.db", false, true));
+}
+
+TEST_CASE("BTree - bloom filter") {
+    {
+        BloomFilter filter(20000, 10);
+        for (long i = 0; i < 20000; ++i) {
+            filter.add(i * 2);
+        }
+        long false_positives = 0;
+        for (long i = 0; i < 20000; ++i) {
+            REQUIRE(filter.may_contain(i * 2));
+            false_positives += filter.may_contain(i * 2 + 1);
+        }
+        REQUIRE(false_positives < 600);
+        REQUIRE(!filter.is_chained());
+
+        filter.write("test_bloom.bin");
+        BloomFilter copy("test_bloom.bin");
+        REQUIRE(copy.size() == 20000);
+        REQUIRE(copy.bits_per_key() == 10);
+        for (long i = 0; i < 40000; ++i) {
+            REQUIRE(copy.may_contain(i) == filter.may_contain(i));
+        }
+
+        // adding many more keys than it was sized for chains bigger filters instead of losing any
+        BloomFilter small(0, 10);
+        for (long i = 0; i < 100000; ++i) {
+            small.add(i * 7);
+        }
+        REQUIRE(small.is_chained());
+        REQUIRE_THROWS(small.write("test_bloom.bin"));
+        false_positives = 0;
+        for (long i = 0; i < 100000; ++i) {
+            REQUIRE(small.may_contain(i * 7));
+            false_positives += small.may_contain(i * 7 + 3);
+        }
+        REQUIRE(false_positives < 5000);
+    }
+
+    BTreeConfig config;
+    config.bloom_bits_per_key = 10;
+
+    std::vector<long> lookups;
+    for (long i = -10; i < 70000; ++i) {
+        lookups.push_back(i);
+    }
+
+    // checks every lookup against keys being the even numbers below 2 * count
+    auto check = [&lookups](BTreeDB<test::Entry>& db, long count) {
+        long mismatches = 0;
+        std::vector<test::Entry> found = db.find_many(lookups);
+        for (size_t i = 0; i < lookups.size(); ++i) {
+            long key = lookups[i];
+            bool present = key >= 0 && key < 2 * count && key % 2 == 0;
+            if ((present ? found[i].x != key : found[i].id != NULL_VAL) || (present ? db.find(key).x != key : db.find(key).id != NULL_VAL)) {
+                ++mismatches;
+            }
+            if (db.find_view(key).valid() != present) {
+                ++mismatches;
+            }
+        }
+        REQUIRE(mismatches == 0);
+    };
+
+    // filled by inserts, so the filter grows, and is saved as one filter when the database is closed
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        for (long i = 0; i < 20000; ++i) {
+            test::Entry entry(i * 2, "a", i * 2);
+            db.insert(i * 2, entry);
+        }
+        check(db, 20000);
+    }
+    {
+        std::ifstream saved("test_db_keys_bloom.bin");
+        REQUIRE(saved.is_open());
+    }
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        check(db, 20000);
+    }
+
+    // keys added after reopening are found too
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, false);
+        std::vector<std::pair<long, test::Entry>> batch;
+        for (long i = 20000; i < 30000; ++i) {
+            batch.push_back({i * 2, test::Entry(i * 2, "b", i * 2)});
+        }
+        db.insert_many(batch);
+        check(db, 30000);
+    }
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        check(db, 30000);
+    }
+
+    // a filter that is missing is rebuilt by writable instances and skipped by read only ones
+    std::remove("test_db_keys_bloom.bin");
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+        check(db, 30000);
+    }
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, false);
+        check(db, 30000);
+    }
+    {
+        std::ifstream saved("test_db_keys_bloom.bin");
+        REQUIRE(saved.is_open());
+    }
+
+    // bulk loads size the filter once every key is in
+    {
+        std::vector<std::pair<long, test::Entry>> pairs;
+        for (long i = 0; i < 35000; ++i) {
+            pairs.push_back({i * 2, test::Entry(i * 2, "c", i * 2)});
+        }
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        db.bulk_load(pairs.begin(), pairs.end());
+        check(db, 35000);
+    }
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true);
+    check(db, 35000);
+}
+
+TEST_CASE("BTree - record cache") {
+    {
+        // a single shard of 64 entries
+        RecordCache<test::Entry> cache(1);
+        for (long i = 0; i < 64; ++i) {
+            cache.put(i, test::Entry(i, "a", i), cache.epoch());
+        }
+        test::Entry found;
+        for (long i = 0; i < 32; ++i) {
+            REQUIRE(cache.get(i, found));
+            REQUIRE(found.x == i);
+        }
+
+        // the entries that were just used survive the next 32
+        for (long i = 64; i < 96; ++i) {
+            cache.put(i, test::Entry(i, "a", i), cache.epoch());
+        }
+        for (long i = 0; i < 32; ++i) {
+            REQUIRE(cache.get(i, found));
+        }
+        REQUIRE(!cache.get(40, found));
+        REQUIRE(cache.stats().hits == 64);
+        REQUIRE(cache.stats().misses == 1);
+        REQUIRE(cache.stats().evictions == 32);
+
+        // a record read before an erase may be the old copy, so it isn't added
+        uint64_t epoch = cache.epoch();
+        cache.erase(5);
+        REQUIRE(!cache.get(5, found));
+        cache.put(5, test::Entry(5, "old", 5), epoch);
+        REQUIRE(!cache.get(5, found));
+        cache.put(5, test::Entry(6, "new", 5), cache.epoch());
+        REQUIRE(cache.get(5, found));
+        REQUIRE(found.x == 6);
+    }
+
+    BTreeConfig config;
+    config.record_cache_entries = 1000;
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        for (long i = 0; i < 5000; ++i) {
+            test::Entry entry(i, "a", i);
+            db.insert(i, entry);
+        }
+
+        REQUIRE(db.find(10).x == 10);
+        REQUIRE(db.find(10).x == 10);
+        REQUIRE(db.record_cache_stats().hits == 1);
+
+        std::vector<long> keys({10, 11, 12, -4, 11});
+        std::vector<test::Entry> found = db.find_many(keys);
+        found = db.find_many(keys);
+        REQUIRE(found[0].x == 10);
+        REQUIRE(found[2].x == 12);
+        REQUIRE(found[3].id == NULL_VAL);
+        REQUIRE(found[4].x == 11);
+        REQUIRE(db.record_cache_stats().hits == 6);
+
+        // overwrites never leave the old value behind
+        test::Entry entry(-10, "changed", 10);
+        db.insert(10, entry);
+        REQUIRE(db.find(10).x == -10);
+        std::vector<std::pair<long, test::Entry>> batch({{11, test::Entry(-11, "changed", 11)}});
+        db.insert_many(batch);
+        REQUIRE(db.find_many(keys)[1].x == -11);
+    }
+
+    // readers keep caching values while a writer changes them
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, false, config);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    for (unsigned int t = 0; t < 4; ++t) {
+        readers.emplace_back([&db, &done, t]() {
+            std::mt19937 gen(t);
+            while (!done) {
+                long key = gen() % 200;
+                if (t % 2 == 0) {
+                    db.find(key);
+                } else {
+                    db.find_many({key, key + 1, key + 2});
+                }
+            }
+        });
+    }
+    for (long round = 1; round <= 20; ++round) {
+        for (long i = 0; i < 200; ++i) {
+            test::Entry entry(round, "round", i);
+            db.insert(i, entry);
+        }
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    long stale = 0;
+    for (long i = 0; i < 200; ++i) {
+        stale += db.find(i).x != 20;
+    }
+    REQUIRE(stale == 0);
+    REQUIRE(db.record_cache_stats().hits > 0);
+}
+
+TEST_CASE("BTree - stats") {
+    {
+        LatencyHistogram histogram;
+        REQUIRE(histogram.summary().count == 0);
+        for (uint64_t ns = 1; ns <= 1000; ++ns) {
+            histogram.record(ns);
+        }
+        LatencySummary summary = histogram.summary();
+        REQUIRE(summary.count == 1000);
+        REQUIRE(summary.mean_ns == 500);
+        REQUIRE(summary.max_ns == 1000);
+        // percentiles are at most 1/8 above the true value
+        REQUIRE(summary.p50_ns >= 500);
+        REQUIRE(summary.p50_ns <= 500 * 9 / 8);
+        REQUIRE(summary.p99_ns >= 990);
+        REQUIRE(summary.p999_ns == 1000);
+    }
+
+    // the smallest cache, so pages are evicted and written while inserting
+    BTreeConfig config;
+    config.cache_bytes = 0;
+    config.dirty_bytes = 0;
+    config.use_mmap = false;
+    config.bloom_bits_per_key = 10;
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        REQUIRE(db.stats().height == 0);
+        for (long i = 0; i < 20000; ++i) {
+            test::Entry entry(i, "a", i);
+            db.insert(i, entry);
+        }
+        for (long i = 0; i < 100; ++i) {
+            REQUIRE(db.find(i * 200).x == i * 200);
+        }
+        REQUIRE(db.find(-7).id == NULL_VAL);
+
+        BTreeStats stats = db.stats();
+        REQUIRE(stats.entries == 20000);
+        REQUIRE(stats.height >= 2);
+        REQUIRE(stats.splits > 0);
+        REQUIRE(stats.cache.hits[Key] > 0);
+        REQUIRE(stats.cache.evictions > 0);
+        REQUIRE(stats.pages_written > 0);
+        REQUIRE(stats.bytes_written == stats.pages_written * 4096);
+        REQUIRE(stats.writes > 0);
+        REQUIRE(stats.filtered == 1);
+        REQUIRE(stats.insert_latency.count == 20000);
+        REQUIRE(stats.find_latency.count == 101);
+        REQUIRE(stats.find_latency.max_ns >= stats.find_latency.p50_ns);
+    }
+
+    // a fresh instance has to read what it looks up
+    BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true, config);
+    REQUIRE(db.find(1234).x == 1234);
+    BTreeStats stats = db.stats();
+    REQUIRE(stats.cache.misses[Key] >= stats.height);
+    REQUIRE(stats.cache.misses[Value] == 1);
+    REQUIRE(stats.pages_read >= stats.height + 1);
+    REQUIRE(stats.bytes_read == stats.pages_read * 4096);
+    REQUIRE(stats.pages_written == 0);
+    REQUIRE(stats.splits == 0);
+}
+
+TEST_CASE("BTree - direct io") {
+    // a small cache, so most pages go to and from the disk with direct I/O (or ordinary I/O on filesystems without it)
+    BTreeConfig config;
+    config.cache_bytes = 64 * 4096;
+    config.direct_io = true;
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true, false, config);
+        for (long i = 0; i < 20000; ++i) {
+            test::Entry entry(i, "a", i);
+            db.insert(i, entry);
+        }
+        for (long i = 0; i < 20000; i += 97) {
+            REQUIRE(db.find(i).x == i);
+        }
+        REQUIRE(db.stats().cache.evictions > 0);
+    }
+    {
+        // read only instances don't map the files with direct I/O, so lookups still go through the cache
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", false, true, config);
+        for (long i = 0; i < 20000; i += 89) {
+            REQUIRE(db.find(i).x == i);
+        }
+        REQUIRE(db.find(20001).id == NULL_VAL);
+        REQUIRE(db.stats().pages_read > 0);
+    }
+}
+
+TEST_CASE("BTree - sharded") {
+    typedef ShardedBTreeDB<test::Entry> ShardedDB;
+    REQUIRE(ShardedDB::shard_filename("test_db_keys.db", 2) == "test_db_keys.2.db");
+    REQUIRE(ShardedDB::shard_filename("dir.d/keys", 0) == "dir.d/keys.0");
+
+    std::vector<std::pair<long, test::Entry>> sorted;
+    for (long i = 0; i < 20000; ++i) {
+        sorted.emplace_back(i * 3, test::Entry(static_cast<int>(i), "a", i * 3));
+    }
+    {
+        ShardedDB db("test_db_keys.db", "test_db_values.db", DEFAULT_SHARDS, true);
+        REQUIRE(db.num_shards() == DEFAULT_SHARDS);
+        db.bulk_load(sorted.begin(), sorted.end());
+
+        // every shard gets a fair share of the keys
+        for (unsigned int i = 0; i < DEFAULT_SHARDS; ++i) {
+            REQUIRE(db.shard(i).stats().entries > 20000 / DEFAULT_SHARDS - 1000);
+        }
+        REQUIRE(db.stats().entries == 20000);
+
+        for (long i = 0; i < 20000; i += 37) {
+            REQUIRE(db.find(i * 3).x == i);
+        }
+        REQUIRE(db.find(1).id == NULL_VAL);
+
+        std::vector<std::pair<long, test::Entry>> more;
+        for (long i = 0; i < 1000; ++i) {
+            more.emplace_back(i * 3 + 1, test::Entry(static_cast<int>(-i), "b", i * 3 + 1));
+        }
+        // the last pair of a key wins
+        more.emplace_back(4, test::Entry(-99, "c", 4));
+        db.insert_many(more);
+        test::Entry single(7, "d", 60001);
+        db.insert(60001, single);
+    }
+    // the number of shards is recorded, and opening with another one fails instead of looking in the wrong shards
+    REQUIRE(ShardedDB::stored_shards("test_db_keys.db", "test_db_values.db") == DEFAULT_SHARDS);
+    REQUIRE_THROWS(ShardedDB("test_db_keys.db", "test_db_values.db", DEFAULT_SHARDS - 1, false, true));
+    REQUIRE_THROWS(BTreeDB<test::Entry>(ShardedDB::shard_filename("test_db_keys.db", 0), ShardedDB::shard_filename("test_db_values.db", 0), false, true));
+    {
+        ShardedDB db("test_db_keys.db", "test_db_values.db", 0, false, true);
+        REQUIRE(db.num_shards() == DEFAULT_SHARDS);
+        std::vector<long> keys;
+        for (long i = 0; i < 3000; ++i) {
+            keys.push_back(i);
+        }
+        keys.push_back(60001);
+        keys.push_back(3);
+        std::vector<test::Entry> res = db.find_many(keys);
+        REQUIRE(res.size() == keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            long key = keys[i];
+            if (key == 60001) {
+                REQUIRE(res[i].x == 7);
+            } else if (key == 4) {
+                REQUIRE(res[i].x == -99);
+            } else if (key % 3 == 0) {
+                REQUIRE(res[i].x == key / 3);
+            } else if (key % 3 == 1 && key < 3000) {
+                REQUIRE(res[i].x == -(key / 3));
+            } else {
+                REQUIRE(res[i].id == NULL_VAL);
+            }
+        }
+        REQUIRE(db.find_view(60001).valid());
+        REQUIRE(db.get_id_from_name(test::Entry(12345)) == 12345 * 3);
+        REQUIRE(db.get_id_from_name(test::Entry(-100000)) == -1);
+        REQUIRE(db.get_ids_from_name(test::Entry(12345)) == std::vector<long>({12345 * 3}));
+
+        // scans put the shards back in key order
+        std::vector<long> scanned;
+        db.scan(2990, 3020, [&](long key, const test::Entry& entry) {
+            REQUIRE(entry.id == key);
+            scanned.push_back(key);
+        });
+        REQUIRE(scanned == std::vector<long>({2991, 2992, 2994, 2995, 2997, 2998, 3000, 3003, 3006, 3009, 3012, 3015, 3018}));
+        size_t count = 0;
+        long prev = -1;
+        db.scan(0, 100000, [&](long key, const test::Entry&) {
+            REQUIRE(key > prev);
+            prev = key;
+            ++count;
+        });
+        REQUIRE(count == 20000 + 1000 + 1);
+    }
+
+    // readers find whichever kind of database is there
+    bool sharded = false;
+    open_db<test::Entry>("test_db_keys.db", "test_db_values.db", true, BTreeConfig(), [&](auto& db) {
+        sharded = std::is_same<std::decay_t<decltype(db)>, ShardedDB>::value;
+        REQUIRE(db.find(60001).x == 7);
+    });
+    REQUIRE(sharded);
+
+    // with as many shards as the database was built with
+    ShardedDB::remove_files("test_db_keys.db", "test_db_values.db");
+    {
+        ShardedDB db("test_db_keys.db", "test_db_values.db", 3, true);
+        db.bulk_load(sorted.begin(), sorted.end());
+    }
+    unsigned int shards = 0;
+    open_db<test::Entry>("test_db_keys.db", "test_db_values.db", true, BTreeConfig(), [&](auto& db) {
+        if constexpr (std::is_same<std::decay_t<decltype(db)>, ShardedDB>::value) {
+            shards = db.num_shards();
+        }
+        REQUIRE(db.find(3000).x == 1000);
+    });
+    REQUIRE(shards == 3);
+
+    ShardedDB::remove_files("test_db_keys.db", "test_db_values.db");
+    REQUIRE(!std::ifstream(ShardedDB::shard_filename("test_db_keys.db", 0)).good());
+    REQUIRE(!std::ifstream("test_db_keys.0_names.db").good());
+    REQUIRE(ShardedDB::stored_shards("test_db_keys.db", "test_db_values.db") == 0);
+    {
+        BTreeDB<test::Entry> db("test_db_keys.db", "test_db_values.db", true);
+    }
+    REQUIRE(BTreeDB<test::Entry>::stored_shards("test_db_keys.db", "test_db_values.db") == 1);
+    open_db<test::Entry>("test_db_keys.db", "test_db_values.db", true, BTreeConfig(), [&](auto& db) {
+        sharded = std::is_same<std::decay_t<decltype(db)>, ShardedDB>::value;
+    });
+    REQUIRE(!sharded);
+}
+
 const std::unordered_set<unsigned long> tarjans_test_set1({2142249029, 2113592602, 2103626414, 2117665592, 2023460672, 2174205032, 2022192081});
 
 TEST_CASE("TarjansTest 1") {
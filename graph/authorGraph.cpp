@@ -87,12 +87,9 @@ void AuthorGraph::add_same_paper_authors(const std::vector<unsigned long>& autho
     } 
 }
 
-void AuthorGraph::add_referenced_authors(const std::vector<unsigned long>& authors_in_paper, const std::array<long, 8>& authors_referenced, unsigned int n_citation_paper, unsigned int n_citation_ref) {
+void AuthorGraph::add_referenced_authors(const std::vector<unsigned long>& authors_in_paper, const std::vector<long>& authors_referenced, unsigned int n_citation_paper, unsigned int n_citation_ref) {
     for (unsigned int i = 0; i < authors_in_paper.size() && i < AUTHOR_EDGE_LIMIT; ++i) {
-        for (unsigned int j = 0; j < AUTHOR_EDGE_LIMIT; ++j) {
-            if (authors_referenced[j] == 0) {
-                break;
-            } 
+        for (unsigned int j = 0; j < authors_referenced.size() && j < AUTHOR_EDGE_LIMIT; ++j) {
             addEdge(ref_author_weight_orig * n_citation_paper + ref_author_weight_ref * n_citation_ref, authors_in_paper[i], authors_referenced[j]);
         }
     }
@@ -124,12 +121,10 @@ AuthorGraph::AuthorGraph(const std::vector<author_parse_wrapper>& node_data) {
     for (const author_parse_wrapper& paper : node_data) {
         add_same_paper_authors(paper.authors, 1);
         for (const unsigned long& reference : paper.cited) {
-            std::array<long, 8> arr;
-            std::fill(arr.begin(), arr.end(), 0);
             const std::vector<unsigned long>& to_add = static_author_mapping[reference];
-            std::copy_n(to_add.begin(), std::min(to_add.size(), arr.size()), arr.begin());
+            std::vector<long> referenced(to_add.begin(), to_add.end());
 
-            add_referenced_authors(paper.authors, arr, 1, 1);
+            add_referenced_authors(paper.authors, referenced, 1, 1);
         }
     }
 
@@ -3,6 +3,7 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <array>
 #include <limits>
 #include <queue>
 #include <algorithm>
@@ -124,11 +125,11 @@ public:
 /**
  * Adds authors that are in the same paper
  * @param authors_in_paper a vector of all the authors within a paper.
- * @param authors_referenced a max size 8 array of authors that were referenced from a paper
+ * @param authors_referenced the authors of a paper that was referenced (only the first AUTHOR_EDGE_LIMIT are connected)
  * @param n_citation_paper credibility of a paper, used for weighing
  * @param n_citation_ref credibility of the referenced paper, used for weighing
 */
-    void add_referenced_authors(const std::vector<unsigned long>& authors_in_paper, const std::array<long, 8>& authors_referenced, unsigned int n_citation_paper, unsigned int n_citation_ref) ;
+    void add_referenced_authors(const std::vector<unsigned long>& authors_in_paper, const std::vector<long>& authors_referenced, unsigned int n_citation_paper, unsigned int n_citation_ref) ;
 
 /**
  * Performs Dijkstras algorithm from a given node to a destination node
@@ -7,22 +7,85 @@
 #include <exception>
 #include <iostream>
 #include <unordered_set>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <memory>
+#include <climits>
 
 #include "../storage/btree_db_v2.hpp"
+#include "../storage/sharded_btree_db.hpp"
 #include "../storage/btree_types.cpp"
+#include "../storage/posting_index.hpp"
+#include "../storage/external_sort.hpp"
+#include "../storage/paper_columns.hpp"
+#include "../storage/title_index.hpp"
 #include "../graph/journalGraph.h"
 #include "../graph/authorGraph.h"
 #include "../lib/simdjson.h" // the simdjson library was used to do the json parsing
 
 using namespace simdjson;
 
-void build_db(const std::string &filename) {
+/**
+    Bulk loads a new database from its sorted records.
+
+    @param db The database
+    @param sorted The records, in one sorter
+*/
+template <typename T>
+void load_sorted(BTreeDB<T>& db, std::vector<std::unique_ptr<ExternalSorter<T>>>& sorted) {
+    db.bulk_load(sorted[0]->begin(), sorted[0]->end());
+}
+
+/**
+    Bulk loads a new sharded database from its sorted records, every shard from its own sorter and on the threads of the database.
+
+    @param db The database
+    @param sorted The records, in a sorter per shard
+*/
+template <typename T>
+void load_sorted(ShardedBTreeDB<T>& db, std::vector<std::unique_ptr<ExternalSorter<T>>>& sorted) {
+    db.for_each_shard([&](unsigned int i) {
+        db.shard(i).bulk_load(sorted[i]->begin(), sorted[i]->end());
+    });
+}
+
+/**
+    Indexes the papers of every author and the trigrams of every title, copies the numeric fields into columns, and writes all of them to disk.
+
+    @param paper_db The loaded paper database (a BTreeDB or a ShardedBTreeDB)
+*/
+template <typename DB>
+void index_papers(DB& paper_db) {
+    // the database has exactly one copy of every paper, and scans go in id order, which is the order the builders need
+    PostingIndex::Builder author_papers;
+    PostingIndex::Builder title_trigrams;
+    PaperColumns::Builder columns;
+    paper_db.scan(LONG_MIN, LONG_MAX, [&](long, const paper::Entry& paper) {
+        for (long author : paper.authors) {
+            author_papers.add(author, paper.id);
+        }
+
+        TitleIndex::add_title(title_trigrams, paper.title.c_str(), paper.id);
+        columns.add(paper);
+    });
+
+    author_papers.write("author_papers.idx");
+    title_trigrams.write("title_trigrams.idx");
+    columns.write("");
+}
+
+void build_db(const std::string &filename, bool direct_io, unsigned int shards) {
     // create ifstream to read from json
     std::ifstream ifs(filename);
 
-    // create new author and paper dbs, overwriting as necessary
-    BTreeDB<author::Entry> author_db("author_keys.db", "author_values.db", true);
-    BTreeDB<paper::Entry> paper_db("paper_keys.db", "paper_values.db", true);
+    // ids are dense, so the key pages compress well, and most names, titles, and author lists are much shorter than the space reserved for them
+    BTreeConfig config;
+    config.key_format = Delta;
+    config.value_format = Slotted;
+    // build_author_graph looks up every reference, and many of them aren't in the dataset
+    config.bloom_bits_per_key = 10;
+    config.direct_io = direct_io;
 
     // creating a new journal graph
     journalGraph g;
@@ -45,6 +108,27 @@ void build_db(const std::string &filename) {
     // keep track of traversed authors to prevent duplicates
     std::unordered_set<long> traversed;
 
+    // records are sorted on disk and bulk loaded in sorted order at the end, which is much faster than inserting them one at a time, and only holds a run of them in memory
+    // a sharded build sorts the records of every shard separately (sharing the memory of one sorter), so that each shard can be loaded from its own stream at the same time as the others
+    typedef ShardedBTreeDB<author::Entry> ShardedAuthors;
+    typedef ShardedBTreeDB<paper::Entry> ShardedPapers;
+    if (shards > MAX_SHARDS) {
+        throw std::runtime_error("a sharded database needs 1 to " + std::to_string(MAX_SHARDS) + " shards");
+    }
+    bool sharded = shards > 0;
+    unsigned int num_shards = sharded ? shards : 1;
+    std::vector<std::unique_ptr<ExternalSorter<author::Entry>>> authors_to_load;
+    std::vector<std::unique_ptr<ExternalSorter<paper::Entry>>> papers_to_load;
+    for (unsigned int s = 0; s < num_shards; ++s) {
+        authors_to_load.push_back(std::make_unique<ExternalSorter<author::Entry>>(ShardedAuthors::shard_filename("author_sort", s), SORT_RUN_BYTES / num_shards));
+        papers_to_load.push_back(std::make_unique<ExternalSorter<paper::Entry>>(ShardedPapers::shard_filename("paper_sort", s), SORT_RUN_BYTES / num_shards));
+    }
+    auto shard_of = [&](long id) {
+        return sharded ? ShardedPapers::shard_of(id, num_shards) : 0;
+    };
+    size_t num_authors = 0;
+    size_t num_papers = 0;
+
     // loop through the json line by line
     while(std::getline(ifs, line)) {
         if (i % 100000 == 0) {
@@ -73,8 +157,7 @@ void build_db(const std::string &filename) {
         }
 
         // extract author array; if not found, skip
-        std::array<long, 8> author_vec;
-        author_vec.fill(0);
+        std::vector<long> author_vec;
 
         ondemand::array authors;
         auto author_error = curr.find_field("authors").get(authors);
@@ -83,12 +166,7 @@ void build_db(const std::string &filename) {
         }
 
         // iterate over author array
-        int j = 0;
-
         for (ondemand::object author : authors) {
-            // only traverse 8 authors for time/memory reasons
-            if (j == 8) break;
-
             // get name of author and organization (if found)
             std::string name = std::string(author.find_field("name").get_string().value());
 
@@ -102,21 +180,18 @@ void build_db(const std::string &filename) {
 
             // get author id
             long id = author["id"].get_int64();
+            author_vec.push_back(id);
 
-            // if id already traversed, continue
+            // if id already traversed, it is only added to this paper's authors
             if (traversed.find(id) != traversed.end()) {
-                break;
+                continue;
             }
 
-            // insert author into the database, updating things as needed
-            author::Entry entry(name, org, id);
-            author_db.insert(id, entry);
+            // queue the author for the database
+            authors_to_load[shard_of(id)]->add(id, author::Entry(name, org, id));
+            ++num_authors;
 
             traversed.insert(id);
-
-            author_vec[j] = id;
-
-            ++j;
         }
 
         // extract paper title; if not found, skip
@@ -182,25 +257,61 @@ void build_db(const std::string &filename) {
         // get rid of trailing space
         fos_list = fos_list.substr(0, fos_list.size() - 1);
 
-        // insert the paper into the database
-        paper::Entry to_insert(title, fos_list, n_citations, paper_year, author_vec, paper_id);
-        paper_db.insert(paper_id, to_insert);
+        // queue the paper for the database
+        papers_to_load[shard_of(paper_id)]->add(paper_id, paper::Entry(title, fos_list, n_citations, paper_year, author_vec, paper_id));
+        ++num_papers;
 
         ++i;
     }
 
+    // merge the sorted runs straight into new databases, overwriting as necessary (the sort is stable, so the last copy of a repeated id wins like it would with insert)
+    // the files of the other way of building are removed, since readers would otherwise find them (see open_db)
+    if (sharded) {
+        BTreeDB<author::Entry>::remove_files("author_keys.db", "author_values.db");
+        BTreeDB<paper::Entry>::remove_files("paper_keys.db", "paper_values.db");
+        // an earlier build with more shards would otherwise leave its extra shards behind
+        ShardedAuthors::remove_files("author_keys.db", "author_values.db");
+        ShardedPapers::remove_files("paper_keys.db", "paper_values.db");
+        ShardedAuthors author_db("author_keys.db", "author_values.db", num_shards, true, false, config);
+        ShardedPapers paper_db("paper_keys.db", "paper_values.db", num_shards, true, false, config);
+
+        std::cout << "bulk loading " << num_authors << " authors into " << num_shards << " shards" << std::endl;
+        load_sorted(author_db, authors_to_load);
+        std::cout << "bulk loading " << num_papers << " papers into " << num_shards << " shards" << std::endl;
+        load_sorted(paper_db, papers_to_load);
+
+        std::cout << "indexing authors and titles" << std::endl;
+        index_papers(paper_db);
+    } else {
+        ShardedAuthors::remove_files("author_keys.db", "author_values.db");
+        ShardedPapers::remove_files("paper_keys.db", "paper_values.db");
+        BTreeDB<author::Entry> author_db("author_keys.db", "author_values.db", true, false, config);
+        BTreeDB<paper::Entry> paper_db("paper_keys.db", "paper_values.db", true, false, config);
+
+        std::cout << "bulk loading " << num_authors << " authors" << std::endl;
+        load_sorted(author_db, authors_to_load);
+        std::cout << "bulk loading " << num_papers << " papers" << std::endl;
+        load_sorted(paper_db, papers_to_load);
+
+        std::cout << "indexing authors and titles" << std::endl;
+        index_papers(paper_db);
+    }
+
     // save journal graph to disk (db files implicitly do this when out of scope)
     g.export_to_file("journalgraph.bin");
 }
 
-void build_author_graph(const std::string& filename) {
+/**
+    Builds the author graph, looking up the papers that every paper references in the paper database.
+
+    @param filename The filename of the dblp json to read in (relative to the build folder).
+    @param paper_db The paper database (a BTreeDB or a ShardedBTreeDB)
+*/
+template <typename DB>
+void build_author_graph(const std::string& filename, DB& paper_db) {
     // open the dblp json
     std::ifstream ifs(filename);
 
-    // instantiate the paper db in read only format to prevent mutating it
-    // only loads into memory as needed; speeds up when used for longer
-    BTreeDB<paper::Entry> paper_db("paper_keys.db", "paper_values.db", false, true);
-
     // create author graph
     AuthorGraph g;
 
@@ -286,15 +397,19 @@ void build_author_graph(const std::string& filename) {
         if (refs_error) {
             
         } else {
+            // get the data for all referenced papers in one batch
+            std::vector<long> ref_ids;
             for (unsigned long id : refs) {
-                // get the data for this paper id
-                paper::Entry cur_paper = paper_db.find(id);
+                ref_ids.push_back(id);
+            }
+            std::vector<paper::Entry> ref_papers = paper_db.find_many(ref_ids);
 
+            for (paper::Entry& cur_paper : ref_papers) {
                 // if this paper doesn't have authors or has id -1 (invalid), skip
-                if (cur_paper.authors[0] == 0) continue;
+                if (cur_paper.authors.empty()) continue;
                 if (cur_paper.id == -1) continue;
 
-                // add connections between the authors of this paper and those in the referenced paper (which is max 8)
+                // add connections between the authors of this paper and those in the referenced paper (the first AUTHOR_EDGE_LIMIT of each)
                 g.add_referenced_authors(author_vec, cur_paper.authors, n_citations, cur_paper.n_citations);
             }
         }
@@ -305,3 +420,11 @@ void build_author_graph(const std::string& filename) {
     // save author graph to disk
     g.export_to_file("author_graph.bin");
 }
+
+void build_author_graph(const std::string& filename) {
+    // instantiate the paper db (sharded or not, whichever build_db wrote) in read only format to prevent mutating it
+    // only loads into memory as needed; speeds up when used for longer
+    open_db<paper::Entry>("paper_keys.db", "paper_values.db", true, BTreeConfig(), [&](auto& paper_db) {
+        build_author_graph(filename, paper_db);
+    });
+}
@@ -7,11 +7,13 @@
 */
 
 /**
-    Builds the author/paper databases as well as the paper graph and stores them to disk in the build folder.
+    Builds the author/paper databases, their indexes, the paper columns, and the paper graph and stores them to disk in the build folder.
 
     @param filename The filename of the dblp json to read in (relative to the build folder).
+    @param direct_io Whether to write the databases with direct I/O (see BTreeConfig::direct_io), so the build doesn't fill the OS page cache with pages it won't read again.
+    @param shards How many shards to build the author and paper databases as (see ShardedBTreeDB), loading the shards at the same time; at most MAX_SHARDS, and 0 builds them unsharded. Readers open either kind, with any number of shards, with open_db.
 */
-void build_db(const std::string& filename);
+void build_db(const std::string& filename, bool direct_io = false, unsigned int shards = 0);
 
 /**
     Builds the author graph. Assumes that the author/paper databases already exist and are ready to query.
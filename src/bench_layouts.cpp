@@ -0,0 +1,136 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include "../storage/btree_db_v2.hpp"
+#include "../storage/btree_types.cpp"
+
+using std::cout;
+using std::endl;
+
+/**
+    Milliseconds since a start time.
+*/
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+    Size of a file in KB, or 0 if it doesn't exist.
+*/
+long file_kb(const std::string& filename) {
+    struct stat info;
+    return stat(filename.c_str(), &info) == 0 ? info.st_size / 1024 : 0;
+}
+
+/**
+    Builds a copy of the papers with one page layout and key format, then times lookups and a full scan of it through a small cache, so that most pages have to be read from the files.
+
+    @param name What to call the configuration in the table
+    @param key_format The key format of the copy
+    @param papers Every paper, sorted by id
+    @param lookups Ids to look up (in this order)
+*/
+template <typename Layout>
+void run_config(const std::string& name, KeyFormat key_format, std::vector<std::pair<long, paper::Entry>>& papers, const std::vector<long>& lookups) {
+    const std::string keys_file = "bench_layout_keys.db", values_file = "bench_layout_values.db";
+
+    BTreeConfig config;
+    config.key_format = key_format;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        BTreeDB<paper::Entry, Layout> db(keys_file, values_file, true, false, config);
+        db.bulk_load(papers.begin(), papers.end());
+    }
+    double build = elapsed_ms(start);
+
+    // the smallest cache the pool allows
+    config.use_mmap = false;
+    config.cache_bytes = 0;
+    BTreeDB<paper::Entry, Layout> db(keys_file, values_file, false, true, config);
+
+    start = std::chrono::steady_clock::now();
+    long found = 0;
+    for (long id : lookups) {
+        found += db.find(id).id == id;
+    }
+    double finds = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<paper::Entry> batch = db.find_many(lookups);
+    double find_many = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    long scanned = 0;
+    db.scan(LONG_MIN, LONG_MAX, [&scanned](long, const paper::Entry&) {
+        ++scanned;
+    });
+    double scan = elapsed_ms(start);
+
+    cout << std::left << std::setw(12) << name << std::right
+         << std::setw(10) << file_kb(keys_file)
+         << std::setw(12) << std::fixed << std::setprecision(1) << build
+         << std::setw(12) << std::setprecision(2) << finds * 1000 / lookups.size()
+         << std::setw(12) << std::setprecision(1) << find_many
+         << std::setw(12) << scan;
+    if (found != static_cast<long>(lookups.size()) || scanned != static_cast<long>(papers.size())) {
+        cout << "  (found " << found << " of " << lookups.size() << ", scanned " << scanned << ")";
+    }
+    cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 4) {
+        cout << "Invalid number of arguments passed." << endl;
+        cout << "Usage: ./bench_layouts [paper key db filename (paper_keys.db)] [paper value db filename (paper_values.db)] [number of lookups (default 100000)]" << endl;
+
+        return 0;
+    }
+    size_t num_lookups = argc == 4 ? std::stoul(argv[3]) : 100000;
+
+    cout << "Reading the papers from " << argv[1] << " and " << argv[2] << endl;
+    std::vector<std::pair<long, paper::Entry>> papers;
+    {
+        BTreeDB<paper::Entry> db(argv[1], argv[2], false, true);
+        for (auto iter = db.first(); iter.valid(); iter.next()) {
+            papers.push_back({iter.key(), iter.value()});
+        }
+    }
+    if (papers.empty()) {
+        cout << "The paper database is empty." << endl;
+        return 0;
+    }
+
+    std::vector<long> lookups;
+    std::mt19937 gen(225);
+    std::uniform_int_distribution<size_t> pick(0, papers.size() - 1);
+    for (size_t i = 0; i < num_lookups; ++i) {
+        lookups.push_back(papers[pick(gen)].first);
+    }
+
+    cout << papers.size() << " papers, " << lookups.size() << " random lookups, smallest cache" << endl << endl;
+    cout << std::left << std::setw(12) << "layout" << std::right
+         << std::setw(10) << "keys KB"
+         << std::setw(12) << "build ms"
+         << std::setw(12) << "find us"
+         << std::setw(12) << "batch ms"
+         << std::setw(12) << "scan ms" << endl;
+
+    run_config<DefaultLayout>("4K split", Split, papers, lookups);
+    run_config<DefaultLayout>("4K delta", Delta, papers, lookups);
+    run_config<PageLayout<16384>>("16K split", Split, papers, lookups);
+    run_config<PageLayout<16384>>("16K delta", Delta, papers, lookups);
+    run_config<PageLayout<65536>>("64K split", Split, papers, lookups);
+    run_config<PageLayout<65536>>("64K delta", Delta, papers, lookups);
+
+    std::remove("bench_layout_keys.db");
+    std::remove("bench_layout_values.db");
+    std::remove("bench_layout_keysbench_layout_values.txt");
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <exception>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "bench_storage.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/**
+    Runs one engine in a child process and collects its results, so that every engine starts from the same clean process and its peak RSS is its own.
+
+    @param engine The name of the engine (v1, v2, v2_direct, or vector)
+    @param options The sizes and seed of the run
+    @return the engine's JSON object
+*/
+std::string run_engine(const std::string& engine, const BenchOptions& options) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("error creating pipe");
+    }
+
+    cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("error starting benchmark process");
+    }
+
+    if (pid == 0) {
+        // the engines print debugging output of their own, which would end up in the middle of the JSON
+        close(fds[0]);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+
+        try {
+            EngineResult results = engine == "v1" ? bench_v1(options) : engine == "v2" ? bench_v2(options) : engine == "v2_direct" ? bench_v2_direct(options) : bench_vector(options);
+            std::string json = results_json(results);
+            size_t written = 0;
+            while (written < json.size()) {
+                ssize_t curr = write(fds[1], json.data() + written, json.size() - written);
+                if (curr <= 0) {
+                    _exit(1);
+                }
+                written += curr;
+            }
+        } catch (const std::exception& e) {
+            cerr << engine << ": " << e.what() << endl;
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::string json;
+    char buffer[4096];
+    ssize_t curr;
+    while ((curr = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        json.append(buffer, curr);
+    }
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return "{\"engine\": \"" + engine + "\", \"error\": \"failed\"}";
+    }
+
+    std::ostringstream out;
+    out << "{\"engine\": \"" << engine << "\", \"peak_rss_kb\": " << usage.ru_maxrss << ", " << json << "}";
+    return out.str();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 5) {
+        cout << "Invalid number of arguments passed." << endl;
+        cout << "Usage: ./bench_storage [engines: all, or a comma separated list of v1, v2, v2_direct, and vector (default all)] [number of entries (default 100000)] [operations per workload (default 100000)] [seed (default 225)]" << endl;
+
+        return 0;
+    }
+
+    std::string engines = argc > 1 ? argv[1] : "all";
+    if (engines == "all") {
+        engines = "v1,v2,v2_direct,vector";
+    }
+
+    BenchOptions options;
+    options.entries = argc > 2 ? std::stoul(argv[2]) : 100000;
+    options.ops = argc > 3 ? std::stoul(argv[3]) : 100000;
+    options.seed = argc > 4 ? std::stoull(argv[4]) : 225;
+
+    std::vector<std::string> results;
+    std::stringstream names(engines);
+    std::string engine;
+    while (std::getline(names, engine, ',')) {
+        if (engine != "v1" && engine != "v2" && engine != "v2_direct" && engine != "vector") {
+            cout << "Unknown engine " << engine << "; valid engines are v1, v2, v2_direct, and vector" << endl;
+            return 1;
+        }
+        cerr << "running " << engine << endl;
+        results.push_back(run_engine(engine, options));
+    }
+
+    // one object per run, so results can be kept as a baseline and compared after a change
+    cout << "{\n  \"seed\": " << options.seed << ",\n  \"entries\": " << options.entries << ",\n  \"ops\": " << options.ops << ",\n  \"engines\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        cout << (i == 0 ? "" : ",") << "\n    " << results[i];
+    }
+    cout << "\n  ]\n}" << endl;
+    return 0;
+}
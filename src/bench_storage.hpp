@@ -0,0 +1,358 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <climits>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../storage/btree_types.cpp"
+#include "../storage/latency_histogram.hpp"
+
+#define BENCH_ZIPF_SKEW 0.99 // skew of the Zipfian lookups (the usual YCSB value); the hottest 1% of the ids get about half of the lookups
+#define BENCH_MISS_SHARE 0.9 // share of the miss heavy lookups that are of ids that aren't in the database
+#define BENCH_MAX_WRITERS 8 // the parallel inserts run with 1, 2, 4, ... up to this many threads
+
+/**
+    This struct is the settings shared by every engine's run. Engines that can't handle as many entries or operations in reasonable time (see the max_ fields of the engines) use fewer.
+*/
+struct BenchOptions {
+    size_t entries;
+    size_t ops;
+    uint64_t seed;
+};
+
+/**
+    This struct is the outcome of one workload: how many operations ran, how many of them found what they looked for (inserts always count), and how long they took.
+*/
+struct WorkloadResult {
+    std::string name;
+    uint64_t ops = 0;
+    uint64_t found = 0;
+    double seconds = 0;
+    LatencySummary latency;
+};
+
+/**
+    This struct is the outcome of every workload on one engine, with the number of entries its databases had and how much of their files the OS kept in its page cache after the sequential inserts (which isn't part of the engine's RSS, but is memory all the same).
+*/
+struct EngineResult {
+    size_t entries = 0;
+    size_t page_cache_kb = 0;
+    std::vector<WorkloadResult> workloads;
+};
+
+/**
+    Runs every workload on one engine. Each is defined in the file that includes that engine (bench_storage_*.cpp), since the engines can't share a translation unit.
+
+    @param options The sizes and seed of the run
+    @return the results, with the workloads in the order they ran
+*/
+EngineResult bench_v1(const BenchOptions& options);
+EngineResult bench_v2(const BenchOptions& options);
+EngineResult bench_v2_direct(const BenchOptions& options);
+EngineResult bench_vector(const BenchOptions& options);
+
+/**
+    Times a workload one operation at a time, recording the latency of each.
+
+    @param name What to call the workload in the results
+    @param keys The id each operation is on, in order
+    @param op Called with each id; returns whether it found what it looked for
+    @return the result of the workload
+*/
+template <typename F>
+WorkloadResult time_ops(const std::string& name, const std::vector<long>& keys, F op) {
+    LatencyHistogram histogram;
+    WorkloadResult res;
+    res.name = name;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long key : keys) {
+        LatencyHistogram::Timer timer(histogram);
+        res.found += op(key);
+    }
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    res.ops = keys.size();
+    res.latency = histogram.summary();
+    return res;
+}
+
+/**
+    Times a workload split over several threads, each doing an equal run of the operations one at a time. The latencies of all the threads go into one histogram, and the time is that of the whole workload, so ops_per_sec is the combined throughput.
+
+    @param name What to call the workload in the results
+    @param keys The id each operation is on; thread i gets the i-th run of them
+    @param threads The number of threads
+    @param op Called with each id, from any thread; returns whether it found what it looked for
+    @return the result of the workload
+*/
+template <typename F>
+WorkloadResult time_threaded_ops(const std::string& name, const std::vector<long>& keys, unsigned int threads, F op) {
+    LatencyHistogram histogram;
+    WorkloadResult res;
+    res.name = name;
+    std::atomic<uint64_t> found(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; ++t) {
+        size_t begin = keys.size() * t / threads, end = keys.size() * (t + 1) / threads;
+        workers.emplace_back([&keys, &histogram, &found, &op, begin, end]() {
+            uint64_t curr = 0;
+            for (size_t i = begin; i < end; ++i) {
+                LatencyHistogram::Timer timer(histogram);
+                curr += op(keys[i]);
+            }
+            found += curr;
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    res.found = found;
+    res.ops = keys.size();
+    res.latency = histogram.summary();
+    return res;
+}
+
+/**
+    Returns the ids of a database of n entries. They are the even numbers, so odd ones are never in it.
+*/
+inline std::vector<long> stored_ids(size_t n) {
+    std::vector<long> res(n);
+    for (size_t i = 0; i < n; ++i) {
+        res[i] = static_cast<long>(i) * 2;
+    }
+    return res;
+}
+
+/**
+    Returns ops ids picked uniformly from a database of n entries.
+*/
+inline std::vector<long> uniform_keys(size_t n, size_t ops, std::mt19937_64& gen) {
+    std::uniform_int_distribution<size_t> pick(0, n - 1);
+    std::vector<long> res(ops);
+    for (long& key : res) {
+        key = static_cast<long>(pick(gen)) * 2;
+    }
+    return res;
+}
+
+/**
+    Returns ops ids from a database of n entries with Zipfian popularity. The most popular ids are spread over the whole key range (not all in the first leaf), like popular papers are.
+*/
+inline std::vector<long> zipf_keys(size_t n, size_t ops, std::mt19937_64& gen) {
+    // the share of lookups of every rank, summed up, so a rank is a binary search away from a uniform number
+    std::vector<double> cdf(n);
+    double total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        total += 1.0 / std::pow(static_cast<double>(i + 1), BENCH_ZIPF_SKEW);
+        cdf[i] = total;
+    }
+
+    std::vector<long> ids = stored_ids(n);
+    std::shuffle(ids.begin(), ids.end(), gen);
+
+    std::uniform_real_distribution<double> pick(0, total);
+    std::vector<long> res(ops);
+    for (long& key : res) {
+        size_t rank = std::lower_bound(cdf.begin(), cdf.end(), pick(gen)) - cdf.begin();
+        key = ids[std::min(rank, n - 1)];
+    }
+    return res;
+}
+
+/**
+    Returns ops ids of a database of n entries, BENCH_MISS_SHARE of which aren't in it (like the references of the dataset to papers outside it).
+*/
+inline std::vector<long> miss_keys(size_t n, size_t ops, std::mt19937_64& gen) {
+    std::vector<long> res = uniform_keys(n, ops, gen);
+    std::bernoulli_distribution miss(BENCH_MISS_SHARE);
+    for (long& key : res) {
+        key += miss(gen);
+    }
+    return res;
+}
+
+/**
+    Returns the synthetic paper stored under an id. Every field is derived from the id, so a run is the same every time.
+*/
+inline paper::Entry make_paper(long id) {
+    std::string title = "Synthetic paper number " + std::to_string(id) + " on the performance of storage engines";
+    std::string keywords = "storage btree " + std::to_string(id % 97);
+    std::vector<long> authors(8);
+    for (unsigned int i = 0; i < authors.size(); ++i) {
+        authors[i] = id * 8 + i;
+    }
+    return paper::Entry(title, keywords, static_cast<unsigned int>(id % 1000), 1950 + static_cast<unsigned int>(id % 70), authors, id);
+}
+
+/**
+    Returns the synthetic author stored under an id. Names are unique, so a name lookup has exactly one answer.
+*/
+inline author::Entry make_author(long id) {
+    return author::Entry("Author " + std::to_string(id), "Organization " + std::to_string(id % 500), id);
+}
+
+/**
+    Writes a file's dirty pages and drops it from the OS page cache, so the next reads of it come from the disk.
+
+    @param filename The file; missing files are ignored
+*/
+inline void drop_file_cache(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/**
+    Returns how much of a file is in the OS page cache.
+
+    @param filename The file; missing and empty files have none
+    @return the size of its cached pages in KB
+*/
+inline size_t file_cache_kb(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    size_t res = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        // mapping a file doesn't read it, and mincore tells which of its pages are resident
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            size_t os_page = sysconf(_SC_PAGESIZE);
+            std::vector<unsigned char> resident((st.st_size + os_page - 1) / os_page);
+            if (mincore(map, st.st_size, resident.data()) == 0) {
+                for (unsigned char page : resident) {
+                    res += page & 1;
+                }
+            }
+            munmap(map, st.st_size);
+            res = res * os_page / 1024;
+        }
+    }
+    close(fd);
+    return res;
+}
+
+/**
+    Runs the workloads on an engine, in an order that reuses databases where it can:
+    - random_insert and sequential_insert build a database of the even ids in shuffled and in increasing order
+    - parallel_insert_1, parallel_insert_2, ... up to BENCH_MAX_WRITERS build it from the shuffled ids again, split over that many threads, for engines that are safe to insert into from several threads
+    - find_uniform, find_zipf, and find_miss look ids up in the sequentially built one while it is still open (so warm)
+    - find_cold and find_warm reopen it after dropping its files from the OS page cache, then look the same ids up twice
+    - find_name looks ids up by author name in a separate database of authors, for engines that can
+
+    An engine is a class with a constructor Engine(bool create_new), insert(long id) and find(long id) (which returns whether it was found) on the synthetic papers, static drop_caches(), page_cache_kb() (how much of its paper files are in the OS page cache), and remove_files(), max_entries, max_ops, has_names, and thread_safe (whether insert can be called from several threads at once); engines with names also have a Names class with a constructor from the ids it holds and find(long id), which looks the author up by name, and max_name_ops.
+
+    @tparam Engine The engine
+    @param options The sizes and seed of the run
+    @return the results, with the workloads in the order they ran
+*/
+template <typename Engine>
+EngineResult run_workloads(const BenchOptions& options) {
+    size_t n = std::max<size_t>(1, std::min(options.entries, Engine::max_entries));
+    size_t ops = std::min(options.ops, Engine::max_ops);
+
+    // the ids depend only on the seed and the number of entries, so engines of the same size get the same ones
+    std::mt19937_64 gen(options.seed);
+    std::vector<long> ids = stored_ids(n);
+    std::vector<long> shuffled = ids;
+    std::shuffle(shuffled.begin(), shuffled.end(), gen);
+    std::vector<long> uniform = uniform_keys(n, ops, gen);
+    std::vector<long> zipf = zipf_keys(n, ops, gen);
+    std::vector<long> misses = miss_keys(n, ops, gen);
+
+    auto insert = [](Engine& db) {
+        return [&db](long id) {
+            db.insert(id);
+            return true;
+        };
+    };
+    auto find = [](Engine& db) {
+        return [&db](long id) {
+            return db.find(id);
+        };
+    };
+
+    EngineResult res;
+    res.entries = n;
+    std::vector<WorkloadResult>& workloads = res.workloads;
+    {
+        Engine db(true);
+        workloads.push_back(time_ops("random_insert", shuffled, insert(db)));
+    }
+    if constexpr (Engine::thread_safe) {
+        // the same inserts at every thread count, so the throughputs show how inserts scale with writers
+        for (unsigned int writers = 1; writers <= BENCH_MAX_WRITERS; writers *= 2) {
+            Engine db(true);
+            workloads.push_back(time_threaded_ops("parallel_insert_" + std::to_string(writers), shuffled, writers, insert(db)));
+        }
+    }
+    {
+        Engine db(true);
+        workloads.push_back(time_ops("sequential_insert", ids, insert(db)));
+        workloads.push_back(time_ops("find_uniform", uniform, find(db)));
+        workloads.push_back(time_ops("find_zipf", zipf, find(db)));
+        workloads.push_back(time_ops("find_miss", misses, find(db)));
+    }
+    res.page_cache_kb = Engine::page_cache_kb();
+
+    Engine::drop_caches();
+    {
+        Engine db(false);
+        workloads.push_back(time_ops("find_cold", uniform, find(db)));
+        workloads.push_back(time_ops("find_warm", uniform, find(db)));
+    }
+
+    if constexpr (Engine::has_names) {
+        typename Engine::Names names(ids);
+        std::vector<long> keys = uniform_keys(n, std::min(ops, Engine::max_name_ops), gen);
+        workloads.push_back(time_ops("find_name", keys, [&names](long id) {
+            return names.find(id);
+        }));
+    }
+
+    Engine::remove_files();
+    return res;
+}
+
+/**
+    Formats the results of an engine as the body of a JSON object (without the braces), so the caller can add fields of its own.
+
+    @param results The results of run_workloads
+    @return the fields entries, page_cache_kb, and workloads
+*/
+inline std::string results_json(const EngineResult& results) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(6);
+    out << "\"entries\": " << results.entries << ", \"page_cache_kb\": " << results.page_cache_kb << ", \"workloads\": [";
+    for (size_t i = 0; i < results.workloads.size(); ++i) {
+        const WorkloadResult& result = results.workloads[i];
+        out << (i == 0 ? "" : ",") << "\n        {\"name\": \"" << result.name << "\", \"ops\": " << result.ops << ", \"found\": " << result.found
+            << ", \"seconds\": " << result.seconds << ", \"ops_per_sec\": " << std::setprecision(1) << (result.seconds > 0 ? result.ops / result.seconds : 0.0) << std::setprecision(6)
+            << ", \"mean_ns\": " << result.latency.mean_ns << ", \"p50_ns\": " << result.latency.p50_ns << ", \"p99_ns\": " << result.latency.p99_ns << ", \"max_ns\": " << result.latency.max_ns << "}";
+    }
+    out << "\n    ]";
+    return out.str();
+}
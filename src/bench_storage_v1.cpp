@@ -0,0 +1,96 @@
+#include <string>
+#include <fstream>
+#include <array>
+#include <climits>
+#include <iostream>
+#include <cassert>
+#include <stack>
+#include <cstdint>
+#include <stdexcept>
+#include <exception>
+#include <cstring>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+#include "../storage/btree_types.cpp"
+#include "bench_storage.hpp"
+
+// v1 has the same names as v2 (BTreeDB, FileType), so it gets a namespace of its own in this binary; its includes are all above, so only its own code ends up in it
+// it is kept as it was for comparison, so its warnings are silenced here instead of fixed
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wclass-memaccess"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+namespace v1 {
+#include "../storage/btree_db.hpp"
+}
+#pragma GCC diagnostic pop
+
+/**
+    The deprecated v1 BTree, with its fixed cache of CACHE_SIZE sets of two pages per file. It has no name index, so name lookups read every value.
+*/
+struct V1Engine {
+    static const size_t max_entries = SIZE_MAX;
+    static const size_t max_ops = SIZE_MAX;
+    static const size_t max_name_ops = 200;
+    static const bool has_names = true;
+    static const bool thread_safe = false;
+
+    v1::BTreeDB<paper::Entry> db;
+
+    V1Engine(bool create_new): db("bench_v1_keys.db", "bench_v1_values.db", create_new) {}
+
+    void insert(long id) {
+        paper::Entry paper = make_paper(id);
+        db.insert(id, paper);
+    }
+
+    bool find(long id) {
+        return db.find(id).id == id;
+    }
+
+    /**
+        A database of the synthetic authors, looked up by scanning the values. v1's get_id_from_name runs off its end when the name isn't there, so only names that are stored are looked up.
+    */
+    struct Names {
+        v1::BTreeDB<author::Entry> db;
+        std::vector<long> ids;
+
+        Names(const std::vector<long>& set_ids): db("bench_v1_author_keys.db", "bench_v1_author_values.db", true), ids(set_ids) {
+            for (long id : ids) {
+                author::Entry author = make_author(id);
+                db.insert(id, author);
+            }
+            std::sort(ids.begin(), ids.end());
+        }
+
+        bool find(long id) {
+            if (!std::binary_search(ids.begin(), ids.end(), id)) {
+                return false;
+            }
+            return db.get_id_from_name(make_author(id)) == id;
+        }
+    };
+
+    static void drop_caches() {
+        drop_file_cache("bench_v1_keys.db");
+        drop_file_cache("bench_v1_values.db");
+    }
+
+    static size_t page_cache_kb() {
+        return file_cache_kb("bench_v1_keys.db") + file_cache_kb("bench_v1_values.db");
+    }
+
+    static void remove_files() {
+        for (const char* name : {"bench_v1_keys.db", "bench_v1_values.db", "bench_v1_keysbench_v1_values.txt",
+                                 "bench_v1_author_keys.db", "bench_v1_author_values.db", "bench_v1_author_keysbench_v1_author_values.txt"}) {
+            std::remove(name);
+        }
+    }
+};
+
+EngineResult bench_v1(const BenchOptions& options) {
+    return run_workloads<V1Engine>(options);
+}
@@ -0,0 +1,95 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "../storage/btree_db_v2.hpp"
+#include "bench_storage.hpp"
+
+/**
+    The v2 BTree with its default settings (see BTreeConfig), as the rest of the project opens it. Lookups after reopening go through the mapped files, like those of read only programs.
+
+    With Direct, the databases are opened with direct I/O instead (see BTreeConfig::direct_io), so nothing is mapped and every page the cache doesn't hold comes from the disk.
+
+    @tparam Direct Whether to use direct I/O
+*/
+template <bool Direct>
+struct V2Engine {
+    static const size_t max_entries = SIZE_MAX;
+    static const size_t max_ops = SIZE_MAX;
+    static const size_t max_name_ops = SIZE_MAX;
+    static const bool has_names = true;
+    static const bool thread_safe = true;
+
+    BTreeDB<paper::Entry> db;
+
+    V2Engine(bool create_new): db(file("keys.db"), file("values.db"), create_new, !create_new, config()) {}
+
+    /**
+        Returns the name of one of the engine's files, so the two variants don't share any.
+    */
+    static std::string file(const std::string& name) {
+        return (Direct ? "bench_v2_direct_" : "bench_v2_") + name;
+    }
+
+    static BTreeConfig config() {
+        BTreeConfig res;
+        res.direct_io = Direct;
+        return res;
+    }
+
+    void insert(long id) {
+        paper::Entry paper = make_paper(id);
+        db.insert(id, paper);
+    }
+
+    bool find(long id) {
+        return db.find(id).id == id;
+    }
+
+    /**
+        A database of the synthetic authors, looked up through its name index.
+    */
+    struct Names {
+        BTreeDB<author::Entry> db;
+
+        Names(const std::vector<long>& ids): db(file("author_keys.db"), file("author_values.db"), true, false, config()) {
+            for (long id : ids) {
+                author::Entry author = make_author(id);
+                db.insert(id, author);
+            }
+        }
+
+        bool find(long id) {
+            return db.get_id_from_name(make_author(id)) == id;
+        }
+    };
+
+    static void drop_caches() {
+        drop_file_cache(file("keys.db"));
+        drop_file_cache(file("values.db"));
+    }
+
+    static size_t page_cache_kb() {
+        return file_cache_kb(file("keys.db")) + file_cache_kb(file("values.db"));
+    }
+
+    static void remove_files() {
+        // metadata files are named after both database files
+        for (std::string db : {"", "author_"}) {
+            for (std::string suffix : {"", "_names"}) {
+                std::string keys = file(db + "keys" + suffix), values = file(db + "values" + suffix);
+                std::remove((keys + ".db").c_str());
+                std::remove((values + ".db").c_str());
+                std::remove((keys + values + ".txt").c_str());
+            }
+        }
+    }
+};
+
+EngineResult bench_v2(const BenchOptions& options) {
+    return run_workloads<V2Engine<false>>(options);
+}
+
+EngineResult bench_v2_direct(const BenchOptions& options) {
+    return run_workloads<V2Engine<true>>(options);
+}
@@ -0,0 +1,54 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "bench_storage.hpp"
+#include "../storage/vector_db.cpp"
+
+/**
+    The vector database proof of concept, which stores an id and a name per entry in one unsorted file and searches all of it for every operation. Its runs are capped so they finish in seconds, and it stores the titles of the synthetic papers, since it can't hold whole records.
+*/
+struct VectorEngine {
+    static const size_t max_entries = 5000;
+    static const size_t max_ops = 1000;
+    static const bool has_names = false;
+    static const bool thread_safe = false;
+
+    VectorDatabase db;
+
+    VectorEngine(bool create_new): db(filename(create_new)) {}
+
+    /**
+        Returns the file of the database, deleting it first for a new one (VectorDatabase always opens what is there).
+    */
+    static std::string filename(bool create_new) {
+        if (create_new) {
+            remove_files();
+        }
+        return "bench_vector.db";
+    }
+
+    void insert(long id) {
+        db.insert(id, make_paper(id).title);
+    }
+
+    bool find(long id) {
+        return db.select(id) != "null";
+    }
+
+    static void drop_caches() {
+        drop_file_cache("bench_vector.db");
+    }
+
+    static size_t page_cache_kb() {
+        return file_cache_kb("bench_vector.db");
+    }
+
+    static void remove_files() {
+        std::remove("bench_vector.db");
+    }
+};
+
+EngineResult bench_vector(const BenchOptions& options) {
+    return run_workloads<VectorEngine>(options);
+}
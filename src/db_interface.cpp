@@ -5,221 +5,388 @@
 #include <string>
 #include <fstream>
 #include <exception>
+#include <memory>
 
 #include "../storage/btree_db_v2.hpp"
+#include "../storage/sharded_btree_db.hpp"
 #include "../storage/btree_types.cpp"
+#include "../storage/posting_index.hpp"
+#include "../storage/title_index.hpp"
+#include "../storage/paper_columns.hpp"
 
 using std::cout;
 using std::endl;
 using std::cin;
 
-int main(int argc, char* argv[]) {
-    if (argc != 6) {
-        cout << "Invalid number of arguments passed." << endl;
-        cout << "Usage: ./db_interface [key db filename] [value db filename] [type of the database (test, paper, or author)] [whether or not to create a new db (0 for no, 1 for yes)] [read only (0 for no, 1 for yes)]" << endl;;
+/**
+    Prints a latency summary on one line, in microseconds.
+*/
+void print_latency(const std::string& name, const LatencySummary& latency) {
+    auto us = [](uint64_t ns) {
+        return ns / 1000.0;
+    };
+    cout << name << ": " << latency.count << " calls, mean " << us(latency.mean_ns) << " us, p50 " << us(latency.p50_ns) << " us, p90 " << us(latency.p90_ns)
+         << " us, p99 " << us(latency.p99_ns) << " us, p99.9 " << us(latency.p999_ns) << " us, max " << us(latency.max_ns) << " us" << endl;
+}
+
+/**
+    Prints what a database has done since it was opened (see BTreeStats).
+*/
+void print_stats(const BTreeStats& stats) {
+    cout << stats.entries << " entries, height " << stats.height << ", " << stats.key_pages << " key pages, " << stats.value_pages << " value pages" << endl;
+    cout << "key cache: " << stats.cache.hits[Key] << " hits, " << stats.cache.misses[Key] << " misses, " << stats.cache.prefetched[Key] << " read ahead" << endl;
+    cout << "value cache: " << stats.cache.hits[Value] << " hits, " << stats.cache.misses[Value] << " misses, " << stats.cache.prefetched[Value] << " read ahead" << endl;
+    cout << "evictions: " << stats.cache.evictions << endl;
+    cout << "read: " << stats.pages_read << " pages (" << stats.bytes_read << " bytes)" << endl;
+    cout << "written: " << stats.pages_written << " pages (" << stats.bytes_written << " bytes) in " << stats.writes << " writes" << endl;
+    cout << "splits: " << stats.splits << ", lookups stopped by the bloom filter: " << stats.filtered << endl;
+    cout << "record cache: " << stats.record_cache.hits << " hits, " << stats.record_cache.misses << " misses" << endl;
+    print_latency("find", stats.find_latency);
+    print_latency("insert", stats.insert_latency);
+}
+
+/**
+    Runs the prompt for a paper database until the user quits.
+
+    @param db The paper database (a BTreeDB or a ShardedBTreeDB)
+    @param key_path The filename of the key database; the indexes are looked for next to it
+*/
+template <typename DB>
+void run_paper_prompt(DB& db, const std::string& key_path) {
+    std::string temp;
 
-        return 0;
+    // parse writes the author -> papers and title indexes next to the paper databases; without them, search_author has to scan every paper and search_title isn't available
+    std::string db_dir = key_path.substr(0, key_path.find_last_of('/') + 1);
+    std::unique_ptr<PostingIndex> author_papers;
+    try {
+        author_papers = std::make_unique<PostingIndex>(db_dir + "author_papers.idx");
+    } catch (std::runtime_error& err) {
+        cout << "No author_papers.idx found next to the key database; search_author will scan every paper." << endl;
     }
-
-    int read_only = std::stoi(argv[5]);
-    
-
-    if (std::string(argv[4]) == "1") {
-        cout << "Creating a new database file" << endl;
-        BTreeDB<test::Entry> db(argv[1], argv[2], true);
+    std::unique_ptr<TitleIndex> titles;
+    try {
+        titles = std::make_unique<TitleIndex>(db_dir + "title_trigrams.idx");
+    } catch (std::runtime_error& err) {
+        cout << "No title_trigrams.idx found next to the key database; search_title is disabled." << endl;
+    }
+    std::unique_ptr<PaperColumns> columns;
+    try {
+        columns = std::make_unique<PaperColumns>(db_dir);
+    } catch (std::runtime_error& err) {
+        cout << "No paper columns found next to the key database; by_year and top_cited are disabled." << endl;
     }
 
-    cout << "Note: the key and value databases should be compatible, or an error will be thrown." << endl;
-    cout << "We don't recommend insertion if you are working with the full graph/paper databases to prevent any data corruption." << endl;
+    while (true) {
+        cout << ">> ";
 
-    cout << "DO NOT ctrl + C to exit the prompt if you are not in read only mode; only use the quit command to prevent data corruption." << endl;
-    cout << "If a key/value file opening error is thrown, try running parse first or download the data directly." << endl;
-    cout << "A stoi/stol error may be thrown if you input a non-numerical value when prompted for one." << endl;
+        std::string input;
+        std::getline(cin, input);
 
-    std::string temp;
+        if (input == "quit") {
+            return;
+        } else if (input == "insert") {
+            cout << "Please provide the title: ";
 
-    if (std::string(argv[3]) == "test") {
-        BTreeDB<test::Entry> db(argv[1], argv[2], false, read_only);
+            std::string title;
+            std::getline(cin, title);
 
-        while (true) {
-            cout << ">> ";
+            cout << "Please provide the keywords space separated: ";
+            std::string keywords;
+            std::getline(cin, keywords);
 
-            std::string input;
-            std::getline(cin, input);
+            cout << "Please provide me the number of authors: ";
 
-            if (input == "quit") {
-                return 0;
-            } else if (input == "insert") {
-                cout << "Please provide the x: ";
+            std::getline(cin, temp);
+            unsigned int num_authors = std::stoi(temp);
+
+            std::vector<long> authors;
 
+            for (unsigned int i = 0; i < num_authors; ++i) {
+                cout << "Please provide the id of author number: " << i << endl;
                 std::getline(cin, temp);
-                int x = std::stoi(temp);
+                long author_id = std::stol(temp);
+                authors.push_back(author_id);
 
-                cout << "Please provide the str: ";
-                std::string str;
-                std::getline(cin, str);
+            }
 
-                cout << "Please provide the id: ";
-                std::getline(cin, temp);
-                long id = std::stol(temp);
+            cout << "Please provide the number of citations of this paper: ";
 
-                test::Entry entry(x, str, id);
+            std::getline(cin, temp);
+            unsigned int n_citations = std::stoi(temp);
 
-                db.insert(entry.id, entry);
-            } else if (input == "find") {
-                cout << "Please provide the id you want to search for: ";
+            cout << "Please provide the publication year of this paper: ";
 
-                std::getline(cin, temp);
-                long id = std::stol(temp);
+            std::getline(cin, temp);
+            unsigned int year = std::stoi(temp);
 
-                test::Entry entry = db.find(id);
+            cout << "Please provide the paper id: ";
+            std::getline(cin, temp);
+            long id = std::stol(temp);
 
-                if (entry.id == -1) {
-                    cout << "Entry not found" << endl;
-                } else {
-                    cout << "x: " << entry.x << ", str: " << std::string(entry.str.data()) << endl; 
-                }
-            } else if (input == "get_id") {
-                cout << "Please provide the x you want to find the id for: ";
+            paper::Entry entry(title, keywords, n_citations, year, authors, id);
 
-                std::getline(cin, temp);
-                int x = std::stoi(temp);
+            db.insert(entry.id, entry);
 
-                test::Entry entry(x);
+        } else if (input == "find") {
+            cout << "Please provide the id you want to search for: ";
 
-                long found = db.get_id_from_name(entry);
+            std::getline(cin, temp);
+            long id = std::stol(temp);
 
-                if (found == -1) {
-                    cout << "entry not found" << endl;
-                } else {
-                    cout << "id: " << found << endl;
-                }
-            } else if (input == "help") {
-                cout << "insert - insert an entry into the database (not recommended for author/graph)" << endl;
-                cout << "find - find the entry in the database corresponding to an id" << endl;
-                cout << "get_id - find the characteristic name/title/value associated an id" << endl;
-                cout << "quit - exit the CLI interface" << endl;
+            paper::Entry entry = db.find(id);
+
+            if (entry.id == -1) {
+                cout << "Entry not found" << endl;
             } else {
-                cout << "Invalid command entered. Valid commands include insert, find, get_id, help, and quit" << endl;
+                cout << "title: " << entry.title << ", keywords: " << std::string(entry.keywords.data()) << ", authors: ";
+
+                for (long author : entry.authors) {
+                    cout << author << " ";
+                }
+
+                cout << ", number of citations: " << entry.n_citations << ", publication year: " << entry.pub_year << endl;
             }
-        }
-    } else if (std::string(argv[3]) == "paper") {
-        BTreeDB<paper::Entry> db(argv[1], argv[2], false, read_only);
+        } else if (input == "get_id") {
+            cout << "Please provide the title you want to find the id for: ";
 
-        while (true) {
-            cout << ">> ";
+            std::string title;
+            std::getline(cin, title);
 
-            std::string input;
-            std::getline(cin, input);
+            paper::Entry entry(title);
 
-            if (input == "quit") {
-                return 0;
-            } else if (input == "insert") {
-                cout << "Please provide the title: ";
+            long found = db.get_id_from_name(entry);
 
-                std::string title;
-                std::getline(cin, title);
+            if (found == -1) {
+                cout << "entry not found" << endl;
+            } else {
+                cout << "id: " << found << endl;
+            }
+        } else if (input == "scan") {
+            cout << "Please provide the smallest id to include: ";
+            std::getline(cin, temp);
+            long lo = std::stol(temp);
+
+            cout << "Please provide the id to stop before: ";
+            std::getline(cin, temp);
+            long hi = std::stol(temp);
+
+            db.scan(lo, hi, [](long key, const paper::Entry& entry) {
+                cout << key << ": " << entry.title << endl;
+            });
+        } else if (input == "search_author") {
+            cout << "Please provide the id of the author whose papers you want to search for: ";
+
+            std::getline(cin, temp);
+            long id = std::stol(temp);
+
+            // note: the index only knows about papers that were in the database when parse ran
+            std::vector<long> papers;
+            if (author_papers) {
+                cout << "Papers: ";
+                papers = author_papers->get(id);
+            } else {
+                cout << "Papers (this may take a while): ";
+                papers = db.get_papers(id);
+            }
 
-                cout << "Please provide the keywords space separated: ";
-                std::string keywords;
-                std::getline(cin, keywords);
+            for (long x : papers) {
+                cout << x << ' ';
+            }
 
-                cout << "Please provide me the number of authors: ";
+            cout << endl;
+        } else if (input == "search_title") {
+            if (!titles) {
+                cout << "search_title needs title_trigrams.idx (run parse to create it)" << endl;
+                continue;
+            }
 
-                std::getline(cin, temp);
-                unsigned int num_authors = std::stoi(temp);
+            cout << "Please provide the text to search for: ";
+            std::string query;
+            std::getline(cin, query);
 
-                std::array<long, 8> authors;
-                authors.fill(0);
+            cout << "Match the whole text (0) or each word separately (1)? ";
+            std::getline(cin, temp);
+            bool keywords = temp == "1";
 
-                for (unsigned int i = 0; i < num_authors; ++i) {
-                    cout << "Please provide the id of author number: " << i << endl;
-                    std::getline(cin, temp);
-                    long author_id = std::stol(temp);
-                    authors[i] = author_id;
+            try {
+                std::vector<long> ids = titles->search(db, query, keywords, 50);
+                std::vector<paper::Entry> papers = db.find_many(ids);
+                for (size_t i = 0; i < ids.size(); ++i) {
+                    cout << ids[i] << ": " << papers[i].title << endl;
+                }
+                cout << ids.size() << " result(s) (at most 50 are shown)" << endl;
+            } catch (std::runtime_error& err) {
+                cout << err.what() << endl;
+            }
+        } else if (input == "by_year" || input == "top_cited") {
+            if (!columns) {
+                cout << input << " needs the paper columns (run parse to create them)" << endl;
+                continue;
+            }
 
+            // note: the columns only know about papers that were in the database when parse ran
+            if (input == "by_year") {
+                for (const PaperColumns::YearTotals& totals : columns->by_year()) {
+                    cout << totals.year << ": " << totals.papers << " papers, " << totals.citations << " citations" << endl;
                 }
+                continue;
+            }
 
-                cout << "Please provide the number of citations of this paper: ";
+            cout << "Please provide the first year to include: ";
+            std::getline(cin, temp);
+            unsigned int from_year = std::stoul(temp);
 
-                std::getline(cin, temp);
-                unsigned int n_citations = std::stoi(temp);
+            cout << "Please provide the last year to include: ";
+            std::getline(cin, temp);
+            unsigned int to_year = std::stoul(temp);
 
-                cout << "Please provide the publication year of this paper: ";
+            std::vector<long> ids = columns->top_cited(20, from_year, to_year);
+            std::vector<paper::Entry> papers = db.find_many(ids);
+            for (size_t i = 0; i < ids.size(); ++i) {
+                cout << ids[i] << " (" << papers[i].n_citations << " citations, " << papers[i].pub_year << "): " << papers[i].title << endl;
+            }
+        } else if (input == "stats") {
+            print_stats(db.stats());
+        } else if (input == "help") {
+            cout << "insert - insert an entry into the database (not recommended for author/graph)" << endl;
+            cout << "find - find the entry in the database corresponding to an id" << endl;
+            cout << "get_id - find the characteristic name/title/value associated an id" << endl;
+            cout << "scan - list the ids and titles of all papers with ids in a range, in id order" << endl;
+            cout << "search_title - find papers whose titles contain some text or some words" << endl;
+            cout << "search_author - find all papers associated with an author (this might take a while without author_papers.idx)" << endl;
+            cout << "by_year - count the papers and their citations for every publication year" << endl;
+            cout << "top_cited - list the 20 most cited papers published in a range of years" << endl;
+            cout << "stats - show cache, I/O, and latency counts since the database was opened" << endl;
+            cout << "quit - exit the CLI interface" << endl;
+        } else {
+            cout << input << endl;
+            cout << "Invalid command entered. Valid commands include insert, find, get_id, scan, search_title, search_author, by_year, top_cited, stats, help, and quit" << endl;
+        }
+    }
+}
 
-                std::getline(cin, temp);
-                unsigned int year = std::stoi(temp);
-    
-                cout << "Please provide the paper id: ";
-                std::getline(cin, temp);
-                long id = std::stol(temp);
+/**
+    Runs the prompt for an author database until the user quits.
 
-                paper::Entry entry(title, keywords, n_citations, year, authors, id);
+    @param db The author database (a BTreeDB or a ShardedBTreeDB)
+*/
+template <typename DB>
+void run_author_prompt(DB& db) {
+    std::string temp;
 
-                db.insert(entry.id, entry);
+    while (true) {
+        cout << ">> ";
 
-            } else if (input == "find") {
-                cout << "Please provide the id you want to search for: ";
+        std::string input;
+        std::getline(cin, input);
 
-                std::getline(cin, temp);
-                long id = std::stol(temp);
+        if (input == "quit") {
+            return;
+        } else if (input == "insert") {
+            cout << "Please provide the author name: ";
 
-                paper::Entry entry = db.find(id);
+            std::string name;
+            std::getline(cin, name);
 
-                if (entry.id == -1) {
-                    cout << "Entry not found" << endl;
-                } else {
-                    cout << "title: " << std::string(entry.title.data()) << ", keywords: " << std::string(entry.keywords.data()) << ", authors: ";
+            cout << "Please provide the organization: ";
 
-                    int j = 0;
-                    while (entry.authors[j] != 0 && j < 8) {
-                        cout << entry.authors[j] << " ";
-                        ++j;
-                    }
+            std::string org;
+            std::getline(cin, org);
 
-                    cout << ", number of citations: " << entry.n_citations << ", publication year: " << entry.pub_year << endl;
-                }
-            } else if (input == "get_id") {
-                cout << "Please provide the title you want to find the id for: ";
+            cout << "Please provide me the id: ";
 
-                std::string title;
-                std::getline(cin, title);
+            std::getline(cin, temp);
+            long id = std::stol(temp);
 
-                paper::Entry entry(title);
+            author::Entry entry(name, org, id);
 
-                long found = db.get_id_from_name(entry);
+            db.insert(entry.id, entry);
 
-                if (found == -1) {
-                    cout << "entry not found" << endl;
-                } else {
-                    cout << "id: " << found << endl;
-                }
-            } else if (input == "search_author") {
-                cout << "Please provide the id of the author whose papers you want to search for: ";
+        } else if (input == "find") {
+            cout << "Please provide the id you want to search for: ";
 
-                std::getline(cin, temp);
-                long id = std::stol(temp);
+            std::getline(cin, temp);
+            long id = std::stol(temp);
 
-                cout << "Papers (this may take a while): ";
+            author::Entry entry = db.find(id);
 
-                for (long x : db.get_papers(id)) {
-                    cout << x << ' ';
-                }
+            if (entry.id == -1) {
+                cout << "Entry not found" << endl;
+            } else {
+                cout << "name: " << std::string(entry.name.data()) << ", organization: " << std::string(entry.organization.data()) << endl;
+            }
+        } else if (input == "get_id") {
+            cout << "Please provide the name you want to find the id for: ";
 
-                cout << endl;
-            } else if (input == "help") {
-                cout << "insert - insert an entry into the database (not recommended for author/graph)" << endl;
-                cout << "find - find the entry in the database corresponding to an id" << endl;
-                cout << "get_id - find the characteristic name/title/value associated an id" << endl;
-                cout << "search_author - find all papers associated with an author (this might take a while)" << endl;
-                cout << "quit - exit the CLI interface" << endl;
+            std::string name;
+            std::getline(cin, name);
+
+            author::Entry entry(name);
+
+            // several authors can share a name, so show all of them
+            std::vector<long> found = db.get_ids_from_name(entry);
+
+            if (found.empty()) {
+                cout << "entry not found" << endl;
             } else {
-                cout << input << endl;
-                cout << "Invalid command entered. Valid commands include insert, find, get_id, search_author, help, and quit" << endl;
+                for (long id : found) {
+                    cout << "id: " << id << endl;
+                }
             }
+        } else if (input == "scan") {
+            cout << "Please provide the smallest id to include: ";
+            std::getline(cin, temp);
+            long lo = std::stol(temp);
+
+            cout << "Please provide the id to stop before: ";
+            std::getline(cin, temp);
+            long hi = std::stol(temp);
+
+            db.scan(lo, hi, [](long key, const author::Entry& entry) {
+                cout << key << ": " << std::string(entry.name.data()) << endl;
+            });
+        } else if (input == "stats") {
+            print_stats(db.stats());
+        } else if (input == "help") {
+            cout << "insert - insert an entry into the database (not recommended for author/graph)" << endl;
+            cout << "find - find the entry in the database corresponding to an id" << endl;
+            cout << "get_id - find the characteristic name/title/value associated an id" << endl;
+            cout << "scan - list the ids and names of all authors with ids in a range, in id order" << endl;
+            cout << "stats - show cache, I/O, and latency counts since the database was opened" << endl;
+            cout << "quit - exit the CLI interface" << endl;
+        } else {
+            cout << "Invalid command entered. Valid commands include insert, find, get_id, scan, stats, help, and quit" << endl;
         }
-    } else if (std::string(argv[3]) == "author") {
-        BTreeDB<author::Entry> db(argv[1], argv[2], false, read_only);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 6) {
+        cout << "Invalid number of arguments passed." << endl;
+        cout << "Usage: ./db_interface [key db filename] [value db filename] [type of the database (test, paper, or author)] [whether or not to create a new db (0 for no, 1 for yes)] [read only (0 for no, 1 for yes)]" << endl;;
+
+        return 0;
+    }
+
+    int read_only = std::stoi(argv[5]);
+    
+
+    if (std::string(argv[4]) == "1") {
+        cout << "Creating a new database file" << endl;
+        BTreeDB<test::Entry> db(argv[1], argv[2], true);
+    }
+
+    cout << "Note: the key and value databases should be compatible, or an error will be thrown." << endl;
+    cout << "We don't recommend insertion if you are working with the full graph/paper databases to prevent any data corruption." << endl;
+
+    cout << "DO NOT ctrl + C to exit the prompt if you are not in read only mode; only use the quit command to prevent data corruption." << endl;
+    cout << "If a key/value file opening error is thrown, try running parse first or download the data directly." << endl;
+    cout << "A stoi/stol error may be thrown if you input a non-numerical value when prompted for one." << endl;
+
+    std::string temp;
+
+    if (std::string(argv[3]) == "test") {
+        BTreeDB<test::Entry> db(argv[1], argv[2], false, read_only);
 
         while (true) {
             cout << ">> ";
@@ -230,45 +397,42 @@ int main(int argc, char* argv[]) {
             if (input == "quit") {
                 return 0;
             } else if (input == "insert") {
-                cout << "Please provide the author name: ";
-
-                std::string name;
-                std::getline(cin, name);
-
-                cout << "Please provide the organization: ";
+                cout << "Please provide the x: ";
 
-                std::string org;
-                std::getline(cin, org);
+                std::getline(cin, temp);
+                int x = std::stoi(temp);
 
-                cout << "Please provide me the id: ";
+                cout << "Please provide the str: ";
+                std::string str;
+                std::getline(cin, str);
 
+                cout << "Please provide the id: ";
                 std::getline(cin, temp);
                 long id = std::stol(temp);
 
-                author::Entry entry(name, org, id);
+                test::Entry entry(x, str, id);
 
                 db.insert(entry.id, entry);
-
             } else if (input == "find") {
                 cout << "Please provide the id you want to search for: ";
 
                 std::getline(cin, temp);
                 long id = std::stol(temp);
 
-                author::Entry entry = db.find(id);
+                test::Entry entry = db.find(id);
 
                 if (entry.id == -1) {
                     cout << "Entry not found" << endl;
                 } else {
-                    cout << "name: " << std::string(entry.name.data()) << ", organization: " << std::string(entry.organization.data()) << endl;
+                    cout << "x: " << entry.x << ", str: " << std::string(entry.str.data()) << endl; 
                 }
             } else if (input == "get_id") {
-                cout << "Please provide the name you want to find the id for: ";
+                cout << "Please provide the x you want to find the id for: ";
 
-                std::string name;
-                std::getline(cin, name);
+                std::getline(cin, temp);
+                int x = std::stoi(temp);
 
-                author::Entry entry(name);
+                test::Entry entry(x);
 
                 long found = db.get_id_from_name(entry);
 
@@ -277,15 +441,28 @@ int main(int argc, char* argv[]) {
                 } else {
                     cout << "id: " << found << endl;
                 }
+            } else if (input == "stats") {
+                print_stats(db.stats());
             } else if (input == "help") {
                 cout << "insert - insert an entry into the database (not recommended for author/graph)" << endl;
                 cout << "find - find the entry in the database corresponding to an id" << endl;
                 cout << "get_id - find the characteristic name/title/value associated an id" << endl;
+                cout << "stats - show cache, I/O, and latency counts since the database was opened" << endl;
                 cout << "quit - exit the CLI interface" << endl;
             } else {
-                cout << "Invalid command entered. Valid commands include insert, find, get_id, help, and quit" << endl;
+                cout << "Invalid command entered. Valid commands include insert, find, get_id, stats, help, and quit" << endl;
             }
         }
+    } else if (std::string(argv[3]) == "paper") {
+        open_db<paper::Entry>(argv[1], argv[2], read_only, BTreeConfig(), [&](auto& db) {
+            run_paper_prompt(db, argv[1]);
+        });
+        return 0;
+    } else if (std::string(argv[3]) == "author") {
+        open_db<author::Entry>(argv[1], argv[2], read_only, BTreeConfig(), [&](auto& db) {
+            run_author_prompt(db);
+        });
+        return 0;
     }
 
     cout << "Invalid type provided; only test, paper, and author are valid options at the moment" << endl;
@@ -9,20 +9,23 @@
 #include "../graph/dijkstrasSP.cpp"
 #include "../dataset/parsing.cpp"
 #include "../storage/btree_db_v2.hpp"
+#include "../storage/sharded_btree_db.hpp"
 #include "../storage/btree_types.cpp"
 
 #define exit_failure 0
 #define exit_success 1
+#define AUTHOR_RECORD_CACHE 100000 // decoded authors kept in memory; the components and paths of the graph keep coming back to the same authors
 
 bool is_valid_algorithm(const std::string& algorithm) {
     return algorithm == "Tarjans" || algorithm == "Dijkstras";
 }
 
-bool is_valid_paper_id(std::string paper_id, BTreeDB<paper::Entry>& db) {
+template <typename DB>
+bool is_valid_paper_id(std::string paper_id, DB& db) {
     try {
 
-        paper::Entry entry = db.find(std::stol(paper_id));
-        return entry.pub_year != 0;
+        BTreeDB<paper::Entry>::View entry = db.find_view(std::stol(paper_id));
+        return entry.valid() && entry.get<paper::Entry::PubYear>() != 0;
 
     } catch (exception& e) {
 
@@ -34,12 +37,13 @@ bool is_valid_paper_id(std::string paper_id, BTreeDB<paper::Entry>& db) {
     return false;
 }
 
-void print_tarjans(std::vector<std::vector<unsigned long>>& ans, BTreeDB<author::Entry>& db) {
+template <typename DB>
+void print_tarjans(std::vector<std::vector<unsigned long>>& ans, DB& db) {
     if (ans.size() > 0) {
         for (auto& i : ans) {
             std::cout << "Strongly Connected Component | ";
-            for (auto& entry : i) {
-                author::Entry name = db.find(entry);
+            std::vector<author::Entry> names = db.find_many(std::vector<long>(i.begin(), i.end()));
+            for (auto& name : names) {
                 std::cout << std::string(name.name.data()) << " - ";
             }
             std::cout << "\n";
@@ -49,7 +53,8 @@ void print_tarjans(std::vector<std::vector<unsigned long>>& ans, BTreeDB<author:
     }
 }
 
-void run_tarjans(BTreeDB<author::Entry>& db, AuthorGraph& g) {
+template <typename DB>
+void run_tarjans(DB& db, AuthorGraph& g) {
 
     std::string query;
     while (true) {
@@ -84,7 +89,8 @@ void run_tarjans(BTreeDB<author::Entry>& db, AuthorGraph& g) {
     std::cout << "Returning to start" << "\n";
 }
 
-void run_dijkstras(BTreeDB<author::Entry>& db, AuthorGraph& g) {
+template <typename DB>
+void run_dijkstras(DB& db, AuthorGraph& g) {
 
     while (true) {
         std::cout << "Please enter an author id: ";
@@ -102,8 +108,8 @@ void run_dijkstras(BTreeDB<author::Entry>& db, AuthorGraph& g) {
 
             if (ans.size() > 0) {
                 std::cout << "Shortest Path | ";
-                for (auto& i : ans) {
-                    author::Entry src = db.find(i);  
+                std::vector<author::Entry> path = db.find_many(std::vector<long>(ans.begin(), ans.end()));
+                for (auto& src : path) {
                     std::cout << std::string(src.name.data()) << " - ";
                 }
                 break;
@@ -119,70 +125,85 @@ void run_dijkstras(BTreeDB<author::Entry>& db, AuthorGraph& g) {
 
 void run_authors_graph(AuthorGraph& g) {
     std::cout << "Initializing author database" << "\n";
-    BTreeDB<author::Entry> db("author_keys.db", "author_values.db", false, true);
+    BTreeConfig config;
+    config.record_cache_entries = AUTHOR_RECORD_CACHE;
+    open_db<author::Entry>("author_keys.db", "author_values.db", true, config, [&](auto& db) {
 
-    std::string algorithm;
-    while (true) {
-        std::cout << "Enter and algorithm (Tarjans or Dijkstras).\n";
+        std::string algorithm;
+        while (true) {
+            std::cout << "Enter and algorithm (Tarjans or Dijkstras).\n";
         
-        std::cin >> algorithm;
-
-        std::cout << "Running " << algorithm << " algorithm on Authors graph" << std::endl;
-        if (algorithm == "Tarjans") {
-            run_tarjans(db, g);
-            break;
-        } else if (algorithm == "Dijkstras") {
-            run_dijkstras(db, g);
-            break;
-        } else {
-            std::cout << "Invalid algorithm. Please enter \"Tarjans\" or \"Dijkstras\"" << "\n";
-        }
+            std::cin >> algorithm;
+
+            std::cout << "Running " << algorithm << " algorithm on Authors graph" << std::endl;
+            if (algorithm == "Tarjans") {
+                run_tarjans(db, g);
+                break;
+            } else if (algorithm == "Dijkstras") {
+                run_dijkstras(db, g);
+                break;
+            } else {
+                std::cout << "Invalid algorithm. Please enter \"Tarjans\" or \"Dijkstras\"" << "\n";
+            }
         
-    }
+        }
+
+        RecordCacheStats stats = db.record_cache_stats();
+        std::cout << "Author lookups: " << stats.hits << " answered from the record cache, " << stats.misses << " from the database" << "\n";
+    });
 }
 
-void print_dfs_ids_to_names_proxy(BTreeDB<paper::Entry>& db, const std::vector<std::pair<unsigned int, unsigned int>>& ids) {
+template <typename DB>
+void print_dfs_ids_to_names_proxy(DB& db, const std::vector<std::pair<unsigned int, unsigned int>>& ids) {
     if (ids.size() == 0) {
         return;
     }
 
-    paper::Entry first = db.find(ids[0].second);
+    // look up every paper in one batch; the source of pair i is at 2 * i and the destination at 2 * i + 1
+    std::vector<long> keys;
+    keys.reserve(2 * ids.size());
+    for (auto& pair : ids) {
+        keys.push_back(pair.first);
+        keys.push_back(pair.second);
+    }
+    std::vector<paper::Entry> entries = db.find_many(keys);
 
-    std::cout << "starting from " << std::string(first.title.data()) << ", it references: ";
+    std::cout << "starting from " << entries[1].title << ", it references: ";
 
-    for (auto& pair : ids) {
-        paper::Entry source = db.find(pair.first);
-        paper::Entry dest = db.find(pair.second);
-        std::cout << std::string(source.title.data()) << " -> " << std::string(dest.title.data()) << "\n";
+    for (unsigned int i = 0; i < ids.size(); ++i) {
+        paper::Entry& source = entries[2 * i];
+        paper::Entry& dest = entries[2 * i + 1];
+        std::cout << source.title << " -> " << dest.title << "\n";
     }
 
     return;
 }
 
 void run_journals_graph(journalGraph& graph) {
-    BTreeDB<paper::Entry> db("paper_keys.db", "paper_values.db", false, true);
+    open_db<paper::Entry>("paper_keys.db", "paper_values.db", true, BTreeConfig(), [&](auto& db) {
     
-    std::string paper_id;
-    std::cout << "\nRecommended ID: 162256\n";
-    std::cout << "Please enter a paper ID: ";
-    std::cin >> paper_id;
-
-    while (!is_valid_paper_id(paper_id, db)) {
+        std::string paper_id;
+        std::cout << "\nRecommended ID: 162256\n";
         std::cout << "Please enter a paper ID: ";
         std::cin >> paper_id;
-    }
 
-    paper::Entry entry = db.find(std::stol(paper_id));
+        while (!is_valid_paper_id(paper_id, db)) {
+            std::cout << "Please enter a paper ID: ";
+            std::cin >> paper_id;
+        }
 
-    std::cout << "You entered the id for: " << std::string(entry.title.data()) << "\n";
+        BTreeDB<paper::Entry>::View entry = db.find_view(std::stol(paper_id));
 
-    std::cout << "Getting the historical trace of the paper's origins using DFS... \n";
+        std::cout << "You entered the id for: " << entry.get<paper::Entry::Title>() << "\n";
 
-    const std::vector<std::pair<unsigned int, unsigned int>>& answer = graph.getIdeaHistory(std::stoul(paper_id));
+        std::cout << "Getting the historical trace of the paper's origins using DFS... \n";
 
-    print_dfs_ids_to_names_proxy(db, answer);
+        const std::vector<std::pair<unsigned int, unsigned int>>& answer = graph.getIdeaHistory(std::stoul(paper_id));
 
-    return;
+        print_dfs_ids_to_names_proxy(db, answer);
+
+        return;
+    });
 }
 
 
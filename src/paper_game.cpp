@@ -8,6 +8,7 @@
 #include <cstdlib>
 
 #include "../storage/btree_db_v2.hpp"
+#include "../storage/sharded_btree_db.hpp"
 #include "../storage/btree_types.cpp"
 #include "../graph/journalGraph.h"
 
@@ -15,23 +16,15 @@ using std::cout;
 using std::endl;
 using std::cin;
 
-int main(int argc, char* argv[]) {
-    if (argc != 5) {
-        cout << "invalid number of arguments passed" << endl;
-        cout << "usage: ./paper_game [paper graph binary file (journalgraph.bin)] [paper keys db file (paper_keys.db)] [paper values db file (paper_values.db)] [start paper (try 1091 if you don't have a specific one)]" << endl;
+/**
+    Runs the game until the player quits.
 
-        return 0;
-    }
-
-    cout << "Initializing the journal graph from journalgraph.bin" << endl;
-    cout << "If a key/value file opening error is thrown, try running parse first or download the data directly." << endl;
-    journalGraph g(argv[1]);
-
-    cout << "Initializing the paper database using the paper_keys.db and paper_values.db files" << endl;
-    BTreeDB<paper::Entry> db(argv[2], argv[3], false, true);
-
-    // TODO: get a random start id and a random end id (using BFS to find the smallest path and to ensure a solution is possible)
-    long curr = std::stol(argv[4]);
+    @param g The paper graph
+    @param db The paper database (a BTreeDB or a ShardedBTreeDB)
+    @param curr The paper to start at
+*/
+template <typename DB>
+void play(journalGraph& g, DB& db, long curr) {
     int steps = 0;
 
     std::string temp;
@@ -66,15 +59,15 @@ int main(int argc, char* argv[]) {
             }
 
 
-            paper::Entry entry = db.find(query);
-            if (entry.id == -1) {
+            BTreeDB<paper::Entry>::View entry = db.find_view(query);
+            if (!entry.valid()) {
                 cout << "Invalid paper id provided" << endl;
             } else {
                 // TODO: possibly add authors
-                cout << "Title: " << std::string(entry.title.data()) << endl;
-                cout << "Keywords: " << std::string(entry.keywords.data()) << endl;
-                cout << "Number of citations: " << entry.n_citations << endl;
-                cout << "Publication year: " << entry.pub_year << endl;
+                cout << "Title: " << entry.get<paper::Entry::Title>() << endl;
+                cout << "Keywords: " << entry.get<paper::Entry::Keywords>() << endl;
+                cout << "Number of citations: " << entry.get<paper::Entry::NCitations>() << endl;
+                cout << "Publication year: " << entry.get<paper::Entry::PubYear>() << endl;
             }
         } else if (input == "move") {
             cout << "Which paper would you like to move to?" << endl;
@@ -106,4 +99,24 @@ int main(int argc, char* argv[]) {
             cout << "Invalid command. The available ones include get_neighbors, query, move, help, and quit." << endl;
         }
     }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        cout << "invalid number of arguments passed" << endl;
+        cout << "usage: ./paper_game [paper graph binary file (journalgraph.bin)] [paper keys db file (paper_keys.db)] [paper values db file (paper_values.db)] [start paper (try 1091 if you don't have a specific one)]" << endl;
+
+        return 0;
+    }
+
+    cout << "Initializing the journal graph from journalgraph.bin" << endl;
+    cout << "If a key/value file opening error is thrown, try running parse first or download the data directly." << endl;
+    journalGraph g(argv[1]);
+
+    cout << "Initializing the paper database using the paper_keys.db and paper_values.db files" << endl;
+    // TODO: get a random start id and a random end id (using BFS to find the smallest path and to ensure a solution is possible)
+    long start = std::stol(argv[4]);
+    open_db<paper::Entry>(argv[2], argv[3], true, BTreeConfig(), [&](auto& db) {
+        play(g, db, start);
+    });
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include "../parsing/parsing.h"
 #include "../storage/btree_db_v2.hpp"
+#include "../storage/sharded_btree_db.hpp"
 #include "../storage/btree_types.cpp"
 
 using std::cout;
@@ -12,13 +13,31 @@ using std::endl;
 using std::cin;
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    // the options after the json can come in any order
+    bool direct_io = false;
+    unsigned int shards = 0;
+    bool valid_args = argc >= 2 && argc <= 4;
+    for (int i = 2; i < argc && valid_args; ++i) {
+        std::string arg = argv[i];
+        if (arg == "direct") {
+            direct_io = true;
+        } else if (arg == "shards") {
+            shards = DEFAULT_SHARDS;
+        } else if (arg.rfind("shards=", 0) == 0 && arg.size() > 7 && arg.size() <= 9 && arg.find_first_not_of("0123456789", 7) == std::string::npos) {
+            shards = std::stoul(arg.substr(7));
+            valid_args = shards >= 1 && shards <= MAX_SHARDS;
+        } else {
+            valid_args = false;
+        }
+    }
+
+    if (!valid_args) {
         cout << "Invalid number of arguments passed." << endl;
-        cout << "Usage: ./parse [path to dblp json file relative to the build folder]" << endl;
+        cout << "Usage: ./parse [path to dblp json file relative to the build folder] [direct (optional; writes the databases with direct I/O, bypassing the OS page cache)] [shards or shards=N (optional; builds the author and paper databases as " << DEFAULT_SHARDS << " shards each, or N from 1 to " << MAX_SHARDS << ", loaded at the same time)]" << endl;
         return 0;
     }
 
-    cout << "Are you sure you want to parse the data? It will take around half an hour with the full dataset and will wipe any any existing db and graph files. It is also relatively intensive, requiring around 8GB of memory. An alternative is to simply download the built things from the provide google drivel ink" << endl;
+    cout << "Are you sure you want to parse the data? It will take around half an hour with the full dataset and will wipe any any existing db and graph files. It is also relatively intensive, although the records are sorted on disk, so its memory use is mostly the paper graph and the title index rather than the records themselves. An alternative is to simply download the built things from the provide google drivel ink" << endl;
     cout << "Type y if you want to proceed." << endl;
     
     std::string input;
@@ -30,14 +49,14 @@ int main(int argc, char* argv[]) {
     }
 
     cout << "Building the databases and the paper graph" << endl;
-    cout << "You may experience a significant pause when 4.8 million is reached; that is the code writing everything to the build folder" << endl;
-    build_db(argv[1]);
+    cout << "You may experience a pause when 4.8 million is reached; that is the code sorting the records and bulk loading them into the databases in the build folder" << endl;
+    build_db(argv[1], direct_io, shards);
 
     cout << "Building the author graph" << std::endl;
     cout << "This will gradually speed up as more of the database is loaded directly into memory as the code goes on. A small pause will also occur due to writebacks near the end of execution." << endl;
     build_author_graph(argv[1]);
 
-    cout << "Successfully parsed the dblp data. Everything should now be in the build directory with the names author_keys.db, author_values.db, paper_keys.db, paper_values.db, author_graph.bin, and journalgraph.bin, along with the associated metadata for the database files." << endl;
+    cout << "Successfully parsed the dblp data. Everything should now be in the build directory with the names author_keys.db, author_values.db, paper_keys.db, paper_values.db, author_papers.idx, title_trigrams.idx, author_graph.bin, and journalgraph.bin, along with the associated metadata for the database files (with a shard number before the extension of each database file if the databases were sharded)." << endl;
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,420 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#else
+#define HAVE_IO_URING 0
+#endif
+
+#define DEFAULT_IO_DEPTH 32 // most page reads a batch keeps in flight by default
+#define MAX_IO_THREADS 16 // most threads the pread fallback starts, whatever the depth
+
+/**
+    This enum is how batches of page reads are issued (see AsyncReader).
+
+    SyncIO reads one page after another on the calling thread, like a cache miss does. ThreadPoolIO hands the reads to a pool of threads that each issue blocking preads, so several are in flight at once. UringIO submits the whole batch to a Linux io_uring and reaps the completions as they arrive; it needs no threads, and falls back to ThreadPoolIO on kernels (or builds) without io_uring.
+*/
+enum IOBackend {
+    SyncIO,
+    ThreadPoolIO,
+    UringIO
+};
+
+/**
+    This struct is one read of a batch: len bytes of a file starting at offset, into dest. The part past the end of the file reads as zeros.
+*/
+struct ReadRequest {
+    int fd;
+    off_t offset;
+    char* dest;
+    size_t len;
+};
+
+/**
+    This class reads batches of pages with many reads in flight at once. A cache miss only ever has one read outstanding, so a caller that knows which pages it will need (a batched lookup, a scan) gets them much faster by handing them all over at once, letting the device work on them in parallel.
+
+    A batch is read as a whole: read returns once every request of it is done. Reads that fail or come back short (io_uring doesn't promise full reads) are finished with plain preads, so callers see the same results (and errors) as a synchronous read. The reader may be used from several threads at once; batches on the io_uring take turns, batches on the thread pool share its threads.
+*/
+class AsyncReader {
+    public:
+        /**
+            Constructor for the reader. Sets up the io_uring or starts the threads, depending on the backend.
+
+            @param backend How to issue the reads
+            @param depth How many reads may be in flight at once (at least 1)
+        */
+        AsyncReader(IOBackend backend, unsigned int depth);
+
+        /**
+            Destructor. Stops the threads and tears down the io_uring. No batch may be running.
+        */
+        ~AsyncReader();
+
+        AsyncReader(const AsyncReader& other) = delete;
+        AsyncReader& operator=(const AsyncReader& other) = delete;
+
+        /**
+            Reads every request of a batch and waits for all of them.
+
+            @param requests The reads to do; they may be in any order and on any files
+        */
+        void read(const std::vector<ReadRequest>& requests);
+
+        /**
+            Returns the backend that is actually used, which is ThreadPoolIO if UringIO was asked for but isn't available.
+
+            @return the backend in use
+        */
+        IOBackend backend() const;
+
+        /**
+            Does a single read with blocking preads, retrying interrupted and short reads and filling whatever lies past the end of the file with zeros.
+
+            @param request The read to do
+        */
+        static void read_sync(const ReadRequest& request);
+
+    private:
+        /**
+            The batch a queued read belongs to; lives on the stack of the thread that called read. Guarded by mutex_.
+        */
+        struct Batch {
+            size_t remaining;
+            std::exception_ptr error;
+        };
+
+        /**
+            Sets up the io_uring and maps its rings.
+
+            @return whether the kernel supports it
+        */
+        bool setup_uring();
+
+        /**
+            Unmaps the rings and closes the io_uring.
+        */
+        void close_uring();
+
+        /**
+            Reads a batch through the io_uring, keeping up to its size in flight.
+        */
+        void read_uring(const std::vector<ReadRequest>& requests);
+
+        /**
+            Reads a batch on the thread pool.
+        */
+        void read_threads(const std::vector<ReadRequest>& requests);
+
+        /**
+            Main loop of the pool's threads.
+        */
+        void run();
+
+        IOBackend backend_;
+        unsigned int depth_;
+
+        /**
+            The io_uring: its descriptor, its mapped rings, and pointers to the ring fields within them (see io_uring_setup(2)).
+        */
+        int ring_fd_;
+        void* sq_ring_;
+        size_t sq_ring_size_;
+        void* cq_ring_;
+        size_t cq_ring_size_;
+        void* sqes_;
+        size_t sqes_size_;
+        unsigned int sq_entries_;
+        unsigned int* sq_head_;
+        unsigned int* sq_tail_;
+        unsigned int* sq_mask_;
+        unsigned int* sq_array_;
+        unsigned int* cq_head_;
+        unsigned int* cq_tail_;
+        unsigned int* cq_mask_;
+        void* cqes_;
+        /**
+            Held by the batch that is using the io_uring; a ring has a single submitter.
+        */
+        std::mutex ring_mutex_;
+
+        /**
+            Reads waiting for a thread of the pool, with the batch each belongs to.
+        */
+        std::deque<std::pair<const ReadRequest*, Batch*>> queue_;
+        std::mutex mutex_;
+        /**
+            Signaled when reads are queued.
+        */
+        std::condition_variable work_ready_;
+        /**
+            Signaled when the last read of a batch is done.
+        */
+        std::condition_variable work_done_;
+        bool stopping_;
+        std::vector<std::thread> threads_;
+};
+
+inline AsyncReader::AsyncReader(IOBackend backend, unsigned int depth): backend_(backend), depth_(std::max(depth, 1u)), ring_fd_(-1), sq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_(MAP_FAILED), cq_ring_size_(0), sqes_(MAP_FAILED), sqes_size_(0), sq_entries_(0), stopping_(false) {
+    if (backend_ == UringIO && !setup_uring()) {
+        backend_ = ThreadPoolIO;
+    }
+
+    if (backend_ == ThreadPoolIO) {
+        unsigned int num_threads = std::min(depth_, static_cast<unsigned int>(MAX_IO_THREADS));
+        for (unsigned int i = 0; i < num_threads; ++i) {
+            threads_.emplace_back(&AsyncReader::run, this);
+        }
+    }
+}
+
+inline AsyncReader::~AsyncReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+    close_uring();
+}
+
+inline IOBackend AsyncReader::backend() const {
+    return backend_;
+}
+
+inline void AsyncReader::read(const std::vector<ReadRequest>& requests) {
+    // nothing to overlap a single read with
+    if (backend_ == SyncIO || requests.size() == 1) {
+        for (const ReadRequest& request : requests) {
+            read_sync(request);
+        }
+    } else if (backend_ == UringIO) {
+        read_uring(requests);
+    } else if (!requests.empty()) {
+        read_threads(requests);
+    }
+}
+
+inline void AsyncReader::read_sync(const ReadRequest& request) {
+    size_t got = 0;
+    while (got < request.len) {
+        ssize_t res = pread(request.fd, request.dest + got, request.len - got, request.offset + got);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("error reading database page");
+        }
+        if (res == 0) {
+            break;
+        }
+        got += res;
+    }
+
+    // the part past the end of the file (not written yet) reads as zeros
+    memset(request.dest + got, 0, request.len - got);
+}
+
+inline bool AsyncReader::setup_uring() {
+#if HAVE_IO_URING
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    long fd = syscall(__NR_io_uring_setup, depth_, &params);
+    if (fd < 0) {
+        return false;
+    }
+    ring_fd_ = static_cast<int>(fd);
+
+    // newer kernels map both rings with a single mapping
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ != MAP_FAILED) {
+        cq_ring_ = single_mmap ? sq_ring_ : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    if (cq_ring_ != MAP_FAILED) {
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    }
+    if (sqes_ == MAP_FAILED) {
+        close_uring();
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    char* cq = static_cast<char*>(cq_ring_);
+    sq_entries_ = params.sq_entries;
+    sq_head_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline void AsyncReader::close_uring() {
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = MAP_FAILED;
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = MAP_FAILED;
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = MAP_FAILED;
+    }
+    if (ring_fd_ != -1) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+inline void AsyncReader::read_uring(const std::vector<ReadRequest>& requests) {
+#if HAVE_IO_URING
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(sqes_);
+    io_uring_cqe* cqes = static_cast<io_uring_cqe*>(cqes_);
+
+    size_t next = 0, done = 0, in_flight = 0;
+    std::exception_ptr error;
+
+    // once something failed, nothing more is submitted, but what is in flight still has to land before the buffers go back to the caller
+    while (done < next || (!error && next < requests.size())) {
+        // fill the submission queue; the kernel only reads the tail, so our copy of it is current
+        unsigned int tail = *sq_tail_;
+        while (!error && next < requests.size() && in_flight < sq_entries_) {
+            const ReadRequest& request = requests[next];
+            unsigned int idx = tail & *sq_mask_;
+            io_uring_sqe& sqe = sqes[idx];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = request.fd;
+            sqe.off = request.offset;
+            sqe.addr = reinterpret_cast<uint64_t>(request.dest);
+            sqe.len = static_cast<unsigned int>(request.len);
+            sqe.user_data = next;
+            sq_array_[idx] = idx;
+
+            ++tail;
+            ++next;
+            ++in_flight;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+        // submit whatever the kernel hasn't taken yet (an interrupted call may have left some), and wait for at least one completion
+        unsigned int to_submit = tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            // nothing can be reaped from a ring that can't be entered; this only happens if the ring itself broke
+            throw std::runtime_error("error submitting page reads");
+        }
+
+        unsigned int head = *cq_head_;
+        unsigned int cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != cq_tail) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask_];
+            const ReadRequest& request = requests[cqe.user_data];
+
+            // finish failed and short reads synchronously; that also zero fills past the end of the file and reports real errors
+            size_t got = cqe.res > 0 ? static_cast<size_t>(cqe.res) : 0;
+            if (got < request.len) {
+                try {
+                    read_sync({request.fd, static_cast<off_t>(request.offset + got), request.dest + got, request.len - got});
+                } catch (...) {
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+
+            ++head;
+            ++done;
+            --in_flight;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+#else
+    read_threads(requests);
+#endif
+}
+
+inline void AsyncReader::read_threads(const std::vector<ReadRequest>& requests) {
+    Batch batch{requests.size(), nullptr};
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const ReadRequest& request : requests) {
+        queue_.push_back({&request, &batch});
+    }
+    work_ready_.notify_all();
+    work_done_.wait(lock, [&batch] { return batch.remaining == 0; });
+
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+inline void AsyncReader::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+
+        std::pair<const ReadRequest*, Batch*> job = queue_.front();
+        queue_.pop_front();
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            read_sync(*job.first);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error && !job.second->error) {
+            job.second->error = error;
+        }
+        if (--job.second->remaining == 0) {
+            work_done_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+
+#define BLOOM_BLOCK_WORDS 8 // 64 bit words in a block of a Bloom filter; a block is one cache line, and a key sets one bit in each word
+#define BLOOM_MIN_KEYS 4096 // fewest keys a Bloom filter is sized for
+#define BLOOM_MAX_LEVELS 32 // most filters a growing Bloom filter chains together (each twice the size of the last)
+
+/**
+    Odd multipliers that turn the low half of a key's hash into the bit it sets in each word of its block.
+*/
+static const uint32_t BLOOM_SALTS[BLOOM_BLOCK_WORDS] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+/**
+    This class is a Bloom filter over long keys, which answers whether a key may have been added (with a small rate of false positives) or certainly wasn't.
+
+    It is a split block filter: the bits are grouped into blocks of one cache line, a key's hash picks one block, and the key sets one bit in each of the block's BLOOM_BLOCK_WORDS words. A lookup is then a single cache miss and a handful of independent bit tests, instead of one miss per hash function. With 10 bits per key, about 1% of the keys that were never added pass.
+
+    A filter is sized for a number of keys up front. Adding more than that doesn't rehash anything: once the newest filter is full, a new one twice its size is chained after it, and lookups check every filter in the chain. A chained filter can't be written to a file; the owner rebuilds a single filter of the right size from its keys first.
+
+    Keys can be added and looked up from several threads at once.
+*/
+class BloomFilter {
+    public:
+        /**
+            Creates an empty filter.
+
+            @param keys How many keys the filter is sized for (at least BLOOM_MIN_KEYS)
+            @param bits_per_key How many bits of filter to use per key; more bits mean fewer false positives
+        */
+        BloomFilter(uint64_t keys, unsigned int bits_per_key);
+
+        /**
+            Reads a filter previously written by write.
+
+            @param filename The file the filter is stored in
+        */
+        BloomFilter(const std::string& filename);
+
+        BloomFilter(const BloomFilter& other) = delete;
+        BloomFilter& operator=(const BloomFilter& other) = delete;
+
+        /**
+            Adds a key, chaining a bigger filter first if the newest one is full.
+
+            @param key The key to add
+        */
+        void add(long key);
+
+        /**
+            Returns whether a key may have been added.
+
+            @param key The key to look up
+            @return false if the key was certainly never added; true if it was (or for a small fraction of the keys that weren't)
+        */
+        bool may_contain(long key) const;
+
+        /**
+            Writes the filter to a file, overwriting any existing one. The filter must not have grown past its first size (see is_chained).
+
+            @param filename The file to write the filter to
+        */
+        void write(const std::string& filename) const;
+
+        /**
+            Returns the number of keys added.
+
+            @return the number of calls to add, over every filter in the chain
+        */
+        uint64_t size() const;
+
+        /**
+            Returns the bits per key the filter was created with.
+
+            @return the bits per key
+        */
+        unsigned int bits_per_key() const;
+
+        /**
+            Returns whether more keys were added than the filter was first sized for, so that lookups check more than one filter.
+
+            @return true if a bigger filter was chained after the first one
+        */
+        bool is_chained() const;
+
+    private:
+        /**
+            This struct is one filter of the chain: its blocks, how many keys it is sized for, and how many were added to it.
+        */
+        struct Level {
+            std::unique_ptr<std::atomic<uint64_t>[]> words;
+            uint64_t num_blocks;
+            uint64_t capacity;
+            std::atomic<uint64_t> count;
+
+            Level(uint64_t keys, unsigned int bits_per_key);
+
+            void add(uint64_t hash);
+            bool may_contain(uint64_t hash) const;
+        };
+
+        /**
+            Mixes the bits of a key, since ids are dense and would otherwise land in neighboring blocks.
+
+            @param key The key
+            @return the hash of the key
+        */
+        static uint64_t hash(long key);
+
+        /**
+            Chains a filter twice the size of the newest one, unless another thread already did.
+
+            @param num_levels How many filters the chain had when the newest one was found to be full
+        */
+        void grow(unsigned int num_levels);
+
+        unsigned int bits_per_key_;
+
+        /**
+            The chain. Only the first num_levels_ are set, and a level is never changed (other than by adding keys) once it's published by incrementing num_levels_.
+        */
+        std::array<std::unique_ptr<Level>, BLOOM_MAX_LEVELS> levels_;
+        std::atomic<unsigned int> num_levels_;
+
+        /**
+            Held while chaining a new filter.
+        */
+        std::mutex grow_mutex_;
+};
+
+inline BloomFilter::Level::Level(uint64_t keys, unsigned int bits_per_key): capacity(std::max<uint64_t>(keys, BLOOM_MIN_KEYS)), count(0) {
+    num_blocks = (capacity * bits_per_key + BLOOM_BLOCK_WORDS * 64 - 1) / (BLOOM_BLOCK_WORDS * 64);
+    // value initialization zeroes the words
+    words.reset(new std::atomic<uint64_t>[num_blocks * BLOOM_BLOCK_WORDS]());
+}
+
+inline void BloomFilter::Level::add(uint64_t hash) {
+    // the high half of the hash picks the block and the low half picks the bits
+    std::atomic<uint64_t>* block = words.get() + ((hash >> 32) * num_blocks >> 32) * BLOOM_BLOCK_WORDS;
+    uint32_t bits = static_cast<uint32_t>(hash);
+    for (unsigned int i = 0; i < BLOOM_BLOCK_WORDS; ++i) {
+        block[i].fetch_or(1UL << ((bits * BLOOM_SALTS[i]) >> 26), std::memory_order_relaxed);
+    }
+}
+
+inline bool BloomFilter::Level::may_contain(uint64_t hash) const {
+    const std::atomic<uint64_t>* block = words.get() + ((hash >> 32) * num_blocks >> 32) * BLOOM_BLOCK_WORDS;
+    uint32_t bits = static_cast<uint32_t>(hash);
+
+    // no early exit, so the tests of the words don't wait on each other
+    bool found = true;
+    for (unsigned int i = 0; i < BLOOM_BLOCK_WORDS; ++i) {
+        found &= (block[i].load(std::memory_order_relaxed) >> ((bits * BLOOM_SALTS[i]) >> 26)) & 1;
+    }
+    return found;
+}
+
+inline BloomFilter::BloomFilter(uint64_t keys, unsigned int bits_per_key): bits_per_key_(std::max(bits_per_key, 1u)), num_levels_(1) {
+    levels_[0] = std::make_unique<Level>(keys, bits_per_key_);
+}
+
+inline BloomFilter::BloomFilter(const std::string& filename): num_levels_(1) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open()) {
+        throw std::runtime_error("error opening bloom filter file");
+    }
+
+    // bits per key, then the number of keys the filter is sized for and the number added, then the blocks
+    uint64_t header[3];
+    ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+    ifs.seekg(0, std::ios::end);
+    uint64_t file_size = ifs.tellg();
+    if (!ifs || header[0] == 0 || header[0] > UINT_MAX || header[1] > file_size * 8 / header[0] + BLOOM_MIN_KEYS) {
+        throw std::runtime_error("bloom filter file is invalid");
+    }
+    ifs.seekg(sizeof(header));
+    bits_per_key_ = static_cast<unsigned int>(header[0]);
+
+    levels_[0] = std::make_unique<Level>(header[1], bits_per_key_);
+    Level& level = *levels_[0];
+    level.count = header[2];
+
+    // atomics of plain integers have the same layout as the integers
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "atomic words must be plain words");
+    ifs.read(reinterpret_cast<char*>(level.words.get()), level.num_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    if (!ifs || ifs.peek() != EOF) {
+        throw std::runtime_error("bloom filter file is invalid");
+    }
+}
+
+inline uint64_t BloomFilter::hash(long key) {
+    // the splitmix64 finalizer
+    uint64_t x = static_cast<uint64_t>(key);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+    return x ^ (x >> 31);
+}
+
+inline void BloomFilter::add(long key) {
+    unsigned int num_levels = num_levels_.load(std::memory_order_acquire);
+    Level& level = *levels_[num_levels - 1];
+    level.add(hash(key));
+
+    // only a filter that goes past the keys it was sized for grows, so one sized exactly for its keys stays a single filter
+    if (level.count.fetch_add(1, std::memory_order_relaxed) == level.capacity) {
+        grow(num_levels);
+    }
+}
+
+inline bool BloomFilter::may_contain(long key) const {
+    uint64_t h = hash(key);
+    unsigned int num_levels = num_levels_.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < num_levels; ++i) {
+        if (levels_[i]->may_contain(h)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void BloomFilter::grow(unsigned int num_levels) {
+    std::lock_guard<std::mutex> lock(grow_mutex_);
+    if (num_levels_.load(std::memory_order_relaxed) != num_levels) {
+        return;
+    }
+    if (num_levels == BLOOM_MAX_LEVELS) {
+        // the newest filter just keeps filling up, which only costs false positives
+        return;
+    }
+
+    levels_[num_levels] = std::make_unique<Level>(levels_[num_levels - 1]->capacity * 2, bits_per_key_);
+    num_levels_.store(num_levels + 1, std::memory_order_release);
+}
+
+inline void BloomFilter::write(const std::string& filename) const {
+    if (is_chained()) {
+        throw std::runtime_error("a bloom filter that has grown can't be written");
+    }
+
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("error creating bloom filter file");
+    }
+
+    const Level& level = *levels_[0];
+    uint64_t header[3] = {bits_per_key_, level.capacity, level.count};
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(level.words.get()), level.num_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+
+    if (!ofs) {
+        throw std::runtime_error("error writing bloom filter file");
+    }
+}
+
+inline uint64_t BloomFilter::size() const {
+    uint64_t res = 0;
+    unsigned int num_levels = num_levels_.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < num_levels; ++i) {
+        res += levels_[i]->count.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+inline unsigned int BloomFilter::bits_per_key() const {
+    return bits_per_key_;
+}
+
+inline bool BloomFilter::is_chained() const {
+    return num_levels_.load(std::memory_order_acquire) > 1;
+}
@@ -6,22 +6,59 @@
 #include <climits>
 #include <iostream>
 #include <cassert>
-#include <stack>
 #include <cstdint>
 #include <stdexcept>
 #include <exception>
 #include <cstring>
+#include <cstdio>
 #include <vector>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
 #include <unordered_map>
-
-#define ORDER 337 // max entries in key page (assuming int pointer sand long ids and 4096 byte pages), db designed for odd orders
-#define PAGE_SIZE 4096 // size of a page in bytes
+#include <algorithm>
+#include <optional>
+#include <memory>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+
+#include "buffer_pool.hpp"
+#include "writeback.hpp"
+#include "async_reader.hpp"
+#include "bloom_filter.hpp"
+#include "record_cache.hpp"
+#include "latency_histogram.hpp"
+#include "key_search.hpp"
+#include "varint.hpp"
+
+#define ORDER 337 // max entries in key page of the default layout (assuming int pointer sand long ids and 4096 byte pages), db designed for odd orders
+#define PAGE_SIZE 4096 // size of a page in bytes in the default layout
 
 #define KEYENTRY_SIZE 12 // size of a key entry (long + int)
 #define HEADER_SIZE 16 // size of header
 
+#define DELTA_KEYS_OFFSET (HEADER_SIZE + 8) // where the deltas start in key pages with compressed keys (after the base key)
+#define DELTA_PAGE 1 // value of header byte 6 for key pages with compressed keys
+
 #define DEFAULT_VAL 0 // default val to initialize arrays to 
+#define NULL_PAGE UINT_MAX // page pointer that doesn't point to anything (e.g. the next leaf of the last leaf)
+
+#define SLOT_BITS 10 // bits of an entry number in a database with slotted value pages that pick the slot within the page (the rest pick the page)
+#define SLOTTED_HEADER_SIZE 8 // header of slotted value pages: number of slots (4 bytes), start of the records (2 bytes), unused (2 bytes)
+#define SLOT_SIZE 4 // a slot of a slotted value page: offset (2 bytes) and length (2 bytes) of its record; offset 0 means the record moved away
+
+#define DEFAULT_CACHE_BYTES (1UL << 30) // default budget of the page cache (1GB)
+#define DEFAULT_DIRTY_BYTES (64UL << 20) // default budget of dirty pages before they are written back in the background (64MB)
+#define DEFAULT_FILL_FACTOR 1.0 // how full bulk_load packs key pages by default
+
+#define NAME_HASH_BITS 47 // bits of the name hash kept in name index keys
+#define NAME_DUP_BITS 16 // bits of name index keys used to tell apart ids whose names have the same hash
+#define NAME_LOCK_STRIPES 64 // locks the name index is split over by name hash; an id only waits for ids whose names land on the same lock
+#define NAME_INDEX_SHARE 16 // the name index gets 1/16 of its database's cache and dirty budgets; it holds about 20 bytes per id, next to records of hundreds
 
 /**
     This class defines a B+ Tree based persistent database. It is built on 3 main things: a key database, which contains the tree BST structure, a value database, which stores values separate from the key database in a vector format, and a metadata file, which allows for the persistence of critical member variables. Pointers are also switched to page numbers.
@@ -30,86 +67,378 @@
 
     This is a somewhat simplified implementation of a B+ Tree, only supporting the find and insert operations, as we did not require a deletion functionality. 
 
-    The main difference between v2 and v1 is the addition of an infinite cache implemented via a hash-based dictionary, which reduces thrashing significantly at the tradeoff of unbounded memory usage. 
+    The main difference between v2 and v1 is the cache. v1 uses a tiny fixed cache and thrashes constantly; v2 originally used an infinite cache implemented via a hash-based dictionary, which traded unbounded memory usage for speed. It now uses a bounded buffer pool (see buffer_pool.hpp) with a configurable byte budget and CLOCK eviction, which keeps nearly the same hit rates on our workloads while putting a hard cap on memory.
+
+    Read only instances skip the cache entirely and mmap the database files (see BTreeConfig), so opening even the full paper database is nearly instant and the pages are shared with any other process reading the same files.
+
+    Several threads can use one instance at once: the buffer pool is sharded with a lock per shard, pages are pinned while they are used so other threads can't evict them, and page I/O uses pread/pwrite instead of the position of a shared stream. Key pages are latched from the root down (see LatchMode), letting go of each page once its child is latched: reads latch everything shared, and inserts latch only the leaf exclusively, so inserts into different leaves run in parallel. An insert that has to split a page starts over and latches its path exclusively, keeping only the pages that the split can reach. New values are appended under a single lock. Only bulk_load needs the instance to itself.
+*/
+
+/**
+    This struct is the page layout a BTreeDB is compiled for (its second template parameter): the size of its pages, and how many keys fit in a key page of each key format. Bigger pages make the tree shallower and let scans read more per page, at the cost of reading (and caching) more for each lookup.
+
+    The orders follow from the page size by default: the most keys whose cells and child pointers fit after the header, rounded down to odd since the splits are designed for odd orders. The default layout keeps the order of the original 4K files, which left room for two more cells. The layout is recorded in the metadata file, and opening a database with a different one fails.
+
+    @tparam PageSize The size of a page in bytes; a multiple of 4K, and at most 64K since offsets within slotted value pages are 2 bytes
+    @tparam Order Most keys of a key page with uncompressed keys (Interleaved and Split)
+    @tparam DeltaOrder Most keys of a key page with compressed keys (Delta)
+*/
+template <unsigned int PageSize, unsigned int Order = ((PageSize - HEADER_SIZE - 4) / KEYENTRY_SIZE - 1) | 1, unsigned int DeltaOrder = ((PageSize - DELTA_KEYS_OFFSET - 4) / 8 - 1) | 1>
+struct PageLayout {
+    static_assert(PageSize % 4096 == 0 && PageSize <= 65536, "pages must be a multiple of 4K, and at most 64K");
+    static_assert(Order % 2 == 1 && HEADER_SIZE + 4 + Order * KEYENTRY_SIZE <= PageSize, "the order must be odd, and its keys must fit in a page");
+    static_assert(DeltaOrder % 2 == 1 && DELTA_KEYS_OFFSET + DeltaOrder * 4 + (DeltaOrder + 1) * 4 <= PageSize, "the compressed order must be odd, and its keys must fit in a page");
+
+    static constexpr unsigned int page_size = PageSize;
+    static constexpr unsigned int order = Order;
+    static constexpr unsigned int delta_order = DeltaOrder;
+
+    /**
+        Where the child pointers start in key pages with split keys (after order keys).
+    */
+    static constexpr unsigned int split_ptr_offset = HEADER_SIZE + Order * 8;
+    /**
+        Where the child pointers start in key pages with compressed keys (after delta_order 4 byte deltas).
+    */
+    static constexpr unsigned int delta_ptr_offset = DELTA_KEYS_OFFSET + DeltaOrder * 4;
+};
+
+/**
+    The layout of every database built before layouts could be picked: 4K pages, and ORDER keys per uncompressed key page.
+*/
+typedef PageLayout<PAGE_SIZE, ORDER> DefaultLayout;
+
+/**
+    This enum is how the keys and child pointers of a key page are laid out after the header.
+
+    Interleaved is the original layout: the first child pointer, then (key, child pointer) cells of KEYENTRY_SIZE bytes. Split keeps all keys in one contiguous array (room for the layout's order of keys right after the header, see PageLayout) followed by all child pointers, so the search inside a page only touches the key array, a cache line holds 8 keys instead of 5, and it can be searched with SIMD compares (see key_search.hpp).
+
+    Delta compresses the keys of each page (frame of reference): the page stores its smallest key once and every key as a 4 byte difference from it, followed by the child pointers, which fits 507 entries in a 4K page instead of 337. Ids are dense, so the keys of a page are almost always within 2^32 of each other; a page whose keys aren't is stored in the Split layout instead (marked by header byte 6), splitting it first if it has more keys than a Split page can hold.
+*/
+enum KeyFormat {
+    Interleaved,
+    Split,
+    Delta
+};
+
+/**
+    This enum is how records are stored in value pages.
+
+    Fixed is the original format: every record is serialized to T::size bytes and a page is a count followed by as many records as fit, so an entry number is just the record's position in the file. Records can be read in place (see BTreeDB::View), but every string and list takes its full reserved size.
+
+    Slotted stores each record in its compact encoding (T::encode_value), which drops the unused parts of strings and id lists and stores numbers as varints. Pages are slotted: a directory of (offset, length) slots grows from the front and the records grow from the back, and an entry number is the page number and the slot (see SLOT_BITS). A record that grows and no longer fits in its page is moved to the end of the file, which gives it a new entry number.
+*/
+enum ValueFormat {
+    Fixed,
+    Slotted
+};
+
+/**
+    This struct holds the optional settings for opening a BTree database. The defaults are what the rest of the project expects, so most callers never need to pass one.
+*/
+struct BTreeConfig {
+    /**
+        Whether read only instances should mmap the key and value files instead of reading pages into the cache. Pages are then served straight out of the mapping, so there is no copying, no per-page allocation, and the OS page cache is shared between processes. Ignored for writable instances.
+    */
+    bool use_mmap = true;
+
+    /**
+        Budget for the page cache in bytes, shared between key and value pages (and the name index, if the type has one; see NAME_INDEX_SHARE). Once it is full, the least recently used (approximately) pages are evicted, writing them back first if they are dirty.
+    */
+    size_t cache_bytes = DEFAULT_CACHE_BYTES;
+
+    /**
+        Budget for dirty pages of writable instances in bytes, split with the name index like cache_bytes. Once more pages than this are dirty, they are handed to a background thread (see writeback.hpp) that writes them in page order, merging neighboring pages into single writes, so dirty data doesn't pile up in the cache until the database is closed. Evicted dirty pages go through the same thread. 0 turns the thread off; dirty pages are then only written when they are evicted or the database is closed.
+    */
+    size_t dirty_bytes = DEFAULT_DIRTY_BYTES;
+
+    /**
+        How the key pages of a new database are laid out (see KeyFormat). Only used when creating a database; existing databases keep the format they were created with.
+    */
+    KeyFormat key_format = Split;
+
+    /**
+        How the value pages of a new database store records (see ValueFormat). Only used when creating a database; existing databases keep the format they were created with.
+    */
+    ValueFormat value_format = Fixed;
+
+    /**
+        How batches of page reads are issued (see IOBackend). Batched lookups, scans, and full passes over the values know which pages they need before they read them, so with ThreadPoolIO or UringIO they read them ahead in batches with many reads in flight, instead of waiting on one cache miss at a time. Mapped instances ask the kernel to read the pages ahead instead.
+
+        The default reads on the calling thread, since every instance gets a reader of its own: where io_uring is blocked (as it often is in containers), UringIO falls back to a pool of up to MAX_IO_THREADS threads per instance, which adds up quickly with name indexes and shards. Opt in for writable instances that scan a lot.
+    */
+    IOBackend io_backend = SyncIO;
+
+    /**
+        How many page reads a batch keeps in flight at most; also how many pages are read ahead at once.
+    */
+    unsigned int io_depth = DEFAULT_IO_DEPTH;
+
+    /**
+        Bits per key of a Bloom filter over the keys of a new database (see bloom_filter.hpp), which lets lookups of keys that aren't in the database return after touching one cache line instead of searching the tree and reading a value. 10 bits let about 1% of those lookups through to the tree anyway. 0 leaves the filter out. Only used when creating a database; existing databases keep the filter they were created with.
+    */
+    unsigned int bloom_bits_per_key = 0;
+
+    /**
+        Most decoded records to keep in a cache in front of the tree (see record_cache.hpp), so that find and find_many return records that were looked up recently with one hash probe instead of a search and a decode. Worth it for sessions that resolve the same ids over and over, like the graph algorithms. 0 turns the cache off.
+    */
+    size_t record_cache_entries = 0;
+
+    /**
+        Whether to open the key and value files with O_DIRECT, so pages move straight between the disk and the buffer pool without a second copy in the OS page cache. For ingests much bigger than memory this keeps the cache at cache_bytes instead of letting the page cache grow with every page written, at the price of nothing being cached past cache_bytes. Pages are whole disk blocks and the frames and writeback copies are aligned to IO_ALIGN_BYTES, as O_DIRECT needs. Turns off use_mmap. Filesystems without O_DIRECT (like tmpfs) fall back to ordinary I/O.
+    */
+    bool direct_io = false;
+
+    /**
+        How many shards the database is one of (see ShardedBTreeDB); 1 for a database that isn't sharded. A key only belongs to the same shard for the same number of shards, so the number is recorded in the metadata file, and opening a database with another one fails.
+    */
+    unsigned int shards = 1;
+};
+
+/**
+    This struct is a snapshot of what a BTree database has done since it was opened (see BTreeDB::stats), for telling where its time goes: how often pages were found in the cache, how much was read and written, and how long lookups and inserts took.
+
+    Pages of mapped instances are read by the kernel, so they count neither as hits nor as misses, and nothing is read through the files.
 */
+struct BTreeStats {
+    uint64_t entries = 0;
+    /**
+        Levels of key pages from the root to the leaves; 0 for an empty database.
+    */
+    unsigned int height = 0;
+    uint64_t key_pages = 0;
+    uint64_t value_pages = 0;
+
+    /**
+        Page cache counts, indexed by FileType (see BufferPoolStats).
+    */
+    BufferPoolStats cache;
+
+    /**
+        Pages read from the files, one at a time on cache misses or in batches ahead of time.
+    */
+    uint64_t pages_read = 0;
+    uint64_t bytes_read = 0;
+    /**
+        Pages written to the files, and how many writes they took (neighboring pages are written together).
+    */
+    uint64_t pages_written = 0;
+    uint64_t bytes_written = 0;
+    uint64_t writes = 0;
+
+    /**
+        Key pages split by inserts (bulk loads fill pages without splitting them).
+    */
+    uint64_t splits = 0;
+    /**
+        Lookups of keys that the Bloom filter showed aren't in the database.
+    */
+    uint64_t filtered = 0;
+
+    RecordCacheStats record_cache;
+
+    LatencySummary find_latency;
+    LatencySummary insert_latency;
+};
 
 /**
-    This is a helper enum to switch between function behavior for key pages and value pages
+    This struct is the value type of the name index that databases of types with has_name_index keep next to their key file. The index is itself a BTree whose keys are the name hash (top bits) and a duplicate number (bottom bits), so every id with the same name hash is in one contiguous key range. Entries whose id is EMPTY are left behind by renames and are reused by the next id with that hash.
 */
-enum FileType {
-    Key,
-    Value
+struct NameIndexEntry {
+    /**
+        Id of slots that don't hold anything.
+    */
+    static const long EMPTY = -1;
+
+    long id;
+
+    NameIndexEntry(long set_id): id(set_id) {}
+
+    NameIndexEntry(): id(EMPTY) {}
+
+    static void deserialize_value(const char* source, NameIndexEntry* dest) {
+        memcpy(&(dest->id), source, 8);
+    }
+
+    static void serialize_value(NameIndexEntry* source, char* dest) {
+        memcpy(dest, &(source->id), 8);
+    }
+
+    static void encode_value(const NameIndexEntry& source, std::vector<char>& dest) {
+        put_signed_varint(dest, source.id);
+    }
+
+    static void decode_value(const char* source, NameIndexEntry* dest) {
+        dest->id = get_signed_varint(source);
+    }
+
+    static const unsigned int size = 8;
+
+    static const bool has_name_index = false;
+
+    bool operator==(const NameIndexEntry& other) {
+        return id == other.id;
+    }
+
+    bool has_author(long author_id) {
+        author_id = author_id;
+        throw std::runtime_error("invalid call");
+    }
 };
 
 /**
-    this class is templated on a ValueEntry-type struct. Such a struct must have at least a field for a long id, a deserialization function, a serialization function, a equality operator, a default constructor, and a size variable (as an unsigned int)
+    this class is templated on a ValueEntry-type struct. Such a struct must have at least a field for a long id, a deserialization function, a serialization function, compact encode_value/decode_value functions, a equality operator, a default constructor, a size variable (as an unsigned int), and a has_name_index flag (plus a name_hash function if it is set)
 */ 
-template <typename T>
+template <typename T, typename Layout = DefaultLayout>
 class BTreeDB {
     private: 
         /**
             A page is a 4096 byte (4096 chars) region of data.
         */
-        typedef std::array<char, PAGE_SIZE> Page;
+        typedef std::array<char, Layout::page_size> Page;
         
-        /**
-            This struct is how cache blocks are stored. data is the data the cache block holds. dirty refers to whether the block should be written back on destruction.
-        */
-        struct CacheBlock {
-            char* data = nullptr;
-            bool dirty = false;
-        };
-
         /**
             This is the amount of values that can fit on a single page. One is subtracted for safety. NOTE: the size of the struct being stored should be less than 4092 bytes or underflow may occur.
         */
-        const unsigned int values_per_page = (PAGE_SIZE - 4) / T::size - 1;
+        const unsigned int values_per_page = (Layout::page_size - 4) / T::size - 1;
 
         /**
-            This struct is how the header of key pages are structured, although it is unused. num_cells is the number of key-pointer pairs are in the page, node_type is whether the page is internal (1) or a leaf (not 1), is_root is whether the page is the root (1) or not (not 1), parent_ptr is the page number of the parent pointer or CHAR_MAX if it doesn't have one, and next_ptr is the next node on the same level the page points to (if this page is a leaf).
+            This struct is how the header of key pages are structured, although it is unused. num_cells is the number of key-pointer pairs are in the page, node_type is whether the page is internal (1) or a leaf (not 1), is_root is whether the page is the root (1) or not (not 1), and next_leaf/prev_leaf are the neighboring leaves on the same level (NULL_PAGE if there isn't one, and only for trees with leaf links).
         */
         struct Header {
             unsigned int num_cells;
             char node_type;
             char is_root;
+            char unused[2];
+            unsigned int next_leaf;
+            unsigned int prev_leaf;
         };
 
         /**
             Number of pages in the values vector database.
         */
-        unsigned int num_value_pages;
+        std::atomic<unsigned int> num_value_pages;
         /**
             Number of pages in the key-pointer database.
         */
-        unsigned int num_key_pages;
+        std::atomic<unsigned int> num_key_pages;
         /**
             Number of total key-value entries in the database. Should apply ot both the value and key pages. 
         */
-        unsigned int num_entries;
+        std::atomic<unsigned int> num_entries;
 
         /**
-            The number of the page that is the root.
+            The number of the page that is the root. Readers check that the page they latch is still the root, since it may change while they wait.
         */
-        unsigned int key_root;
+        std::atomic<unsigned int> key_root;
 
         /**
-            Cache for the key pages. Has infinite capacity to be more performant.
+            Whether the leaf key pages are linked to their neighbors (bytes 8-15 of the header hold the next and previous leaf). Databases created before the links existed don't have them; cursors fall back to searching from the root to move between leaves in that case.
         */
-        std::unordered_map<unsigned int, CacheBlock> key_cache;
-        
+        bool has_leaf_links;
+
+        /**
+            Whether the name index is up to date with every entry. Only ever true for types with has_name_index. Databases created before the index existed are indexed the first time they are opened as writable; read only instances of them fall back to scanning.
+        */
+        bool has_name_index;
+
         /**
-            Cache for the value pages. Has infinite capacity to be more performant.
+            How the key pages are laid out (see KeyFormat). Databases created before the split format existed are Interleaved.
         */
-        std::unordered_map<unsigned int, CacheBlock> value_cache;
+        KeyFormat key_format;
 
         /**
-            File handler for the key database (read and write access).
+            How the value pages store records (see ValueFormat). Databases created before slotted pages existed are Fixed.
         */
-        std::fstream key_handler;
+        ValueFormat value_format;
+
+        /**
+            How many shards the database is one of (see BTreeConfig::shards); 1 for databases created before sharding existed.
+        */
+        unsigned int num_shards;
+
+        /**
+            The name index (see NameIndexEntry), or nullptr if this database doesn't have one.
+        */
+        std::unique_ptr<BTreeDB<NameIndexEntry, Layout>> name_db;
+
+        /**
+            Bloom filter over every key, or nullptr if this database doesn't have one (see BTreeConfig::bloom_bits_per_key). Keys are added before they reach their leaf, so a key that can be found always passes. It is stored next to the key file.
+        */
+        std::unique_ptr<BloomFilter> key_filter;
+        std::string key_filter_filename;
+
+        /**
+            Cache of decoded records by key, or nullptr if BTreeConfig::record_cache_entries is 0. Overwrites erase the key from it once the new value is stored.
+        */
+        std::unique_ptr<RecordCache<T>> record_cache;
+
+        /**
+            Counts for stats. They are only ever added to, so relaxed increments are enough.
+        */
+        std::atomic<uint64_t> pages_read{0};
+        std::atomic<uint64_t> pages_written{0};
+        std::atomic<uint64_t> write_calls{0};
+        std::atomic<uint64_t> key_splits{0};
+        std::atomic<uint64_t> filtered_lookups{0};
+
+        /**
+            How long every call to find and insert took.
+        */
+        LatencyHistogram find_latency;
+        LatencyHistogram insert_latency;
+
+        /**
+            Cache for the key and value pages, bounded by BTreeConfig::cache_bytes.
+        */
+        BufferPool pool;
+
+        /**
+            Background writer for dirty pages, or nullptr if writes happen in place (read only instances and BTreeConfig::dirty_bytes of 0).
+        */
+        std::unique_ptr<Writeback> writeback;
+
+        /**
+            Reader for batches of pages (see prefetch_pages), or nullptr if every page is served from a mapping.
+        */
+        std::unique_ptr<AsyncReader> async_reader;
+
+        /**
+            How many pages are read ahead at once (BTreeConfig::io_depth).
+        */
+        unsigned int io_depth;
+
+        /**
+            How many pages may be dirty before they are handed to the writeback thread.
+        */
+        unsigned int max_dirty_pages;
+
+        /**
+            Held by the insert that creates the root of an empty tree.
+        */
+        std::mutex structure_mutex;
+        /**
+            Held while changing value pages (and num_value_pages), since every new value goes to the end of the same file. Taken after any key page latches, and before the latch of the value page.
+        */
+        std::mutex value_mutex;
+        /**
+            Held while changing the name index, since picking a free slot for a name hash and filling it has to happen at once. Slots of different hashes never collide, so there is a lock per stripe of hashes (see name_lock) rather than one for the whole index.
+        */
+        std::array<std::mutex, NAME_LOCK_STRIPES> name_mutexes;
         /**
-            File handler for the value database (read and write access).
+            Held by the thread handing dirty pages to the writeback thread; the others don't wait for it.
         */
-        std::fstream value_handler;
+        std::mutex flush_mutex;
+
+        /**
+            Descriptor of the key database, used for page reads and writes. Pages are read and written with pread/pwrite, which don't share a file position, so several threads (and the writeback thread) can use it at once.
+        */
+        int key_fd;
+        /**
+            Descriptor of the value database, used like key_fd.
+        */
+        int value_fd;
+
         /**
             File handler for the metadata for the database (only write access).
         */
@@ -118,13 +447,30 @@ class BTreeDB {
         /**
             Dummy array filled with 0's for copying.
         */
-        char empty_array[PAGE_SIZE];
+        char empty_array[Layout::page_size];
 
         /**
             Member variable to determine if the current instance is read only. If true, nothing will be written to disk. 
         */
         bool read_only;
 
+        /**
+            This struct describes a read only memory mapping of a database file. data is nullptr if the file is not mapped.
+        */
+        struct MappedFile {
+            char* data = nullptr;
+            size_t size = 0;
+        };
+
+        /**
+            Mapping of the key database. Only used for read only instances opened with use_mmap.
+        */
+        MappedFile key_map;
+        /**
+            Mapping of the value database. Only used for read only instances opened with use_mmap.
+        */
+        MappedFile value_map;
+
     public:
         /**
             Constructor for the BTree database. Either creates a new database if the filename doesn't refer to anything or instantitates a previously created database if the filenames do refer to something. The key and value databases should be compatible with each other.
@@ -133,14 +479,32 @@ class BTreeDB {
             @param values_filename The filename for the value database
             @param create_new Whether or not new files should be created to store the dbs (will overwrite existing ones)
             @param read_only_opt Whether or not this instance should be read only
+            @param config Optional settings for how the database is opened (see BTreeConfig)
         */
-        BTreeDB(const std::string& key_filename, const std::string& values_filename, bool create_new=false, bool read_only_opt=false);
+        BTreeDB(const std::string& key_filename, const std::string& values_filename, bool create_new=false, bool read_only_opt=false, const BTreeConfig& config=BTreeConfig());
 
         /**
-            Destructor for the BTree database. Iterates through the cache block and writebacks any still-dirty blocks of data to the databases and closes the file handlers.
+            Destructor for the BTree database. Iterates through the cache block and writebacks any still-dirty blocks of data to the databases, waits for the writeback thread to finish, and closes the file handlers.
         */
         ~BTreeDB();
 
+        /**
+            Removes every file of a database: the key and value files, the metadata and Bloom filter files, and the files of its name index. Files that don't exist are skipped. The database must not be open.
+
+            @param key_filename The filename for the key database
+            @param values_filename The filename for the value database
+        */
+        static void remove_files(const std::string& key_filename, const std::string& values_filename);
+
+        /**
+            Reads the number of shards a database is one of from its metadata file, without opening the database.
+
+            @param key_filename The filename for the key database
+            @param values_filename The filename for the value database
+            @return the number of shards (1 if it isn't sharded), or 0 if there is no database
+        */
+        static unsigned int stored_shards(const std::string& key_filename, const std::string& values_filename);
+
         /**
             Inserts a key-value pair into the database according to the BTree structure.
 
@@ -156,6 +520,46 @@ class BTreeDB {
         */
         T find(long key);
 
+        /**
+            A view of a value stored in the database. See the definition below.
+        */
+        class View;
+
+        /**
+            Retrieves a view of the value stored under a key instead of a copy. Reading single fields through the view only copies those fields, which is much cheaper than find when only a name or title is needed. Databases with slotted value pages have to decode the record, so their views hold a serialized copy instead of pointing into the page.
+
+            @param key The key to lookup
+            @return a view of the value; invalid if the key wasn't found
+        */
+        View find_view(long key);
+
+        /**
+            Builds the database bottom-up from a stream of key-value pairs sorted by key. This is much faster than inserting one at a time: value pages are written out sequentially as they fill up, leaf key pages are packed to the fill factor instead of being split at 50%, and the internal levels are built one at a time from the leaves once the stream is done. Only a single pass is made over the input, so an input iterator over an externally sorted file works just as well as a sorted vector.
+
+            The database must be empty, and nothing else may use it until this returns. If a key appears more than once in a row, the last value wins (same as inserting them in order).
+
+            @param begin Iterator to the first pair; dereferences to something with a long first (the key) and T second (the value), like std::pair<long, T>
+            @param end Iterator past the last pair
+            @param fill_factor How full to pack each key page, from just above 0 to 1 (completely full)
+        */
+        template <typename Iter>
+        void bulk_load(Iter begin, Iter end, double fill_factor=DEFAULT_FILL_FACTOR);
+
+        /**
+            Retrieves the values for many keys at once. The keys are looked up in sorted order, so the tree is only searched from the root once per leaf that the keys fall in (instead of once per key), and the values are read in storage order so each value page is only visited once per batch.
+
+            @param keys The keys to look up, in any order (duplicates are fine)
+            @return The values for the keys, in the same order as the keys; the default ValueEntry for keys that weren't found
+        */
+        std::vector<T> find_many(const std::vector<long>& keys);
+
+        /**
+            Inserts or overwrites many key-value pairs at once. The pairs are applied in sorted key order so consecutive keys that land in the same leaf share one search from the root, and overwrites are applied in storage order so each value page is only visited once per batch. If a key appears more than once, the last pair wins.
+
+            @param entries The key-value pairs to insert, in any order
+        */
+        void insert_many(std::vector<std::pair<long, T>>& entries);
+
         /**
             Retrieves an id from the database according to an implemented operator== function for the template struct. For authors, it searches for a name, and for papers, it searches for a paper title.
 
@@ -164,14 +568,73 @@ class BTreeDB {
         */
         long get_id_from_name(const T& search_val);
 
+        /**
+            Retrieves the ids of every entry that matches the passed in value according to operator==. For types with a name index this is a lookup in the index (with each candidate checked against its stored value, so hash collisions are never returned); otherwise every value is scanned.
+
+            @param search_val A struct that at minimum has the members needed for its operator== function to work.
+            @return the ids of all matching entries (empty if there are none)
+        */
+        std::vector<long> get_ids_from_name(const T& search_val);
+
         /**
             This function gets all the papers associated with a provided author id. This takes a while to run, and it is only defined when working with the paper database (opening with other types will cause an exception to be thrown if this function is called).
 
             @param author_id The author to search for papers for
-            @return A list of paper ids that the author is an author on (up to 8th coauthor)
+            @return A list of paper ids that the author is an author on (up to 8th coauthor with fixed value pages, which only have room for 8)
         */
         std::vector<long> get_papers(long author_id);
 
+        /**
+            A cursor over the entries of the database in key order. See the definition below.
+        */
+        class Cursor;
+
+        /**
+            Returns a cursor at the first entry with a key greater than or equal to the passed in key.
+
+            @param key The key to search for
+            @return a cursor at the first entry >= key; invalid if there is none
+        */
+        Cursor lower_bound(long key);
+
+        /**
+            Returns a cursor at the entry with the smallest key.
+
+            @return a cursor at the first entry; invalid if the database is empty
+        */
+        Cursor first();
+
+        /**
+            Returns a cursor at the entry with the largest key.
+
+            @return a cursor at the last entry; invalid if the database is empty
+        */
+        Cursor last();
+
+        /**
+            Streams every entry with a key in [lo, hi) to a callback, in key order. Only the leaves covering the range are visited.
+
+            @param lo The smallest key to include
+            @param hi One past the largest key to include
+            @param callback Called with (long key, const T& value) for each entry in the range
+        */
+        template <typename Callback>
+        void scan(long lo, long hi, Callback callback);
+
+        /**
+            Returns how often find and find_many were answered by the record cache (see BTreeConfig::record_cache_entries).
+
+            @return the hit, miss, and eviction counts of the cache; all 0 if there is no cache
+        */
+        RecordCacheStats record_cache_stats() const;
+
+        /**
+            Takes a snapshot of the counters of the database (see BTreeStats). Other threads may keep using the database meanwhile; the snapshot then includes some of what they are doing.
+
+            @return the counts since the database was opened
+        */
+        BTreeStats stats();
+
     private:
     
         /**
@@ -186,8 +649,56 @@ class BTreeDB {
 
                     @param page_num The page number this interface should wrap.
                     @param tree The BTreeDB this page is within. Used for accessing member functions/data.
+                    @param latch How to latch the page for the lifetime of the interface
+                */
+                KeyPageInterface(unsigned int page_num, BTreeDB* tree, LatchMode latch=NoLatch);
+
+                /**
+                    Constructor for an interface that takes over a frame that is already pinned (and latched).
+
+                    @param page_num The page number held in the frame
+                    @param tree The BTreeDB this page is within
+                    @param frame The pinned frame; its pin now belongs to this interface
+                    @param latch How the frame is latched; the latch now belongs to this interface
+                */
+                KeyPageInterface(unsigned int page_num, BTreeDB* tree, unsigned int frame, LatchMode latch);
+
+                /**
+                    Copy constructor. The copy holds its own pin on the page, but not the latch.
                 */
-                KeyPageInterface(unsigned int page_num, BTreeDB* tree);
+                KeyPageInterface(const KeyPageInterface& other);
+
+                /**
+                    Move constructor. The pin and latch move to the new interface. Can't throw, so vectors of latched pages move them when they grow instead of copying them (which would drop the latches).
+                */
+                KeyPageInterface(KeyPageInterface&& other) noexcept;
+
+                /**
+                    Assignment operator. Releases the pin (and latch) on the current page and pins the other interface's page, without latching it.
+                */
+                KeyPageInterface& operator=(const KeyPageInterface& other);
+
+                /**
+                    Move assignment operator. Releases the latch and pin on the current page and takes over the other interface's. Moving a freshly latched child into the interface of its parent is how searches hand over from parent to child.
+                */
+                KeyPageInterface& operator=(KeyPageInterface&& other);
+
+                /**
+                    Destructor. Releases the latch and the pin on the page.
+                */
+                ~KeyPageInterface();
+
+                /**
+                    Latches the page. The interface must not hold a latch already.
+
+                    @param mode How to latch the page
+                */
+                void latch(LatchMode mode) const;
+
+                /**
+                    Releases the latch on the page, if the interface holds one. The pin stays.
+                */
+                void unlatch() const;
 
                 /**
                     Return the number of filled cells in the page.
@@ -228,6 +739,62 @@ class BTreeDB {
                 */
                 void set_root(bool x);
 
+                /**
+                    Returns the next leaf on the same level. Only meaningful for leaves of trees with leaf links.
+
+                    @return the page number of the next leaf, or NULL_PAGE for the last leaf
+                */
+                unsigned int get_next_leaf() const;
+                /**
+                    Sets the next leaf pointer of this page.
+
+                    @param page_num the page number of the next leaf, or NULL_PAGE
+                */
+                void set_next_leaf(unsigned int page_num);
+
+                /**
+                    Returns the previous leaf on the same level. Only meaningful for leaves of trees with leaf links.
+
+                    @return the page number of the previous leaf, or NULL_PAGE for the first leaf
+                */
+                unsigned int get_prev_leaf() const;
+                /**
+                    Sets the previous leaf pointer of this page.
+
+                    @param page_num the page number of the previous leaf, or NULL_PAGE
+                */
+                void set_prev_leaf(unsigned int page_num);
+
+                /**
+                    Links a newly created page in as the right neighbor of this leaf. Does nothing for internal pages or trees without leaf links.
+
+                    @param right The new page that goes directly after this one
+                */
+                void link_right(KeyPageInterface& right);
+
+                /**
+                    Returns the number of entries this page can hold; it is split when it reaches this size.
+
+                    @return Layout::delta_order for pages with compressed keys, Layout::order otherwise
+                */
+                unsigned int capacity() const;
+
+                /**
+                    Returns whether a key can be added to this page without changing its layout. Always true unless the page has compressed keys and the key is too far from them.
+
+                    @param key The key that would be added
+                    @return whether the key fits
+                */
+                bool fits(long key) const;
+
+                /**
+                    Returns whether a key can be added to this page without splitting it, so that a change below it can't reach its parent. Internal pages don't know which key a split below them will add, so they only count as having room if any key would fit.
+
+                    @param key The key that would be added to a leaf
+                    @return whether the page has room
+                */
+                bool has_room_for(long key) const;
+
                 /**
                     Gets the page number (if it is internal) or entry number (if it is a root) of the nth entry within the key page. 
 
@@ -258,14 +825,14 @@ class BTreeDB {
                 unsigned int get_page_num() const;
 
                 /**
-                    Pushes a new key/child_ptr key pair in sorted order.
+                    Pushes a new key/child_ptr key pair in sorted order. A page with compressed keys that the key doesn't fit into is converted to the Split layout first, which it must have room for (fewer than Layout::order keys).
 
                     @param key Key to insert
                     @param child_ptr child pointer to insert following the key
                 */
                 void push(long key, unsigned int child_ptr);
                 /**
-                    Moves the latter half of the keys in this interface to another interface. Used for splitting nodes.
+                    Moves the latter half of the keys in this interface to another interface. Used for splitting nodes. The key at get_size() / 2 is the middle key: internal pages drop it (it goes to the parent) and leaves keep it. Pages of trees without compressed keys are only split when full.
 
                     @param other A reference to the interface to copy keys to (should be empty)
                 */
@@ -281,23 +848,6 @@ class BTreeDB {
                 */
                 unsigned int find_pos(long key) const;
 
-                /**
-                    Splits this interface's keypage according to the BTree logic. This page should not have a parent. Should only be called on a full key page. 
-
-                    Splits the latter half of the keys to a new key page and creates a new parent page to store the middle key.
-                */
-                void split_page();
-
-
-                /**
-                    Splits a key page according to the BTree logic. Should only be called on a full key page. This page should have a parent.
-
-                    Splits the latter half of the keys to a new key page and pushes the middle key to the parent. 
-
-                    @param parent An interface to the parent of the key page that is being split.
-                */
-                void split_page(KeyPageInterface& parent);
-
             private:
                 /**
                     Helper function to mark the current page number as dirty for writeback later. Used in all non-const functions in this class.
@@ -310,13 +860,82 @@ class BTreeDB {
                 char* get_data() const;
 
                 /**
-                    Inserts a key entry (key + child_ptr) at the given location, moving everything else to the right accordingly.
+                    Returns the address of the nth key in the page data, according to the tree's key format.
 
-                    @param key Key of the entry to insert
-                    @param child_ptr child pointer that follows this key
-                    @param loc location to insert this entry into; 0 to size
+                    @param data The page data
+                    @param entry_num The key number, 0 to Layout::order - 1
+                    @return the address of the key
                 */
-                void insert(long key, unsigned int child_ptr, unsigned int loc);
+                char* key_addr(char* data, unsigned int entry_num) const;
+
+                /**
+                    Returns the address of the nth child pointer in the page data, according to the tree's key format.
+
+                    @param data The page data
+                    @param entry_num The child pointer number, 0 to Layout::order
+                    @return the address of the child pointer
+                */
+                char* ptr_addr(char* data, unsigned int entry_num) const;
+
+                /**
+                    Returns whether the page data has compressed keys.
+
+                    @param data The page data
+                    @return true if the keys are stored as deltas from a base key
+                */
+                bool is_delta(const char* data) const;
+
+                /**
+                    Returns the base key of a page with compressed keys.
+
+                    @param data The page data
+                    @return the key every delta is added to
+                */
+                static long get_base(const char* data);
+
+                /**
+                    Changes the base key of a page with compressed keys, updating every delta. Every key must be within 2^32 above the new base.
+
+                    @param data The page data
+                    @param base The new base key
+                */
+                void rebase(char* data, long base);
+
+                /**
+                    Copies every key and child pointer of the page out.
+
+                    @param keys Where to copy the get_size() keys to
+                    @param ptrs Where to copy the get_size() + 1 child pointers to
+                */
+                void load(long* keys, unsigned int* ptrs) const;
+
+                /**
+                    Replaces every key and child pointer of the page. Leaves the header (other than the size and layout) alone.
+
+                    @param keys The keys
+                    @param ptrs The n + 1 child pointers
+                    @param n The number of keys
+                    @param compress Whether to compress the keys (they must be within 2^32 of each other) or use the Split layout
+                */
+                void store(const long* keys, const unsigned int* ptrs, unsigned int n, bool compress);
+
+                /**
+                    Returns whether sorted keys are close enough together to be compressed.
+
+                    @param keys The keys, sorted
+                    @param n The number of keys
+                    @return true if they are all within 2^32 of the first one
+                */
+                static bool keys_fit(const long* keys, unsigned int n);
+
+                /**
+                    Inserts a key entry (key + child_ptr) at the given location, moving everything else to the right accordingly.
+
+                    @param key Key of the entry to insert
+                    @param child_ptr child pointer that follows this key
+                    @param loc location to insert this entry into; 0 to size
+                */
+                void insert(long key, unsigned int child_ptr, unsigned int loc);
 
                 /**
                     The page number this interface refers to.
@@ -326,6 +945,14 @@ class BTreeDB {
                     A pointer to the tree this interface is serving. Used to access functions.
                 */
                 BTreeDB* tree_;
+                /**
+                    The buffer pool frame the page is pinned in for the lifetime of this interface, or BufferPool::NO_FRAME if the page is served from a mapping.
+                */
+                unsigned int frame_;
+                /**
+                    How the interface currently has the page latched. Latching doesn't change the page, so it is allowed on const interfaces.
+                */
+                mutable LatchMode latch_;
         };
 
         /**
@@ -348,14 +975,15 @@ class BTreeDB {
                 */
                 T get_value(unsigned int entry_num) const;
                 /**
-                    Sets the nth value in the value database to the passed value entry.
+                    Sets the nth value in the value database to the passed value entry. With slotted pages, a value that grows too big for its page is moved, and the caller has to update the child pointer that refers to it.
 
                     @param entry The ValueEntry to copy into the value database
                     @param entry_num The number value entry to change
+                    @return the entry number the value is stored under now
                 */
-                void set_value(T& entry, unsigned int entry_num);
+                unsigned int set_value(T& entry, unsigned int entry_num);
                 /**
-                    Push a new value entry record into the value database. Inserts into the last page, if possible, or creates a new page if the last page is full.
+                    Push a new value entry record into the value database. Inserts into the last page, if possible, or creates a new page if the last page is full. Values pushed by several threads at once are appended one at a time.
 
                     @param entry The entry to insert into the value database
                     @return The entry number that represents the newly inserted record
@@ -370,382 +998,2243 @@ class BTreeDB {
                 */
                 unsigned int get_size(unsigned int page_num) const;
                 /**
-                    Sets the size of the passed in page_num. Does not change its internal representation otherwise.
+                    Returns the page an entry is stored in.
+
+                    @param entry_num The entry number
+                    @return the value page number
+                */
+                unsigned int page_of(unsigned int entry_num) const;
+
+                /**
+                    Returns whether an entry is still stored in the data of its page. Always true for fixed records; a slotted record that grew may have moved to another entry number since it was looked up.
+
+                    @param data The data of the entry's page
+                    @param entry_num The entry number
+                    @return whether the entry's record is there
+                */
+                bool has_record(const char* data, unsigned int entry_num) const;
+
+                /**
+                    Reads an entry out of the data of its page, which the caller already has.
+
+                    @param data The data of the entry's page
+                    @param entry_num The entry number
+                    @param dest Where to read the value into
+                */
+                void read(const char* data, unsigned int entry_num, T* dest) const;
+
+                /**
+                    Calls a function with every value in the database, in storage order. Each page is only visited once.
+
+                    @param callback Called with (T& value); returns false to stop early
+                */
+                template <typename Callback>
+                void for_each_value(Callback callback) const;
+
+            private:
+                /**
+                    Returns the record of an entry in a slotted page.
+
+                    @param data The data of the entry's page
+                    @param slot The slot of the entry
+                    @param len Set to the length of the record
+                    @return the start of the record
+                */
+                const char* slotted_record(const char* data, unsigned int slot, unsigned int* len) const;
+
+                /**
+                    Returns how many bytes are free between the slots and the records of a slotted page.
+                */
+                static unsigned int free_space(const char* data);
+
+                /**
+                    Moves the records of a slotted page together at the end of the page, so the space of moved records is free again.
+                */
+                static void compact(char* data);
+
+                /**
+                    Writes a record into a slot of a slotted page at the start of the free space. The page must have room for it.
+
+                    @param data The page data
+                    @param slot The slot to point at the record
+                    @param record The encoded record
+                */
+                static void place(char* data, unsigned int slot, const std::vector<char>& record);
+
+                /**
+                    Adds a record in a new slot of a slotted page. The page must have room for both.
+
+                    @param data The page data
+                    @param page_num The page number
+                    @param record The encoded record
+                    @return the entry number of the record
+                */
+                static unsigned int add_slot(char* data, unsigned int page_num, const std::vector<char>& record);
+
+                /**
+                    Adds an encoded record in a new slot at the end of the value file, starting a new page if the last one is full. value_mutex must be held.
+
+                    @param record The encoded record
+                    @return the entry number of the record
+                */
+                unsigned int append(const std::vector<char>& record);
+
+                BTreeDB* tree_;
+        };
+
+        /**
+            This class holds a pin (and latch) on a page for as long as it exists, so its data stays valid while other threads use the cache. Used by the paths that don't go through a KeyPageInterface, which is everything that touches value pages; pages of mapped files don't need a pin.
+        */
+        class PinnedPage {
+            public:
+                /**
+                    Constructor. Pins and latches the page, reading it in if needed.
+
+                    @param tree The tree the page belongs to
+                    @param page_num The page to pin
+                    @param type Which file the page belongs to
+                    @param latch How to latch the page; readers share it
+                    @param create Whether the page is brand new, so it is added to the cache zero-filled instead of read
+                */
+                PinnedPage(BTreeDB* tree, unsigned int page_num, FileType type, LatchMode latch=SharedLatch, bool create=false);
+
+                /**
+                    Destructor. Releases the latch and the pin.
+                */
+                ~PinnedPage();
+
+                PinnedPage(const PinnedPage& other) = delete;
+                PinnedPage& operator=(const PinnedPage& other) = delete;
+
+                /**
+                    Returns the data of the page.
+                */
+                char* data() const;
+
+            private:
+                BTreeDB* tree_;
+                unsigned int frame_;
+                LatchMode latch_;
+                char* data_;
+        };
+
+    public:
+        /**
+            This class is a cursor over the entries of the database in key order. It holds a pin on the leaf it is on, and steps between leaves using the leaf links (or by searching from the root for databases without them).
+
+            The leaf is only latched while the cursor reads it, so other threads can insert while a cursor is open. The cursor remembers its current key and finds it again if a split moved it to another leaf; entries inserted after the cursor was opened may or may not be seen.
+        */
+        class Cursor {
+            public:
+                /**
+                    Returns whether the cursor is at an entry. Cursors become invalid when they step past either end.
+
+                    @return true if the cursor is at an entry
+                */
+                bool valid() const;
+
+                /**
+                    Returns the key of the current entry. Should only be called on valid cursors.
+
+                    @return the current key
+                */
+                long key() const;
+
+                /**
+                    Returns the value of the current entry. Should only be called on valid cursors.
+
+                    @return the current value
+                */
+                T value() const;
+
+                /**
+                    Moves to the entry with the next larger key.
+
+                    @return whether the cursor is still valid
+                */
+                bool next();
+
+                /**
+                    Moves to the entry with the next smaller key.
+
+                    @return whether the cursor is still valid
+                */
+                bool prev();
+
+            private:
+                friend class BTreeDB;
+
+                /**
+                    Constructor for an invalid cursor.
+                */
+                Cursor();
+
+                /**
+                    Constructor for a cursor at the given position of a leaf. The leaf must be latched by the caller.
+
+                    @param leaf The leaf the cursor is on
+                    @param pos The position in the leaf; 0 to size - 1
+                */
+                Cursor(BTreeDB* tree, const KeyPageInterface& leaf, unsigned int pos);
+
+                /**
+                    The tree the cursor is iterating over.
+                */
+                BTreeDB* tree_;
+                /**
+                    The leaf the cursor is on (pinned), or nothing for invalid cursors.
+                */
+                std::optional<KeyPageInterface> leaf_;
+                /**
+                    Position of the current entry within the leaf.
+                */
+                unsigned int pos_;
+                /**
+                    Key of the current entry, used to check that it is still at pos_.
+                */
+                long key_;
+
+                /**
+                    Returns whether the current entry is still at pos_ of the leaf. The leaf must be latched.
+                */
+                bool in_place() const;
+
+                /**
+                    Moves the cursor to a new leaf. The new leaf must be latched by the caller.
+
+                    @param leaf The leaf to move to
+                    @param pos The position in the leaf
+                */
+                void move_to(const KeyPageInterface& leaf, unsigned int pos);
+        };
+
+        /**
+            This class is a view of one serialized value, pointing straight into the cached (or mapped) value page. Fields are read with get and the entry type's Field typedefs, e.g. view.get<paper::Entry::Title>(), which returns a std::string_view into the page for strings and a copy for everything else.
+
+            The view holds a pin on its value page, so the data stays valid for as long as the view exists. Don't hold on to more views than the cache has frames, and don't use a view after the value has been overwritten.
+
+            Records of slotted value pages have to be decoded, so their views hold the decoded value instead (shared by every copy of the view) and read fields out of it. Variable length fields then come back whole, while views into fixed value pages only have what the serialized form has room for (see Field).
+        */
+        class View {
+            public:
+                /**
+                    Copy constructor. The copy holds its own pin on the page.
+                */
+                View(const View& other);
+
+                /**
+                    Assignment operator. Releases the current pin and pins the other view's page.
+                */
+                View& operator=(const View& other);
+
+                /**
+                    Destructor. Releases the pin on the page.
+                */
+                ~View();
+
+                /**
+                    Returns whether the view refers to a value (false if the key wasn't found).
+
+                    @return true if the view refers to a value
+                */
+                bool valid() const;
+
+                /**
+                    Reads a single field of the value. Should only be called on valid views.
+
+                    @return the field (see Field::view)
+                */
+                template <typename F>
+                auto get() const;
+
+                /**
+                    Copies out the whole value. Should only be called on valid views.
+
+                    @return the value
+                */
+                T value() const;
+
+            private:
+                friend class BTreeDB;
+
+                /**
+                    Constructor for an invalid view.
+                */
+                View();
+
+                /**
+                    Constructor for a view of a record.
+
+                    @param tree The tree the record is in
+                    @param record The start of the serialized record
+                    @param frame The buffer pool frame holding the record's page (already pinned for this view), or BufferPool::NO_FRAME
+                */
+                View(BTreeDB* tree, const char* record, unsigned int frame);
+
+                /**
+                    Constructor for a view of a decoded value, for records that aren't stored in the serialized form.
+
+                    @param tree The tree the record is in
+                    @param value The decoded value, shared by every copy of the view
+                */
+                View(BTreeDB* tree, std::shared_ptr<const T> value);
+
+                BTreeDB* tree_;
+                const char* record_;
+                unsigned int frame_;
+                std::shared_ptr<const T> value_;
+        };
+
+    private:
+        /**
+            Finds the leaf that a key belongs in by searching from the root. Each page is latched shared until its child is latched. The caller must not hold any latches, since they are only ever taken from the root down.
+
+            @param key The key to search for
+            @param upper_bound If not null, set to the largest key that belongs in the returned leaf (LONG_MAX if the leaf is the last one). Keys in between the searched key and this bound are guaranteed to be in the same leaf for as long as it stays latched.
+            @param leaf_latch How to latch the leaf
+            @return an interface to the leaf, holding its latch
+        */
+        KeyPageInterface find_leaf(long key, long* upper_bound=nullptr, LatchMode leaf_latch=SharedLatch);
+
+        /**
+            Latches the root page. The root can change while waiting for its latch, so this tries again until the page it latched is still the root.
+
+            @param leaf_latch How to latch the root if it is a leaf (internal roots are always latched shared)
+            @return an interface to the root, holding its latch
+        */
+        KeyPageInterface latch_root(LatchMode leaf_latch);
+
+        /**
+            Adds a key-value pair to the tree, or overwrites the value if the key is already there. The name index is left alone; insert updates it before and after, while no key page is latched.
+
+            @param key The key
+            @param value The value
+            @param old_value Set to the value the key had if it was overwritten (only for databases with a name index)
+            @return true if the key was already there and its value was overwritten
+        */
+        bool place(long key, T& value, T& old_value);
+
+        /**
+            Overwrites the value of a key that is already in a leaf, updating the leaf if a slotted value moved. The name index is left to the caller.
+
+            @param leaf The leaf, latched exclusively
+            @param pos The position of the key in the leaf
+            @param key The key
+            @param value The new value
+            @param old_value Set to the value the key had (only for databases with a name index)
+        */
+        void overwrite(KeyPageInterface& leaf, unsigned int pos, long key, T& value, T& old_value);
+
+        /**
+            Finds the leaf directly before or after the leaf a key is in by searching from the root. Used to step between leaves in trees without leaf links. The caller must not hold any latches.
+
+            @param key A key in the starting leaf
+            @param forward Whether to find the next (true) or previous (false) leaf
+            @return the page number of the neighboring leaf, or NULL_PAGE if there isn't one
+        */
+        unsigned int find_neighbor_leaf(long key, bool forward);
+
+        /**
+            Returns the filename of the name index file that goes with a database file.
+
+            @param filename The key or value filename of this database
+            @return the filename of the matching name index file
+        */
+        static std::string name_index_filename(const std::string& filename);
+
+        /**
+            Returns the first name index key for a name hash. Every id with this hash has a key in [name_index_key(hash), name_index_key(hash) + 2^NAME_DUP_BITS).
+
+            @param hash The name hash
+            @return the first key of the hash's range
+        */
+        static long name_index_key(unsigned long hash);
+
+        /**
+            Returns the part of a memory budget of the config that the database keeps for itself. Types with a name index leave 1/NAME_INDEX_SHARE of it to the index (read only instances of databases without an index leave it unused).
+
+            @param bytes The budget of the config
+            @return the database's own part of it
+        */
+        static size_t own_budget(size_t bytes);
+
+        /**
+            Returns the lock that covers the name index keys of one name hash.
+
+            @param index_key Any name index key of the hash
+            @return the lock of its stripe
+        */
+        std::mutex& name_lock(long index_key);
+
+        /**
+            Adds an id to the name index under the name hash of its value. Inserts call this before latching any key page, so that running out of slots fails before the tree has changed and the index is never changed under a latch; the slot is given back (see name_index_clear) if the id doesn't end up in the tree.
+
+            @param value The value being stored under the id
+            @param key The id
+            @return the name index key of the slot the id took, or nothing if there is no name index
+        */
+        std::optional<long> name_index_add(const T& value, long key);
+
+        /**
+            Adds an id to the name index under a name hash. The name index must exist.
+
+            @param hash The name hash
+            @param key The id
+            @return the name index key of the slot the id took
+        */
+        long name_index_insert(unsigned long hash, long key);
+
+        /**
+            Empties a slot of the name index taken by name_index_add.
+
+            @param slot The name index key of the slot, or nothing (which does nothing)
+        */
+        void name_index_clear(std::optional<long> slot);
+
+        /**
+            Removes an id from the name index under the name hash of its old value.
+
+            @param value The value that used to be stored under the id
+            @param key The id
+        */
+        void name_index_remove(const T& value, long key);
+
+        /**
+            Updates the name index once an id's value has been overwritten, given the slot name_index_add took for the new value beforehand. If the old value's name had the same hash, the id already has a slot there and the new one is given back; otherwise the old slot is emptied.
+
+            @param old_value The value that used to be stored under the id
+            @param new_value The new value
+            @param key The id
+            @param slot The slot taken for the new value
+        */
+        void name_index_replace(const T& old_value, const T& new_value, long key, std::optional<long> slot);
+
+        /**
+            Adds many (name hash, id) pairs to the name index at once. If the index is empty it is bulk loaded.
+
+            @param names The pairs to add; sorted in place
+        */
+        void name_index_add_all(std::vector<std::pair<unsigned long, long>>& names);
+
+        /**
+            Returns the filename of the Bloom filter file that goes with a key file.
+
+            @param filename The key filename of this database
+            @return the filename of the matching Bloom filter file
+        */
+        static std::string key_filter_filename_for(const std::string& filename);
+
+        /**
+            Returns the filename of the metadata file that goes with a pair of database files.
+
+            @param key_filename The key filename of this database
+            @param values_filename The value filename of this database
+            @return the filename of the matching metadata file
+        */
+        static std::string metadata_filename_for(const std::string& key_filename, const std::string& values_filename);
+
+        /**
+            Replaces the Bloom filter with one sized for the current number of entries, filled from the keys in the leaves. Nothing else may use the database meanwhile.
+
+            @param bits_per_key The bits per key of the new filter
+        */
+        void rebuild_key_filter(unsigned int bits_per_key);
+
+        /**
+            Creates a new keypage. It is latched before anyone else can reach it.
+
+            @param latch How to latch the new page
+            @return A keypage interface for the newly created keypage
+        */
+        KeyPageInterface create_new_keypage(unsigned int num_cells, bool internal, bool is_root, LatchMode latch);
+
+        /**
+            Adds a key and the child pointer after it to a key page, splitting pages on the way up as needed. Every page of the path must be latched exclusively; a split never goes past the first page of the path unless it is the root.
+
+            @param path The page numbers of the latched pages, from the highest one down to the page the key goes into
+            @param depth Which page of the path the key goes into
+            @param key The key to add
+            @param child_ptr The child pointer (value entry number in leaves) that follows the key
+            @param held The latched pages; pages created by splits are added to it, so they stay latched until the insert is done
+        */
+        void insert_entry(const std::vector<unsigned int>& path, size_t depth, long key, unsigned int child_ptr, std::vector<KeyPageInterface>& held);
+
+        /**
+            Splits a key page in two, moving the latter half of its keys to a new page and adding the middle key to its parent (or a new root).
+
+            @param path The page numbers of the latched pages, from the highest one down to the page being split
+            @param depth Which page of the path is being split
+            @param held The latched pages; the new pages are added to it
+            @return the middle key and the page number of the new right page
+        */
+        std::pair<long, unsigned int> split_key_page(const std::vector<unsigned int>& path, size_t depth, std::vector<KeyPageInterface>& held);
+
+        /**
+            Starts loading the parts of a key page that a search reads first (the header and the middle of the keys) into the CPU cache, so that they arrive while the current page is still being worked on. Does nothing if the page isn't mapped or in the cache.
+
+            @param page_num The key page that will be searched next
+        */
+        void prefetch_key_page(unsigned int page_num);
+
+        /**
+            Helper function to write all dirty pages to disk and close the files. Only the destructor calls it: errors are thrown while other threads (or the caller itself) may still hold latches and pins, so they leave the instance as it is and teardown waits for the destructor.
+        */
+        void write_all();
+
+        /**
+            Hands every dirty page to the writeback thread once there are more than max_dirty_pages of them. Pages are written under their shared latches, so the calling thread must not hold any latches. If another thread is already doing it, this returns right away.
+        */
+        void write_back_dirty();
+
+        /**
+            Writes a run of consecutive pages with a single pwritev. Used by the writeback thread, and by write_page for single pages when there is no thread.
+
+            @param type Specifies which database to write to
+            @param first_page The page number of the first page
+            @param pages The data of each page
+        */
+        void write_pages(FileType type, unsigned int first_page, const std::vector<const char*>& pages);
+
+        /**
+            Helper function to set the page_num page dirty for writeback.
+
+            @param page_num the page number to set dirty
+            @param type which cache to set dirty
+        */
+        void set_dirty(unsigned int page_num, FileType type);
+
+        /**
+            Helper function to write a page_num to the file database. Used by the buffer pool for writebacks.
+
+            @param page_num the page number to write
+            @param type Specifies which database to write to
+            @param data The page data to write
+        */
+        void write_page(unsigned int page_num, FileType type, const char* data);
+
+        /**
+            Helper function to read a page_num from the file database. Used by the buffer pool on cache misses. Any part of the page past the end of the file is zero-filled.
+
+            @param page_num the page number to read
+            @param type Specifies which database to read from
+            @param dest Where to copy the page data to
+        */
+        void read_page(unsigned int page_num, FileType type, char* dest);
+
+        /**
+            Helper function to read a batch of pages from one file with async_reader, so the reads are in flight together. Used by the buffer pool for prefetches. Pages that are still waiting to be written back are copied from the writeback queue instead.
+
+            @param type Specifies which database to read from
+            @param pages The page number and destination of every page
+        */
+        void read_pages(FileType type, const std::vector<std::pair<unsigned int, char*>>& pages);
+
+        /**
+            Reads pages that are about to be used ahead of time, in a single batch (see BufferPool::prefetch). For mapped files, asks the kernel to read them in instead. Callers pass at most io_depth pages, so that what is read ahead is used before it can be evicted.
+
+            @param type Which file the pages belong to
+            @param page_nums The pages to read ahead
+        */
+        void prefetch_pages(FileType type, const std::vector<unsigned int>& page_nums);
+
+        /**
+            Reads ahead the leaves that follow the leaf a key is in, up to io_depth of them and stopping at the first that starts at or past hi. They are found through the parent of the leaf, which knows where its children are without reading them.
+
+            @param key A key in the leaf the scan is at
+            @param hi One past the largest key of the scan
+            @return the leaves that were read ahead, in key order
+        */
+        std::vector<unsigned int> prefetch_leaves(long key, long hi);
+
+        /**
+            Reads ahead the value pages of a leaf's entries below hi, io_depth pages at a time.
+
+            @param leaf The leaf (not latched; it is latched shared while it is read)
+            @param hi One past the largest key whose value is needed
+        */
+        void prefetch_values(const KeyPageInterface& leaf, long hi);
+
+        /**
+            Pins a page in the buffer pool so it stays in memory. Mapped pages don't need pinning.
+
+            @param page_num the page number to pin
+            @param type Which file the page belongs to
+            @return the frame the page is pinned in, or BufferPool::NO_FRAME for mapped pages
+        */
+        unsigned int pin_page(unsigned int page_num, FileType type);
+
+        /**
+            Helper function to map a database file into memory as read only.
+
+            @param filename The file to map
+            @return The mapping; data is nullptr if the file is empty
+        */
+        static MappedFile map_file(const std::string& filename);
+
+        /**
+            Helper function to open a key or value file. If the filesystem refuses O_DIRECT, the file is opened without it.
+
+            @param filename The file to open
+            @param flags The flags to open it with
+            @return the descriptor, or -1 if the file couldn't be opened
+        */
+        static int open_file(const std::string& filename, int flags);
+
+        /**
+            Helper function to release the key and value mappings, if there are any.
+        */
+        void unmap_files();
+
+        /**
+            Gets the actual data of a given page number. Handles cache misses and cache hits implicitly.
+
+            @param page_num The page being requested
+            @param type Whwether a key or value page is being requested
+            @return the character array representing the page's binary data
+        */
+        char* get_page(unsigned int page_num, FileType type);
+};
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::BTreeDB(const std::string& key_filename, const std::string& values_filename, bool create_new, bool read_only_opt, const BTreeConfig& config):
+    pool(Layout::page_size, own_budget(config.cache_bytes),
+         [this](FileType type, unsigned int page_num, char* dest) { read_page(page_num, type, dest); },
+         [this](FileType type, unsigned int page_num, const char* data) { write_page(page_num, type, data); },
+         [this](FileType type, const std::vector<std::pair<unsigned int, char*>>& pages) { read_pages(type, pages); }),
+    io_depth(std::max(config.io_depth, 1u)),
+    max_dirty_pages(static_cast<unsigned int>(std::min<size_t>(own_budget(config.dirty_bytes) / Layout::page_size, UINT_MAX))),
+    key_fd(-1),
+    value_fd(-1),
+    read_only(read_only_opt) {
+    // decare a read/write stream for the metadata file (that stores the important member variables)
+    std::fstream fs_meta;
+
+    // construct name for metadata file from filenames
+    std::string metadata_file = metadata_filename_for(key_filename, values_filename);
+    key_filter_filename = key_filter_filename_for(key_filename);
+
+    // bits per key of the Bloom filter (0 if there is none)
+    unsigned int bloom_bits = config.bloom_bits_per_key;
+
+    if (create_new) {
+        // if creating a new BTreeDB, open with std::ios::trunc to create fresh files, overwriting any existing things
+        fs_meta.open(metadata_file, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+
+        // everything should be zero on new db
+        num_entries = num_key_pages = key_root = num_value_pages = 0;
+        has_leaf_links = true;
+        has_name_index = T::has_name_index;
+        key_format = config.key_format;
+        value_format = config.value_format;
+        num_shards = config.shards;
+    } else {
+        // open normally without overwriting if not creating a new one
+        fs_meta.open(metadata_file, std::ios::binary | std::ios::in | std::ios::out);
+    }
+    
+    // error handling for io errors
+    if (!fs_meta.is_open()) {
+        throw std::runtime_error("error reading/creating metadata file");
+    }
+
+    if (!create_new) {
+        // if not creating a new file, read member variables from the metadata file (through plain numbers, since they are atomic)
+        unsigned int entries = 0, value_pages = 0, key_pages = 0, root = 0;
+        fs_meta >> entries;
+        fs_meta >> value_pages;
+        fs_meta >> key_pages;
+        fs_meta >> root;
+        num_entries = entries;
+        num_value_pages = value_pages;
+        num_key_pages = key_pages;
+        key_root = root;
+
+        // newer features are stored as "name value" lines after the original four numbers; anything missing is from an older database
+        has_leaf_links = false;
+        has_name_index = false;
+        key_format = Interleaved;
+        value_format = Fixed;
+        unsigned int page_size = DefaultLayout::page_size, order = DefaultLayout::order, delta_order = DefaultLayout::delta_order;
+        bloom_bits = 0;
+        num_shards = 1;
+
+        std::string field;
+        while (fs_meta >> field) {
+            if (field == "leaf_links") {
+                fs_meta >> has_leaf_links;
+            } else if (field == "name_index") {
+                fs_meta >> has_name_index;
+            } else if (field == "key_format") {
+                std::string format;
+                fs_meta >> format;
+                if (format == "delta") {
+                    key_format = Delta;
+                } else if (format == "split") {
+                    key_format = Split;
+                } else if (format == "interleaved") {
+                    key_format = Interleaved;
+                } else {
+                    throw std::runtime_error("unknown key format in metadata file: " + format);
+                }
+            } else if (field == "value_format") {
+                std::string format;
+                fs_meta >> format;
+                if (format == "slotted") {
+                    value_format = Slotted;
+                } else if (format == "fixed") {
+                    value_format = Fixed;
+                } else {
+                    throw std::runtime_error("unknown value format in metadata file: " + format);
+                }
+            } else if (field == "layout") {
+                fs_meta >> page_size >> order >> delta_order;
+            } else if (field == "bloom") {
+                fs_meta >> bloom_bits;
+            } else if (field == "shards") {
+                fs_meta >> num_shards;
+            } else {
+                throw std::runtime_error("unknown field in metadata file: " + field);
+            }
+        }
+
+        // pages of another layout can't even be found in the files, let alone read
+        if (page_size != Layout::page_size || order != Layout::order || delta_order != Layout::delta_order) {
+            throw std::runtime_error("database was built with a different page layout (" + std::to_string(page_size) + " byte pages, order " + std::to_string(order) + ")");
+        }
+
+        // keys would be looked for in the wrong shard
+        if (num_shards != config.shards) {
+            throw std::runtime_error("database was built as one of " + std::to_string(num_shards) + " shards, but opened as one of " + std::to_string(config.shards));
+        }
+    }
+
+    if (!read_only) {
+        // if not read only, reset the metadata file to allow the storing of the new ones once finished
+        fs_meta.close();
+        fs_meta.open(metadata_file, std::ios::out | std::ios::trunc);
+
+        // store meta handler with move semantics
+        meta_handler = std::move(fs_meta);
+    }
+
+    // std::cout << num_entries << ' ' << num_value_pages << ' ' << num_key_pages << ' ' << key_root << std::endl;
+
+    // open the key and value files (creating fresh ones, overwriting any existing things, for a new database)
+    int flags = read_only && !create_new ? O_RDONLY : O_RDWR;
+    if (create_new) {
+        flags |= O_CREAT | O_TRUNC;
+    }
+    if (config.direct_io) {
+        flags |= O_DIRECT;
+    }
+    key_fd = open_file(key_filename, flags);
+    if (key_fd == -1) {
+        throw std::runtime_error("error reading/creating keys file");
+    }
+    value_fd = open_file(values_filename, flags);
+    if (value_fd == -1) {
+        close(key_fd);
+        throw std::runtime_error("error reading/creating values file");
+    }
+
+    if (read_only && config.use_mmap && !config.direct_io && !create_new) {
+        // read only instances never write, so pages can be served directly out of a mapping of the files
+        key_map = map_file(key_filename);
+        value_map = map_file(values_filename);
+
+        // the key pages are small and hit on every lookup, so start reading them in right away
+        if (key_map.data != nullptr) {
+            madvise(key_map.data, key_map.size, MADV_WILLNEED);
+        }
+        if (value_map.data != nullptr) {
+            madvise(value_map.data, value_map.size, MADV_RANDOM);
+        }
+    }
+
+    // pages that aren't mapped are read through the pool, which reads batches with many reads in flight
+    if (key_map.data == nullptr || value_map.data == nullptr) {
+        async_reader = std::make_unique<AsyncReader>(config.io_backend, io_depth);
+    }
+
+    if (!read_only && config.dirty_bytes > 0) {
+        writeback = std::make_unique<Writeback>(Layout::page_size, std::max(max_dirty_pages, 1u),
+            [this](FileType type, unsigned int first_page, const std::vector<const char*>& pages) { write_pages(type, first_page, pages); });
+    }
+
+    // initialize empty array
+    for (unsigned int i = 0; i < Layout::page_size; ++i) {
+        empty_array[i] = 0;
+    }
+
+    if (config.record_cache_entries > 0) {
+        record_cache = std::make_unique<RecordCache<T>>(config.record_cache_entries);
+    }
+
+    if (bloom_bits > 0) {
+        if (create_new) {
+            key_filter = std::make_unique<BloomFilter>(BLOOM_MIN_KEYS, bloom_bits);
+        } else {
+            try {
+                key_filter = std::make_unique<BloomFilter>(key_filter_filename);
+                // a filter that is missing keys would hide them; that only happens if it wasn't saved with the database
+                if (key_filter->size() < num_entries) {
+                    key_filter.reset();
+                }
+            } catch (std::runtime_error& err) {
+                key_filter.reset();
+            }
+
+            // without a usable file, writable instances rebuild the filter and read only ones go without
+            if (!key_filter && !read_only) {
+                rebuild_key_filter(bloom_bits);
+            }
+        }
+    }
+
+    if constexpr (T::has_name_index) {
+        // older databases without an index can only get one if we are allowed to write
+        if (has_name_index || !read_only) {
+            bool build = !has_name_index;
+            // name index keys are hashes, which are too spread out to compress, and its values are single ids, which are smaller fixed
+            BTreeConfig name_config = config;
+            if (name_config.key_format == Delta) {
+                name_config.key_format = Split;
+            }
+            name_config.value_format = Fixed;
+            // the index is searched by range, never by single keys
+            name_config.bloom_bits_per_key = 0;
+            name_config.record_cache_entries = 0;
+            // its share of the budgets was taken out of ours, so the two together stay within the config
+            name_config.cache_bytes = config.cache_bytes / NAME_INDEX_SHARE;
+            name_config.dirty_bytes = config.dirty_bytes / NAME_INDEX_SHARE;
+            // the ranges are short, so batched reads would only add another reader
+            name_config.io_backend = SyncIO;
+            name_db = std::make_unique<BTreeDB<NameIndexEntry, Layout>>(name_index_filename(key_filename), name_index_filename(values_filename), create_new || build, read_only, name_config);
+
+            if (build) {
+                std::vector<std::pair<unsigned long, long>> names;
+                for (Cursor iter = first(); iter.valid(); iter.next()) {
+                    names.push_back({iter.value().name_hash(), iter.key()});
+                }
+                name_index_add_all(names);
+                has_name_index = true;
+            }
+        }
+    }
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::write_all() {
+    // the filter is saved as a single filter of the right size (this reads the leaves, so it happens before anything is closed)
+    if (!read_only && key_filter && key_fd != -1) {
+        if (key_filter->is_chained()) {
+            rebuild_key_filter(key_filter->bits_per_key());
+        }
+        key_filter->write(key_filter_filename);
+    }
+
+    // release mappings (if any); nothing in them can be dirty
+    unmap_files();
+
+    // write back all dirty pages (in page order) and free the cache
+    // clearing also makes a later call (e.g. the destructor after an exception) a no-op
+    if (!read_only) {
+        pool.flush_all();
+    }
+    pool.clear();
+
+    // wait for the writeback thread to write everything it was given before closing anything
+    if (writeback) {
+        writeback->drain();
+        writeback.reset();
+    }
+
+    // close the files
+    if (key_fd != -1) {
+        close(key_fd);
+        close(value_fd);
+        key_fd = value_fd = -1;
+    }
+
+    if (read_only) {
+        return;
+    }
+    // store metadata member variables
+    meta_handler << num_entries << std::endl;
+    meta_handler << num_value_pages << std::endl;
+    meta_handler << num_key_pages << std::endl;
+    meta_handler << key_root << std::endl;
+    meta_handler << "leaf_links " << has_leaf_links << std::endl;
+    meta_handler << "name_index " << has_name_index << std::endl;
+    meta_handler << "key_format " << (key_format == Delta ? "delta" : key_format == Split ? "split" : "interleaved") << std::endl;
+    meta_handler << "value_format " << (value_format == Slotted ? "slotted" : "fixed") << std::endl;
+    meta_handler << "layout " << Layout::page_size << ' ' << Layout::order << ' ' << Layout::delta_order << std::endl;
+    if (key_filter) {
+        meta_handler << "bloom " << key_filter->bits_per_key() << std::endl;
+    }
+    if (num_shards != 1) {
+        meta_handler << "shards " << num_shards << std::endl;
+    }
+    
+    meta_handler.close();
+}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::~BTreeDB() {
+    // on destruction, write all
+    write_all();
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::write_back_dirty() {
+    if (writeback && pool.dirty_count() > max_dirty_pages) {
+        // one thread hands the pages over while the rest keep going
+        std::unique_lock<std::mutex> lock(flush_mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            pool.flush_all();
+            writeback->submit();
+        }
+    }
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::insert(long key, T& value) {
+    // if read only, don't allow insertions
+    if (read_only) return;
+
+    LatencyHistogram::Timer timer(insert_latency);
+
+    // the previous change is complete and nothing is latched, so this is a safe point to write back
+    write_back_dirty();
+
+    // the name index is only changed while no key page is latched: the id takes its slot first, and gives it back if it doesn't end up in the tree as a new key
+    std::optional<long> slot = name_index_add(value, key);
+    T old_value;
+    bool overwritten;
+    try {
+        overwritten = place(key, value, old_value);
+    } catch (...) {
+        name_index_clear(slot);
+        throw;
+    }
+    if (overwritten) {
+        name_index_replace(old_value, value, key, slot);
+    }
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::place(long key, T& value, T& old_value) {
+    // the key goes into the filter before it can be found in its leaf
+    if (key_filter) {
+        key_filter->add(key);
+    }
+
+    // if there are no key pages, create a new keypage and push the value; other inserts wait until the root exists
+    if (num_entries == 0) {
+        std::lock_guard<std::mutex> lock(structure_mutex);
+        if (num_key_pages == 0) {
+            KeyPageInterface key_iter = create_new_keypage(0, false, true, ExclusiveLatch);
+            ValuePageInterface value_iter(this);
+            key_iter.push(key, value_iter.push(value));
+            return false;
+        }
+    }
+
+    ValuePageInterface value_iter(this);
+
+    // most inserts don't split the leaf, so first try with only the leaf latched exclusively
+    {
+        KeyPageInterface leaf = find_leaf(key, nullptr, ExclusiveLatch);
+        unsigned int target = leaf.find_pos(key);
+
+        // check if id already exists; if so, overwrite it
+        if (target < leaf.get_size() && leaf.get_key(target) == key) {
+            overwrite(leaf, target, key, value, old_value);
+            return true;
+        }
+
+        if (leaf.has_room_for(key)) {
+            leaf.push(key, value_iter.push(value));
+            return false;
+        }
+    }
+
+    // the leaf has to split, which can go all the way up; latch the path exclusively, from the last page that the split can't get past
+    std::vector<KeyPageInterface> held;
+    std::vector<unsigned int> path;
+    while (held.empty()) {
+        KeyPageInterface root(key_root, this, ExclusiveLatch);
+        if (root.is_root()) {
+            path.push_back(root.get_page_num());
+            held.push_back(std::move(root));
+        }
+    }
+
+    while (held.back().is_internal()) {
+        unsigned int next_page = held.back().get_child_ptr(held.back().find_pos(key));
+        prefetch_key_page(next_page);
+        KeyPageInterface child(next_page, this, ExclusiveLatch);
+
+        // nothing above a page with room can change
+        if (child.has_room_for(key)) {
+            held.clear();
+            path.clear();
+        }
+        path.push_back(next_page);
+        held.push_back(std::move(child));
+    }
+
+    // another thread may have added the key (or made room) while nothing was latched
+    unsigned int target = held.back().find_pos(key);
+    if (target < held.back().get_size() && held.back().get_key(target) == key) {
+        overwrite(held.back(), target, key, value, old_value);
+        return true;
+    }
+
+    // id doesn't exist--make a new entry, splitting nodes up the path as needed
+    insert_entry(path, path.size() - 1, key, value_iter.push(value), held);
+    return false;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::overwrite(KeyPageInterface& leaf, unsigned int pos, long key, T& value, T& old_value) {
+    ValuePageInterface value_iter(this);
+    unsigned int entry_num = leaf.get_child_ptr(pos + 1);
+    if (name_db) {
+        old_value = value_iter.get_value(entry_num);
+    }
+
+    // slotted values can move when they grow
+    unsigned int new_entry_num = value_iter.set_value(value, entry_num);
+    if (new_entry_num != entry_num) {
+        leaf.set_child_ptr(new_entry_num, pos + 1);
+    }
+
+    if (record_cache) {
+        record_cache->erase(key);
+    }
+}
+
+template <typename T, typename Layout>
+T BTreeDB<T, Layout>::find(long key) {
+    LatencyHistogram::Timer timer(find_latency);
+
+    // can't find on an empty datbaase
+    if (num_entries == 0) {
+        throw std::runtime_error("database is empty");
+    }
+
+    // records looked up recently don't need the tree at all
+    uint64_t epoch = 0;
+    if (record_cache) {
+        T cached;
+        if (record_cache->get(key, cached)) {
+            return cached;
+        }
+        epoch = record_cache->epoch();
+    }
+
+    // most keys that aren't in the database don't get past the filter
+    if (key_filter && !key_filter->may_contain(key)) {
+        filtered_lookups.fetch_add(1, std::memory_order_relaxed);
+        return T();
+    }
+
+    // binary search down to the leaf the key would be in
+    KeyPageInterface iter = find_leaf(key);
+
+    // target id to search
+    unsigned int target = iter.find_pos(key);
+
+    ValuePageInterface value_iter(this);
+
+    // if id is present at the id, return it; the leaf stays latched so a slotted value can't move away while it is read
+    if (target < iter.get_size() && iter.get_key(target) == key) {
+        T res = value_iter.get_value(iter.get_child_ptr(target + 1));
+        if (record_cache) {
+            record_cache->put(key, res, epoch);
+        }
+        return res;
+    }
+
+    // if not, return a default struct
+    return T();
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::View BTreeDB<T, Layout>::find_view(long key) {
+    // can't find on an empty datbaase
+    if (num_entries == 0) {
+        throw std::runtime_error("database is empty");
+    }
+
+    if (key_filter && !key_filter->may_contain(key)) {
+        filtered_lookups.fetch_add(1, std::memory_order_relaxed);
+        return View();
+    }
+
+    KeyPageInterface iter = find_leaf(key);
+    unsigned int target = iter.find_pos(key);
+    if (target >= iter.get_size() || iter.get_key(target) != key) {
+        return View();
+    }
+
+    unsigned int entry_num = iter.get_child_ptr(target + 1);
+    ValuePageInterface value_iter(this);
+
+    // compact records have to be decoded, so the view holds on to the decoded value
+    if (value_format == Slotted) {
+        return View(this, std::make_shared<const T>(value_iter.get_value(entry_num)));
+    }
+
+    unsigned int page_num = entry_num / values_per_page;
+
+    // bounds checks
+    if (entry_num % values_per_page >= value_iter.get_size(page_num)) {
+        throw std::runtime_error("entry_num out of bounds for specific page value get");
+    }
+
+    // keep the page in memory for as long as the view exists
+    unsigned int frame = pin_page(page_num, Value);
+    char* data = frame == BufferPool::NO_FRAME ? get_page(page_num, Value) : pool.frame_data(frame);
+
+    return View(this, data + 4 + (entry_num % values_per_page) * T::size, frame);
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::KeyPageInterface BTreeDB<T, Layout>::find_leaf(long key, long* upper_bound, LatchMode leaf_latch) {
+    // base page to do binary search on
+    KeyPageInterface iter = latch_root(leaf_latch);
+
+    if (upper_bound != nullptr) {
+        *upper_bound = LONG_MAX;
+    }
+
+    // continue binary search until we have reached a leaf node (which stores values)
+    while (iter.is_internal()) {
+        unsigned int target = iter.find_pos(key);
+        unsigned int next_page = iter.get_child_ptr(target);
+        prefetch_key_page(next_page);
+
+        // the key after the child pointer is the largest key in that child; deeper levels only narrow it
+        if (upper_bound != nullptr && target < iter.get_size()) {
+            *upper_bound = iter.get_key(target);
+        }
+
+        // latch the child before letting go of the parent, so the child can't be split in between
+        KeyPageInterface child(next_page, this, SharedLatch);
+        if (leaf_latch == ExclusiveLatch && !child.is_internal()) {
+            // splitting the leaf needs its parent latched exclusively, so the leaf stays the same while its latch is swapped
+            child.unlatch();
+            child.latch(ExclusiveLatch);
+        }
+        iter = std::move(child);
+    }
+
+    return iter;
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::KeyPageInterface BTreeDB<T, Layout>::latch_root(LatchMode leaf_latch) {
+    while (true) {
+        KeyPageInterface root(key_root, this, SharedLatch);
+        if (leaf_latch == ExclusiveLatch && !root.is_internal()) {
+            root.unlatch();
+            root.latch(ExclusiveLatch);
+        }
+
+        // the root was split while we waited; nothing can change in read only instances
+        if (read_only || root.is_root()) {
+            return root;
+        }
+    }
+}
+
+template <typename T, typename Layout>
+std::vector<T> BTreeDB<T, Layout>::find_many(const std::vector<long>& keys) {
+    if (keys.empty()) {
+        return std::vector<T>();
+    }
+
+    // can't find on an empty datbaase
+    if (num_entries == 0) {
+        throw std::runtime_error("database is empty");
+    }
+
+    std::vector<T> res(keys.size());
+
+    // visit the keys in sorted order
+    std::vector<unsigned int> order(keys.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&keys](unsigned int a, unsigned int b) {
+        return keys[a] < keys[b];
+    });
+
+    // value entry number and result index of every key that was found
+    std::vector<std::pair<unsigned int, unsigned int>> hits;
+    hits.reserve(keys.size());
+
+    std::optional<KeyPageInterface> leaf;
+    long upper_bound = LONG_MAX;
+
+    // values read from the tree are only cached if nothing changed since the batch started
+    uint64_t epoch = record_cache ? record_cache->epoch() : 0;
+
+    for (unsigned int idx : order) {
+        long key = keys[idx];
+
+        if (record_cache && record_cache->get(key, res[idx])) {
+            continue;
+        }
+
+        // keys that don't get past the filter don't need their leaf at all
+        if (key_filter && !key_filter->may_contain(key)) {
+            filtered_lookups.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // only search from the root again once the keys leave the current leaf (letting go of it first, since latches are taken from the root down)
+        if (!leaf || key > upper_bound) {
+            leaf.reset();
+            leaf = find_leaf(key, &upper_bound);
+        }
+
+        unsigned int target = leaf->find_pos(key);
+        if (target < leaf->get_size() && leaf->get_key(target) == key) {
+            hits.push_back({leaf->get_child_ptr(target + 1), idx});
+        }
+    }
+    leaf.reset();
+
+    // read the values in storage order; entries on the same page are next to each other
+    std::sort(hits.begin(), hits.end());
+
+    ValuePageInterface value_iter(this);
+    unsigned int curr_page = NULL_PAGE;
+    std::optional<PinnedPage> page;
+
+    // the pages the values are on, in the order they are read, which are read ahead io_depth at a time
+    std::vector<unsigned int> pages;
+    for (const auto& hit : hits) {
+        unsigned int page_num = value_iter.page_of(hit.first);
+        if (pages.empty() || pages.back() != page_num) {
+            pages.push_back(page_num);
+        }
+    }
+    size_t page_idx = 0;
+
+    // keys whose value moved since its leaf was read (a slotted value overwritten by another thread)
+    std::vector<unsigned int> moved;
+
+    for (const auto& hit : hits) {
+        unsigned int page_num = value_iter.page_of(hit.first);
+        if (page_num != curr_page) {
+            page.reset();
+            if (page_idx % io_depth == 0) {
+                prefetch_pages(Value, std::vector<unsigned int>(pages.begin() + page_idx, pages.begin() + std::min(pages.size(), page_idx + io_depth)));
+            }
+            ++page_idx;
+
+            // bounds checks are done once per page by get_size
+            value_iter.get_size(page_num);
+            page.emplace(this, page_num, Value);
+            curr_page = page_num;
+        }
+
+        if (!value_iter.has_record(page->data(), hit.first)) {
+            moved.push_back(hit.second);
+            continue;
+        }
+        value_iter.read(page->data(), hit.first, &res[hit.second]);
+        if (record_cache) {
+            record_cache->put(keys[hit.second], res[hit.second], epoch);
+        }
+    }
+    page.reset();
+
+    for (unsigned int idx : moved) {
+        res[idx] = find(keys[idx]);
+    }
+
+    return res;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::insert_many(std::vector<std::pair<long, T>>& entries) {
+    // if read only, don't allow insertions
+    if (read_only) return;
+
+    // apply the pairs in sorted order; stable so the last copy of a key ends up last
+    std::vector<unsigned int> order(entries.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&entries](unsigned int a, unsigned int b) {
+        return entries[a].first < entries[b].first;
+    });
+
+    // the name index slots of the last copy of every key are taken before any leaf is latched (see insert); slots[i] belongs to order[i], and is emptied once it is settled
+    std::vector<std::optional<long>> slots(order.size());
+    try {
+        for (unsigned int i = 0; i < order.size(); ++i) {
+            if (i + 1 == order.size() || entries[order[i]].first != entries[order[i + 1]].first) {
+                slots[i] = name_index_add(entries[order[i]].second, entries[order[i]].first);
+            }
+        }
+    } catch (...) {
+        for (const auto& slot : slots) {
+            name_index_clear(slot);
+        }
+        throw;
+    }
+
+    // overwrites of existing values (entry number, position in order), applied at the end
+    std::vector<std::pair<unsigned int, unsigned int>> updates;
+
+    // the leaf the last key went into, latched exclusively
+    std::optional<KeyPageInterface> leaf;
+    long upper_bound = LONG_MAX;
+    ValuePageInterface value_iter(this);
+
+    // settles the slot of a pair once it is in the tree; called with no leaf latched
+    auto settle = [&](unsigned int i, bool overwritten, const T& old_value) {
+        std::optional<long> slot = slots[i];
+        slots[i].reset();
+        if (overwritten) {
+            name_index_replace(old_value, entries[order[i]].second, entries[order[i]].first, slot);
+        }
+    };
+
+    try {
+        for (unsigned int i = 0; i < order.size(); ++i) {
+            // skip all but the last copy of a key
+            if (i + 1 < order.size() && entries[order[i]].first == entries[order[i + 1]].first) {
+                continue;
+            }
+
+            long key = entries[order[i]].first;
+            T& value = entries[order[i]].second;
+
+            if (num_entries == 0) {
+                T old_value;
+                bool overwritten = place(key, value, old_value);
+                settle(i, overwritten, old_value);
+                continue;
+            }
+
+            // let go of the leaf before searching from the root again (and before writing back, which needs every latch released)
+            if (!leaf || key > upper_bound) {
+                leaf.reset();
+                write_back_dirty();
+                leaf = find_leaf(key, &upper_bound, ExclusiveLatch);
+            }
+
+            unsigned int target = leaf->find_pos(key);
+            if (target < leaf->get_size() && leaf->get_key(target) == key) {
+                updates.push_back({leaf->get_child_ptr(target + 1), i});
+            } else if (leaf->has_room_for(key)) {
+                // fits without splitting; add it straight to the leaf
+                if (key_filter) {
+                    key_filter->add(key);
+                }
+                leaf->push(key, value_iter.push(value));
+                slots[i].reset();
+            } else {
+                // needs a split; let place handle it and search again for the next key since the leaves changed
+                leaf.reset();
+                write_back_dirty();
+                T old_value;
+                bool overwritten = place(key, value, old_value);
+                settle(i, overwritten, old_value);
+            }
+        }
+        leaf.reset();
+
+        // apply overwrites in storage order; the entry numbers are looked up again under the leaf's latch, since another thread may have moved a value meanwhile
+        std::sort(updates.begin(), updates.end());
+        for (const auto& update : updates) {
+            long key = entries[order[update.second]].first;
+            T& value = entries[order[update.second]].second;
+
+            write_back_dirty();
+            T old_value;
+            {
+                KeyPageInterface leaf_iter = find_leaf(key, nullptr, ExclusiveLatch);
+                overwrite(leaf_iter, leaf_iter.find_pos(key), key, value, old_value);
+            }
+            settle(update.second, true, old_value);
+        }
+    } catch (...) {
+        // give back the slots of the pairs that didn't make it into the tree
+        leaf.reset();
+        for (const auto& slot : slots) {
+            name_index_clear(slot);
+        }
+        throw;
+    }
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::find_neighbor_leaf(long key, bool forward) {
+    KeyPageInterface iter = latch_root(SharedLatch);
+
+    // remember the separator closest to the starting leaf in the desired direction; deeper levels only narrow it
+    std::optional<long> bound;
+
+    while (iter.is_internal()) {
+        unsigned int target = iter.find_pos(key);
+        if (forward && target < iter.get_size()) {
+            bound = iter.get_key(target);
+        } else if (!forward && target > 0) {
+            bound = iter.get_key(target - 1);
+        }
+        iter = KeyPageInterface(iter.get_child_ptr(target), this, SharedLatch);
+    }
+
+    // the starting leaf is the first/last one
+    if (!bound) {
+        return NULL_PAGE;
+    }
+
+    // a separator is the largest key of the subtree to its left, so the next leaf starts just above it and the previous leaf ends with it
+    iter.unlatch();
+    return find_leaf(forward ? *bound + 1 : *bound).get_page_num();
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::Cursor BTreeDB<T, Layout>::lower_bound(long key) {
+    if (num_entries == 0) {
+        return Cursor();
+    }
+
+    KeyPageInterface leaf = find_leaf(key);
+    unsigned int pos = leaf.find_pos(key);
+    unsigned int size = leaf.get_size();
+    Cursor res(this, leaf, std::min(pos, size - 1));
+
+    // every key in this leaf is smaller; the answer is the first entry of the next leaf (which the cursor latches itself)
+    if (pos >= size) {
+        leaf.unlatch();
+        res.next();
+    }
+
+    return res;
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::Cursor BTreeDB<T, Layout>::first() {
+    return lower_bound(LONG_MIN);
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::Cursor BTreeDB<T, Layout>::last() {
+    if (num_entries == 0) {
+        return Cursor();
+    }
+
+    // always follow the rightmost child
+    KeyPageInterface iter = latch_root(SharedLatch);
+    while (iter.is_internal()) {
+        iter = KeyPageInterface(iter.get_child_ptr(iter.get_size()), this, SharedLatch);
+    }
+
+    return Cursor(this, iter, iter.get_size() - 1);
+}
+
+template <typename T, typename Layout>
+template <typename Callback>
+void BTreeDB<T, Layout>::scan(long lo, long hi, Callback callback) {
+    // the leaves read ahead last, and the leaf the scan is at
+    std::vector<unsigned int> ahead;
+    unsigned int curr_leaf = NULL_PAGE;
+
+    for (Cursor iter = lower_bound(lo); iter.valid() && iter.key() < hi; iter.next()) {
+        // on getting to a new leaf, read its values in batches, and the next leaves once the last ones run out
+        if (iter.leaf_->get_page_num() != curr_leaf) {
+            curr_leaf = iter.leaf_->get_page_num();
+            if (ahead.empty() || curr_leaf == ahead.back() || std::find(ahead.begin(), ahead.end(), curr_leaf) == ahead.end()) {
+                ahead = prefetch_leaves(iter.key(), hi);
+            }
+            prefetch_values(*iter.leaf_, hi);
+        }
+        callback(iter.key(), iter.value());
+    }
+}
+
+template <typename T, typename Layout>
+RecordCacheStats BTreeDB<T, Layout>::record_cache_stats() const {
+    return record_cache ? record_cache->stats() : RecordCacheStats();
+}
+
+template <typename T, typename Layout>
+BTreeStats BTreeDB<T, Layout>::stats() {
+    BTreeStats res;
+    res.entries = num_entries;
+    res.key_pages = num_key_pages;
+    res.value_pages = num_value_pages;
+
+    // every leaf is at the same depth, so the leftmost path has the height of the tree
+    if (num_entries > 0) {
+        KeyPageInterface iter = latch_root(SharedLatch);
+        res.height = 1;
+        while (iter.is_internal()) {
+            iter = KeyPageInterface(iter.get_child_ptr(0), this, SharedLatch);
+            ++res.height;
+        }
+    }
 
-                    @param size the value to set the size to
-                    @param page_num The page number to change the size for
-                */
-                void set_size(unsigned int size, unsigned int page_num);
-                
-            private:
-                BTreeDB* tree_;
-        };
+    res.cache = pool.stats();
+    res.pages_read = pages_read.load(std::memory_order_relaxed);
+    res.bytes_read = res.pages_read * Layout::page_size;
+    res.pages_written = pages_written.load(std::memory_order_relaxed);
+    res.bytes_written = res.pages_written * Layout::page_size;
+    res.writes = write_calls.load(std::memory_order_relaxed);
+    res.splits = key_splits.load(std::memory_order_relaxed);
+    res.filtered = filtered_lookups.load(std::memory_order_relaxed);
+    res.record_cache = record_cache_stats();
+    res.find_latency = find_latency.summary();
+    res.insert_latency = insert_latency.summary();
+    return res;
+}
 
-        /**
-            Creates a new keypage.
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::View::View(): tree_(nullptr), record_(nullptr), frame_(BufferPool::NO_FRAME) {}
 
-            @return A keypage interface for the newly created keypage
-        */
-        KeyPageInterface create_new_keypage(unsigned int num_cells, bool internal, bool is_root);
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::View::View(BTreeDB* tree, const char* record, unsigned int frame): tree_(tree), record_(record), frame_(frame) {}
 
-        /**
-            Helper function to write all dirty pages to disk.
-        */
-        void write_all();
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::View::View(BTreeDB* tree, std::shared_ptr<const T> value): tree_(tree), record_(nullptr), frame_(BufferPool::NO_FRAME), value_(value) {}
 
-        /**
-            Helper function to set the page_num page dirty for writeback.
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::View::View(const View& other): tree_(other.tree_), record_(other.record_), frame_(other.frame_), value_(other.value_) {
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.repin(frame_);
+    }
+}
 
-            @param page_num the page number to set dirty
-            @param type which cache to set dirty
-        */
-        void set_dirty(unsigned int page_num, FileType type);
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::View& BTreeDB<T, Layout>::View::operator=(const View& other) {
+    if (this == &other) {
+        return *this;
+    }
 
-        /**
-            Helper function to write a page_num to the file database.
+    // pin the new page before releasing the old one
+    if (other.frame_ != BufferPool::NO_FRAME) {
+        other.tree_->pool.repin(other.frame_);
+    }
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.unpin(frame_);
+    }
 
-            @param page_num the page number to write
-            @param type Specifies which database to write to
-        */
-        void write_page(unsigned int page_num, FileType type);
+    tree_ = other.tree_;
+    record_ = other.record_;
+    frame_ = other.frame_;
+    value_ = other.value_;
 
-        /**
-            Gets the actual data of a given page number. Handles cache misses and cache hits implicitly.
+    return *this;
+}
 
-            @param page_num The page being requested
-            @param type Whwether a key or value page is being requested
-            @return the character array representing the page's binary data
-        */
-        char* get_page(unsigned int page_num, FileType type);
-};
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::View::~View() {
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.unpin(frame_);
+    }
+}
 
-template <typename T>
-BTreeDB<T>::BTreeDB(const std::string& key_filename, const std::string& values_filename, bool create_new, bool read_only_opt): read_only(read_only_opt) {
-    // decare read/write streams for the db files and the metadata file (that stores the important member variables)
-    std::fstream fs_keys;
-    std::fstream fs_values;
-    std::fstream fs_meta;
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::View::valid() const {
+    return record_ != nullptr || value_ != nullptr;
+}
 
-    // construct name for metadata file from filenames
-    std::string metadata_file = key_filename.substr(0, key_filename.size() - 3) + values_filename.substr(0, values_filename.size() - 3) + ".txt";
+template <typename T, typename Layout>
+template <typename F>
+auto BTreeDB<T, Layout>::View::get() const {
+    static_assert(std::is_same<typename F::Owner, T>::value, "field belongs to a different entry type");
+    if (value_) {
+        return F::view(*value_);
+    }
+    return F::view(record_);
+}
 
-    if (create_new) {
-        // if creating a new BTreeDB, open with std::ios::trunc to create fresh files, overwriting any existing things
-        fs_keys.open(key_filename, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
-        fs_values.open(values_filename, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
-        fs_meta.open(metadata_file, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+template <typename T, typename Layout>
+T BTreeDB<T, Layout>::View::value() const {
+    if (value_) {
+        return *value_;
+    }
+    T res;
+    T::deserialize_value(record_, &res);
+    return res;
+}
 
-        // everything should be zero on new db
-        num_entries = num_key_pages = key_root = num_value_pages = 0;
-    } else {
-        // open normally without overwriting if not creating a new one
-        fs_keys.open(key_filename, std::ios::binary | std::ios::in | std::ios::out);
-        fs_values.open(values_filename, std::ios::binary | std::ios::in | std::ios::out);
-        fs_meta.open(metadata_file, std::ios::binary | std::ios::in | std::ios::out);
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::Cursor::Cursor(): tree_(nullptr), pos_(0), key_(0) {}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::Cursor::Cursor(BTreeDB* tree, const KeyPageInterface& leaf, unsigned int pos): tree_(tree), leaf_(leaf), pos_(pos), key_(leaf.get_key(pos)) {}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::Cursor::valid() const {
+    return leaf_.has_value();
+}
+
+template <typename T, typename Layout>
+long BTreeDB<T, Layout>::Cursor::key() const {
+    return key_;
+}
+
+template <typename T, typename Layout>
+T BTreeDB<T, Layout>::Cursor::value() const {
+    // the leaf is read under its latch, which also keeps a slotted value from moving away while it is read
+    leaf_->latch(SharedLatch);
+    if (in_place()) {
+        // leaf entries point at their value after the key
+        ValuePageInterface value_iter(tree_);
+        T res = value_iter.get_value(leaf_->get_child_ptr(pos_ + 1));
+        leaf_->unlatch();
+        return res;
     }
-    
-    // error handling for io errors
-    if (!fs_keys.is_open()) {
-        throw std::runtime_error("error reading/creating keys file");
+    leaf_->unlatch();
+
+    // a split moved the entry to another leaf
+    return tree_->find(key_);
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::Cursor::next() {
+    if (!valid()) {
+        return false;
     }
 
-    if (!fs_values.is_open()) {
-        throw std::runtime_error("error reading/creating values file");
+    leaf_->latch(SharedLatch);
+    if (!in_place()) {
+        // a split moved the entry to another leaf; search from the root for the one after it
+        leaf_->unlatch();
+        if (key_ == LONG_MAX) {
+            leaf_.reset();
+            return false;
+        }
+        *this = tree_->lower_bound(key_ + 1);
+        return valid();
     }
 
-    if (!fs_meta.is_open()) {
-        throw std::runtime_error("error reading/creating metadata file");
+    // still entries left in this leaf
+    if (pos_ + 1 < leaf_->get_size()) {
+        ++pos_;
+        key_ = leaf_->get_key(pos_);
+        leaf_->unlatch();
+        return true;
     }
 
-    // store handlers for values/keys using move semantics
-    value_handler = std::move(fs_values);
-    key_handler = std::move(fs_keys);
+    unsigned int next_page = tree_->has_leaf_links ? leaf_->get_next_leaf() : NULL_PAGE;
+    leaf_->unlatch();
 
-    if (!create_new) {
-        // if not creating a new file, read member variables from the metadata file
-        fs_meta >> num_entries;
-        fs_meta >> num_value_pages;
-        fs_meta >> num_key_pages;
-        fs_meta >> key_root;
+    // no links; search from the root instead
+    if (!tree_->has_leaf_links) {
+        next_page = tree_->find_neighbor_leaf(key_, true);
     }
 
-    if (!read_only) {
-        // if not read only, reset the metadata file to allow the storing of the new ones once finished
-        fs_meta.close();
-        fs_meta.open(metadata_file, std::ios::out | std::ios::trunc);
+    if (next_page == NULL_PAGE) {
+        leaf_.reset();
+        return false;
+    }
 
-        // store meta handler with move semantics
-        meta_handler = std::move(fs_meta);
+    KeyPageInterface next_leaf(next_page, tree_, SharedLatch);
+    move_to(next_leaf, 0);
+    return true;
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::Cursor::prev() {
+    if (!valid()) {
+        return false;
     }
 
-    // std::cout << num_entries << ' ' << num_value_pages << ' ' << num_key_pages << ' ' << key_root << std::endl;
+    leaf_->latch(SharedLatch);
+    if (!in_place()) {
+        // a split moved the entry to another leaf; find it again and step back from there
+        leaf_->unlatch();
+        *this = tree_->lower_bound(key_);
+        return prev();
+    }
 
-    // initialize empty array
-    for (unsigned int i = 0; i < PAGE_SIZE; ++i) {
-        empty_array[i] = 0;
+    // still entries left in this leaf
+    if (pos_ > 0) {
+        --pos_;
+        key_ = leaf_->get_key(pos_);
+        leaf_->unlatch();
+        return true;
     }
-}
 
-template <typename T>
-void BTreeDB<T>::write_all() {
+    unsigned int page_num = leaf_->get_page_num();
+    unsigned int prev_page = tree_->has_leaf_links ? leaf_->get_prev_leaf() : NULL_PAGE;
+    leaf_->unlatch();
 
-    // iterate over all key pages and write if dirty; also delete allocated data
-    for (auto& entry : key_cache) {
-        if (entry.second.data != nullptr && entry.second.dirty && !read_only) {
-            write_page(entry.first, Key);
-        } 
-        if (entry.second.data != nullptr) {
-            delete[] entry.second.data;
+    // the previous leaf can only be latched once this one is let go of, so it may have split in between; it has to still link to this leaf
+    std::optional<KeyPageInterface> prev_leaf;
+    if (prev_page != NULL_PAGE) {
+        prev_leaf.emplace(prev_page, tree_, SharedLatch);
+        if (prev_leaf->get_next_leaf() != page_num) {
+            prev_leaf.reset();
         }
-        
     }
-    
-    // iterate over all value pages and write if dirty; also delete allocated data
-    for (auto& entry : value_cache) {
-        if (entry.second.data != nullptr && entry.second.dirty && !read_only) {
-            write_page(entry.first, Value);
-        } 
-        if (entry.second.data != nullptr) {
-            delete[] entry.second.data;
+
+    // no links (or a stale one); search from the root instead
+    if (!prev_leaf && (!tree_->has_leaf_links || prev_page != NULL_PAGE)) {
+        prev_page = tree_->find_neighbor_leaf(key_, false);
+        if (prev_page != NULL_PAGE) {
+            prev_leaf.emplace(prev_page, tree_, SharedLatch);
         }
     }
 
-    // close handlers
-    key_handler.close();
-    value_handler.close();
-
-    if (read_only) {
-        return;
+    if (!prev_leaf) {
+        leaf_.reset();
+        return false;
     }
-    // store metadata member variables
-    meta_handler << num_entries << std::endl;
-    meta_handler << num_value_pages << std::endl;
-    meta_handler << num_key_pages << std::endl;
-    meta_handler << key_root << std::endl;
-    
-    meta_handler.close();
+
+    move_to(*prev_leaf, prev_leaf->get_size() - 1);
+    return true;
 }
 
-template <typename T>
-BTreeDB<T>::~BTreeDB() {
-    // on destruction, write all
-    write_all();
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::Cursor::in_place() const {
+    return pos_ < leaf_->get_size() && leaf_->get_key(pos_) == key_;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::Cursor::move_to(const KeyPageInterface& leaf, unsigned int pos) {
+    leaf_ = leaf;
+    pos_ = pos;
+    key_ = leaf.get_key(pos);
 }
 
-template <typename T>
-void BTreeDB<T>::insert(long key, T& value) {
+template <typename T, typename Layout>
+template <typename Iter>
+void BTreeDB<T, Layout>::bulk_load(Iter begin, Iter end, double fill_factor) {
     // if read only, don't allow insertions
     if (read_only) return;
 
-    // if there are no key pages, create a new keypage and push the value
-    if (num_key_pages == 0) {
-        KeyPageInterface key_iter = create_new_keypage(0, false, true);
-        ValuePageInterface value_iter(this);
-
-        key_iter.push(key, value_iter.push(value));
-
+    if (num_entries != 0 || num_key_pages != 0) {
+        throw std::runtime_error("bulk_load requires an empty database");
+    }
+    if (!(fill_factor > 0 && fill_factor <= 1)) {
+        throw std::runtime_error("bulk_load fill factor must be in (0, 1]");
+    }
+    if (begin == end) {
         return;
     }
 
-    // base page to perform binary search on
-    unsigned int curr_page = key_root;
-    KeyPageInterface key_iter(curr_page, this);
+    // pages split once they reach their capacity, so one key less (capacity children for internal pages) is completely full
+    unsigned int capacity = key_format == Delta ? Layout::delta_order : Layout::order;
+    unsigned int leaf_fill = std::max(1u, static_cast<unsigned int>((capacity - 1) * fill_factor));
+    unsigned int internal_fill = std::max(2u, static_cast<unsigned int>(capacity * fill_factor));
 
-    // keep track of call stack in case node splits are needed
-    std::stack<unsigned int> traversal;
+    ValuePageInterface value_iter(this);
 
-    // continue binary searching until we have reached a leaf node (which store values)
-    while (key_iter.is_internal()) {
-        traversal.push(key_iter.get_page_num());
-        // get the id to search w.r.t. binray search
-        unsigned int target = key_iter.find_pos(key);
-        // change the curr page
-        unsigned int next_page = key_iter.get_child_ptr(target);
-        key_iter = KeyPageInterface(next_page, this);
-    }
+    // page number and largest key of every page on the level currently being built
+    std::vector<std::pair<unsigned int, long>> level;
 
-    // get the final position to insert to
-    unsigned int target = key_iter.find_pos(key);
-    ValuePageInterface value_iter(this);
+    // name hash and id of every entry, indexed once everything is loaded
+    std::vector<std::pair<unsigned long, long>> names;
 
-    // check if id already exists; if so, overwrite it
-    if (target < key_iter.get_size() && key_iter.get_key(target) == key) {
-        value_iter.set_value(value, key_iter.get_child_ptr(target + 1));
+    // the value page being filled
+    unsigned int curr_value_page = NULL_PAGE;
 
-        return;
-    }
+    // nothing else uses the database while it is loaded, so nothing is latched
+    KeyPageInterface leaf = create_new_keypage(0, false, false, NoLatch);
+    level.push_back({leaf.get_page_num(), 0});
 
-    // id doesn't exist--make a new entry
-    key_iter.push(key, value_iter.push(value));
+    // appends a pair to the current leaf, starting a new leaf when it is full (or its keys can't be compressed together with this one)
+    auto append = [&](long key, T& value) {
+        write_back_dirty();
+        if (leaf.get_size() == leaf_fill || !leaf.fits(key)) {
+            KeyPageInterface next_leaf = create_new_keypage(0, false, false, NoLatch);
+            leaf.link_right(next_leaf);
 
-    // if we have reached the max key size, split
-    if (key_iter.get_size() == ORDER) {
-        // go through the call stack of nodes
-        while (!traversal.empty()) {
-            // stop when no more splitting needed
-            if (key_iter.get_size() != ORDER) {
-                break;
+            // the finished leaf will never change again, so write it out now
+            pool.flush_page(Key, leaf.get_page_num());
+            leaf = next_leaf;
+            level.push_back({leaf.get_page_num(), key});
+        }
+
+        unsigned int entry_num = value_iter.push(value);
+        leaf.push(key, entry_num);
+        level.back().second = key;
+
+        if constexpr (T::has_name_index) {
+            if (name_db) {
+                names.push_back({value.name_hash(), key});
+            }
+        }
+
+        // same for value pages once the values have moved on to the next one
+        unsigned int value_page = value_iter.page_of(entry_num);
+        if (value_page != curr_value_page) {
+            if (curr_value_page != NULL_PAGE) {
+                pool.flush_page(Value, curr_value_page);
             }
-            // do the splitting logic for nodes with a parent
-            KeyPageInterface curr(traversal.top(), this);
-            traversal.pop();
-            key_iter.split_page(curr);
-            key_iter = curr;
+            curr_value_page = value_page;
+        }
+    };
+
+    // hold back one pair so that runs of the same key collapse into the last one
+    long pending_key = begin->first;
+    T pending_value = begin->second;
+    ++begin;
+
+    for (; begin != end; ++begin) {
+        long key = begin->first;
+        if (key == pending_key) {
+            pending_value = begin->second;
+            continue;
+        }
+        if (key < pending_key) {
+            throw std::runtime_error("bulk_load input is not sorted by key");
         }
-        // split a node that doesn't have a parent -- only happens when call stack is fully traversed
-        if (key_iter.get_size() == ORDER) {
-                key_iter.split_page();
+
+        append(pending_key, pending_value);
+        pending_key = key;
+        pending_value = begin->second;
+    }
+    append(pending_key, pending_value);
+    pool.flush_page(Key, leaf.get_page_num());
+
+    // build the internal levels bottom-up until only the root is left
+    while (level.size() > 1) {
+        std::vector<std::pair<unsigned int, long>> next_level;
+
+        for (size_t i = 0; i < level.size(); ) {
+            size_t count = std::min<size_t>(internal_fill, level.size() - i);
+            // don't leave a single child for the last page of the level
+            if (level.size() - i - count == 1 && count > 2) {
+                --count;
+            }
+
+            // children are separated by the largest key of the child to their left (equal keys go left)
+            KeyPageInterface node = create_new_keypage(0, true, false, NoLatch);
+            node.set_child_ptr(level[i].first, 0);
+            for (size_t j = 1; j < count; ++j) {
+                // end the page early rather than let it lose its compression
+                if (!node.fits(level[i + j - 1].second)) {
+                    count = j;
+                    break;
+                }
+                node.push(level[i + j - 1].second, level[i + j].first);
+            }
+
+            next_level.push_back({node.get_page_num(), level[i + count - 1].second});
+            pool.flush_page(Key, node.get_page_num());
+            i += count;
         }
+
+        level = std::move(next_level);
+    }
+
+    KeyPageInterface root(level[0].first, this);
+    root.set_root(true);
+    key_root = root.get_page_num();
+
+    name_index_add_all(names);
+
+    // now that the number of keys is known, the filter can be sized for them
+    if (key_filter) {
+        rebuild_key_filter(key_filter->bits_per_key());
     }
 }
 
-template <typename T>
-T BTreeDB<T>::find(long key) {
-    // can't find on an empty datbaase
-    if (num_entries == 0) {
-        write_all();
-        throw std::runtime_error("database is empty");
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::KeyPageInterface::KeyPageInterface(unsigned int page_num, BTreeDB* tree, LatchMode latch): page_num_(page_num), tree_(tree), latch_(NoLatch) {
+    // keep the page in memory for as long as this interface exists
+    frame_ = tree_->pin_page(page_num_, Key);
+    this->latch(latch);
+}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::KeyPageInterface::KeyPageInterface(unsigned int page_num, BTreeDB* tree, unsigned int frame, LatchMode latch): page_num_(page_num), tree_(tree), frame_(frame), latch_(latch) {}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::KeyPageInterface::KeyPageInterface(const KeyPageInterface& other): page_num_(other.page_num_), tree_(other.tree_), frame_(other.frame_), latch_(NoLatch) {
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.repin(frame_);
     }
+}
 
-    // base page to do binary search on
-    unsigned int curr_page = key_root;
-    KeyPageInterface iter(curr_page, this);
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::KeyPageInterface::KeyPageInterface(KeyPageInterface&& other) noexcept: page_num_(other.page_num_), tree_(other.tree_), frame_(other.frame_), latch_(other.latch_) {
+    other.frame_ = BufferPool::NO_FRAME;
+    other.latch_ = NoLatch;
+}
 
-    // continue binary search until we have reached a leaf node (which stores values)
-    while (iter.is_internal()) {
-        unsigned int target = iter.find_pos(key);
-        unsigned int next_page = iter.get_child_ptr(target);
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::KeyPageInterface& BTreeDB<T, Layout>::KeyPageInterface::operator=(const KeyPageInterface& other) {
+    if (this == &other) {
+        return *this;
+    }
 
-        iter = KeyPageInterface(next_page, this);
+    // pin the new page before releasing the old one
+    if (other.frame_ != BufferPool::NO_FRAME) {
+        other.tree_->pool.repin(other.frame_);
+    }
+    unlatch();
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.unpin(frame_);
     }
 
-    // target id to search
-    unsigned int target = iter.find_pos(key);
+    page_num_ = other.page_num_;
+    tree_ = other.tree_;
+    frame_ = other.frame_;
+    return *this;
+}
 
-    ValuePageInterface value_iter(this);
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::KeyPageInterface& BTreeDB<T, Layout>::KeyPageInterface::operator=(KeyPageInterface&& other) {
+    if (this == &other) {
+        return *this;
+    }
 
-    // if id is present at the id, return it
-    if (target < iter.get_size() && iter.get_key(target) == key) {
-        return value_iter.get_value(iter.get_child_ptr(target + 1));
+    unlatch();
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.unpin(frame_);
     }
 
-    // if not, return a default struct
-    return T();
+    page_num_ = other.page_num_;
+    tree_ = other.tree_;
+    frame_ = other.frame_;
+    latch_ = other.latch_;
+    other.frame_ = BufferPool::NO_FRAME;
+    other.latch_ = NoLatch;
+    return *this;
+}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::KeyPageInterface::~KeyPageInterface() {
+    unlatch();
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.unpin(frame_);
+    }
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::latch(LatchMode mode) const {
+    tree_->pool.latch(frame_, mode);
+    latch_ = mode;
 }
 
-template <typename T>
-BTreeDB<T>::KeyPageInterface::KeyPageInterface(unsigned int page_num, BTreeDB* tree): page_num_(page_num), tree_(tree) {}
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::unlatch() const {
+    tree_->pool.unlatch(frame_, latch_);
+    latch_ = NoLatch;
+}
 
-template <typename T>
-unsigned int BTreeDB<T>::KeyPageInterface::get_size() const {
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::get_size() const {
     // extract size from key page (first 4 bytes of header)
     unsigned int res;
     memcpy(&res, get_data(), 4);
     return res;
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::set_size(unsigned int x) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::set_size(unsigned int x) {
     // set size from key page (first 4 bytes of header)
     memcpy(get_data(), &x, 4);
     // set dirty
     handle_set();
 }
 
-template <typename T>
-bool BTreeDB<T>::KeyPageInterface::is_internal() const {
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::KeyPageInterface::is_internal() const {
     // get whether the page is internal (5th byte of header)
     char res;
     memcpy(&res, get_data() + 4, 1);
     return res == 1;
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::set_internal(bool x) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::set_internal(bool x) {
     // set whether the page is internal (5th byte of header)
     char temp = x;
     memcpy(get_data() + 4, &temp, 1);
     handle_set();
 }
 
-template <typename T>
-bool BTreeDB<T>::KeyPageInterface::is_root() const {
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::KeyPageInterface::is_root() const {
     // get whether the page is the root (6th byte)
     char res;
     memcpy(&res, get_data() + 5, 1);
     return res == 1;
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::set_root(bool x) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::set_root(bool x) {
     // set whether the page is the root (6th byte)
     char temp = x;
     memcpy(get_data() + 5, &temp, 1);
     handle_set();
 }
 
-template <typename T>
-long BTreeDB<T>::KeyPageInterface::get_key(unsigned int entry_num) const {
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::get_next_leaf() const {
+    // next leaf pointer is bytes 8-11 of the header
+    unsigned int res;
+    memcpy(&res, get_data() + 8, 4);
+    return res;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::set_next_leaf(unsigned int page_num) {
+    memcpy(get_data() + 8, &page_num, 4);
+    handle_set();
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::get_prev_leaf() const {
+    // previous leaf pointer is bytes 12-15 of the header
+    unsigned int res;
+    memcpy(&res, get_data() + 12, 4);
+    return res;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::set_prev_leaf(unsigned int page_num) {
+    memcpy(get_data() + 12, &page_num, 4);
+    handle_set();
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::link_right(KeyPageInterface& right) {
+    if (!tree_->has_leaf_links || is_internal()) {
+        return;
+    }
+
+    // splice the new page in between this page and its old right neighbor
+    unsigned int old_next = get_next_leaf();
+    right.set_next_leaf(old_next);
+    right.set_prev_leaf(page_num_);
+    set_next_leaf(right.get_page_num());
+
+    // latches are taken left to right along the leaves, so the old neighbor can be latched while this page is
+    if (old_next != NULL_PAGE) {
+        KeyPageInterface after(old_next, tree_, ExclusiveLatch);
+        after.set_prev_leaf(right.get_page_num());
+    }
+}
+
+template <typename T, typename Layout>
+long BTreeDB<T, Layout>::KeyPageInterface::get_key(unsigned int entry_num) const {
     // if trying to get an entry that is out of bounds of the current page, throw an exception
     if (entry_num >= get_size()) {
-        tree_->write_all();
         std::cout << entry_num << ' ' << get_size() << std::endl;
         throw std::runtime_error("entry num out of bounds key");
     }
 
-    // get the the address of the desired key
-    char* curr = get_data();
-    curr += HEADER_SIZE;
-    curr += 4;
-    curr += entry_num * KEYENTRY_SIZE;
+    char* data = get_data();
+    if (is_delta(data)) {
+        // unsigned math so that keys far from 0 can't overflow
+        return static_cast<long>(static_cast<unsigned long>(get_base(data)) + load_delta(data + DELTA_KEYS_OFFSET, entry_num));
+    }
 
     // copy in the key data into a dummy long and return it
     long res;
-    memcpy(&res, curr, 8);
+    memcpy(&res, key_addr(data, entry_num), 8);
+    return res;
+}
+
+template <typename T, typename Layout>
+char* BTreeDB<T, Layout>::KeyPageInterface::key_addr(char* data, unsigned int entry_num) const {
+    if (tree_->key_format == Interleaved) {
+        // keys come after the first child pointer, one per cell
+        return data + HEADER_SIZE + 4 + entry_num * KEYENTRY_SIZE;
+    }
+    // pages with compressed keys that had to be widened use the split layout
+    return data + HEADER_SIZE + entry_num * 8;
+}
+
+template <typename T, typename Layout>
+char* BTreeDB<T, Layout>::KeyPageInterface::ptr_addr(char* data, unsigned int entry_num) const {
+    if (tree_->key_format == Interleaved) {
+        // the first child pointer is right after the header and the rest are at the end of each cell
+        return data + HEADER_SIZE + entry_num * KEYENTRY_SIZE;
+    }
+    if (is_delta(data)) {
+        return data + Layout::delta_ptr_offset + entry_num * 4;
+    }
+    return data + Layout::split_ptr_offset + entry_num * 4;
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::KeyPageInterface::is_delta(const char* data) const {
+    return tree_->key_format == Delta && data[6] == DELTA_PAGE;
+}
+
+template <typename T, typename Layout>
+long BTreeDB<T, Layout>::KeyPageInterface::get_base(const char* data) {
+    long res;
+    memcpy(&res, data + HEADER_SIZE, 8);
     return res;
 }
 
-template <typename T>
-unsigned int BTreeDB<T>::KeyPageInterface::get_page_num() const  {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::rebase(char* data, long base) {
+    unsigned long old_base = get_base(data);
+    char* deltas = data + DELTA_KEYS_OFFSET;
+    unsigned int num_cells = get_size();
+
+    for (unsigned int i = 0; i < num_cells; ++i) {
+        unsigned int delta = static_cast<unsigned int>(old_base + load_delta(deltas, i) - static_cast<unsigned long>(base));
+        memcpy(deltas + i * 4, &delta, 4);
+    }
+    memcpy(data + HEADER_SIZE, &base, 8);
+    handle_set();
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::capacity() const {
+    return is_delta(get_data()) ? Layout::delta_order : Layout::order;
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::KeyPageInterface::fits(long key) const {
+    unsigned int num_cells = get_size();
+    if (!is_delta(get_data()) || num_cells == 0) {
+        return true;
+    }
+
+    long low = std::min(key, get_key(0));
+    long high = std::max(key, get_key(num_cells - 1));
+    return static_cast<unsigned long>(high) - static_cast<unsigned long>(low) <= UINT_MAX;
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::KeyPageInterface::has_room_for(long key) const {
+    unsigned int num_cells = get_size();
+    if (!is_internal() && fits(key)) {
+        return num_cells + 1 < capacity();
+    }
+
+    // a key that doesn't fit widens the page to the split layout, which is split once it has Layout::order keys
+    return num_cells + 1 < Layout::order;
+}
+
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::KeyPageInterface::keys_fit(const long* keys, unsigned int n) {
+    return n == 0 || static_cast<unsigned long>(keys[n - 1]) - static_cast<unsigned long>(keys[0]) <= UINT_MAX;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::load(long* keys, unsigned int* ptrs) const {
+    unsigned int num_cells = get_size();
+    for (unsigned int i = 0; i < num_cells; ++i) {
+        keys[i] = get_key(i);
+    }
+    for (unsigned int i = 0; i <= num_cells; ++i) {
+        ptrs[i] = get_child_ptr(i);
+    }
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::store(const long* keys, const unsigned int* ptrs, unsigned int n, bool compress) {
+    char* data = get_data();
+    memset(data + HEADER_SIZE, 0, Layout::page_size - HEADER_SIZE);
+    data[6] = compress ? DELTA_PAGE : -1;
+
+    if (compress) {
+        long base = n > 0 ? keys[0] : 0;
+        memcpy(data + HEADER_SIZE, &base, 8);
+        for (unsigned int i = 0; i < n; ++i) {
+            unsigned int delta = static_cast<unsigned int>(static_cast<unsigned long>(keys[i]) - static_cast<unsigned long>(base));
+            memcpy(data + DELTA_KEYS_OFFSET + i * 4, &delta, 4);
+        }
+    } else {
+        for (unsigned int i = 0; i < n; ++i) {
+            memcpy(key_addr(data, i), &keys[i], 8);
+        }
+    }
+    for (unsigned int i = 0; i <= n; ++i) {
+        memcpy(ptr_addr(data, i), &ptrs[i], 4);
+    }
+
+    set_size(n);
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::get_page_num() const  {
     return page_num_;
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::insert(long key, unsigned int child_ptr, unsigned int loc) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::insert(long key, unsigned int child_ptr, unsigned int loc) {
     // get current size
     unsigned int num_cells = get_size();
 
-    // move to where we need to insert
-    char* curr = get_data();
-    curr += HEADER_SIZE;
-    curr += 4;
+    char* data = get_data();
 
-    curr += loc * KEYENTRY_SIZE;
+    if (is_delta(data)) {
+        // the key is known to fit, but the base may have to move down to it (or up to the first key, if the key is far above the base)
+        long base = get_base(data);
+        if (key < base || static_cast<unsigned long>(key) - static_cast<unsigned long>(base) > UINT_MAX) {
+            base = std::min(key, get_key(0));
+            rebase(data, base);
+        }
+
+        char* deltas = data + DELTA_KEYS_OFFSET;
+        memmove(deltas + (loc + 1) * 4, deltas + loc * 4, (num_cells - loc) * 4);
+        memmove(ptr_addr(data, loc + 2), ptr_addr(data, loc + 1), (num_cells - loc) * 4);
+
+        unsigned int delta = static_cast<unsigned int>(static_cast<unsigned long>(key) - static_cast<unsigned long>(base));
+        memcpy(deltas + loc * 4, &delta, 4);
+        memcpy(ptr_addr(data, loc + 1), &child_ptr, 4);
+
+        set_size(num_cells + 1);
+        return;
+    }
 
     // move entries where we are tryign to insert to the right (using memmove to account for overlaps)
-    memmove(curr + KEYENTRY_SIZE, curr, (num_cells - loc) * KEYENTRY_SIZE);
+    if (tree_->key_format != Interleaved) {
+        memmove(key_addr(data, loc + 1), key_addr(data, loc), (num_cells - loc) * 8);
+        memmove(ptr_addr(data, loc + 2), ptr_addr(data, loc + 1), (num_cells - loc) * 4);
+    } else {
+        memmove(key_addr(data, loc + 1), key_addr(data, loc), (num_cells - loc) * KEYENTRY_SIZE);
+    }
 
     // copying in the data to be inserted into its right position
-    memcpy(curr, &key, 8);
-    memcpy(curr + 8, &child_ptr, 4);
-    
+    memcpy(key_addr(data, loc), &key, 8);
+    memcpy(ptr_addr(data, loc + 1), &child_ptr, 4);
+
     // increment size
     set_size(num_cells + 1);
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::push(long key, unsigned int child_ptr) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::push(long key, unsigned int child_ptr) {
     // getting size
     unsigned int num_cells = get_size();
 
+    if (!fits(key)) {
+        // the keys can't be compressed anymore; switch to the split layout, which doesn't care how far apart they are
+        if (num_cells >= Layout::order) {
+            throw std::runtime_error("key page too full to widen");
+        }
+
+        std::vector<long> keys(num_cells);
+        std::vector<unsigned int> ptrs(num_cells + 1);
+        load(keys.data(), ptrs.data());
+        store(keys.data(), ptrs.data(), num_cells, false);
+    }
+
     if (num_cells == 0) {
         // if page is empty, just write to first key/ptr position
-        char* curr = get_data();
-        curr += HEADER_SIZE;
-        curr += 4;
-
-        memcpy(curr, &key, 8);
-        memcpy(curr + 8, &child_ptr, 4);
+        char* data = get_data();
+        if (is_delta(data)) {
+            memcpy(data + HEADER_SIZE, &key, 8);
+            memset(data + DELTA_KEYS_OFFSET, 0, 4);
+        } else {
+            memcpy(key_addr(data, 0), &key, 8);
+        }
+        memcpy(ptr_addr(data, 1), &child_ptr, 4);
     } else {
         // otherwise, get the correct binary search position and insert there
         unsigned int pos = find_pos(key);
@@ -756,81 +3245,95 @@ void BTreeDB<T>::KeyPageInterface::push(long key, unsigned int child_ptr) {
     set_size(num_cells + 1);
 }
 
-template <typename T>
-unsigned int BTreeDB<T>::KeyPageInterface::get_child_ptr(unsigned int entry_num) const {
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::get_child_ptr(unsigned int entry_num) const {
     // if trying to query out of bounds, throw an exception
     if (entry_num > get_size()) {
-        tree_->write_all();
         throw std::runtime_error("entry num out of bounds childptr get");
     }
 
-    // get to the address of the desired child ponter
-    char* curr = get_data();
-    curr += HEADER_SIZE; // get past headers
-
-    if (entry_num != 0) {
-        // 1st child pointer is already here; other wise need to do an offset to reach the desired pointer address
-        curr += 4;
-        curr += (entry_num - 1) * KEYENTRY_SIZE;
-        curr += 8;
-    }
-
     // copy the pointer number into a dummy variable and return it
     unsigned int res;
-    memcpy(&res, curr, 4);
+    memcpy(&res, ptr_addr(get_data(), entry_num), 4);
     return res;
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::set_child_ptr(unsigned int target, unsigned int entry_num) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::set_child_ptr(unsigned int target, unsigned int entry_num) {
     // if trying to access out of bounds, throw an exception
     if (entry_num > get_size()) {
-        tree_->write_all();
-        throw std::runtime_error("entry num out of bounds childptr set");
-    }
-
-    //get to the address of the desired pointer
-    char* curr = get_data();
-    curr += HEADER_SIZE; // get past headers
-
-    if (entry_num != 0) {
-        curr += 4;
-        curr += (entry_num - 1) * KEYENTRY_SIZE;
-        curr += 8;
+        throw std::runtime_error("entry num out of bounds childptr set");
     }
 
     // overwrite the existing value
-    memcpy(curr, &target, 4);
+    memcpy(ptr_addr(get_data(), entry_num), &target, 4);
     handle_set();
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::move_keys(KeyPageInterface& other) {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::move_keys(KeyPageInterface& other) {
     // the offset to reach the middle of the key page, which is the pivot of the moving
-    static const unsigned int offset = HEADER_SIZE + 4 + (ORDER / 2) * KEYENTRY_SIZE;
+    static const unsigned int offset = HEADER_SIZE + 4 + (Layout::order / 2) * KEYENTRY_SIZE;
+    static const unsigned int middle = Layout::order / 2;
     
     // get pointers to the two pages
     char* source = get_data();
     char* target = other.get_data();
 
-    if (is_internal()) {
+    if (tree_->key_format == Delta) {
+        // pages of any size can be split, and each half is compressed again if its keys allow it
+        unsigned int num_cells = get_size();
+        unsigned int half = num_cells / 2;
+        std::vector<long> keys(num_cells);
+        std::vector<unsigned int> ptrs(num_cells + 1);
+        load(keys.data(), ptrs.data());
+
+        // internal pages give up the middle key, leaves keep it; leaves don't use their first child pointer
+        unsigned int kept = is_internal() ? half : half + 1;
+        std::vector<unsigned int> right_ptrs;
+        if (is_internal()) {
+            right_ptrs.assign(ptrs.begin() + half + 1, ptrs.end());
+        } else {
+            right_ptrs.push_back(0);
+            right_ptrs.insert(right_ptrs.end(), ptrs.begin() + half + 2, ptrs.end());
+        }
+
+        other.store(keys.data() + half + 1, right_ptrs.data(), num_cells - half - 1, keys_fit(keys.data() + half + 1, num_cells - half - 1));
+        store(keys.data(), ptrs.data(), kept, keys_fit(keys.data(), kept));
+    } else if (tree_->key_format == Split) {
+        // same split as below, but the keys and child pointers are moved as two separate arrays
+        // internal pages give up the middle key (it goes to the parent), leaves keep it
+        unsigned int num_moved = Layout::order - (middle + 1);
+        unsigned int first_ptr = is_internal() ? middle + 1 : middle + 2;
+        unsigned int target_ptr = is_internal() ? 0 : 1;
+        unsigned int kept = is_internal() ? middle : middle + 1;
+
+        memcpy(key_addr(target, 0), key_addr(source, middle + 1), num_moved * 8);
+        memcpy(ptr_addr(target, target_ptr), ptr_addr(source, first_ptr), (Layout::order + 1 - first_ptr) * 4);
+
+        memset(key_addr(source, kept), 0, (Layout::order - kept) * 8);
+        memset(ptr_addr(source, kept + 1), 0, (Layout::order - kept) * 4);
+
+        set_size(kept);
+        other.set_size(num_moved);
+    } else if (is_internal()) {
         // copy the latter half of the key/children to the other key page (skipping the first key for alignment)
-        memcpy(target + HEADER_SIZE, source + offset + 8, PAGE_SIZE - (offset + 8));
+        memcpy(target + HEADER_SIZE, source + offset + 8, Layout::page_size - (offset + 8));
         // replace the moved key files in the original key page with nothing, erase the middle key
-        memcpy(source + offset, tree_->empty_array, PAGE_SIZE - (offset + 8));
+        memcpy(source + offset, tree_->empty_array, Layout::page_size - (offset + 8));
 
         // update size
-        set_size(ORDER / 2);
-        other.set_size(ORDER / 2);
+        set_size(Layout::order / 2);
+        other.set_size(Layout::order / 2);
     } else {
         // copy the latter half of the key/children to the other key page (skipping the first pointer)
-        memcpy(target + HEADER_SIZE + 4, source + offset + KEYENTRY_SIZE, PAGE_SIZE - offset - KEYENTRY_SIZE);
+        memcpy(target + HEADER_SIZE + 4, source + offset + KEYENTRY_SIZE, Layout::page_size - offset - KEYENTRY_SIZE);
         // replace the moved key files in the original key page with nothing; keep the middle key
-        memcpy(source + offset + KEYENTRY_SIZE, tree_->empty_array, PAGE_SIZE - (offset + KEYENTRY_SIZE));
+        memcpy(source + offset + KEYENTRY_SIZE, tree_->empty_array, Layout::page_size - (offset + KEYENTRY_SIZE));
 
         // update size
-        set_size(ORDER / 2 + 1);
-        other.set_size(ORDER / 2);
+        set_size(Layout::order / 2 + 1);
+        other.set_size(Layout::order / 2);
     }
 
     // set everything to dirty
@@ -838,40 +3341,71 @@ void BTreeDB<T>::KeyPageInterface::move_keys(KeyPageInterface& other) {
     other.handle_set();
 }
 
-template <typename T>
-char* BTreeDB<T>::KeyPageInterface::get_data() const {
+template <typename T, typename Layout>
+char* BTreeDB<T, Layout>::KeyPageInterface::get_data() const {
+    // pinned pages can't move, so go straight to the frame
+    if (frame_ != BufferPool::NO_FRAME) {
+        return tree_->pool.frame_data(frame_);
+    }
     return tree_->get_page(page_num_, Key);
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::handle_set()  {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::KeyPageInterface::handle_set()  {
     // set the cache block to dirty for writeback later
     tree_->set_dirty(page_num_, Key);
 }
 
-template <typename T>
-BTreeDB<T>::ValuePageInterface::ValuePageInterface(BTreeDB* tree): tree_(tree) {}
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::PinnedPage::PinnedPage(BTreeDB* tree, unsigned int page_num, FileType type, LatchMode latch, bool create): tree_(tree), latch_(latch) {
+    frame_ = create ? tree_->pool.create(type, page_num) : tree_->pin_page(page_num, type);
+    tree_->pool.latch(frame_, latch_);
+    data_ = frame_ == BufferPool::NO_FRAME ? tree_->get_page(page_num, type) : tree_->pool.frame_data(frame_);
+}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::PinnedPage::~PinnedPage() {
+    tree_->pool.unlatch(frame_, latch_);
+    if (frame_ != BufferPool::NO_FRAME) {
+        tree_->pool.unpin(frame_);
+    }
+}
+
+template <typename T, typename Layout>
+char* BTreeDB<T, Layout>::PinnedPage::data() const {
+    return data_;
+}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>::ValuePageInterface::ValuePageInterface(BTreeDB* tree): tree_(tree) {}
 
-template <typename T>
-T BTreeDB<T>::ValuePageInterface::get_value(unsigned int entry_num) const {
+template <typename T, typename Layout>
+T BTreeDB<T, Layout>::ValuePageInterface::get_value(unsigned int entry_num) const {
     // if querying out of bounds, throw an excpetion
     // page num is the entry num divided by the number of values per page
-    unsigned int page_num = entry_num / tree_->values_per_page;
+    unsigned int page_num = page_of(entry_num);
     if (page_num >= tree_->num_value_pages) {
-        tree_->write_all();
         throw std::runtime_error("entry num out of bounds for pages value get");
     }
 
+    // the page is pinned while it is read, since other threads may be using the cache
+    if (tree_->value_format == Slotted) {
+        PinnedPage page(tree_, page_num, Value);
+        T res;
+        read(page.data(), entry_num, &res);
+        return res;
+    }
+
     // specific entry num in a page is the entry num moduloed by the number of values per page
     unsigned int target = entry_num % tree_->values_per_page;
     if (target >= get_size(page_num)) {
-        tree_->write_all();
         std::cout << "data: " << page_num << ' ' << entry_num << ' ' << target << ' ' << get_size(page_num) << std::endl;
         throw std::runtime_error("entry_num out of bounds for specific page value get");
     }
 
     // get to the desired address
-    char* data = tree_->get_page(page_num, Value);
+    PinnedPage page(tree_, page_num, Value);
+    char* data = page.data();
     data += 4; // get past size header
 
     data += target * T::size;
@@ -883,18 +3417,59 @@ T BTreeDB<T>::ValuePageInterface::get_value(unsigned int entry_num) const {
     return res;
 }
 
-template <typename T>
-void BTreeDB<T>::ValuePageInterface::set_value(T& entry, unsigned int entry_num) {
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::set_value(T& entry, unsigned int entry_num) {
     // if querying out of bounds, throw an exception
-    unsigned int page_num = entry_num / tree_->values_per_page;
+    unsigned int page_num = page_of(entry_num);
     if (page_num >= tree_->num_value_pages) {
-        tree_->write_all();
         throw std::runtime_error("entry num out of bounds value set");
     }
 
+    // the record is encoded before taking the lock, so that only the change itself waits for other inserts
+    std::vector<char> record;
+    if (tree_->value_format == Slotted) {
+        T::encode_value(entry, record);
+    }
+
+    // records of other entries on the page may move (and the page may be appended to), so changes are made one at a time
+    std::lock_guard<std::mutex> lock(tree_->value_mutex);
+
+    if (tree_->value_format == Slotted) {
+        {
+            PinnedPage page(tree_, page_num, Value, ExclusiveLatch);
+            char* data = page.data();
+            unsigned int slot = entry_num & ((1u << SLOT_BITS) - 1);
+            unsigned int len;
+            char* curr = const_cast<char*>(slotted_record(data, slot, &len));
+            tree_->set_dirty(page_num, Value);
+
+            // same size or smaller; overwrite in place
+            if (record.size() <= len) {
+                memcpy(curr, record.data(), record.size());
+                unsigned short new_len = record.size();
+                memcpy(data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE + 2, &new_len, 2);
+                return entry_num;
+            }
+
+            // bigger; free the old record and put the new one in the free space of the page if it (or the page once compacted) has room
+            memset(data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE, 0, SLOT_SIZE);
+            if (free_space(data) < record.size()) {
+                compact(data);
+            }
+            if (free_space(data) >= record.size()) {
+                place(data, slot, record);
+                return entry_num;
+            }
+        }
+
+        // the page is full; the slot stays empty and the record moves to the end (which may be this page, so it has to be unlatched first)
+        return append(record);
+    }
+
     // get to the target address
     unsigned int target = entry_num % tree_->values_per_page;
-    char* data = tree_->get_page(page_num, Value);
+    PinnedPage page(tree_, page_num, Value, ExclusiveLatch);
+    char* data = page.data();
     data += 4; // get past size header
 
     data += target * T::size;
@@ -903,123 +3478,341 @@ void BTreeDB<T>::ValuePageInterface::set_value(T& entry, unsigned int entry_num)
     T::serialize_value(&entry, data);
     // set the cache block to dirty
     tree_->set_dirty(page_num, Value);
+
+    return entry_num;
 }
 
-template <typename T>
-unsigned int BTreeDB<T>::ValuePageInterface::push(T& entry) {
-    // increase the number of entries
-    tree_->num_entries += 1;
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::push(T& entry) {
+    // the record is encoded before taking the lock, so that only the append waits for other inserts
+    std::vector<char> record;
+    if (tree_->value_format == Slotted) {
+        T::encode_value(entry, record);
+    }
 
-    if (tree_->num_value_pages == 0 || get_size(tree_->num_value_pages - 1) == tree_->values_per_page) {
-        // if db is empty or the current last page of the values db is full, make a new page and 0-initialize it
-        std::array<char, PAGE_SIZE> new_value_page;
-        new_value_page.fill(DEFAULT_VAL);
+    // every new value goes at the end of the file, so they are added one at a time
+    std::lock_guard<std::mutex> lock(tree_->value_mutex);
 
-        //allocate heap memory to store this newly created page
-        tree_->value_cache[tree_->num_value_pages].data = new char[PAGE_SIZE];
-        memcpy(tree_->value_cache[tree_->num_value_pages].data, new_value_page.data(), PAGE_SIZE);
+    // the number of entries only goes up once the value is in, so a failed append leaves it as it was
+    if (tree_->value_format == Slotted) {
+        unsigned int entry_num = append(record);
+        tree_->num_entries += 1;
+        return entry_num;
+    }
 
+    // if db is empty or the current last page of the values db is full, make a new (0-initialized) page
+    // it only lives in the cache until it is evicted or flushed
+    bool create = tree_->num_value_pages == 0 || get_size(tree_->num_value_pages - 1) == tree_->values_per_page;
+    unsigned int page_num = create ? tree_->num_value_pages.load() : tree_->num_value_pages - 1;
+    PinnedPage page(tree_, page_num, Value, ExclusiveLatch, create);
+    if (create) {
         // increment number of values pages
         tree_->num_value_pages += 1;
-    } 
-    
-    // set the size and value of this new page and set it to dirty for writeback
-    set_size(get_size(tree_->num_value_pages - 1) + 1, tree_->num_value_pages - 1);
-    set_value(entry, tree_->num_entries - 1);
-    tree_->set_dirty(tree_->num_value_pages - 1, Value);
+    }
+
+    // add the value after the last one of the page, then update the page's size and set it to dirty for writeback
+    unsigned int size;
+    memcpy(&size, page.data(), 4);
+    T::serialize_value(&entry, page.data() + 4 + size * T::size);
+    ++size;
+    memcpy(page.data(), &size, 4);
+    tree_->set_dirty(page_num, Value);
+    tree_->num_entries += 1;
 
     // return the entry num of the pushed value
-    return tree_->num_entries - 1;
+    return page_num * tree_->values_per_page + size - 1;
 }
 
-template <typename T>
-unsigned int BTreeDB<T>::ValuePageInterface::get_size(unsigned int page_num) const {
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::get_size(unsigned int page_num) const {
     // if indexing out of bounds, throw an exception
     if (page_num >= tree_->num_value_pages) {
-        tree_->write_all();
         std::cout << page_num << ' ' << tree_->num_value_pages << std::endl;
         throw std::runtime_error("entry num out of bounds size get");
     }
 
     // get ot hte desired address and read the page num from it to return
-    char* data = tree_->get_page(page_num, Value);
+    PinnedPage page(tree_, page_num, Value);
     unsigned int res;
-    memcpy(&res, data, 4);
+    memcpy(&res, page.data(), 4);
     return res;
 }
 
-template <typename T>
-void BTreeDB<T>::ValuePageInterface::set_size(unsigned int size, unsigned int page_num) {
-    // if querying out of bounds, throw an exception
-    if (page_num >= tree_->num_value_pages) {
-        tree_->write_all();
-        throw std::runtime_error("entry num out of bounds size set");
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::page_of(unsigned int entry_num) const {
+    if (tree_->value_format == Slotted) {
+        return entry_num >> SLOT_BITS;
     }
+    return entry_num / tree_->values_per_page;
+}
 
-    // navigate to the desired address and change it to reflect hte passed in size; set dirty
-    char* data = tree_->get_page(page_num, Value);
-    memcpy(data, &size, 4);
-    tree_->set_dirty(page_num, Value);
+template <typename T, typename Layout>
+bool BTreeDB<T, Layout>::ValuePageInterface::has_record(const char* data, unsigned int entry_num) const {
+    if (tree_->value_format != Slotted) {
+        return true;
+    }
+
+    unsigned int slot = entry_num & ((1u << SLOT_BITS) - 1);
+    unsigned int num_slots;
+    memcpy(&num_slots, data, 4);
+    unsigned short offset = 0;
+    if (slot < num_slots) {
+        memcpy(&offset, data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE, 2);
+    }
+    return offset != 0;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::ValuePageInterface::read(const char* data, unsigned int entry_num, T* dest) const {
+    if (tree_->value_format == Slotted) {
+        unsigned int len;
+        T::decode_value(slotted_record(data, entry_num & ((1u << SLOT_BITS) - 1), &len), dest);
+        return;
+    }
+    T::deserialize_value(data + 4 + (entry_num % tree_->values_per_page) * T::size, dest);
+}
+
+template <typename T, typename Layout>
+template <typename Callback>
+void BTreeDB<T, Layout>::ValuePageInterface::for_each_value(Callback callback) const {
+    T curr;
+    for (unsigned int page_num = 0; page_num < tree_->num_value_pages; ++page_num) {
+        // read the pages ahead of the pass in batches
+        if (page_num % tree_->io_depth == 0) {
+            std::vector<unsigned int> batch;
+            for (unsigned int i = page_num; i < tree_->num_value_pages && i - page_num < tree_->io_depth; ++i) {
+                batch.push_back(i);
+            }
+            tree_->prefetch_pages(Value, batch);
+        }
+
+        PinnedPage page(tree_, page_num, Value);
+        const char* data = page.data();
+        unsigned int num_slots;
+        memcpy(&num_slots, data, 4);
+
+        for (unsigned int i = 0; i < num_slots; ++i) {
+            if (tree_->value_format == Slotted) {
+                // skip the slots of records that moved
+                unsigned short offset;
+                memcpy(&offset, data + SLOTTED_HEADER_SIZE + i * SLOT_SIZE, 2);
+                if (offset == 0) {
+                    continue;
+                }
+                read(data, (page_num << SLOT_BITS) | i, &curr);
+            } else {
+                read(data, page_num * tree_->values_per_page + i, &curr);
+            }
+
+            if (!callback(curr)) {
+                return;
+            }
+        }
+    }
+}
+
+template <typename T, typename Layout>
+const char* BTreeDB<T, Layout>::ValuePageInterface::slotted_record(const char* data, unsigned int slot, unsigned int* len) const {
+    unsigned int num_slots;
+    memcpy(&num_slots, data, 4);
+
+    unsigned short offset = 0, length = 0;
+    if (slot < num_slots) {
+        memcpy(&offset, data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE, 2);
+        memcpy(&length, data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE + 2, 2);
+    }
+    if (offset == 0) {
+        throw std::runtime_error("entry_num out of bounds for specific page value get");
+    }
+
+    *len = length;
+    return data + offset;
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::free_space(const char* data) {
+    unsigned int num_slots;
+    unsigned short records_start;
+    memcpy(&num_slots, data, 4);
+    memcpy(&records_start, data + 4, 2);
+
+    // an empty 64K page starts its records at 65536, which wraps to 0 (the arithmetic on the 2 byte offsets wraps the same way)
+    unsigned int start = records_start == 0 ? Layout::page_size : records_start;
+    return start - (SLOTTED_HEADER_SIZE + num_slots * SLOT_SIZE);
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::ValuePageInterface::compact(char* data) {
+    Page copy;
+    memcpy(copy.data(), data, Layout::page_size);
+
+    unsigned int num_slots;
+    memcpy(&num_slots, data, 4);
+
+    // copy the records back in from the end of the page, skipping the free space between them
+    unsigned short records_start = static_cast<unsigned short>(Layout::page_size);
+    for (unsigned int i = 0; i < num_slots; ++i) {
+        char* slot = data + SLOTTED_HEADER_SIZE + i * SLOT_SIZE;
+        unsigned short offset, length;
+        memcpy(&offset, slot, 2);
+        memcpy(&length, slot + 2, 2);
+        if (offset == 0) {
+            continue;
+        }
+
+        records_start -= length;
+        memcpy(data + records_start, copy.data() + offset, length);
+        memcpy(slot, &records_start, 2);
+    }
+    memcpy(data + 4, &records_start, 2);
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::ValuePageInterface::place(char* data, unsigned int slot, const std::vector<char>& record) {
+    unsigned short records_start;
+    memcpy(&records_start, data + 4, 2);
+    records_start -= record.size();
+    memcpy(data + records_start, record.data(), record.size());
+    memcpy(data + 4, &records_start, 2);
+
+    unsigned short length = record.size();
+    memcpy(data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE, &records_start, 2);
+    memcpy(data + SLOTTED_HEADER_SIZE + slot * SLOT_SIZE + 2, &length, 2);
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::split_page() {
-    // splitting a node without a parent (the new root)
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::append(const std::vector<char>& record) {
+    if (record.size() + SLOT_SIZE > Layout::page_size - SLOTTED_HEADER_SIZE) {
+        throw std::runtime_error("value too big for a value page");
+    }
+
+    // a new record needs room for itself and its slot
+    if (tree_->num_value_pages != 0 && get_size(tree_->num_value_pages - 1) < (1u << SLOT_BITS)) {
+        unsigned int page_num = tree_->num_value_pages - 1;
+        PinnedPage page(tree_, page_num, Value, ExclusiveLatch);
+        if (free_space(page.data()) < record.size() + SLOT_SIZE) {
+            compact(page.data());
+            tree_->set_dirty(page_num, Value);
+        }
+        if (free_space(page.data()) >= record.size() + SLOT_SIZE) {
+            unsigned int entry_num = add_slot(page.data(), page_num, record);
+            tree_->set_dirty(page_num, Value);
+            return entry_num;
+        }
+    }
+
+    if (tree_->num_value_pages >= (1u << (32 - SLOT_BITS))) {
+        throw std::runtime_error("too many value pages for slotted entry numbers");
+    }
 
-    // create a new root node and new right node
-    KeyPageInterface new_root = tree_->create_new_keypage(0, true, true);
-    KeyPageInterface right = tree_->create_new_keypage(0, is_internal(), false);
+    // new (0-initialized) page with no records yet
+    unsigned int page_num = tree_->num_value_pages;
+    PinnedPage page(tree_, page_num, Value, ExclusiveLatch, true);
+    unsigned short records_start = static_cast<unsigned short>(Layout::page_size);
+    memcpy(page.data() + 4, &records_start, 2);
+    tree_->num_value_pages += 1;
 
-    // add the middle element to the new root and update its child pointers
-    new_root.push(get_key(ORDER / 2), right.get_page_num());
-    new_root.set_child_ptr(get_page_num(), 0);
+    unsigned int entry_num = add_slot(page.data(), page_num, record);
+    tree_->set_dirty(page_num, Value);
+    return entry_num;
+}
 
-    // update root and move keys from left to right
-    set_root(false);
-    move_keys(right);
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::ValuePageInterface::add_slot(char* data, unsigned int page_num, const std::vector<char>& record) {
+    unsigned int slot;
+    memcpy(&slot, data, 4);
+    place(data, slot, record);
 
-    // setting the key root page number to its new value
-    tree_->key_root = new_root.get_page_num();
+    unsigned int num_slots = slot + 1;
+    memcpy(data, &num_slots, 4);
+    return (page_num << SLOT_BITS) | slot;
 }
 
-template <typename T>
-void BTreeDB<T>::KeyPageInterface::split_page(KeyPageInterface& parent) {
-    // splitting a page with a parent
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::insert_entry(const std::vector<unsigned int>& path, size_t depth, long key, unsigned int child_ptr, std::vector<KeyPageInterface>& held) {
+    // the page is already latched through held; this interface only pins it
+    KeyPageInterface page(path[depth], this);
+
+    // a full page with compressed keys that the key doesn't fit into can't be widened; split it first and add the key to the half it belongs in
+    if (!page.fits(key) && page.get_size() >= Layout::order) {
+        std::pair<long, unsigned int> split = split_key_page(path, depth, held);
+        if (key > split.first) {
+            page = KeyPageInterface(split.second, this);
+        }
+        page.push(key, child_ptr);
+        return;
+    }
+
+    page.push(key, child_ptr);
 
-    // getting interface for the new right node
-    KeyPageInterface right = tree_->create_new_keypage(0, is_internal(), false);
+    // if we have reached the max key size, split
+    if (page.get_size() == page.capacity()) {
+        split_key_page(path, depth, held);
+    }
+}
 
-    // getting the middle key
-    long middle_key = get_key(ORDER / 2);
+template <typename T, typename Layout>
+std::pair<long, unsigned int> BTreeDB<T, Layout>::split_key_page(const std::vector<unsigned int>& path, size_t depth, std::vector<KeyPageInterface>& held) {
+    KeyPageInterface left(path[depth], this);
+    KeyPageInterface right = create_new_keypage(0, left.is_internal(), false, ExclusiveLatch);
+    key_splits.fetch_add(1, std::memory_order_relaxed);
+
+    // getting the middle key, then moving keys from left to right
+    long middle_key = left.get_key(left.get_size() / 2);
+    left.move_keys(right);
+    left.link_right(right);
+
+    if (depth == 0) {
+        // splitting a node without a parent; create a new root that has the middle element and points to both halves
+        KeyPageInterface new_root = create_new_keypage(0, true, true, ExclusiveLatch);
+        new_root.set_child_ptr(left.get_page_num(), 0);
+        new_root.push(middle_key, right.get_page_num());
+        left.set_root(false);
+
+        // setting the key root page number to its new value; searches that latched the old root see it is no longer the root and start over
+        key_root = new_root.get_page_num();
+        held.push_back(std::move(new_root));
+    } else {
+        // push the middle key/the right pointer to the parent, which may split in turn
+        insert_entry(path, depth - 1, middle_key, right.get_page_num(), held);
+    }
 
-    // move keys from left to right and push the middle key/the right pointer to the parent
-    move_keys(right);
-    parent.push(middle_key, right.get_page_num());
+    unsigned int right_page = right.get_page_num();
+    held.push_back(std::move(right));
+    return {middle_key, right_page};
 }
 
-template <typename T>
-typename BTreeDB<T>::KeyPageInterface BTreeDB<T>::create_new_keypage(unsigned int num_cells, bool internal, bool is_root) {
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::KeyPageInterface BTreeDB<T, Layout>::create_new_keypage(unsigned int num_cells, bool internal, bool is_root, LatchMode latch) {
     // create new page and 0-initialize it
-    std::array<char, PAGE_SIZE> new_page;
+    std::array<char, Layout::page_size> new_page;
     new_page.fill(DEFAULT_VAL);
 
-    // adding in some dummy indicators for binary viewing
-    char temp[8] = {'n', 'e', 'w', 'b', 'l', 'o', 'c', 'k'};
-    memcpy(new_page.data() + HEADER_SIZE - 8, temp, 8);
-    new_page[6] = -1;
+    if (has_leaf_links) {
+        // the last 8 bytes of the header are the next/previous leaf pointers; start unlinked
+        unsigned int unlinked = NULL_PAGE;
+        memcpy(new_page.data() + 8, &unlinked, 4);
+        memcpy(new_page.data() + 12, &unlinked, 4);
+    } else {
+        // adding in some dummy indicators for binary viewing
+        char temp[8] = {'n', 'e', 'w', 'b', 'l', 'o', 'c', 'k'};
+        memcpy(new_page.data() + HEADER_SIZE - 8, temp, 8);
+    }
+    // byte 6 marks pages with compressed keys, which all new pages of such trees start out as
+    new_page[6] = key_format == Delta ? DELTA_PAGE : -1;
     new_page[7] = -1;
 
-    // write the new key page and allocate data to store it
-    key_handler.seekg(0, std::ios::end);
-    key_handler.write(new_page.data(), PAGE_SIZE);
-    key_cache[num_key_pages].data = new char[PAGE_SIZE];
-    memcpy(key_cache[num_key_pages].data, new_page.data(), PAGE_SIZE);
+    // incremenet number of key pages, claiming the last one for this page
+    unsigned int page_num = num_key_pages++;
 
-    // incremenet number of key pages
-    ++num_key_pages;
+    // allocate the new key page in the cache; it starts out dirty, so it reaches the file when it is written back
+    // nothing points at it yet, but it is latched before it is filled in since writeback can already find it
+    unsigned int frame = pool.create(Key, page_num);
+    pool.latch(frame, latch);
+    memcpy(pool.frame_data(frame), new_page.data(), Layout::page_size);
 
     // update the new key pages values using the passed in parameters
-    KeyPageInterface curr(num_key_pages - 1, this);
+    KeyPageInterface curr(page_num, this, frame, latch);
     curr.set_size(num_cells);
     curr.set_internal(internal);
     curr.set_root(is_root);
@@ -1027,14 +3820,61 @@ typename BTreeDB<T>::KeyPageInterface BTreeDB<T>::create_new_keypage(unsigned in
     return curr;
 }
 
-template <typename T>
-unsigned int BTreeDB<T>::KeyPageInterface::find_pos(long key) const {
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::prefetch_key_page(unsigned int page_num) {
+    const char* data = nullptr;
+    if (key_map.data != nullptr) {
+        if ((static_cast<size_t>(page_num) + 1) * Layout::page_size <= key_map.size) {
+            data = key_map.data + static_cast<size_t>(page_num) * Layout::page_size;
+        }
+    } else {
+        data = pool.lookup(Key, page_num);
+    }
+    if (data == nullptr) {
+        return;
+    }
+
+    // the header, then the keys the first steps of the search look at (assuming the page is compressed, since reading the header to check would wait for it)
+    __builtin_prefetch(data);
+    if (key_format == Delta) {
+        __builtin_prefetch(data + DELTA_KEYS_OFFSET + (Layout::delta_order / 4) * 4);
+        __builtin_prefetch(data + DELTA_KEYS_OFFSET + (Layout::delta_order / 2) * 4);
+    } else if (key_format != Interleaved) {
+        __builtin_prefetch(data + HEADER_SIZE + (Layout::order / 4) * 8);
+        __builtin_prefetch(data + HEADER_SIZE + (Layout::order / 2) * 8);
+    } else {
+        __builtin_prefetch(data + HEADER_SIZE + 4 + (Layout::order / 4) * KEYENTRY_SIZE);
+        __builtin_prefetch(data + HEADER_SIZE + 4 + (Layout::order / 2) * KEYENTRY_SIZE);
+    }
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::KeyPageInterface::find_pos(long key) const {
     // get size; if 0, return 0
     unsigned int size = get_size();
     if (size == 0) {
         return 0;
     }
 
+    // compressed pages search the deltas; keys outside the range of the page go before or after every key
+    char* data = get_data();
+    if (is_delta(data)) {
+        long base = get_base(data);
+        if (key < base) {
+            return 0;
+        }
+        unsigned long delta = static_cast<unsigned long>(key) - static_cast<unsigned long>(base);
+        if (delta > UINT_MAX) {
+            return size;
+        }
+        return search_deltas(data + DELTA_KEYS_OFFSET, size, static_cast<unsigned int>(delta));
+    }
+
+    // split pages have the keys in one array, which can be searched with vector compares
+    if (tree_->key_format != Interleaved) {
+        return search_keys(key_addr(data, 0), size, key);
+    }
+
     // initialize binary search trackers
     int left = 0;
     int right = size - 1;
@@ -1055,107 +3895,518 @@ unsigned int BTreeDB<T>::KeyPageInterface::find_pos(long key) const {
     return left;
 }
 
-template <typename T>
-void BTreeDB<T>::set_dirty(unsigned int page_num, FileType type) {
-    switch (type) {
-        case Key: {
-            // throw exception of page num not in cache
-            if (key_cache.find(page_num) == key_cache.end()) {
-                throw std::runtime_error("page_num not in key cache");
-            }
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::set_dirty(unsigned int page_num, FileType type) {
+    // set the cache block to dirty (throws if the page isn't cached)
+    pool.mark_dirty(type, page_num);
+}
 
-            // set the cache block to dirty
-            key_cache.at(page_num).dirty = true;
-            return;
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::write_page(unsigned int page_num, FileType type, const char* data) {
+    // never write anything in read only mode
+    if (read_only) {
+        return;
+    }
+
+    // with a writeback thread, the page is copied and written in the background
+    if (writeback) {
+        writeback->enqueue(type, page_num, data);
+        return;
+    }
+
+    write_pages(type, page_num, {data});
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::write_pages(FileType type, unsigned int first_page, const std::vector<const char*>& pages) {
+    int fd = type == Key ? key_fd : value_fd;
+    std::vector<iovec> vecs(pages.size());
+    for (size_t i = 0; i < pages.size(); ++i) {
+        vecs[i].iov_base = const_cast<char*>(pages[i]);
+        vecs[i].iov_len = Layout::page_size;
+    }
+
+    off_t offset = static_cast<off_t>(first_page) * Layout::page_size;
+    size_t curr = 0;
+    while (curr < vecs.size()) {
+        ssize_t written = pwritev(fd, vecs.data() + curr, static_cast<int>(vecs.size() - curr), offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("error writing back database pages");
         }
-        case Value: {
-            // same as for keys
-            if (value_cache.find(page_num) == value_cache.end()) {
-                throw std::runtime_error("page_num not in value cache");
+        offset += written;
+        write_calls.fetch_add(1, std::memory_order_relaxed);
+
+        // a short write leaves the rest for the next call
+        while (written > 0) {
+            size_t len = vecs[curr].iov_len;
+            if (static_cast<size_t>(written) >= len) {
+                written -= len;
+                ++curr;
+            } else {
+                vecs[curr].iov_base = static_cast<char*>(vecs[curr].iov_base) + written;
+                vecs[curr].iov_len -= written;
+                written = 0;
             }
-            value_cache.at(page_num).dirty = true;
-            return;
         }
     }
+    pages_written.fetch_add(pages.size(), std::memory_order_relaxed);
 }
 
-template <typename T>
-void BTreeDB<T>::write_page(unsigned int page_num, FileType type) {
-    switch (type) {
-        case Key: {
-            // get to the right positio nfor writing and write the data to it
-            key_handler.seekg(page_num * PAGE_SIZE, std::ios::beg);
-            char* curr_page = get_page(page_num, type);
-            key_handler.write(curr_page, PAGE_SIZE);
-            break;
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::read_page(unsigned int page_num, FileType type, char* dest) {
+    // pages that haven't been written back yet are newer than what is in the file
+    if (writeback && writeback->read_pending(type, page_num, dest)) {
+        return;
+    }
+
+    // the part of the page past the end of the file (page not on disk yet) reads as zeros
+    int fd = type == Key ? key_fd : value_fd;
+    pages_read.fetch_add(1, std::memory_order_relaxed);
+    AsyncReader::read_sync({fd, static_cast<off_t>(page_num) * Layout::page_size, dest, Layout::page_size});
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::read_pages(FileType type, const std::vector<std::pair<unsigned int, char*>>& pages) {
+    int fd = type == Key ? key_fd : value_fd;
+    std::vector<ReadRequest> requests;
+    requests.reserve(pages.size());
+    for (const auto& page : pages) {
+        if (!writeback || !writeback->read_pending(type, page.first, page.second)) {
+            requests.push_back({fd, static_cast<off_t>(page.first) * Layout::page_size, page.second, Layout::page_size});
         }
-        case Value: {
-            // same as key
-            value_handler.seekg(page_num * PAGE_SIZE, std::ios::beg);
-            char* curr_page = get_page(page_num, type);
-            value_handler.write(curr_page, PAGE_SIZE);
-            break;
+    }
+    pages_read.fetch_add(requests.size(), std::memory_order_relaxed);
+    async_reader->read(requests);
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::prefetch_pages(FileType type, const std::vector<unsigned int>& page_nums) {
+    const MappedFile& map = type == Key ? key_map : value_map;
+    if (map.data == nullptr) {
+        pool.prefetch(type, page_nums);
+        return;
+    }
+
+    // mapped pages are read in by the kernel; tell it about runs of neighboring pages at once
+    for (size_t i = 0; i < page_nums.size(); ) {
+        size_t j = i + 1;
+        while (j < page_nums.size() && page_nums[j] == page_nums[j - 1] + 1) {
+            ++j;
+        }
+        size_t start = static_cast<size_t>(page_nums[i]) * Layout::page_size;
+        if (start < map.size) {
+            madvise(map.data + start, std::min((j - i) * Layout::page_size, map.size - start), MADV_WILLNEED);
+        }
+        i = j;
+    }
+}
+
+template <typename T, typename Layout>
+std::vector<unsigned int> BTreeDB<T, Layout>::prefetch_leaves(long key, long hi) {
+    std::vector<unsigned int> leaves;
+    {
+        KeyPageInterface iter = latch_root(SharedLatch);
+        while (iter.is_internal()) {
+            unsigned int target = iter.find_pos(key);
+            KeyPageInterface child(iter.get_child_ptr(target), this, SharedLatch);
+
+            // the child is the leaf the scan is at (so reading it was free); the ones after it start past the keys before their pointers
+            if (!child.is_internal()) {
+                for (unsigned int i = target + 1; i <= iter.get_size() && leaves.size() < io_depth && iter.get_key(i - 1) < hi; ++i) {
+                    leaves.push_back(iter.get_child_ptr(i));
+                }
+                break;
+            }
+            iter = std::move(child);
+        }
+    }
+
+    // nothing may be latched while reading, since the reads may have to evict pages
+    std::vector<unsigned int> sorted = leaves;
+    std::sort(sorted.begin(), sorted.end());
+    prefetch_pages(Key, sorted);
+    return leaves;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::prefetch_values(const KeyPageInterface& leaf, long hi) {
+    ValuePageInterface value_iter(this);
+    std::vector<unsigned int> pages;
+    leaf.latch(SharedLatch);
+    unsigned int size = leaf.get_size();
+    for (unsigned int i = 0; i < size && leaf.get_key(i) < hi; ++i) {
+        pages.push_back(value_iter.page_of(leaf.get_child_ptr(i + 1)));
+    }
+    leaf.unlatch();
+
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    for (size_t i = 0; i < pages.size(); i += io_depth) {
+        prefetch_pages(Value, std::vector<unsigned int>(pages.begin() + i, pages.begin() + std::min(pages.size(), i + io_depth)));
+    }
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::pin_page(unsigned int page_num, FileType type) {
+    if ((type == Key ? key_map.data : value_map.data) != nullptr) {
+        return BufferPool::NO_FRAME;
+    }
+    return pool.pin(type, page_num);
+}
+
+template <typename T, typename Layout>
+int BTreeDB<T, Layout>::open_file(const std::string& filename, int flags) {
+    int fd = open(filename.c_str(), flags, 0644);
+    if (fd == -1 && errno == EINVAL && (flags & O_DIRECT)) {
+        fd = open(filename.c_str(), flags & ~O_DIRECT, 0644);
+    }
+    return fd;
+}
+
+template <typename T, typename Layout>
+typename BTreeDB<T, Layout>::MappedFile BTreeDB<T, Layout>::map_file(const std::string& filename) {
+    MappedFile res;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("error opening " + filename + " for mapping");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        close(fd);
+        throw std::runtime_error("error reading the size of " + filename);
+    }
+
+    // an empty file can't be mapped; leave data as nullptr so lookups fail the bounds checks
+    if (info.st_size > 0) {
+        void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("error mapping " + filename);
         }
+        res.data = static_cast<char*>(addr);
+        res.size = info.st_size;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    return res;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::unmap_files() {
+    if (key_map.data != nullptr) {
+        munmap(key_map.data, key_map.size);
+        key_map = MappedFile();
+    }
+    if (value_map.data != nullptr) {
+        munmap(value_map.data, value_map.size);
+        value_map = MappedFile();
     }
 }
 
-template <typename T>
-char* BTreeDB<T>::get_page(unsigned int page_num, FileType type) {
+template <typename T, typename Layout>
+char* BTreeDB<T, Layout>::get_page(unsigned int page_num, FileType type) {
     switch(type) {
         case Key: {
-            // if page num already in cache, return it; cache hit
-            if (key_cache.find(page_num) != key_cache.end()) {
-                return key_cache.at(page_num).data;
+            // mapped files are read only, so pages are returned straight out of the mapping
+            if (key_map.data != nullptr) {
+                if ((static_cast<size_t>(page_num) + 1) * Layout::page_size > key_map.size) {
+                    throw std::runtime_error("page_num out of bounds of mapped key file");
+                }
+                return key_map.data + static_cast<size_t>(page_num) * Layout::page_size;
             }
 
-            // cache miss; allocate data for new block and manually copy it with data read in from teh db file
-            key_cache[page_num].data = new char[PAGE_SIZE];
-            key_handler.seekg(page_num * PAGE_SIZE);
-            key_handler.read(key_cache.at(page_num).data, PAGE_SIZE);
-            return key_cache.at(page_num).data;
+            // otherwise go through the cache, which handles hits and misses
+            return pool.fetch(Key, page_num);
         }
         case Value: {
             // same as key
-            if (value_cache.find(page_num) != value_cache.end()) {
-                return value_cache.at(page_num).data;
+            if (value_map.data != nullptr) {
+                if ((static_cast<size_t>(page_num) + 1) * Layout::page_size > value_map.size) {
+                    throw std::runtime_error("page_num out of bounds of mapped value file");
+                }
+                return value_map.data + static_cast<size_t>(page_num) * Layout::page_size;
             }
 
-            value_cache[page_num].data = new char[PAGE_SIZE];
-            value_handler.seekg(page_num * PAGE_SIZE);
-            value_handler.read(value_cache.at(page_num).data, PAGE_SIZE);
-            return value_cache.at(page_num).data;
+            return pool.fetch(Value, page_num);
         }
     }
     throw std::runtime_error("something went wrong");
 }
 
-template <typename T>
-long BTreeDB<T>::get_id_from_name(const T& search_val) {
+template <typename T, typename Layout>
+long BTreeDB<T, Layout>::get_id_from_name(const T& search_val) {
+    if (name_db) {
+        std::vector<long> ids = get_ids_from_name(search_val);
+        return ids.empty() ? -1 : ids[0];
+    }
+
     // iterate over all values until we reach the entry that matches the passed in entry
+    long res = -1;
+    ValuePageInterface iter(this);
+    iter.for_each_value([&](T& curr) {
+        if (curr == search_val) {
+            res = curr.id;
+            return false;
+        }
+        return true;
+    });
+    return res;
+}
+
+template <typename T, typename Layout>
+std::vector<long> BTreeDB<T, Layout>::get_ids_from_name(const T& search_val) {
+    std::vector<long> res;
+
+    if constexpr (T::has_name_index) {
+        if (name_db) {
+            // every id whose name has the same hash; collisions are weeded out below
+            long lo = name_index_key(search_val.name_hash());
+            std::vector<long> ids;
+            name_db->scan(lo, lo + (1L << NAME_DUP_BITS), [&ids](long, const NameIndexEntry& entry) {
+                if (entry.id != NameIndexEntry::EMPTY) {
+                    ids.push_back(entry.id);
+                }
+            });
+
+            if (ids.empty()) {
+                return res;
+            }
+
+            std::vector<T> values = find_many(ids);
+            for (T& value : values) {
+                if (value == search_val) {
+                    res.push_back(value.id);
+                }
+            }
+            return res;
+        }
+    }
+
+    // no index; iterate over all values
     ValuePageInterface iter(this);
-    for (unsigned int i = 0; i < num_entries; ++i) {
-        if (iter.get_value(i) == search_val) {
-            return iter.get_value(i).id;
+    iter.for_each_value([&](T& curr) {
+        if (curr == search_val) {
+            res.push_back(curr.id);
+        }
+        return true;
+    });
+    return res;
+}
+
+template <typename T, typename Layout>
+std::string BTreeDB<T, Layout>::name_index_filename(const std::string& filename) {
+    // e.g. author_keys.db -> author_keys_names.db
+    return filename.substr(0, filename.size() - 3) + "_names.db";
+}
+
+template <typename T, typename Layout>
+std::string BTreeDB<T, Layout>::key_filter_filename_for(const std::string& filename) {
+    // e.g. paper_keys.db -> paper_keys_bloom.bin
+    return filename.substr(0, filename.size() - 3) + "_bloom.bin";
+}
+
+template <typename T, typename Layout>
+std::string BTreeDB<T, Layout>::metadata_filename_for(const std::string& key_filename, const std::string& values_filename) {
+    // e.g. paper_keys.db and paper_values.db -> paper_keyspaper_values.txt
+    return key_filename.substr(0, key_filename.size() - 3) + values_filename.substr(0, values_filename.size() - 3) + ".txt";
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::remove_files(const std::string& key_filename, const std::string& values_filename) {
+    std::remove(key_filename.c_str());
+    std::remove(values_filename.c_str());
+    std::remove(metadata_filename_for(key_filename, values_filename).c_str());
+    std::remove(key_filter_filename_for(key_filename).c_str());
+    if (T::has_name_index) {
+        BTreeDB<NameIndexEntry, Layout>::remove_files(name_index_filename(key_filename), name_index_filename(values_filename));
+    }
+}
+
+template <typename T, typename Layout>
+unsigned int BTreeDB<T, Layout>::stored_shards(const std::string& key_filename, const std::string& values_filename) {
+    std::ifstream meta(metadata_filename_for(key_filename, values_filename));
+    if (!meta.is_open()) {
+        return 0;
+    }
+
+    // no other field or value of the metadata file is the word shards
+    std::string field;
+    while (meta >> field) {
+        if (field == "shards") {
+            unsigned int res = 0;
+            meta >> res;
+            return res;
+        }
+    }
+    return 1;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::rebuild_key_filter(unsigned int bits_per_key) {
+    std::unique_ptr<BloomFilter> filter = std::make_unique<BloomFilter>(num_entries, bits_per_key);
+    for (Cursor iter = first(); iter.valid(); iter.next()) {
+        filter->add(iter.key());
+    }
+    key_filter = std::move(filter);
+}
+
+template <typename T, typename Layout>
+size_t BTreeDB<T, Layout>::own_budget(size_t bytes) {
+    return T::has_name_index ? bytes - bytes / NAME_INDEX_SHARE : bytes;
+}
+
+template <typename T, typename Layout>
+long BTreeDB<T, Layout>::name_index_key(unsigned long hash) {
+    return static_cast<long>(hash & ((1UL << NAME_HASH_BITS) - 1)) << NAME_DUP_BITS;
+}
+
+template <typename T, typename Layout>
+std::mutex& BTreeDB<T, Layout>::name_lock(long index_key) {
+    // the slots of a hash share the bits above the duplicate bits
+    return name_mutexes[(static_cast<unsigned long>(index_key) >> NAME_DUP_BITS) % NAME_LOCK_STRIPES];
+}
+
+template <typename T, typename Layout>
+std::optional<long> BTreeDB<T, Layout>::name_index_add(const T& value, long key) {
+    if constexpr (T::has_name_index) {
+        if (name_db) {
+            return name_index_insert(value.name_hash(), key);
+        }
+    } else {
+        (void) value;
+        (void) key;
+    }
+    return std::nullopt;
+}
+
+template <typename T, typename Layout>
+long BTreeDB<T, Layout>::name_index_insert(unsigned long hash, long key) {
+    // reuse the first slot left behind by a rename, otherwise take the one after the last used slot
+    long lo = name_index_key(hash);
+    long hi = lo + (1L << NAME_DUP_BITS);
+    std::lock_guard<std::mutex> lock(name_lock(lo));
+    std::optional<long> slot;
+    long next = lo;
+    name_db->scan(lo, hi, [&slot, &next](long index_key, const NameIndexEntry& entry) {
+        if (entry.id == NameIndexEntry::EMPTY && !slot) {
+            slot = index_key;
+        }
+        next = index_key + 1;
+    });
+
+    if (!slot) {
+        if (next == hi) {
+            throw std::runtime_error("too many ids with the same name hash in the name index");
+        }
+        slot = next;
+    }
+
+    NameIndexEntry entry(key);
+    name_db->insert(*slot, entry);
+    return *slot;
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::name_index_clear(std::optional<long> slot) {
+    if (!slot) return;
+
+    // there is no deletion, so leave an empty slot behind
+    std::lock_guard<std::mutex> lock(name_lock(*slot));
+    NameIndexEntry empty;
+    name_db->insert(*slot, empty);
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::name_index_remove(const T& value, long key) {
+    if constexpr (T::has_name_index) {
+        if (!name_db) return;
+
+        long lo = name_index_key(value.name_hash());
+        std::lock_guard<std::mutex> lock(name_lock(lo));
+        std::optional<long> slot;
+        name_db->scan(lo, lo + (1L << NAME_DUP_BITS), [&slot, key](long index_key, const NameIndexEntry& entry) {
+            if (entry.id == key) {
+                slot = index_key;
+            }
+        });
+
+        // there is no deletion, so leave an empty slot behind
+        if (slot) {
+            NameIndexEntry empty;
+            name_db->insert(*slot, empty);
+        }
+    } else {
+        (void) value;
+        (void) key;
+    }
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::name_index_replace(const T& old_value, const T& new_value, long key, std::optional<long> slot) {
+    if constexpr (T::has_name_index) {
+        // the old slot is still filled, so the new one is a second copy
+        if (old_value.name_hash() == new_value.name_hash()) {
+            name_index_clear(slot);
+            return;
+        }
+    } else {
+        (void) new_value;
+    }
+    name_index_remove(old_value, key);
+}
+
+template <typename T, typename Layout>
+void BTreeDB<T, Layout>::name_index_add_all(std::vector<std::pair<unsigned long, long>>& names) {
+    if (!name_db || names.empty()) return;
+
+    // an index that already has entries has to go through the normal path to find free slots
+    if (name_db->first().valid()) {
+        for (const auto& name : names) {
+            name_index_insert(name.first, name.second);
+        }
+        return;
+    }
+
+    // sort by index key, keeping ids with the same hash in id order, and number the duplicates
+    for (auto& name : names) {
+        name.first = static_cast<unsigned long>(name_index_key(name.first));
+    }
+    std::sort(names.begin(), names.end());
+
+    std::vector<std::pair<long, NameIndexEntry>> sorted;
+    sorted.reserve(names.size());
+    long dup = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        dup = (i > 0 && names[i].first == names[i - 1].first) ? dup + 1 : 0;
+        if (dup == (1L << NAME_DUP_BITS)) {
+            throw std::runtime_error("too many ids with the same name hash in the name index");
         }
+        sorted.push_back({static_cast<long>(names[i].first) + dup, NameIndexEntry(names[i].second)});
     }
-    return -1;
+
+    name_db->bulk_load(sorted.begin(), sorted.end());
 }
 
-template <typename T>
-std::vector<long> BTreeDB<T>::get_papers(long author_id) {
+template <typename T, typename Layout>
+std::vector<long> BTreeDB<T, Layout>::get_papers(long author_id) {
     std::vector<long> res;
     try {
         ValuePageInterface iter(this);
-        for (unsigned int i = 0; i < num_entries; ++i) {
-            T curr = iter.get_value(i);
+        iter.for_each_value([&](T& curr) {
             if (curr.has_author(author_id)) {
                 res.push_back(curr.id);
             }
-        }
+            return true;
+        });
 
         return res;
     } catch (std::runtime_error& err) {
-        write_all();
         throw std::runtime_error("function not defined for this template type");
     }
     
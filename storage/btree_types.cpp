@@ -1,17 +1,285 @@
 #pragma once
 
 #include <array>
+#include <algorithm>
 #include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <string_view>
+#include <type_traits>
+
+#include "varint.hpp"
 
 #define NULL_VAL -1
 
 /**
     Template ValueEntry types for the BTrees are defined here. Each must have member variables containing all relevant data, an id field, a default constructor, a static size member detailing the size of the struct in bytes, a static deserialization function, and serialization function. There is also an optional operator<< function that is only applicable for the paper db; for the other ones, it just returns false.
+
+    The serialized form of each type is described once by its layout (see Layout and Field below); the serialization functions, the size, and the field accessors of BTreeDB::View all come from it. The layout also gives the compact encoding that databases with slotted value pages store (encode_value/decode_value): strings only take their actual length, id lists only take their actual number of ids, and numbers are varints.
+
+    Fields can also be variable length (a std::string or a std::vector of numbers, like the title and authors of a paper). The compact encoding stores them whole; the fixed size serialized form only has room for as much of them as its reserved size, so databases with fixed value pages (and views of them) keep a truncated copy.
+
+    Each type also sets has_name_index. If it is true, the type must have a name_hash function (hashing exactly what operator== compares), and the database keeps a secondary index from that hash to ids so get_id_from_name doesn't have to scan every value.
+*/
+
+/**
+    Hashes a run of bytes with 64 bit FNV-1a. Used for the name indexes.
+
+    @param data Start of the bytes to hash
+    @param len Number of bytes to hash
+    @return the hash
+*/
+inline unsigned long hash_bytes(const char* data, size_t len) {
+    unsigned long hash = 14695981039346656037UL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/**
+    Splits a pointer to member into the struct it belongs to and the member's type.
+*/
+template <typename MemberPtr>
+struct MemberPointer;
+
+template <typename Owner, typename Type>
+struct MemberPointer<Type Owner::*> {
+    typedef Owner owner;
+    typedef Type type;
+};
+
+/**
+    Whether a type is a fixed size char array (the string fields of the entries).
+*/
+template <typename Type>
+struct is_char_array : std::false_type {};
+
+template <size_t N>
+struct is_char_array<std::array<char, N>> : std::true_type {};
+
+/**
+    Whether a type is a fixed size array of numbers (like the author ids of a paper), which are 0 past the last one used.
 */
+template <typename Type>
+struct is_number_array : std::false_type {};
+
+template <typename Number, size_t N>
+struct is_number_array<std::array<Number, N>> : std::is_integral<Number> {};
+
+/**
+    Whether a type is a list of numbers of any length (like the author ids of a paper).
+*/
+template <typename Type>
+struct is_number_vector : std::false_type {};
+
+template <typename Number>
+struct is_number_vector<std::vector<Number>> : std::is_integral<Number> {};
+
+/**
+    This struct describes one field of a serialized entry: the member it is stored from and the byte offset it is stored at. It is only used as a type, e.g. Field<&Entry::name, 0>.
+
+    Variable length members (std::string and std::vector of numbers) also need the size reserved for them in the serialized record, e.g. Field<&Entry::title, 0, 96>. A string keeps its first Size - 1 characters there, null terminated, and a list keeps as many numbers as fit, followed by 0s.
+*/
+template <auto Member, unsigned int Offset, unsigned int Size = sizeof(typename MemberPointer<decltype(Member)>::type)>
+struct Field {
+    typedef typename MemberPointer<decltype(Member)>::owner Owner;
+    typedef typename MemberPointer<decltype(Member)>::type Type;
+
+    static constexpr bool is_string = std::is_same<Type, std::string>::value;
+    static constexpr bool is_list = is_number_vector<Type>::value;
+
+    static_assert(is_string || is_list || Size == sizeof(Type), "only variable length fields can have a reserved size of their own");
+
+    static constexpr unsigned int offset = Offset;
+    static constexpr unsigned int size = Size;
+
+    /**
+        Copies this field out of a serialized record into an entry.
+    */
+    static void read(const char* record, Owner* dest) {
+        if constexpr (is_string) {
+            (dest->*Member).assign(record + Offset, strnlen(record + Offset, Size));
+        } else if constexpr (is_list) {
+            dest->*Member = view(record);
+        } else {
+            memcpy(&(dest->*Member), record + Offset, size);
+        }
+    }
+
+    /**
+        Copies this field of an entry into a serialized record, cutting variable length fields off at their reserved size.
+    */
+    static void write(const Owner* source, char* record) {
+        const Type& value = source->*Member;
+        if constexpr (is_string) {
+            memset(record + Offset, 0, Size);
+            memcpy(record + Offset, value.data(), std::min<size_t>(value.size(), Size - 1));
+        } else if constexpr (is_list) {
+            memset(record + Offset, 0, Size);
+            memcpy(record + Offset, value.data(), std::min<size_t>(value.size(), Size / sizeof(typename Type::value_type)) * sizeof(typename Type::value_type));
+        } else {
+            memcpy(record + Offset, &value, size);
+        }
+    }
+
+    /**
+        Appends the compact encoding of this field: strings are their length and then their characters, number arrays are the number of entries up to the last non-zero one and then those entries, and numbers are signed varints.
+    */
+    static void encode(const Owner* source, std::vector<char>& out) {
+        const Type& value = source->*Member;
+        if constexpr (is_string) {
+            put_varint(out, value.size());
+            out.insert(out.end(), value.begin(), value.end());
+        } else if constexpr (is_list) {
+            put_varint(out, value.size());
+            for (auto number : value) {
+                put_signed_varint(out, static_cast<int64_t>(number));
+            }
+        } else if constexpr (is_char_array<Type>::value) {
+            size_t len = strnlen(value.data(), value.size());
+            put_varint(out, len);
+            out.insert(out.end(), value.data(), value.data() + len);
+        } else if constexpr (is_number_array<Type>::value) {
+            size_t used = value.size();
+            while (used > 0 && value[used - 1] == 0) {
+                --used;
+            }
+            put_varint(out, used);
+            for (size_t i = 0; i < used; ++i) {
+                put_signed_varint(out, static_cast<int64_t>(value[i]));
+            }
+        } else if constexpr (std::is_integral<Type>::value) {
+            put_signed_varint(out, static_cast<int64_t>(value));
+        } else {
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+    }
+
+    /**
+        Reads this field back from its compact encoding and moves the pointer past it.
+    */
+    static void decode(const char*& data, Owner* dest) {
+        Type& value = dest->*Member;
+        if constexpr (is_string) {
+            size_t len = get_varint(data);
+            value.assign(data, len);
+            data += len;
+        } else if constexpr (is_list) {
+            value.resize(get_varint(data));
+            for (auto& number : value) {
+                number = static_cast<typename Type::value_type>(get_signed_varint(data));
+            }
+        } else if constexpr (is_char_array<Type>::value) {
+            size_t len = std::min<size_t>(get_varint(data), value.size());
+            value.fill(0);
+            memcpy(value.data(), data, len);
+            data += len;
+        } else if constexpr (is_number_array<Type>::value) {
+            size_t used = std::min<size_t>(get_varint(data), value.size());
+            value.fill(0);
+            for (size_t i = 0; i < used; ++i) {
+                value[i] = static_cast<typename Type::value_type>(get_signed_varint(data));
+            }
+        } else if constexpr (std::is_integral<Type>::value) {
+            value = static_cast<Type>(get_signed_varint(data));
+        } else {
+            memcpy(&value, data, size);
+            data += size;
+        }
+    }
+
+    /**
+        Reads this field straight out of a serialized record. Strings come back as a view into the record (up to the null terminator) without copying; everything else is small and is copied out (the record isn't aligned, so it can't be referenced directly). Variable length fields only have what fits in their reserved size.
+
+        @param record The start of the serialized record
+        @return a std::string_view for strings, the field's value otherwise (lists without the 0s after their last number)
+    */
+    static auto view(const char* record) {
+        if constexpr (is_string || is_char_array<Type>::value) {
+            return std::string_view(record + Offset, strnlen(record + Offset, size));
+        } else if constexpr (is_list) {
+            typedef typename Type::value_type Number;
+            Type res(Size / sizeof(Number));
+            memcpy(res.data(), record + Offset, res.size() * sizeof(Number));
+            while (!res.empty() && res.back() == 0) {
+                res.pop_back();
+            }
+            return res;
+        } else {
+            Type res;
+            memcpy(&res, record + Offset, size);
+            return res;
+        }
+    }
+
+    /**
+        Reads this field out of a whole entry, as the same type view returns. Strings come back as a view into the entry, which must outlive it.
+
+        @param value The entry
+        @return a std::string_view for strings, the field's value otherwise
+    */
+    static auto view(const Owner& value) {
+        const Type& field = value.*Member;
+        if constexpr (is_string) {
+            return std::string_view(field);
+        } else if constexpr (is_char_array<Type>::value) {
+            return std::string_view(field.data(), strnlen(field.data(), field.size()));
+        } else {
+            return field;
+        }
+    }
+};
+
+/**
+    This struct describes the serialized form of an entry as a list of Fields. The fields have to be listed in order and packed back to back, which is checked at compile time.
+*/
+template <typename... Fields>
+struct Layout {
+    static constexpr unsigned int size = (Fields::size + ...);
+
+    /**
+        Returns whether every field starts right where the previous one ends.
+    */
+    static constexpr bool packed() {
+        unsigned int offsets[] = {Fields::offset...};
+        unsigned int sizes[] = {Fields::size...};
+        unsigned int next = 0;
+        for (unsigned int i = 0; i < sizeof...(Fields); ++i) {
+            if (offsets[i] != next) {
+                return false;
+            }
+            next += sizes[i];
+        }
+        return true;
+    }
+
+    static_assert(packed(), "layout fields must be in order with no gaps");
+
+    template <typename Owner>
+    static void read(const char* record, Owner* dest) {
+        (Fields::read(record, dest), ...);
+    }
+
+    template <typename Owner>
+    static void write(const Owner* source, char* record) {
+        (Fields::write(source, record), ...);
+    }
+
+    template <typename Owner>
+    static void encode(const Owner* source, std::vector<char>& out) {
+        (Fields::encode(source, out), ...);
+    }
+
+    template <typename Owner>
+    static void decode(const char* data, Owner* dest) {
+        (Fields::decode(data, dest), ...);
+    }
+};
 
 namespace author {
     struct Entry {
@@ -20,6 +288,12 @@ namespace author {
         std::array<char, 56> organization;
         long id;
 
+        // how an entry is serialized; also used to read single fields through BTreeDB::View
+        typedef Field<&Entry::name, 0> Name;
+        typedef Field<&Entry::organization, 32> Organization;
+        typedef Field<&Entry::id, 88> Id;
+        typedef Layout<Name, Organization, Id> layout;
+
         /**
             Full constructor for an author entry
 
@@ -77,10 +351,8 @@ namespace author {
             @param source Start of char array to copy to the given entry
             @param dest Address of entry to copy data to
         */
-        static void deserialize_value(char* source, Entry* dest) {
-            memcpy(dest->name.data(), source, 32);
-            memcpy(dest->organization.data(), source + 32, 56);
-            memcpy(&(dest->id), source + 88, 8);
+        static void deserialize_value(const char* source, Entry* dest) {
+            layout::read(source, dest);
         }
 
         /**
@@ -90,16 +362,34 @@ namespace author {
             @param dest Start of char array to copy data to
         */
         static void serialize_value(Entry* source, char* dest) {
-            memcpy(dest, source->name.data(), 32);
-            memcpy(dest + 32, source->organization.data(), 56);
-            memcpy(dest + 88, &(source->id), 8);
+            layout::write(source, dest);
+        }
+
+        /**
+            Function to append the compact encoding of a ValueEntry (used by slotted value pages) to a buffer
+
+            @param source Entry to encode
+            @param dest Buffer to append the encoding to
+        */
+        static void encode_value(const Entry& source, std::vector<char>& dest) {
+            layout::encode(&source, dest);
+        }
+
+        /**
+            Function to decode an entry written by encode_value
+
+            @param source Start of the encoding
+            @param dest Address of entry to copy data to
+        */
+        static void decode_value(const char* source, Entry* dest) {
+            layout::decode(source, dest);
         }
 
 
         /**
             This struct occupies this many bytes
         */
-        static const unsigned int size = 32 + 56 + 8;
+        static constexpr unsigned int size = layout::size;
 
         /**
             Equality operator. Only check the name strings are equal.
@@ -110,6 +400,20 @@ namespace author {
             return std::string(name.data()) == std::string(other.name.data());
         }
 
+        /**
+            Authors are looked up by name, so they keep a name index.
+        */
+        static const bool has_name_index = true;
+
+        /**
+            Hashes the name string (the same thing operator== compares).
+
+            @return the hash of the name
+        */
+        unsigned long name_hash() const {
+            return hash_bytes(name.data(), strnlen(name.data(), name.size()));
+        }
+
         bool has_author(long author_id) {
             author_id = author_id;
             throw std::runtime_error("invalid call");
@@ -119,15 +423,25 @@ namespace author {
 
 namespace paper {
     struct Entry {
-        // a paper entry contains the paper title, keywords, 8 authors at max, the number of citations it has, its publication year, and its id
-        std::array<char, 96> title;
+        // a paper entry contains the paper title, keywords, its authors, the number of citations it has, its publication year, and its id
+        // the title and authors are kept whole in slotted value pages; fixed value pages only have room for 95 characters of the title and 8 authors
+        std::string title;
         std::array<char, 40> keywords;
-        std::array<long, 8> authors;
+        std::vector<long> authors;
 
         unsigned int n_citations;
         unsigned int pub_year;
         long id;
 
+        // how an entry is serialized; also used to read single fields through BTreeDB::View
+        typedef Field<&Entry::title, 0, 96> Title;
+        typedef Field<&Entry::keywords, 96> Keywords;
+        typedef Field<&Entry::authors, 136, 64> Authors;
+        typedef Field<&Entry::n_citations, 200> NCitations;
+        typedef Field<&Entry::pub_year, 204> PubYear;
+        typedef Field<&Entry::id, 208> Id;
+        typedef Layout<Title, Keywords, Authors, NCitations, PubYear, Id> layout;
+
         /**
             Full constructor for an author entry
 
@@ -135,30 +449,19 @@ namespace paper {
             @param paper_keywords Keywords corresponding to the paper
             @param paper_citations the number of citations the paper has
             @param paper_year the year the paper was published in
-            @param paper_authors array of authors of the paper (max 8)
+            @param paper_authors ids of the authors of the paper
             @param set_id id of the paper
         */
-        Entry(std::string& paper_title, std::string& paper_keywords, unsigned int paper_citations, unsigned int paper_year, std::array<long, 8> paper_authors, long set_id): n_citations(paper_citations), pub_year(paper_year), id(set_id) {
+        Entry(const std::string& paper_title, const std::string& paper_keywords, unsigned int paper_citations, unsigned int paper_year, std::vector<long> paper_authors, long set_id): title(paper_title), authors(std::move(paper_authors)), n_citations(paper_citations), pub_year(paper_year), id(set_id) {
             // 0 initialize to prevent undeifned behavior
-            title.fill(0);
             keywords.fill(0);
-            authors.fill(0);
 
             // truncate strings to fit inside char arrays
-            if (title.size() >= 96) {
-                strcpy(title.data(), paper_title.substr(0, 95).c_str());
-            } else {
-                strcpy(title.data(), paper_title.c_str());
-            }
-
             if (paper_keywords.size() >= 40) {
                 strcpy(keywords.data(), paper_keywords.substr(0, 39).c_str());
             } else {
                 strcpy(keywords.data(), paper_keywords.c_str());
             }
-
-            // copy author data to this struct member
-            memcpy(authors.data(), paper_authors.data(), 64);
         }
 
         /**
@@ -166,24 +469,15 @@ namespace paper {
 
             @param paper_title title of the paper
         */
-        Entry(std::string& paper_title): n_citations(0), pub_year(0), id(0) {
-            title.fill(0);
+        Entry(const std::string& paper_title): title(paper_title), n_citations(0), pub_year(0), id(0) {
             keywords.fill(0);
-            authors.fill(0);
-            if (title.size() >= 96) {
-                strcpy(title.data(), paper_title.substr(0, 95).c_str());
-            } else {
-                strcpy(title.data(), paper_title.c_str());
-            }
         }
 
         /**
             Default constructor for author entry. Never used in reality except as a temporary variable or as an invalid result (with id -1)
         */
-        Entry(): id(NULL_VAL) {
-            title.fill(0);
+        Entry(): n_citations(0), pub_year(0), id(NULL_VAL) {
             keywords.fill(0);
-            authors.fill(0);
         }
 
         /**
@@ -192,13 +486,8 @@ namespace paper {
             @param source Start of char array to copy to the given entry
             @param dest Address of entry to copy data to
         */
-        static void deserialize_value(char* source, Entry* dest) {
-            memcpy(dest->title.data(), source, 96);
-            memcpy(dest->keywords.data(), source + 96, 40);
-            memcpy(dest->authors.data(), source + 136, 64);
-            memcpy(&(dest->n_citations), source + 200, 4);
-            memcpy(&(dest->pub_year), source + 204, 4);
-            memcpy(&(dest->id), source + 208, 8);
+        static void deserialize_value(const char* source, Entry* dest) {
+            layout::read(source, dest);
         }
 
         /**
@@ -208,18 +497,33 @@ namespace paper {
             @param dest Start of char array to copy data to
         */
         static void serialize_value(Entry* source, char* dest) {
-            memcpy(dest, source->title.data(), 96);
-            memcpy(dest + 96, source->keywords.data(), 40);
-            memcpy(dest + 136, source->authors.data(), 64);
-            memcpy(dest + 200, &(source->n_citations), 4);
-            memcpy(dest + 204, &(source->pub_year), 4);
-            memcpy(dest + 208, &(source->id), 8);
+            layout::write(source, dest);
+        }
+
+        /**
+            Function to append the compact encoding of a ValueEntry (used by slotted value pages) to a buffer
+
+            @param source Entry to encode
+            @param dest Buffer to append the encoding to
+        */
+        static void encode_value(const Entry& source, std::vector<char>& dest) {
+            layout::encode(&source, dest);
+        }
+
+        /**
+            Function to decode an entry written by encode_value
+
+            @param source Start of the encoding
+            @param dest Address of entry to copy data to
+        */
+        static void decode_value(const char* source, Entry* dest) {
+            layout::decode(source, dest);
         }
 
         /**
             This struct occupies this many bytes
         */
-        static const unsigned int size = 96 + 40 + 8 * 8 + 4 + 4 + 8;
+        static constexpr unsigned int size = layout::size;
 
         /**
             Equality operator. Only check if the title strings are equal.
@@ -227,18 +531,16 @@ namespace paper {
             @param other the other Entry to check equality with
         */
         bool operator==(const Entry& other) {
-            return std::string(title.data()) == std::string(other.title.data());
+            return title == other.title;
         }
 
+        /**
+            Title lookups are rare and the paper database is huge, so it doesn't keep a name index.
+        */
+        static const bool has_name_index = false;
+
         bool has_author(long author_id) {
-            int i = 0;
-            while (authors[i] != 0 && i < 8) {
-                if (author_id == authors[i]) {
-                    return true;
-                }
-                ++i;
-            }
-            return false;
+            return std::find(authors.begin(), authors.end(), author_id) != authors.end();
         }
     };
 }
@@ -250,6 +552,11 @@ namespace test {
         std::array<char, 12> str;
         long id;
 
+        typedef Field<&Entry::x, 0> X;
+        typedef Field<&Entry::str, 4> Str;
+        typedef Field<&Entry::id, 16> Id;
+        typedef Layout<X, Str, Id> layout;
+
         Entry(int set_x, const std::string& set_str, long set_id): x(set_x), id(set_id) {
             str.fill(0);
             if (set_str.size() >= 12) {
@@ -267,24 +574,34 @@ namespace test {
             str.fill(0);
         }
 
-        static void deserialize_value(char* source, Entry* dest) {
-            memcpy(&(dest->x), source, 4);
-            memcpy(dest->str.data(), source + 4, 12);
-            memcpy(&(dest->id), source + 16, 8);
+        static void deserialize_value(const char* source, Entry* dest) {
+            layout::read(source, dest);
         }
 
         static void serialize_value(Entry* source, char* dest) {
-            memcpy(dest, &(source->x), 4);
-            memcpy(dest + 4, source->str.data(), 12);
-            memcpy(dest + 16, &(source->id), 8);
+            layout::write(source, dest);
+        }
+
+        static void encode_value(const Entry& source, std::vector<char>& dest) {
+            layout::encode(&source, dest);
+        }
+
+        static void decode_value(const char* source, Entry* dest) {
+            layout::decode(source, dest);
         }
 
-        static const unsigned int size = 24;
+        static constexpr unsigned int size = layout::size;
 
         bool operator==(const Entry& other) {
             return x == other.x;
         }
 
+        static const bool has_name_index = true;
+
+        unsigned long name_hash() const {
+            return hash_bytes(reinterpret_cast<const char*>(&x), sizeof(x));
+        }
+
         bool has_author(long author_id) {
             author_id = author_id;
             throw std::runtime_error("invalid call");
@@ -0,0 +1,747 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "page_arena.hpp"
+#include "page_table.hpp"
+
+#define POOL_SHARDS 16 // most shards the buffer pool splits its frames into
+#define MIN_SHARD_FRAMES 64 // fewest frames a shard may have; smaller pools use fewer shards
+
+/**
+    This is a helper enum to switch between function behavior for key pages and value pages
+*/
+enum FileType {
+    Key,
+    Value
+};
+
+/**
+    This is a helper enum for how a page is latched while it is being used. Any number of readers can share a page's latch, while a writer holds it alone; NoLatch is for single threaded work like bulk loading.
+*/
+enum LatchMode {
+    NoLatch,
+    SharedLatch,
+    ExclusiveLatch
+};
+
+/**
+    This struct is what a buffer pool counted since it was created. The arrays are indexed by FileType. A hit is a pin of a page that was already in the pool (or being read in by another thread), a miss is one that had to read it, and prefetched pages are the ones read in by prefetch.
+*/
+struct BufferPoolStats {
+    uint64_t hits[2] = {0, 0};
+    uint64_t misses[2] = {0, 0};
+    uint64_t prefetched[2] = {0, 0};
+    uint64_t evictions = 0;
+};
+
+/**
+    This class is the page cache used by the v2 BTree database. It holds a fixed number of page sized frames (set by a byte budget) that are shared between the key and value files, and picks pages to evict with the CLOCK algorithm (an approximation of LRU that only needs one reference bit per frame).
+
+    Dirty pages are written back when they are evicted, and frames can be pinned so that a page stays in memory (and its data pointer stays valid) for as long as something is working with it. The page data of each shard's frames is one arena (see page_arena.hpp) that is only committed as frames are first used, so small databases never pay for the whole budget, and pages are found through a flat page table (see page_table.hpp).
+
+    The pool is safe to use from several threads at once. Its frames are split into shards by page, each with its own lock, page table, and CLOCK hand, so threads working on different pages rarely wait on each other. A miss reads the page in without holding the lock; other threads that want the same page wait for that read instead of reading it again. Threads should use pin rather than fetch, since an unpinned page can be evicted by another thread at any time.
+
+    Besides its pins, every frame has a latch (a reader/writer lock) that the owner takes while reading or changing the page's data, so that threads changing different pages at once never see each other's pages halfway through a change. Latches are only taken on pinned frames and without holding a shard's lock, so a thread waiting for a latch doesn't hold up the rest of the shard. Evicted frames are never pinned, so eviction doesn't need their latches; flush_page and flush_all write each page under its shared latch.
+
+    The pool doesn't know anything about the files themselves; the owner provides functions to read a page from disk and write a page back to disk, and optionally one that reads a batch of pages at once (used by prefetch). All of them may be called from several threads at once.
+*/
+class BufferPool {
+    public:
+        /**
+            Function used to read a page from disk. Arguments are the file type, the page number, and the destination buffer.
+        */
+        typedef std::function<void(FileType, unsigned int, char*)> ReadFunction;
+        /**
+            Function used to write a page to disk. Arguments are the file type, the page number, and the page data.
+        */
+        typedef std::function<void(FileType, unsigned int, const char*)> WriteFunction;
+        /**
+            Function used to read a batch of pages from disk, all of the same file. Arguments are the file type and the (page number, destination buffer) of every page.
+        */
+        typedef std::function<void(FileType, const std::vector<std::pair<unsigned int, char*>>&)> BatchReadFunction;
+
+        /**
+            Returned by pin for pages that aren't held in the pool.
+        */
+        static const unsigned int NO_FRAME = UINT_MAX;
+
+        /**
+            Constructor for the buffer pool.
+
+            @param page_size The size of every page/frame in bytes
+            @param budget_bytes How many bytes of page data the pool may hold at once (rounded down to whole pages, with a small minimum)
+            @param reader Function used to read pages in on a miss
+            @param writer Function used to write dirty pages back
+            @param batch_reader Function used to read the pages of a prefetch; if empty, they are read one at a time with reader
+        */
+        BufferPool(unsigned int page_size, size_t budget_bytes, ReadFunction reader, WriteFunction writer, BatchReadFunction batch_reader = nullptr);
+
+        /**
+            Destructor. Frees all frames WITHOUT writing anything back; call flush_all first if the data should be kept.
+        */
+        ~BufferPool();
+
+        BufferPool(const BufferPool& other) = delete;
+        BufferPool& operator=(const BufferPool& other) = delete;
+
+        /**
+            Gets the data of a page, reading it in (and possibly evicting another page) on a miss. The pointer is only guaranteed to be valid until the next call that can evict, unless the page is pinned, so this is only for single threaded use.
+
+            @param type Which file the page belongs to
+            @param page_num The page being requested
+            @return the page's data
+        */
+        char* fetch(FileType type, unsigned int page_num);
+
+        /**
+            Gets the data of a page only if it is already in the pool. Nothing is read in and the page's reference bit isn't touched, so this is safe to call for hints like prefetching.
+
+            @param type Which file the page belongs to
+            @param page_num The page being looked up
+            @return the page's data, or nullptr if it isn't in the pool
+        */
+        char* lookup(FileType type, unsigned int page_num) const;
+
+        /**
+            Adds a brand new zero-filled page to the pool without reading anything from disk and pins it. The page starts out dirty.
+
+            @param type Which file the page belongs to
+            @param page_num The page number of the new page
+            @return the frame the page is held in (used for frame_data and unpin)
+        */
+        unsigned int create(FileType type, unsigned int page_num);
+
+        /**
+            Fetches a page and pins it so that it can't be evicted until unpin is called.
+
+            @param type Which file the page belongs to
+            @param page_num The page to pin
+            @return the frame the page is held in (used for frame_data and unpin)
+        */
+        unsigned int pin(FileType type, unsigned int page_num);
+
+        /**
+            Reads pages that are about to be used into the pool with a single call of the batch reader, so that their reads can be in flight together instead of one miss at a time. Pages that are already in the pool are skipped. The pages aren't pinned afterwards; they stay until they are evicted like any other page, so callers shouldn't prefetch more than they use soon.
+
+            @param type Which file the pages belong to
+            @param page_nums The pages to read in
+        */
+        void prefetch(FileType type, const std::vector<unsigned int>& page_nums);
+
+        /**
+            Adds a pin to a frame that is already pinned. Used when copying a pinned handle.
+
+            @param frame The frame to pin again
+        */
+        void repin(unsigned int frame);
+
+        /**
+            Releases one pin of a frame. Frames that are no longer in the pool (after clear) are ignored.
+
+            @param frame The frame to unpin
+        */
+        void unpin(unsigned int frame);
+
+        /**
+            Returns the data of a pinned frame.
+
+            @param frame The frame to get the data for
+            @return the frame's data
+        */
+        char* frame_data(unsigned int frame) const;
+
+        /**
+            Takes the latch of a pinned frame, waiting for any thread that holds it in a conflicting mode. Must not be called while holding the same frame's latch.
+
+            @param frame The frame to latch; BufferPool::NO_FRAME is ignored
+            @param mode How to latch it; NoLatch does nothing
+        */
+        void latch(unsigned int frame, LatchMode mode);
+
+        /**
+            Releases the latch of a frame taken by latch.
+
+            @param frame The frame to unlatch; BufferPool::NO_FRAME is ignored
+            @param mode The mode it was latched in
+        */
+        void unlatch(unsigned int frame, LatchMode mode);
+
+        /**
+            Marks a page as dirty so it will be written back before its frame is reused. Throws if the page isn't in the pool.
+
+            @param type Which file the page belongs to
+            @param page_num The page to mark
+        */
+        void mark_dirty(FileType type, unsigned int page_num);
+
+        /**
+            Writes a single page back if it is dirty, leaving it in the pool as clean. The calling thread must not hold the page's latch.
+
+            @param type Which file the page belongs to
+            @param page_num The page to flush
+        */
+        void flush_page(FileType type, unsigned int page_num);
+
+        /**
+            Writes back every dirty page, in file/page order so the writes are as sequential as possible. Each page is written under its shared latch, so other threads may keep changing pages meanwhile, but the calling thread must not hold any latches.
+        */
+        void flush_all();
+
+        /**
+            Frees all frames and forgets every page without writing anything back. Nothing else may use the pool while this runs.
+        */
+        void clear();
+
+        /**
+            Returns the maximum number of frames the pool may hold.
+
+            @return the capacity of the pool in frames
+        */
+        unsigned int capacity() const;
+
+        /**
+            Returns how many pages in the pool are dirty.
+
+            @return the number of dirty pages
+        */
+        unsigned int dirty_count() const;
+
+        /**
+            Returns the hit, miss, and eviction counts, summed over the shards.
+
+            @return the counts since the pool was created
+        */
+        BufferPoolStats stats() const;
+
+    private:
+        /**
+            This struct is a single frame of the pool. tag is the file type and page number packed together, referenced is the CLOCK bit, pins is the number of handles currently holding the page, loading is set while the page is being read in, and latch guards the page's data (see latch).
+        */
+        struct Frame {
+            char* data = nullptr;
+            uint64_t tag = 0;
+            bool dirty = false;
+            bool referenced = false;
+            bool loading = false;
+            unsigned int pins = 0;
+            std::shared_mutex latch;
+        };
+
+        /**
+            This struct is one shard of the pool: a fixed share of the frames and the pages that live in them. Everything in it is guarded by mutex, except the data pointers of frames, which never change once they are allocated.
+        */
+        struct Shard {
+            std::mutex mutex;
+            /**
+                Signaled whenever a frame finishes loading.
+            */
+            std::condition_variable loaded;
+            /**
+                Room for every frame the shard may hold; only the first num_frames are in use.
+            */
+            std::unique_ptr<Frame[]> frames;
+            /**
+                The page data of the frames; frame i holds page i of the arena.
+            */
+            PageArena arena;
+            unsigned int num_frames = 0;
+            unsigned int capacity = 0;
+            /**
+                Maps tags of resident pages to the frame they live in.
+            */
+            PageTable page_table;
+            /**
+                The CLOCK hand; the next frame considered for eviction.
+            */
+            unsigned int hand = 0;
+            /**
+                What happened in this shard; counted under the lock the shard is already held with, so counting costs nothing.
+            */
+            BufferPoolStats stats;
+        };
+
+        /**
+            Packs a file type and page number into one key for the page table.
+        */
+        static uint64_t make_tag(FileType type, unsigned int page_num);
+
+        /**
+            Returns the shard a page belongs to. Consecutive pages go to different shards.
+        */
+        unsigned int shard_of(uint64_t tag) const;
+
+        /**
+            Finds a frame for a new page, either by allocating one (if under capacity) or by evicting a page with the CLOCK algorithm. The frame is removed from the page table. The shard must be locked.
+
+            @param shard The shard to find a frame in
+            @return the index of a free frame within the shard
+        */
+        unsigned int get_free_frame(Shard& shard);
+
+        /**
+            Writes back a frame if it is dirty. The frame's shard must be locked.
+        */
+        void write_frame(Frame& frame);
+
+        /**
+            Writes back a frame under its shared latch if it still holds the given page and is dirty. The shard must not be locked.
+
+            @param shard_num The shard the frame is in
+            @param idx The index of the frame within the shard
+            @param tag The page the frame was found holding
+        */
+        void flush_frame(unsigned int shard_num, unsigned int idx, uint64_t tag);
+
+        unsigned int page_size_;
+        unsigned int capacity_;
+        unsigned int num_shards_;
+        std::unique_ptr<Shard[]> shards_;
+        std::atomic<unsigned int> dirty_count_;
+
+        ReadFunction reader_;
+        WriteFunction writer_;
+        BatchReadFunction batch_reader_;
+};
+
+inline BufferPool::BufferPool(unsigned int page_size, size_t budget_bytes, ReadFunction reader, WriteFunction writer, BatchReadFunction batch_reader): page_size_(page_size), dirty_count_(0), reader_(reader), writer_(writer), batch_reader_(batch_reader) {
+    // a single insert pins a handful of pages at once, so never go below a small minimum
+    size_t frames = budget_bytes / page_size;
+    capacity_ = static_cast<unsigned int>(std::min<size_t>(std::max<size_t>(frames, MIN_SHARD_FRAMES), UINT_MAX - 1));
+
+    // every shard needs enough frames for the pins of one operation, so small pools get fewer shards
+    num_shards_ = std::max(1u, std::min<unsigned int>(POOL_SHARDS, capacity_ / MIN_SHARD_FRAMES));
+    shards_.reset(new Shard[num_shards_]);
+    for (unsigned int i = 0; i < num_shards_; ++i) {
+        shards_[i].capacity = capacity_ / num_shards_ + (i < capacity_ % num_shards_ ? 1 : 0);
+        shards_[i].frames.reset(new Frame[shards_[i].capacity]);
+        shards_[i].arena = PageArena(page_size_, shards_[i].capacity);
+    }
+}
+
+inline BufferPool::~BufferPool() {
+    clear();
+}
+
+inline uint64_t BufferPool::make_tag(FileType type, unsigned int page_num) {
+    return (static_cast<uint64_t>(type) << 32) | page_num;
+}
+
+inline unsigned int BufferPool::shard_of(uint64_t tag) const {
+    return static_cast<unsigned int>((tag ^ (tag >> 32)) % num_shards_);
+}
+
+inline char* BufferPool::fetch(FileType type, unsigned int page_num) {
+    // the page stays in its frame after the pin is released until something else evicts it
+    unsigned int frame = pin(type, page_num);
+    char* data = frame_data(frame);
+    unpin(frame);
+    return data;
+}
+
+inline char* BufferPool::lookup(FileType type, unsigned int page_num) const {
+    uint64_t tag = make_tag(type, page_num);
+    Shard& shard = shards_[shard_of(tag)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    unsigned int found = shard.page_table.find(tag);
+    if (found == PageTable::NOT_FOUND || shard.frames[found].loading) {
+        return nullptr;
+    }
+    return shard.frames[found].data;
+}
+
+inline unsigned int BufferPool::create(FileType type, unsigned int page_num) {
+    uint64_t tag = make_tag(type, page_num);
+    unsigned int shard_num = shard_of(tag);
+    Shard& shard = shards_[shard_num];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (shard.page_table.find(tag) != PageTable::NOT_FOUND) {
+        throw std::runtime_error("page already exists in the buffer pool");
+    }
+
+    unsigned int idx = get_free_frame(shard);
+    Frame& frame = shard.frames[idx];
+    memset(frame.data, 0, page_size_);
+
+    frame.tag = tag;
+    frame.dirty = true;
+    ++dirty_count_;
+    frame.referenced = true;
+    frame.loading = false;
+    frame.pins = 1;
+    shard.page_table.insert(tag, idx);
+
+    return idx * num_shards_ + shard_num;
+}
+
+inline unsigned int BufferPool::pin(FileType type, unsigned int page_num) {
+    uint64_t tag = make_tag(type, page_num);
+    unsigned int shard_num = shard_of(tag);
+    Shard& shard = shards_[shard_num];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    // cache hit; set the reference bit so CLOCK gives the page a second chance
+    unsigned int found = shard.page_table.find(tag);
+    if (found != PageTable::NOT_FOUND) {
+        ++shard.stats.hits[type];
+        unsigned int idx = found;
+        Frame& frame = shard.frames[idx];
+        ++frame.pins;
+        frame.referenced = true;
+
+        // another thread is reading the page in; the pin keeps the frame from being reused meanwhile
+        if (frame.loading) {
+            shard.loaded.wait(lock, [&frame] { return !frame.loading; });
+
+            // the read failed and the page was dropped
+            if (shard.page_table.find(tag) != idx) {
+                --frame.pins;
+                throw std::runtime_error("error reading page into the buffer pool");
+            }
+        }
+        return idx * num_shards_ + shard_num;
+    }
+
+    // cache miss; claim a free frame, then read the page in without holding the lock
+    ++shard.stats.misses[type];
+    unsigned int idx = get_free_frame(shard);
+    Frame& frame = shard.frames[idx];
+    frame.tag = tag;
+    frame.dirty = false;
+    frame.referenced = true;
+    frame.loading = true;
+    frame.pins = 1;
+    shard.page_table.insert(tag, idx);
+    lock.unlock();
+
+    try {
+        reader_(type, page_num, frame.data);
+    } catch (...) {
+        lock.lock();
+        frame.loading = false;
+        --frame.pins;
+        shard.page_table.erase(tag);
+        shard.loaded.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    frame.loading = false;
+    shard.loaded.notify_all();
+    return idx * num_shards_ + shard_num;
+}
+
+inline void BufferPool::prefetch(FileType type, const std::vector<unsigned int>& page_nums) {
+    // claim a frame for every page that isn't in the pool, the same way a miss does; other threads that want one of them wait for the batch
+    std::vector<std::pair<unsigned int, char*>> reads;
+    std::vector<unsigned int> frames;
+    for (unsigned int page_num : page_nums) {
+        uint64_t tag = make_tag(type, page_num);
+        unsigned int shard_num = shard_of(tag);
+        Shard& shard = shards_[shard_num];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        if (shard.page_table.find(tag) != PageTable::NOT_FOUND) {
+            continue;
+        }
+
+        // prefetching is only a hint; if every frame of the shard is pinned, just read what was claimed so far
+        unsigned int idx;
+        try {
+            idx = get_free_frame(shard);
+        } catch (const std::runtime_error&) {
+            break;
+        }
+
+        Frame& frame = shard.frames[idx];
+        frame.tag = tag;
+        frame.dirty = false;
+        frame.referenced = true;
+        frame.loading = true;
+        frame.pins = 1;
+        shard.page_table.insert(tag, idx);
+
+        ++shard.stats.prefetched[type];
+        reads.push_back({page_num, frame.data});
+        frames.push_back(idx * num_shards_ + shard_num);
+    }
+
+    if (reads.empty()) {
+        return;
+    }
+
+    std::exception_ptr error;
+    try {
+        if (batch_reader_) {
+            batch_reader_(type, reads);
+        } else {
+            for (const auto& read : reads) {
+                reader_(type, read.first, read.second);
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // hand the frames over like a finished miss; if the batch failed, drop them all, since there is no telling which reads landed
+    for (unsigned int frame_id : frames) {
+        Shard& shard = shards_[frame_id % num_shards_];
+        unsigned int idx = frame_id / num_shards_;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        Frame& frame = shard.frames[idx];
+        frame.loading = false;
+        --frame.pins;
+        if (error) {
+            if (shard.page_table.find(frame.tag) == idx) {
+                shard.page_table.erase(frame.tag);
+            }
+        }
+        shard.loaded.notify_all();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+inline void BufferPool::repin(unsigned int frame) {
+    unsigned int shard_num = frame % num_shards_;
+    unsigned int idx = frame / num_shards_;
+    Shard& shard = shards_[shard_num];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (idx < shard.num_frames) {
+        ++shard.frames[idx].pins;
+    }
+}
+
+inline void BufferPool::unpin(unsigned int frame) {
+    unsigned int shard_num = frame % num_shards_;
+    unsigned int idx = frame / num_shards_;
+    Shard& shard = shards_[shard_num];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (idx < shard.num_frames && shard.frames[idx].pins > 0) {
+        --shard.frames[idx].pins;
+    }
+}
+
+inline char* BufferPool::frame_data(unsigned int frame) const {
+    unsigned int idx = frame / num_shards_;
+    const Shard& shard = shards_[frame % num_shards_];
+    if (frame == NO_FRAME || idx >= shard.capacity) {
+        throw std::runtime_error("frame out of bounds of the buffer pool");
+    }
+    return shard.frames[idx].data;
+}
+
+inline void BufferPool::latch(unsigned int frame, LatchMode mode) {
+    if (frame == NO_FRAME || mode == NoLatch) {
+        return;
+    }
+
+    // the frame is pinned, so it can't be reused while we wait; frames never move once allocated
+    std::shared_mutex& latch = shards_[frame % num_shards_].frames[frame / num_shards_].latch;
+    if (mode == SharedLatch) {
+        latch.lock_shared();
+    } else {
+        latch.lock();
+    }
+}
+
+inline void BufferPool::unlatch(unsigned int frame, LatchMode mode) {
+    if (frame == NO_FRAME || mode == NoLatch) {
+        return;
+    }
+
+    std::shared_mutex& latch = shards_[frame % num_shards_].frames[frame / num_shards_].latch;
+    if (mode == SharedLatch) {
+        latch.unlock_shared();
+    } else {
+        latch.unlock();
+    }
+}
+
+inline void BufferPool::mark_dirty(FileType type, unsigned int page_num) {
+    uint64_t tag = make_tag(type, page_num);
+    Shard& shard = shards_[shard_of(tag)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    unsigned int found = shard.page_table.find(tag);
+    if (found == PageTable::NOT_FOUND) {
+        throw std::runtime_error(type == Key ? "page_num not in key cache" : "page_num not in value cache");
+    }
+    Frame& frame = shard.frames[found];
+    if (!frame.dirty) {
+        frame.dirty = true;
+        ++dirty_count_;
+    }
+}
+
+inline void BufferPool::flush_page(FileType type, unsigned int page_num) {
+    uint64_t tag = make_tag(type, page_num);
+    unsigned int shard_num = shard_of(tag);
+    unsigned int idx;
+    {
+        Shard& shard = shards_[shard_num];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        idx = shard.page_table.find(tag);
+        if (idx == PageTable::NOT_FOUND) {
+            return;
+        }
+    }
+
+    flush_frame(shard_num, idx, tag);
+}
+
+inline void BufferPool::flush_all() {
+    // sort the dirty frames of every shard by file and page number so the writes go out in order
+    std::vector<std::pair<uint64_t, unsigned int>> dirty;
+    for (unsigned int s = 0; s < num_shards_; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        for (unsigned int i = 0; i < shards_[s].num_frames; ++i) {
+            const Frame& frame = shards_[s].frames[i];
+            if (frame.dirty) {
+                dirty.push_back({frame.tag, i * num_shards_ + s});
+            }
+        }
+    }
+    std::sort(dirty.begin(), dirty.end());
+
+    for (const auto& entry : dirty) {
+        flush_frame(entry.second % num_shards_, entry.second / num_shards_, entry.first);
+    }
+}
+
+inline void BufferPool::clear() {
+    for (unsigned int s = 0; s < num_shards_; ++s) {
+        Shard& shard = shards_[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (unsigned int i = 0; i < shard.num_frames; ++i) {
+            // latches can't be copied, so reset the rest of the frame field by field
+            Frame& frame = shard.frames[i];
+            frame.data = nullptr;
+            frame.tag = 0;
+            frame.dirty = false;
+            frame.referenced = false;
+            frame.loading = false;
+            frame.pins = 0;
+        }
+        shard.num_frames = 0;
+        // every frame's data goes back to the system at once
+        shard.arena.release();
+        shard.page_table.clear();
+        shard.hand = 0;
+    }
+    dirty_count_ = 0;
+}
+
+inline unsigned int BufferPool::capacity() const {
+    return capacity_;
+}
+
+inline unsigned int BufferPool::dirty_count() const {
+    return dirty_count_;
+}
+
+inline BufferPoolStats BufferPool::stats() const {
+    BufferPoolStats res;
+    for (unsigned int i = 0; i < num_shards_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        const BufferPoolStats& shard = shards_[i].stats;
+        for (unsigned int type = 0; type < 2; ++type) {
+            res.hits[type] += shard.hits[type];
+            res.misses[type] += shard.misses[type];
+            res.prefetched[type] += shard.prefetched[type];
+        }
+        res.evictions += shard.evictions;
+    }
+    return res;
+}
+
+inline unsigned int BufferPool::get_free_frame(Shard& shard) {
+    // still under budget; take the next page of the arena
+    if (shard.num_frames < shard.capacity) {
+        shard.frames[shard.num_frames].data = shard.arena.page(shard.num_frames);
+        return shard.num_frames++;
+    }
+
+    // sweep the clock; pinned frames are skipped and referenced frames get their bit cleared
+    // two full sweeps are enough to clear every reference bit, so a third means everything is pinned
+    for (size_t steps = 0; steps < 3 * static_cast<size_t>(shard.num_frames); ++steps) {
+        unsigned int idx = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.num_frames;
+
+        Frame& frame = shard.frames[idx];
+        if (frame.pins > 0) {
+            continue;
+        }
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+
+        // found a victim; write it back if needed and drop it from the page table (unless a failed read already did)
+        ++shard.stats.evictions;
+        write_frame(frame);
+        if (shard.page_table.find(frame.tag) == idx) {
+            shard.page_table.erase(frame.tag);
+        }
+        return idx;
+    }
+
+    throw std::runtime_error("buffer pool exhausted: every frame is pinned");
+}
+
+inline void BufferPool::write_frame(Frame& frame) {
+    if (!frame.dirty) {
+        return;
+    }
+    writer_(static_cast<FileType>(frame.tag >> 32), static_cast<unsigned int>(frame.tag), frame.data);
+    frame.dirty = false;
+    --dirty_count_;
+}
+
+inline void BufferPool::flush_frame(unsigned int shard_num, unsigned int idx, uint64_t tag) {
+    Shard& shard = shards_[shard_num];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    // the page may have been written or evicted since it was found
+    Frame& frame = shard.frames[idx];
+    if (idx >= shard.num_frames || frame.tag != tag || !frame.dirty) {
+        return;
+    }
+
+    // pin the frame so it stays put, then wait for anyone changing the page without holding up the shard
+    ++frame.pins;
+    lock.unlock();
+    frame.latch.lock_shared();
+    lock.lock();
+
+    try {
+        write_frame(frame);
+    } catch (...) {
+        --frame.pins;
+        lock.unlock();
+        frame.latch.unlock_shared();
+        throw;
+    }
+
+    --frame.pins;
+    lock.unlock();
+    frame.latch.unlock_shared();
+}
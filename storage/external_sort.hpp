@@ -0,0 +1,305 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+#define SORT_RUN_BYTES (256UL << 20) // most memory the records of an ExternalSorter take before they are sorted and written out as a run
+
+/**
+    This class sorts (key, value) records by key without holding all of them in memory, for feeding BTreeDB::bulk_load. Records are buffered until they take SORT_RUN_BYTES; each full buffer is sorted and written to a run file in the compact encoding of the values (T::encode_value), and reading the records back merges the runs through an input iterator. Memory use is one buffer plus one record per run, however many records there are.
+
+    The sort is stable: records with the same key come out in the order they were added, so the last copy of a repeated key is the last one bulk_load sees (and keeps).
+
+    @tparam T The type of the values, a ValueEntry-type struct (see btree_types.cpp)
+*/
+template <typename T>
+class ExternalSorter {
+    private:
+        /**
+            This struct is where the next record of the merge comes from: a run file, or (for the newest records) the buffer itself, which is never written out.
+        */
+        struct Source {
+            std::ifstream in;
+            const std::vector<std::pair<long, T>>* buffer = nullptr;
+            size_t pos = 0;
+            std::pair<long, T> head;
+
+            /**
+                Reads the next record into head.
+
+                @return false if the source is used up
+            */
+            bool next();
+        };
+
+        /**
+            This struct is the state of a merge: every source with a record left, ordered by (key, source number). Earlier sources hold earlier records, so ties go to them.
+        */
+        struct Merge {
+            std::vector<Source> sources;
+            std::priority_queue<std::pair<long, size_t>, std::vector<std::pair<long, size_t>>, std::greater<std::pair<long, size_t>>> heap;
+        };
+
+    public:
+        /**
+            This class is an input iterator over the sorted records. Only one pass can be made, like over a stream.
+        */
+        class Iterator {
+            public:
+                Iterator() {}
+                Iterator(std::shared_ptr<Merge> merge): merge_(std::move(merge)) {}
+
+                const std::pair<long, T>& operator*() const;
+                const std::pair<long, T>* operator->() const;
+                Iterator& operator++();
+
+                /**
+                    Iterators are only ever compared to the end, so they are equal when both are used up.
+                */
+                bool operator==(const Iterator& other) const;
+                bool operator!=(const Iterator& other) const;
+
+            private:
+                bool done() const;
+
+                std::shared_ptr<Merge> merge_;
+        };
+
+        /**
+            Creates an empty sorter.
+
+            @param prefix The start of the names of the run files (prefix.0.run, prefix.1.run, ...), which are removed once the sorter goes away
+            @param run_bytes How much memory the buffered records may take before they are written out as a run
+        */
+        ExternalSorter(const std::string& prefix, size_t run_bytes=SORT_RUN_BYTES);
+
+        /**
+            Destructor. Removes the run files.
+        */
+        ~ExternalSorter();
+
+        ExternalSorter(const ExternalSorter& other) = delete;
+        ExternalSorter& operator=(const ExternalSorter& other) = delete;
+
+        /**
+            Adds a record. Can't be called once begin has been.
+
+            @param key The key
+            @param value The value
+        */
+        void add(long key, const T& value);
+
+        /**
+            Returns the number of records added so far.
+
+            @return the number of records
+        */
+        size_t size() const;
+
+        /**
+            Returns the number of runs written to disk so far.
+
+            @return the number of run files
+        */
+        size_t num_runs() const;
+
+        /**
+            Sorts the buffered records and starts merging them with the runs. Can only be called once.
+
+            @return an iterator at the record with the smallest key
+        */
+        Iterator begin();
+
+        /**
+            Returns the iterator that begin's iterator equals once every record has been read.
+
+            @return the end iterator
+        */
+        Iterator end() const;
+
+    private:
+        /**
+            Sorts the buffered records by key (keeping the order of equal keys) and writes them to a new run file.
+        */
+        void write_run();
+
+        /**
+            Returns the name of a run file.
+        */
+        std::string run_filename(size_t run) const;
+
+        std::string prefix_;
+        size_t max_buffered_;
+        std::vector<std::pair<long, T>> buffer_;
+        size_t num_runs_;
+        size_t size_;
+        bool merging_;
+};
+
+template <typename T>
+bool ExternalSorter<T>::Source::next() {
+    if (buffer) {
+        if (pos == buffer->size()) {
+            return false;
+        }
+        head = (*buffer)[pos++];
+        return true;
+    }
+
+    // each record is its key, the length of its encoded value, and the encoded value
+    uint32_t len;
+    if (!in.read(reinterpret_cast<char*>(&head.first), sizeof(head.first)) || !in.read(reinterpret_cast<char*>(&len), sizeof(len))) {
+        return false;
+    }
+    std::vector<char> encoded(len);
+    if (!in.read(encoded.data(), len)) {
+        throw std::runtime_error("error reading sort run");
+    }
+    head.second = T();
+    T::decode_value(encoded.data(), &head.second);
+    return true;
+}
+
+template <typename T>
+const std::pair<long, T>& ExternalSorter<T>::Iterator::operator*() const {
+    return merge_->sources[merge_->heap.top().second].head;
+}
+
+template <typename T>
+const std::pair<long, T>* ExternalSorter<T>::Iterator::operator->() const {
+    return &**this;
+}
+
+template <typename T>
+typename ExternalSorter<T>::Iterator& ExternalSorter<T>::Iterator::operator++() {
+    size_t source = merge_->heap.top().second;
+    merge_->heap.pop();
+    if (merge_->sources[source].next()) {
+        merge_->heap.push({merge_->sources[source].head.first, source});
+    }
+    return *this;
+}
+
+template <typename T>
+bool ExternalSorter<T>::Iterator::done() const {
+    return !merge_ || merge_->heap.empty();
+}
+
+template <typename T>
+bool ExternalSorter<T>::Iterator::operator==(const Iterator& other) const {
+    return done() && other.done();
+}
+
+template <typename T>
+bool ExternalSorter<T>::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+template <typename T>
+ExternalSorter<T>::ExternalSorter(const std::string& prefix, size_t run_bytes): prefix_(prefix), max_buffered_(std::max<size_t>(run_bytes / sizeof(std::pair<long, T>), 1)), num_runs_(0), size_(0), merging_(false) {}
+
+template <typename T>
+ExternalSorter<T>::~ExternalSorter() {
+    for (size_t i = 0; i < num_runs_; ++i) {
+        std::remove(run_filename(i).c_str());
+    }
+}
+
+template <typename T>
+void ExternalSorter<T>::add(long key, const T& value) {
+    if (merging_) {
+        throw std::runtime_error("can't add to a sorter that is being read");
+    }
+    buffer_.emplace_back(key, value);
+    ++size_;
+    if (buffer_.size() >= max_buffered_) {
+        write_run();
+    }
+}
+
+template <typename T>
+size_t ExternalSorter<T>::size() const {
+    return size_;
+}
+
+template <typename T>
+size_t ExternalSorter<T>::num_runs() const {
+    return num_runs_;
+}
+
+template <typename T>
+std::string ExternalSorter<T>::run_filename(size_t run) const {
+    return prefix_ + "." + std::to_string(run) + ".run";
+}
+
+template <typename T>
+void ExternalSorter<T>::write_run() {
+    std::stable_sort(buffer_.begin(), buffer_.end(), [](const std::pair<long, T>& a, const std::pair<long, T>& b) {
+        return a.first < b.first;
+    });
+
+    std::ofstream out(run_filename(num_runs_), std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("error creating sort run");
+    }
+    std::vector<char> encoded;
+    for (const auto& record : buffer_) {
+        encoded.clear();
+        T::encode_value(record.second, encoded);
+        uint32_t len = static_cast<uint32_t>(encoded.size());
+        out.write(reinterpret_cast<const char*>(&record.first), sizeof(record.first));
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(encoded.data(), len);
+    }
+    if (!out) {
+        throw std::runtime_error("error writing sort run");
+    }
+    ++num_runs_;
+
+    // the buffer's memory goes back too, so a sorter only holds one buffer at a time
+    std::vector<std::pair<long, T>>().swap(buffer_);
+}
+
+template <typename T>
+typename ExternalSorter<T>::Iterator ExternalSorter<T>::begin() {
+    if (merging_) {
+        throw std::runtime_error("a sorter can only be read once");
+    }
+    merging_ = true;
+
+    // the newest records are sorted in place instead of being written out, so small inputs never touch the disk
+    std::stable_sort(buffer_.begin(), buffer_.end(), [](const std::pair<long, T>& a, const std::pair<long, T>& b) {
+        return a.first < b.first;
+    });
+
+    std::shared_ptr<Merge> merge = std::make_shared<Merge>();
+    merge->sources.resize(num_runs_ + 1);
+    for (size_t i = 0; i < num_runs_; ++i) {
+        merge->sources[i].in.open(run_filename(i), std::ios::binary);
+        if (!merge->sources[i].in.is_open()) {
+            throw std::runtime_error("error opening sort run");
+        }
+    }
+    merge->sources[num_runs_].buffer = &buffer_;
+
+    for (size_t i = 0; i < merge->sources.size(); ++i) {
+        if (merge->sources[i].next()) {
+            merge->heap.push({merge->sources[i].head.first, i});
+        }
+    }
+    return Iterator(std::move(merge));
+}
+
+template <typename T>
+typename ExternalSorter<T>::Iterator ExternalSorter<T>::end() const {
+    return Iterator();
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstring>
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_SEARCH_X86
+#endif
+
+#define KEY_SEARCH_WINDOW 32 // binary search narrows down to this many keys, which are then counted in one pass
+
+/**
+    Search functions for the key pages that store their keys as one contiguous array of longs, or of 32 bit deltas from a base key (see KeyFormat). The search is a branchless binary search down to a small window of keys, followed by counting the keys in the window that are smaller than the search key. The counting step is vectorized with AVX2 or SSE4.2 when the CPU supports it (picked once at runtime, so the binary still runs anywhere), with a branchless scalar fallback.
+
+    Keys are read with memcpy/unaligned loads, so the array doesn't need to be aligned.
+*/
+
+/**
+    Reads the nth long of an unaligned array.
+*/
+inline long load_key(const char* keys, unsigned int n) {
+    long res;
+    memcpy(&res, keys + static_cast<size_t>(n) * 8, 8);
+    return res;
+}
+
+/**
+    Counts the keys smaller than a key, one at a time without branches.
+
+    @param keys The key array
+    @param n Number of keys
+    @param key The key to compare against
+    @return the number of keys < key
+*/
+inline unsigned int count_less_scalar(const char* keys, unsigned int n, long key) {
+    unsigned int res = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        res += load_key(keys, i) < key;
+    }
+    return res;
+}
+
+#ifdef KEY_SEARCH_X86
+/**
+    count_less_scalar, 4 keys at a time with AVX2.
+*/
+__attribute__((target("avx2"))) inline unsigned int count_less_avx2(const char* keys, unsigned int n, long key) {
+    __m256i target = _mm256_set1_epi64x(key);
+    unsigned int res = 0;
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i * 8));
+        // lanes where key > keys[i] are all ones; one bit per lane in the mask
+        __m256i less = _mm256_cmpgt_epi64(target, block);
+        res += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(less)));
+    }
+    return res + count_less_scalar(keys + i * 8, n - i, key);
+}
+
+/**
+    count_less_scalar, 2 keys at a time with SSE4.2.
+*/
+__attribute__((target("sse4.2,popcnt"))) inline unsigned int count_less_sse42(const char* keys, unsigned int n, long key) {
+    __m128i target = _mm_set1_epi64x(key);
+    unsigned int res = 0;
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i * 8));
+        __m128i less = _mm_cmpgt_epi64(target, block);
+        res += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(less)));
+    }
+    return res + count_less_scalar(keys + i * 8, n - i, key);
+}
+#endif
+
+typedef unsigned int (*CountLessFunction)(const char*, unsigned int, long);
+
+/**
+    Returns the fastest count_less implementation the CPU supports.
+*/
+inline CountLessFunction pick_count_less() {
+#ifdef KEY_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return count_less_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return count_less_sse42;
+    }
+#endif
+    return count_less_scalar;
+}
+
+/**
+    Finds the position of the first key that is not smaller than the passed in key (the same result as std::lower_bound) in a sorted key array.
+
+    @param keys The sorted key array
+    @param n Number of keys
+    @param key The key to search for
+    @return the position of the first key >= key; n if there is none
+*/
+inline unsigned int search_keys(const char* keys, unsigned int n, long key) {
+    static const CountLessFunction count_less = pick_count_less();
+
+    // every key before base is smaller than the search key and every key from base + n on is not
+    unsigned int base = 0;
+    while (n > KEY_SEARCH_WINDOW) {
+        unsigned int half = n / 2;
+        base = load_key(keys, base + half) < key ? base + half : base;
+        n -= half;
+    }
+
+    return base + count_less(keys + static_cast<size_t>(base) * 8, n, key);
+}
+
+/**
+    Reads the nth unsigned int of an unaligned array.
+*/
+inline unsigned int load_delta(const char* deltas, unsigned int n) {
+    unsigned int res;
+    memcpy(&res, deltas + static_cast<size_t>(n) * 4, 4);
+    return res;
+}
+
+/**
+    count_less_scalar for the 32 bit deltas of key pages with compressed keys.
+
+    @param deltas The delta array
+    @param n Number of deltas
+    @param delta The delta to compare against
+    @return the number of deltas < delta
+*/
+inline unsigned int count_less_deltas_scalar(const char* deltas, unsigned int n, unsigned int delta) {
+    unsigned int res = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        res += load_delta(deltas, i) < delta;
+    }
+    return res;
+}
+
+#ifdef KEY_SEARCH_X86
+/**
+    count_less_deltas_scalar, 8 deltas at a time with AVX2. There is no unsigned compare, so both sides have their sign bit flipped first, which keeps their order as signed numbers.
+*/
+__attribute__((target("avx2"))) inline unsigned int count_less_deltas_avx2(const char* deltas, unsigned int n, unsigned int delta) {
+    __m256i flip = _mm256_set1_epi32(INT_MIN);
+    __m256i target = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(delta)), flip);
+    unsigned int res = 0;
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(deltas + i * 4)), flip);
+        __m256i less = _mm256_cmpgt_epi32(target, block);
+        res += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+    }
+    return res + count_less_deltas_scalar(deltas + i * 4, n - i, delta);
+}
+
+/**
+    count_less_deltas_scalar, 4 deltas at a time with SSE2 (which every x86-64 CPU has).
+*/
+__attribute__((target("sse2,popcnt"))) inline unsigned int count_less_deltas_sse2(const char* deltas, unsigned int n, unsigned int delta) {
+    __m128i flip = _mm_set1_epi32(INT_MIN);
+    __m128i target = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(delta)), flip);
+    unsigned int res = 0;
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i * 4)), flip);
+        __m128i less = _mm_cmpgt_epi32(target, block);
+        res += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+    }
+    return res + count_less_deltas_scalar(deltas + i * 4, n - i, delta);
+}
+#endif
+
+typedef unsigned int (*CountLessDeltasFunction)(const char*, unsigned int, unsigned int);
+
+/**
+    Returns the fastest count_less_deltas implementation the CPU supports.
+*/
+inline CountLessDeltasFunction pick_count_less_deltas() {
+#ifdef KEY_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return count_less_deltas_avx2;
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        return count_less_deltas_sse2;
+    }
+#endif
+    return count_less_deltas_scalar;
+}
+
+/**
+    search_keys for the 32 bit deltas of key pages with compressed keys.
+
+    @param deltas The sorted delta array
+    @param n Number of deltas
+    @param delta The delta to search for
+    @return the position of the first delta >= delta; n if there is none
+*/
+inline unsigned int search_deltas(const char* deltas, unsigned int n, unsigned int delta) {
+    static const CountLessDeltasFunction count_less = pick_count_less_deltas();
+
+    unsigned int base = 0;
+    while (n > KEY_SEARCH_WINDOW) {
+        unsigned int half = n / 2;
+        base = load_delta(deltas, base + half) < delta ? base + half : base;
+        n -= half;
+    }
+
+    return base + count_less(deltas + static_cast<size_t>(base) * 4, n, delta);
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#define LATENCY_SUB_BITS 3 // bits of each latency kept below its highest bit; every bucket is within 1/8 of its value
+#define LATENCY_MAX_BITS 40 // latencies of 2^40 ns (about 18 minutes) or more all go to the last bucket
+
+/**
+    This struct is a summary of a latency histogram: how many operations were recorded and the latency below which a share of them finished. Latencies are in nanoseconds.
+*/
+struct LatencySummary {
+    uint64_t count = 0;
+    uint64_t mean_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p90_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+/**
+    This class is a histogram of operation latencies with a fixed relative error, in the style of an HDR histogram: latencies are bucketed by their highest set bit and the LATENCY_SUB_BITS bits below it, so a bucket spans 1/8 of its value whether it holds nanoseconds or seconds, and a few hundred buckets cover everything from 1 ns to minutes.
+
+    Recording is one relaxed atomic add, so any number of threads can record at once; summaries taken meanwhile may be off by the operations in flight.
+*/
+class LatencyHistogram {
+    public:
+        /**
+            This class times an operation for its whole scope and records it when it goes out of scope, so every return (and exception) is counted.
+        */
+        class Timer {
+            public:
+                Timer(LatencyHistogram& histogram): histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+                ~Timer() {
+                    histogram_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+                }
+
+                Timer(const Timer& other) = delete;
+                Timer& operator=(const Timer& other) = delete;
+
+            private:
+                LatencyHistogram& histogram_;
+                std::chrono::steady_clock::time_point start_;
+        };
+
+        LatencyHistogram();
+
+        LatencyHistogram(const LatencyHistogram& other) = delete;
+        LatencyHistogram& operator=(const LatencyHistogram& other) = delete;
+
+        /**
+            Records one operation.
+
+            @param ns How long it took in nanoseconds
+        */
+        void record(uint64_t ns);
+
+        /**
+            Summarizes everything recorded so far. Percentiles are the upper end of the bucket they fall in, so they are never below the true value and at most 1/8 above it.
+
+            @return the summary; all 0 if nothing was recorded
+        */
+        LatencySummary summary() const;
+
+    private:
+        static const unsigned int SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+        static const unsigned int NUM_BUCKETS = (LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * SUB_BUCKETS;
+
+        /**
+            Returns the bucket of a latency. Latencies below SUB_BUCKETS get a bucket each.
+        */
+        static unsigned int bucket_of(uint64_t ns);
+
+        /**
+            Returns the largest latency that goes in a bucket.
+        */
+        static uint64_t bucket_max(unsigned int bucket);
+
+        std::atomic<uint64_t> buckets_[NUM_BUCKETS];
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> total_ns_;
+        std::atomic<uint64_t> max_ns_;
+};
+
+inline LatencyHistogram::LatencyHistogram(): count_(0), total_ns_(0), max_ns_(0) {
+    for (unsigned int i = 0; i < NUM_BUCKETS; ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+inline unsigned int LatencyHistogram::bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return static_cast<unsigned int>(ns);
+    }
+
+    // the highest bit picks the group and the bits right below it pick the bucket in the group
+    unsigned int high = 63 - __builtin_clzll(ns);
+    if (high >= LATENCY_MAX_BITS) {
+        return NUM_BUCKETS - 1;
+    }
+    unsigned int sub = static_cast<unsigned int>((ns >> (high - LATENCY_SUB_BITS)) & (SUB_BUCKETS - 1));
+    return (high - LATENCY_SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+inline uint64_t LatencyHistogram::bucket_max(unsigned int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    if (bucket == NUM_BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+
+    unsigned int high = bucket / SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    uint64_t width = 1UL << (high - LATENCY_SUB_BITS);
+    return (1UL << high) + (sub + 1) * width - 1;
+}
+
+inline void LatencyHistogram::record(uint64_t ns) {
+    buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+}
+
+inline LatencySummary LatencyHistogram::summary() const {
+    LatencySummary res;
+
+    // the counts are read once, so the percentiles agree with each other even while others record
+    uint64_t counts[NUM_BUCKETS];
+    for (unsigned int i = 0; i < NUM_BUCKETS; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        res.count += counts[i];
+    }
+    if (res.count == 0) {
+        return res;
+    }
+    res.mean_ns = total_ns_.load(std::memory_order_relaxed) / std::max<uint64_t>(count_.load(std::memory_order_relaxed), 1);
+    res.max_ns = max_ns_.load(std::memory_order_relaxed);
+
+    // the smallest latency that at least a share of the operations are at or below (capped at the largest one seen)
+    auto percentile = [&](double share) {
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(share * res.count + 0.5));
+        uint64_t seen = 0;
+        for (unsigned int i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= target) {
+                return std::min(bucket_max(i), res.max_ns);
+            }
+        }
+        return res.max_ns;
+    };
+    res.p50_ns = percentile(0.5);
+    res.p90_ns = percentile(0.9);
+    res.p99_ns = percentile(0.99);
+    res.p999_ns = percentile(0.999);
+
+    return res;
+}
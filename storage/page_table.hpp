@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <memory>
+#include <utility>
+
+/**
+    This class maps the tags of resident pages (see BufferPool::make_tag) to the frames they live in. It is a flat open addressing table with linear probing, so a lookup is a hash and a short scan of one array instead of a walk through the heap allocated nodes of an std::unordered_map. The table doubles whenever it gets half full, so once the pool is warm nothing is allocated for it anymore.
+
+    Deletions shift the entries after them back instead of leaving tombstones, so lookups never get slower as pages come and go.
+*/
+class PageTable {
+    public:
+        /**
+            Returned by find for tags that aren't in the table.
+        */
+        static constexpr unsigned int NOT_FOUND = UINT_MAX;
+
+        /**
+            Creates an empty table.
+        */
+        PageTable();
+
+        /**
+            Looks a page up.
+
+            @param tag The page's tag
+            @return the frame the page lives in, or NOT_FOUND
+        */
+        unsigned int find(uint64_t tag) const;
+
+        /**
+            Adds a page, or moves it to another frame if it is already in the table.
+
+            @param tag The page's tag
+            @param frame The frame the page lives in
+        */
+        void insert(uint64_t tag, unsigned int frame);
+
+        /**
+            Removes a page if it is in the table.
+
+            @param tag The page's tag
+        */
+        void erase(uint64_t tag);
+
+        /**
+            Removes every page.
+        */
+        void clear();
+
+        /**
+            Returns the number of pages in the table.
+
+            @return the number of entries
+        */
+        size_t size() const;
+
+    private:
+        /**
+            Tag of slots that don't hold anything. Real tags have a file type of 0 or 1 in their top half, so they are never this.
+        */
+        static constexpr uint64_t EMPTY = UINT64_MAX;
+
+        struct Slot {
+            uint64_t tag;
+            unsigned int frame;
+        };
+
+        /**
+            Returns the slot a tag's probe starts at. Tags are page numbers of a file with its type on top, so their bits are mixed first.
+        */
+        size_t home_of(uint64_t tag) const;
+
+        /**
+            Moves every entry to a table of twice as many slots (or the first slots, for an empty table).
+        */
+        void grow();
+
+        std::unique_ptr<Slot[]> slots_;
+        size_t mask_;
+        size_t size_;
+};
+
+inline PageTable::PageTable(): mask_(0), size_(0) {}
+
+inline size_t PageTable::home_of(uint64_t tag) const {
+    return static_cast<size_t>((tag * 0x9e3779b97f4a7c15UL) >> 32) & mask_;
+}
+
+inline unsigned int PageTable::find(uint64_t tag) const {
+    if (!slots_) {
+        return NOT_FOUND;
+    }
+    for (size_t i = home_of(tag); ; i = (i + 1) & mask_) {
+        if (slots_[i].tag == tag) {
+            return slots_[i].frame;
+        }
+        if (slots_[i].tag == EMPTY) {
+            return NOT_FOUND;
+        }
+    }
+}
+
+inline void PageTable::insert(uint64_t tag, unsigned int frame) {
+    // at most half full, so probes stay short
+    if (!slots_ || (size_ + 1) * 2 > mask_ + 1) {
+        grow();
+    }
+
+    size_t i = home_of(tag);
+    while (slots_[i].tag != EMPTY && slots_[i].tag != tag) {
+        i = (i + 1) & mask_;
+    }
+    if (slots_[i].tag == EMPTY) {
+        ++size_;
+    }
+    slots_[i].tag = tag;
+    slots_[i].frame = frame;
+}
+
+inline void PageTable::erase(uint64_t tag) {
+    if (!slots_) {
+        return;
+    }
+    size_t i = home_of(tag);
+    while (slots_[i].tag != tag) {
+        if (slots_[i].tag == EMPTY) {
+            return;
+        }
+        i = (i + 1) & mask_;
+    }
+    --size_;
+
+    // pull later entries of the run back into the hole, unless that would put them before their home slot
+    size_t hole = i;
+    for (size_t j = (hole + 1) & mask_; slots_[j].tag != EMPTY; j = (j + 1) & mask_) {
+        size_t home = home_of(slots_[j].tag);
+        // the entry can move if its home isn't in (hole, j], going around the end of the table
+        bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+        if (movable) {
+            slots_[hole] = slots_[j];
+            hole = j;
+        }
+    }
+    slots_[hole].tag = EMPTY;
+}
+
+inline void PageTable::grow() {
+    // a power of two, so a mask replaces the modulo
+    size_t num_slots = slots_ ? (mask_ + 1) * 2 : 64;
+    std::unique_ptr<Slot[]> old = std::move(slots_);
+    size_t old_slots = old ? mask_ + 1 : 0;
+
+    slots_.reset(new Slot[num_slots]);
+    mask_ = num_slots - 1;
+    for (size_t i = 0; i < num_slots; ++i) {
+        slots_[i].tag = EMPTY;
+    }
+
+    for (size_t i = 0; i < old_slots; ++i) {
+        if (old[i].tag != EMPTY) {
+            size_t j = home_of(old[i].tag);
+            while (slots_[j].tag != EMPTY) {
+                j = (j + 1) & mask_;
+            }
+            slots_[j] = old[i];
+        }
+    }
+}
+
+inline void PageTable::clear() {
+    // the slots go too, so a cleared pool holds no memory
+    slots_.reset();
+    mask_ = 0;
+    size_ = 0;
+}
+
+inline size_t PageTable::size() const {
+    return size_;
+}
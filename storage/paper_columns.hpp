@@ -0,0 +1,346 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "btree_types.cpp"
+
+#define COLUMN_BLOCK_ROWS 4096 // how many rows a scan hands to its callback at once
+
+/**
+    This class is one read only column of numbers, stored as a count followed by the values. The file is memory mapped, so a scan reads exactly the bytes of the column and nothing else.
+*/
+template <typename T>
+class Column {
+    public:
+        /**
+            Opens a column previously written by write.
+
+            @param filename The file the column is stored in
+        */
+        Column(const std::string& filename);
+
+        /**
+            Destructor. Unmaps the file.
+        */
+        ~Column();
+
+        Column(const Column& other) = delete;
+        Column& operator=(const Column& other) = delete;
+
+        /**
+            Writes a column, overwriting any existing file.
+
+            @param filename The file to write the column to
+            @param values The values, in row order
+        */
+        static void write(const std::string& filename, const std::vector<T>& values);
+
+        /**
+            Returns the values of the column.
+
+            @return a pointer to the first of size() values (inside the mapping)
+        */
+        const T* data() const;
+
+        /**
+            Returns the number of rows in the column.
+
+            @return the number of values
+        */
+        uint64_t size() const;
+
+    private:
+        /**
+            Mapping of the whole file.
+        */
+        char* data_;
+        size_t size_;
+
+        /**
+            Number of values after the count.
+        */
+        uint64_t rows_;
+};
+
+/**
+    This class is a columnar copy of the numeric fields of every paper (id, publication year, and number of citations), for analytics that would otherwise have to read and decode every 216 byte record to get at 8 bytes of it.
+
+    Each field is its own file (paper_id.col, paper_year.col, paper_citations.col) and row i of every file is the i-th paper in id order, which is the order of the paper database's leaves. Summing the citations of 4.8M papers by year reads about 40MB of columns instead of about 1GB of value pages, and the loops over a block of rows are simple enough for the compiler to vectorize.
+
+    The columns are a snapshot written by build_db; papers inserted into the database afterwards aren't in them.
+*/
+class PaperColumns {
+    public:
+        /**
+            This class collects the columns of the papers one at a time. Papers must be added in increasing id order.
+        */
+        class Builder {
+            public:
+                /**
+                    Adds the next row.
+
+                    @param paper The paper; its id must be greater than that of the last one added
+                */
+                void add(const paper::Entry& paper);
+
+                /**
+                    Writes the three column files, overwriting any existing ones.
+
+                    @param dir The directory to write the files to, with a trailing slash (or empty for the working directory)
+                */
+                void write(const std::string& dir) const;
+
+            private:
+                std::vector<long> ids_;
+                std::vector<uint32_t> years_;
+                std::vector<uint32_t> citations_;
+        };
+
+        /**
+            This struct is the totals of one publication year.
+        */
+        struct YearTotals {
+            uint32_t year;
+            uint64_t papers;
+            uint64_t citations;
+        };
+
+        /**
+            Opens the columns previously written by a builder.
+
+            @param dir The directory the files are in, with a trailing slash (or empty for the working directory)
+        */
+        PaperColumns(const std::string& dir);
+
+        /**
+            Returns the number of papers.
+
+            @return the number of rows of every column
+        */
+        uint64_t size() const;
+
+        /**
+            Calls a function on every block of up to COLUMN_BLOCK_ROWS rows, in id order. This is the building block of the aggregations below; the function should loop over the arrays it's given rather than look rows up one at a time.
+
+            @param func The function to call as func(ids, years, citations, n) with n rows of each column
+        */
+        template <typename F>
+        void scan(F func) const;
+
+        /**
+            Counts the papers and sums their citations per publication year.
+
+            @return the totals of every year that has at least one paper, in increasing year order
+        */
+        std::vector<YearTotals> by_year() const;
+
+        /**
+            Sums the citations of the papers published in a range of years.
+
+            @param from_year The first year to include
+            @param to_year The last year to include
+            @return the total number of citations
+        */
+        uint64_t total_citations(uint32_t from_year, uint32_t to_year) const;
+
+        /**
+            Finds the most cited papers published in a range of years.
+
+            @param k How many papers to return at most
+            @param from_year The first year to include
+            @param to_year The last year to include
+            @return the ids of the papers, most cited first (ties go to the smaller id)
+        */
+        std::vector<long> top_cited(size_t k, uint32_t from_year = 0, uint32_t to_year = UINT32_MAX) const;
+
+    private:
+        Column<long> ids_;
+        Column<uint32_t> years_;
+        Column<uint32_t> citations_;
+};
+
+template <typename T>
+Column<T>::Column(const std::string& filename): data_(nullptr), size_(0), rows_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("error opening column file " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(uint64_t))) {
+        close(fd);
+        throw std::runtime_error("column file " + filename + " is invalid");
+    }
+    size_ = st.st_size;
+
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("error mapping column file " + filename);
+    }
+    data_ = static_cast<char*>(mapped);
+    madvise(data_, size_, MADV_SEQUENTIAL);
+
+    memcpy(&rows_, data_, sizeof(uint64_t));
+    if ((size_ - sizeof(uint64_t)) / sizeof(T) != rows_) {
+        munmap(data_, size_);
+        throw std::runtime_error("column file " + filename + " is invalid");
+    }
+}
+
+template <typename T>
+Column<T>::~Column() {
+    munmap(data_, size_);
+}
+
+template <typename T>
+void Column<T>::write(const std::string& filename, const std::vector<T>& values) {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("error creating column file " + filename);
+    }
+
+    // the count keeps the values 8 byte aligned in the mapping
+    uint64_t rows = values.size();
+    ofs.write(reinterpret_cast<const char*>(&rows), sizeof(uint64_t));
+    ofs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+
+    if (!ofs) {
+        throw std::runtime_error("error writing column file " + filename);
+    }
+}
+
+template <typename T>
+const T* Column<T>::data() const {
+    return reinterpret_cast<const T*>(data_ + sizeof(uint64_t));
+}
+
+template <typename T>
+uint64_t Column<T>::size() const {
+    return rows_;
+}
+
+inline void PaperColumns::Builder::add(const paper::Entry& paper) {
+    if (!ids_.empty() && paper.id <= ids_.back()) {
+        throw std::runtime_error("paper columns must be built in increasing id order");
+    }
+
+    ids_.push_back(paper.id);
+    years_.push_back(paper.pub_year);
+    citations_.push_back(paper.n_citations);
+}
+
+inline void PaperColumns::Builder::write(const std::string& dir) const {
+    Column<long>::write(dir + "paper_id.col", ids_);
+    Column<uint32_t>::write(dir + "paper_year.col", years_);
+    Column<uint32_t>::write(dir + "paper_citations.col", citations_);
+}
+
+inline PaperColumns::PaperColumns(const std::string& dir): ids_(dir + "paper_id.col"), years_(dir + "paper_year.col"), citations_(dir + "paper_citations.col") {
+    if (years_.size() != ids_.size() || citations_.size() != ids_.size()) {
+        throw std::runtime_error("paper columns have different numbers of rows");
+    }
+}
+
+inline uint64_t PaperColumns::size() const {
+    return ids_.size();
+}
+
+template <typename F>
+void PaperColumns::scan(F func) const {
+    const long* ids = ids_.data();
+    const uint32_t* years = years_.data();
+    const uint32_t* citations = citations_.data();
+
+    for (uint64_t start = 0; start < size(); start += COLUMN_BLOCK_ROWS) {
+        size_t n = std::min<uint64_t>(COLUMN_BLOCK_ROWS, size() - start);
+        func(ids + start, years + start, citations + start, n);
+    }
+}
+
+inline std::vector<PaperColumns::YearTotals> PaperColumns::by_year() const {
+    std::vector<YearTotals> res;
+    if (size() == 0) {
+        return res;
+    }
+
+    // the years are known to be a small dense range, so the totals go straight into arrays indexed by year
+    const uint32_t* years = years_.data();
+    uint32_t lo = *std::min_element(years, years + size());
+    uint32_t hi = *std::max_element(years, years + size());
+    std::vector<uint64_t> papers(static_cast<size_t>(hi - lo) + 1, 0);
+    std::vector<uint64_t> citations(papers.size(), 0);
+
+    scan([&](const long*, const uint32_t* block_years, const uint32_t* block_citations, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            ++papers[block_years[i] - lo];
+            citations[block_years[i] - lo] += block_citations[i];
+        }
+    });
+
+    for (size_t i = 0; i < papers.size(); ++i) {
+        if (papers[i] > 0) {
+            res.push_back({static_cast<uint32_t>(lo + i), papers[i], citations[i]});
+        }
+    }
+    return res;
+}
+
+inline uint64_t PaperColumns::total_citations(uint32_t from_year, uint32_t to_year) const {
+    uint64_t total = 0;
+    scan([&](const long*, const uint32_t* years, const uint32_t* citations, size_t n) {
+        // no branches, so this vectorizes
+        uint64_t block_total = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bool in_range = years[i] >= from_year && years[i] <= to_year;
+            block_total += in_range * static_cast<uint64_t>(citations[i]);
+        }
+        total += block_total;
+    });
+    return total;
+}
+
+inline std::vector<long> PaperColumns::top_cited(size_t k, uint32_t from_year, uint32_t to_year) const {
+    // ranks papers by citations, then by smaller id
+    typedef std::pair<uint32_t, long> Ranked;
+    auto better = [](const Ranked& a, const Ranked& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+
+    // the worst of the best k so far is on top, so it's the one replaced
+    std::priority_queue<Ranked, std::vector<Ranked>, decltype(better)> best(better);
+    if (k > 0) {
+        scan([&](const long* ids, const uint32_t* years, const uint32_t* citations, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                if (years[i] < from_year || years[i] > to_year) continue;
+
+                Ranked curr(citations[i], ids[i]);
+                if (best.size() < k) {
+                    best.push(curr);
+                } else if (better(curr, best.top())) {
+                    best.pop();
+                    best.push(curr);
+                }
+            }
+        });
+    }
+
+    std::vector<long> res(best.size());
+    for (size_t i = res.size(); i > 0; --i) {
+        res[i - 1] = best.top().second;
+        best.pop();
+    }
+    return res;
+}
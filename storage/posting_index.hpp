@@ -0,0 +1,279 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "varint.hpp"
+
+/**
+    This class is a read only inverted index from a key (e.g. an author id) to a sorted list of ids (e.g. the papers they wrote). It is built once from all (key, id) pairs with build (or a Builder, when the pairs are too many to hold in memory) and then opened for queries.
+
+    The file is a count of keys, then a directory of fixed size entries sorted by key (key, offset of its list, number of ids in its list), then every list one after another. Lists are stored with put_deltas (varint gaps between sorted ids), which takes the list of all papers of all authors down to a couple of bytes per id.
+
+    The file is memory mapped, so opening it is instant, a lookup is a binary search over the directory plus a sequential decode of one list, and only the pages that are actually touched are ever read in.
+*/
+class PostingIndex {
+    public:
+        /**
+            This class builds an index one (key, id) pair at a time without holding the pairs themselves; every list is kept compressed as it grows. The ids of each key must be added in increasing order, which is the case when the records are visited in id order.
+        */
+        class Builder {
+            public:
+                /**
+                    Adds an id to a key's list. Adding the same id to a key twice in a row does nothing.
+
+                    @param key The key
+                    @param id The id; must be non-negative and at least the last id added to this key
+                */
+                void add(long key, long id);
+
+                /**
+                    Writes the index to a file, overwriting any existing one.
+
+                    @param filename The file to write the index to
+                */
+                void write(const std::string& filename) const;
+
+            private:
+                /**
+                    This struct is a list being built: its compressed ids, the last id added (for the next gap), and the number of ids.
+                */
+                struct List {
+                    std::vector<char> bytes;
+                    long last = 0;
+                    uint64_t count = 0;
+                };
+
+                std::unordered_map<long, List> lists_;
+        };
+
+        /**
+            Opens an index that was previously written by build.
+
+            @param filename The file the index is stored in
+        */
+        PostingIndex(const std::string& filename);
+
+        /**
+            Destructor. Unmaps the file.
+        */
+        ~PostingIndex();
+
+        PostingIndex(const PostingIndex& other) = delete;
+        PostingIndex& operator=(const PostingIndex& other) = delete;
+
+        /**
+            Writes an index for a list of (key, id) pairs, overwriting any existing file. Duplicate pairs are only stored once. Ids must be non-negative.
+
+            @param filename The file to write the index to
+            @param pairs The (key, id) pairs to index, in any order; sorted in place
+        */
+        static void build(const std::string& filename, std::vector<std::pair<long, long>>& pairs);
+
+        /**
+            Returns every id stored under a key.
+
+            @param key The key to look up
+            @return the ids in increasing order; empty if the key isn't in the index
+        */
+        std::vector<long> get(long key) const;
+
+        /**
+            Returns the number of ids stored under a key without decoding them.
+
+            @param key The key to look up
+            @return the length of the key's list; 0 if the key isn't in the index
+        */
+        uint64_t count(long key) const;
+
+        /**
+            Returns the number of keys in the index.
+
+            @return the number of keys with at least one id
+        */
+        uint64_t size() const;
+
+    private:
+        /**
+            This struct is how a directory entry is laid out in the file. offset is from the start of the list section.
+        */
+        struct DirectoryEntry {
+            long key;
+            uint64_t offset;
+            uint64_t count;
+        };
+
+        /**
+            Finds the directory entry of a key.
+
+            @param key The key to look up
+            @return the entry, or nullptr if the key isn't in the index
+        */
+        const DirectoryEntry* find_entry(long key) const;
+
+        /**
+            Mapping of the whole file.
+        */
+        char* data_;
+        size_t size_;
+
+        /**
+            Number of keys in the directory.
+        */
+        uint64_t num_keys_;
+        /**
+            The directory (inside the mapping).
+        */
+        const DirectoryEntry* directory_;
+        /**
+            Start of the lists (inside the mapping).
+        */
+        const char* lists_;
+};
+
+inline PostingIndex::PostingIndex(const std::string& filename): data_(nullptr), size_(0), num_keys_(0), directory_(nullptr), lists_(nullptr) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("error opening posting index file");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(uint64_t))) {
+        close(fd);
+        throw std::runtime_error("posting index file is invalid");
+    }
+    size_ = st.st_size;
+
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("error mapping posting index file");
+    }
+    data_ = static_cast<char*>(mapped);
+
+    memcpy(&num_keys_, data_, sizeof(uint64_t));
+    if ((size_ - sizeof(uint64_t)) / sizeof(DirectoryEntry) < num_keys_) {
+        munmap(data_, size_);
+        throw std::runtime_error("posting index file is invalid");
+    }
+
+    directory_ = reinterpret_cast<const DirectoryEntry*>(data_ + sizeof(uint64_t));
+    lists_ = data_ + sizeof(uint64_t) + num_keys_ * sizeof(DirectoryEntry);
+}
+
+inline PostingIndex::~PostingIndex() {
+    munmap(data_, size_);
+}
+
+inline void PostingIndex::Builder::add(long key, long id) {
+    if (id < 0) {
+        throw std::runtime_error("posting index ids must be non-negative");
+    }
+
+    List& list = lists_[key];
+    if (list.count > 0) {
+        if (id == list.last) return;
+        if (id < list.last) {
+            throw std::runtime_error("posting index ids must be added in increasing order");
+        }
+    }
+
+    // the first id is stored as the gap from 0
+    put_varint(list.bytes, static_cast<uint64_t>(id - list.last));
+    list.last = id;
+    ++list.count;
+}
+
+inline void PostingIndex::Builder::write(const std::string& filename) const {
+    std::vector<long> keys;
+    keys.reserve(lists_.size());
+    for (const auto& list : lists_) {
+        keys.push_back(list.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // lists are written in key order, right after the directory
+    std::vector<DirectoryEntry> directory;
+    directory.reserve(keys.size());
+    uint64_t offset = 0;
+    for (long key : keys) {
+        const List& list = lists_.at(key);
+        directory.push_back({key, offset, list.count});
+        offset += list.bytes.size();
+    }
+
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("error creating posting index file");
+    }
+
+    uint64_t num_keys = directory.size();
+    ofs.write(reinterpret_cast<const char*>(&num_keys), sizeof(uint64_t));
+    ofs.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(DirectoryEntry));
+    for (long key : keys) {
+        const List& list = lists_.at(key);
+        ofs.write(list.bytes.data(), list.bytes.size());
+    }
+
+    if (!ofs) {
+        throw std::runtime_error("error writing posting index file");
+    }
+}
+
+inline void PostingIndex::build(const std::string& filename, std::vector<std::pair<long, long>>& pairs) {
+    // sorting puts the ids of every key in increasing order
+    std::sort(pairs.begin(), pairs.end());
+
+    Builder builder;
+    for (const auto& pair : pairs) {
+        builder.add(pair.first, pair.second);
+    }
+    builder.write(filename);
+}
+
+inline const PostingIndex::DirectoryEntry* PostingIndex::find_entry(long key) const {
+    const DirectoryEntry* end = directory_ + num_keys_;
+    const DirectoryEntry* found = std::lower_bound(directory_, end, key, [](const DirectoryEntry& entry, long target) {
+        return entry.key < target;
+    });
+    if (found == end || found->key != key) {
+        return nullptr;
+    }
+    return found;
+}
+
+inline std::vector<long> PostingIndex::get(long key) const {
+    std::vector<long> res;
+
+    const DirectoryEntry* found = find_entry(key);
+    if (found == nullptr) {
+        return res;
+    }
+
+    res.reserve(found->count);
+    const char* list = lists_ + found->offset;
+    get_deltas(list, found->count, res);
+
+    return res;
+}
+
+inline uint64_t PostingIndex::count(long key) const {
+    const DirectoryEntry* found = find_entry(key);
+    return found == nullptr ? 0 : found->count;
+}
+
+inline uint64_t PostingIndex::size() const {
+    return num_keys_;
+}
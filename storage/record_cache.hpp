@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#define RECORD_CACHE_SHARDS 16 // most shards a record cache splits its entries into
+#define MIN_RECORD_SHARD_ENTRIES 64 // fewest entries a shard of a record cache may have; smaller caches use fewer shards
+
+/**
+    This struct is the hit and miss counts of a record cache since it was created.
+*/
+struct RecordCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+/**
+    This class is a bounded cache of decoded records by id, kept in front of a BTreeDB's tree so that records that are looked up again and again (like the names of popular authors in a graph session) cost one hash probe instead of a search through the key pages and a decode of the value.
+
+    It holds a fixed number of entries and evicts with the CLOCK algorithm, like the buffer pool below it (see buffer_pool.hpp). Entries are split into shards by id, each with its own lock, table, and CLOCK hand.
+
+    The cache never holds a record that the tree has since changed: whoever changes a record calls erase afterwards, and a record read from the tree is only added if nothing was erased since the reader started (see epoch), since it may be an old copy that the erase was meant to remove.
+
+    @tparam T The record type
+*/
+template <typename T>
+class RecordCache {
+    public:
+        /**
+            Constructor for the cache.
+
+            @param max_entries How many records the cache may hold at once (with a small minimum)
+        */
+        RecordCache(size_t max_entries);
+
+        RecordCache(const RecordCache& other) = delete;
+        RecordCache& operator=(const RecordCache& other) = delete;
+
+        /**
+            Looks up a record, counting a hit or a miss.
+
+            @param key The id of the record
+            @param dest Where to copy the record if it is cached
+            @return whether the record was cached
+        */
+        bool get(long key, T& dest);
+
+        /**
+            Returns the current epoch, which goes up every time something is erased. Readers take it before they read a record from the tree and hand it to put.
+
+            @return the current epoch
+        */
+        uint64_t epoch() const;
+
+        /**
+            Adds a record read from the tree, evicting another if the shard is full. Nothing is added if anything was erased since the epoch was taken.
+
+            @param key The id of the record
+            @param value The record
+            @param read_epoch What epoch returned before the record was read
+        */
+        void put(long key, const T& value, uint64_t read_epoch);
+
+        /**
+            Drops a record from the cache. Must be called after every change to the record in the tree.
+
+            @param key The id of the record
+        */
+        void erase(long key);
+
+        /**
+            Returns the hit, miss, and eviction counts.
+
+            @return the counts since the cache was created
+        */
+        RecordCacheStats stats() const;
+
+    private:
+        /**
+            This struct is one entry of the cache. referenced is the CLOCK bit.
+        */
+        struct Entry {
+            long key = 0;
+            T value;
+            bool used = false;
+            bool referenced = false;
+        };
+
+        /**
+            This struct is one shard of the cache: a fixed share of the entries, a table from ids to entries, and a CLOCK hand. Everything in it is guarded by mutex.
+        */
+        struct Shard {
+            std::mutex mutex;
+            /**
+                The entries added so far; there are never more than capacity.
+            */
+            std::vector<Entry> entries;
+            unsigned int capacity = 0;
+            std::unordered_map<long, unsigned int> table;
+            unsigned int hand = 0;
+        };
+
+        /**
+            Returns the shard an id belongs to. Ids are often dense, so they are mixed first.
+        */
+        Shard& shard_of(long key);
+
+        unsigned int num_shards_;
+        std::unique_ptr<Shard[]> shards_;
+
+        std::atomic<uint64_t> epoch_;
+        std::atomic<uint64_t> hits_;
+        std::atomic<uint64_t> misses_;
+        std::atomic<uint64_t> evictions_;
+};
+
+template <typename T>
+RecordCache<T>::RecordCache(size_t max_entries): epoch_(0), hits_(0), misses_(0), evictions_(0) {
+    size_t entries = std::max<size_t>(max_entries, MIN_RECORD_SHARD_ENTRIES);
+    num_shards_ = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(RECORD_CACHE_SHARDS, entries / MIN_RECORD_SHARD_ENTRIES)));
+    shards_.reset(new Shard[num_shards_]);
+
+    // entries are only added as records come in, so small sessions never pay for the whole budget
+    for (unsigned int i = 0; i < num_shards_; ++i) {
+        shards_[i].capacity = static_cast<unsigned int>(entries / num_shards_ + (i < entries % num_shards_));
+    }
+}
+
+template <typename T>
+typename RecordCache<T>::Shard& RecordCache<T>::shard_of(long key) {
+    uint64_t mixed = static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15UL;
+    return shards_[(mixed >> 32) % num_shards_];
+}
+
+template <typename T>
+bool RecordCache<T>::get(long key, T& dest) {
+    Shard& shard = shard_of(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.table.find(key);
+        if (found != shard.table.end()) {
+            Entry& entry = shard.entries[found->second];
+            entry.referenced = true;
+            dest = entry.value;
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+template <typename T>
+uint64_t RecordCache<T>::epoch() const {
+    return epoch_.load();
+}
+
+template <typename T>
+void RecordCache<T>::put(long key, const T& value, uint64_t read_epoch) {
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // an erase since the record was read may have been for this very record
+    if (epoch_.load() != read_epoch) {
+        return;
+    }
+
+    auto found = shard.table.find(key);
+    if (found != shard.table.end()) {
+        shard.entries[found->second].value = value;
+        shard.entries[found->second].referenced = true;
+        return;
+    }
+
+    unsigned int idx;
+    if (shard.entries.size() < shard.capacity) {
+        // still under budget
+        idx = static_cast<unsigned int>(shard.entries.size());
+        shard.entries.emplace_back();
+    } else {
+        // sweep the clock; referenced entries get their bit cleared, and the first one without it is replaced
+        while (true) {
+            idx = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+
+            Entry& entry = shard.entries[idx];
+            if (!entry.used) {
+                break;
+            }
+            if (entry.referenced) {
+                entry.referenced = false;
+                continue;
+            }
+
+            shard.table.erase(entry.key);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    Entry& entry = shard.entries[idx];
+    entry.key = key;
+    entry.value = value;
+    entry.used = true;
+    entry.referenced = false;
+    shard.table[key] = idx;
+}
+
+template <typename T>
+void RecordCache<T>::erase(long key) {
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // bumped even if the record isn't cached, since a reader may be about to add it
+    ++epoch_;
+
+    auto found = shard.table.find(key);
+    if (found != shard.table.end()) {
+        shard.entries[found->second].used = false;
+        shard.table.erase(found);
+    }
+}
+
+template <typename T>
+RecordCacheStats RecordCache<T>::stats() const {
+    RecordCacheStats res;
+    res.hits = hits_.load(std::memory_order_relaxed);
+    res.misses = misses_.load(std::memory_order_relaxed);
+    res.evictions = evictions_.load(std::memory_order_relaxed);
+    return res;
+}
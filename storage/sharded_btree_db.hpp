@@ -0,0 +1,638 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include "btree_db_v2.hpp"
+
+#define DEFAULT_SHARDS 4 // shards written by the sharded build of build_db when it isn't given a number
+#define MAX_SHARDS 16 // most shards a database may have; every writable shard runs a writeback thread for itself and one for its name index
+#define MAX_SHARD_THREADS 8 // most threads a sharded database works on its shards with at once, whatever the number of shards
+
+/**
+    This class spreads a database over a number of independent BTreeDBs, each with its own key, value, and metadata files (paper_keys.0.db, paper_values.0.db, and so on), so that building and batch lookups can work on several trees at once instead of being serialized on one.
+
+    Keys are assigned to shards by a hash of the key rather than by range. Ids in our datasets are spread very unevenly over their range (and bulk loads arrive sorted), so ranges would either need to be sampled up front or leave a few shards with most of the work; a hash keeps the shards even for any ids. The price is that key order across shards has to be put back together: scan merges the shards' cursors, one entry at a time.
+
+    Single key operations go to their shard on the calling thread. bulk_load, find_many, insert_many, and the name lookups split their work by shard and hand the shards out to at most MAX_SHARD_THREADS threads (and no more than the machine has cores), the calling thread being one of them. The memory budgets of the config (cache_bytes, dirty_bytes, and record_cache_entries) and its io_depth are split evenly between the shards, so a sharded database uses as much memory, and as many reader threads, as a single one opened with the same config.
+
+    The number of shards is picked when the database is created, and every shard records it in its metadata file (see BTreeConfig::shards), since a key is only in the shard shard_of picks for the same number. Opening a database with the wrong number fails instead of looking keys up in the wrong shards, and opening it with 0 uses the number it was created with.
+
+    @tparam T The type of the values
+    @tparam Layout The page layout of every shard (see PageLayout)
+*/
+template <typename T, typename Layout = DefaultLayout>
+class ShardedBTreeDB {
+    public:
+        typedef typename BTreeDB<T, Layout>::View View;
+
+        /**
+            Constructor for the sharded database. Opens (or creates) the files of every shard; see the constructor of BTreeDB for what the parameters do to each one.
+
+            @param key_filename The filename for the key database; each shard's number goes before the extension (paper_keys.db becomes paper_keys.0.db)
+            @param values_filename The filename for the value database, numbered the same way
+            @param shards The number of shards, 1 to MAX_SHARDS; 0 opens an existing database with the number it was created with
+            @param create_new Whether or not new files should be created to store the dbs (will overwrite existing ones)
+            @param read_only_opt Whether or not this instance should be read only
+            @param config Settings for every shard; the memory budgets and io_depth are split between them
+        */
+        ShardedBTreeDB(const std::string& key_filename, const std::string& values_filename, unsigned int shards, bool create_new=false, bool read_only_opt=false, const BTreeConfig& config=BTreeConfig());
+
+        ShardedBTreeDB(const ShardedBTreeDB& other) = delete;
+        ShardedBTreeDB& operator=(const ShardedBTreeDB& other) = delete;
+
+        /**
+            Returns the name of one shard's file.
+
+            @param filename The name of the whole database's file
+            @param shard The number of the shard
+            @return the filename with the shard number before its extension, or at the end if it has none
+        */
+        static std::string shard_filename(const std::string& filename, unsigned int shard);
+
+        /**
+            Returns the shard a key is stored in.
+
+            @param key The key
+            @param shards The number of shards
+            @return the number of its shard, less than shards
+        */
+        static unsigned int shard_of(long key, unsigned int shards);
+
+        /**
+            Reads the number of shards of a database from its first shard's metadata file (see BTreeDB::stored_shards), without opening it.
+
+            @param key_filename The filename for the key database, without shard numbers
+            @param values_filename The filename for the value database, without shard numbers
+            @return the number of shards, or 0 if there is no sharded database
+        */
+        static unsigned int stored_shards(const std::string& key_filename, const std::string& values_filename);
+
+        /**
+            Removes every file of every shard (see BTreeDB::remove_files), however many there are. The database must not be open.
+
+            @param key_filename The filename for the key database, without shard numbers
+            @param values_filename The filename for the value database, without shard numbers
+        */
+        static void remove_files(const std::string& key_filename, const std::string& values_filename);
+
+        /**
+            Returns the number of shards.
+        */
+        unsigned int num_shards() const;
+
+        /**
+            Returns the shard a key of this database is stored in.
+
+            @param key The key
+            @return the number of its shard, less than num_shards()
+        */
+        unsigned int shard_of(long key) const;
+
+        /**
+            Returns one of the shards, for anything the sharded database doesn't do itself. Only the keys that shard_of assigns to it may be inserted into it.
+
+            @param i The number of the shard, less than num_shards()
+            @return the shard
+        */
+        BTreeDB<T, Layout>& shard(unsigned int i);
+
+        /**
+            Runs a function for every shard, handing the shards out to the same threads as the batch operations. Waits for all of them, then rethrows the first error any of them threw.
+
+            @param f Called with the number of a shard; calls for different shards may run at the same time
+        */
+        template <typename F>
+        void for_each_shard(F f);
+
+        /**
+            Inserts a key-value pair into its shard.
+
+            @param key The key
+            @param value The value the key is associated with
+        */
+        void insert(long key, T& value);
+
+        /**
+            Retrieves a value from its shard.
+
+            @param key The key to lookup
+            @return The ValueEntry the key is associated with, or the default ValueEntry if it was not found.
+        */
+        T find(long key);
+
+        /**
+            Retrieves a view of a value from its shard (see BTreeDB::find_view).
+
+            @param key The key to lookup
+            @return a view of the value; invalid if the key wasn't found
+        */
+        View find_view(long key);
+
+        /**
+            Builds every shard from a sequence of key-value pairs sorted by key. Each shard reads the whole sequence, skipping the keys of other shards, and bulk loads the rest as it goes, so nothing is copied and the shards can be built at the same time; the sequence has to be readable more than once, like a vector. To build from a stream that can only be read once, split it by shard_of first and load the shards with for_each_shard.
+
+            The database must be empty, and nothing else may use it until this returns. If a key appears more than once in a row, the last value wins.
+
+            @param begin Iterator to the first pair; dereferences to something with a long first (the key) and T second (the value), like std::pair<long, T>
+            @param end Iterator past the last pair
+            @param fill_factor How full to pack each key page, from just above 0 to 1 (completely full)
+        */
+        template <typename Iter>
+        void bulk_load(Iter begin, Iter end, double fill_factor=DEFAULT_FILL_FACTOR);
+
+        /**
+            Retrieves the values for many keys at once. Each shard looks up its keys with BTreeDB::find_many.
+
+            @param keys The keys to look up, in any order (duplicates are fine)
+            @return The values for the keys, in the same order as the keys; the default ValueEntry for keys that weren't found
+        */
+        std::vector<T> find_many(const std::vector<long>& keys);
+
+        /**
+            Inserts or overwrites many key-value pairs at once. Each shard applies its pairs with BTreeDB::insert_many. If a key appears more than once, the last pair wins.
+
+            @param entries The key-value pairs to insert, in any order
+        */
+        void insert_many(std::vector<std::pair<long, T>>& entries);
+
+        /**
+            Retrieves an id according to an implemented operator== function for the template struct (see BTreeDB::get_id_from_name), searching every shard.
+
+            @param search_val A struct that at minimum has the members needed for its operator== function to work.
+            @return the id of the struct that matches the search val if found, -1 if not
+        */
+        long get_id_from_name(const T& search_val);
+
+        /**
+            Retrieves the ids of every entry that matches the passed in value according to operator== (see BTreeDB::get_ids_from_name), from every shard.
+
+            @param search_val A struct that at minimum has the members needed for its operator== function to work.
+            @return the ids of all matching entries, in increasing order (empty if there are none)
+        */
+        std::vector<long> get_ids_from_name(const T& search_val);
+
+        /**
+            Gets all the papers associated with a provided author id from every shard (see BTreeDB::get_papers).
+
+            @param author_id The author to search for papers for
+            @return A list of paper ids that the author is an author on, in increasing order
+        */
+        std::vector<long> get_papers(long author_id);
+
+        /**
+            Streams every entry with a key in [lo, hi) to a callback, in key order across all shards. Every shard has a cursor open at once, and the one with the smallest key goes next.
+
+            @param lo The smallest key to include
+            @param hi One past the largest key to include
+            @param callback Called with (long key, const T& value) for each entry in the range
+        */
+        template <typename Callback>
+        void scan(long lo, long hi, Callback callback);
+
+        /**
+            Returns the record cache counts of all the shards added together (see BTreeDB::record_cache_stats).
+
+            @return the hit, miss, and eviction counts
+        */
+        RecordCacheStats record_cache_stats() const;
+
+        /**
+            Takes a snapshot of the counters of every shard and adds them together (see BTreeStats). The height is the tallest shard's. Latency percentiles can't be added, so they are the slowest shard's, which makes them an upper bound; the counts and means cover every shard.
+
+            @return the counts since the database was opened
+        */
+        BTreeStats stats();
+
+    private:
+        /**
+            This class is an iterator over the pairs of one shard in a sequence of pairs of all of them; it skips every pair of another shard.
+        */
+        template <typename Iter>
+        class ShardIterator {
+            public:
+                ShardIterator(Iter it, Iter end, unsigned int shard, unsigned int shards);
+
+                decltype(*std::declval<Iter>()) operator*() const;
+                Iter operator->() const;
+                ShardIterator& operator++();
+                bool operator==(const ShardIterator& other) const;
+                bool operator!=(const ShardIterator& other) const;
+
+            private:
+                /**
+                    Moves past the pairs of other shards.
+                */
+                void skip();
+
+                Iter it_;
+                Iter end_;
+                unsigned int shard_;
+                unsigned int shards_;
+        };
+
+        /**
+            Runs a function for some of the shards. The shards are handed out to at most MAX_SHARD_THREADS threads (fewer if the machine has fewer cores or there are fewer shards), the calling thread being one of them. Waits for all of them, then rethrows the first error any of them threw.
+
+            @param shards The numbers of the shards to run it for
+            @param f Called with the number of a shard
+        */
+        template <typename F>
+        void run_shards(const std::vector<unsigned int>& shards, F f);
+
+        /**
+            Adds the latencies of one shard to a summary of all of them (see stats).
+        */
+        static void add_latency(LatencySummary& total, const LatencySummary& shard);
+
+        std::vector<std::unique_ptr<BTreeDB<T, Layout>>> shards_;
+};
+
+/**
+    Opens a database whichever way it was built, and calls a function with it: a ShardedBTreeDB with as many shards as it was built with if its first shard exists, and a BTreeDB otherwise. Both have the same lookup functions, so the function is written once for both (as a template or a generic lambda).
+
+    @tparam T The type of the values
+    @param key_filename The filename for the key database, without shard numbers
+    @param values_filename The filename for the value database, without shard numbers
+    @param read_only Whether or not the database should be read only
+    @param config Settings for the database (see BTreeConfig)
+    @param f Called with the open database, which is closed once it returns
+*/
+template <typename T, typename F>
+void open_db(const std::string& key_filename, const std::string& values_filename, bool read_only, const BTreeConfig& config, F f) {
+    unsigned int shards = ShardedBTreeDB<T>::stored_shards(key_filename, values_filename);
+    if (shards > 0) {
+        ShardedBTreeDB<T> db(key_filename, values_filename, shards, false, read_only, config);
+        f(db);
+    } else {
+        BTreeDB<T> db(key_filename, values_filename, false, read_only, config);
+        f(db);
+    }
+}
+
+template <typename T, typename Layout>
+ShardedBTreeDB<T, Layout>::ShardedBTreeDB(const std::string& key_filename, const std::string& values_filename, unsigned int shards, bool create_new, bool read_only_opt, const BTreeConfig& config) {
+    if (shards == 0 && !create_new) {
+        shards = stored_shards(key_filename, values_filename);
+        if (shards == 0) {
+            throw std::runtime_error("no sharded database at " + shard_filename(key_filename, 0));
+        }
+    }
+    if (shards == 0 || shards > MAX_SHARDS) {
+        throw std::runtime_error("a sharded database needs 1 to " + std::to_string(MAX_SHARDS) + " shards, not " + std::to_string(shards));
+    }
+
+    BTreeConfig shard_config = config;
+    shard_config.shards = shards;
+    shard_config.cache_bytes = config.cache_bytes / shards;
+    shard_config.dirty_bytes = config.dirty_bytes / shards;
+    shard_config.record_cache_entries = config.record_cache_entries / shards;
+    // readers other than SyncIO start threads by the depth, and every shard has its own reader
+    shard_config.io_depth = std::max(config.io_depth / shards, 1u);
+
+    // every shard checks the number against its metadata, so a database opened with the wrong one fails at its first shard
+    for (unsigned int i = 0; i < shards; ++i) {
+        shards_.push_back(std::make_unique<BTreeDB<T, Layout>>(shard_filename(key_filename, i), shard_filename(values_filename, i), create_new, read_only_opt, shard_config));
+    }
+}
+
+template <typename T, typename Layout>
+std::string ShardedBTreeDB<T, Layout>::shard_filename(const std::string& filename, unsigned int shard) {
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return filename + "." + std::to_string(shard);
+    }
+    return filename.substr(0, dot) + "." + std::to_string(shard) + filename.substr(dot);
+}
+
+template <typename T, typename Layout>
+unsigned int ShardedBTreeDB<T, Layout>::shard_of(long key, unsigned int shards) {
+    // ids of a dataset often share their low bits, so they are mixed before picking a shard
+    return static_cast<unsigned int>(((static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15UL) >> 32) % shards);
+}
+
+template <typename T, typename Layout>
+unsigned int ShardedBTreeDB<T, Layout>::stored_shards(const std::string& key_filename, const std::string& values_filename) {
+    return BTreeDB<T, Layout>::stored_shards(shard_filename(key_filename, 0), shard_filename(values_filename, 0));
+}
+
+template <typename T, typename Layout>
+void ShardedBTreeDB<T, Layout>::remove_files(const std::string& key_filename, const std::string& values_filename) {
+    // the database may be one that was built with another number of shards, so every shard it could have goes
+    for (unsigned int i = 0; i < MAX_SHARDS; ++i) {
+        BTreeDB<T, Layout>::remove_files(shard_filename(key_filename, i), shard_filename(values_filename, i));
+    }
+}
+
+template <typename T, typename Layout>
+unsigned int ShardedBTreeDB<T, Layout>::num_shards() const {
+    return static_cast<unsigned int>(shards_.size());
+}
+
+template <typename T, typename Layout>
+unsigned int ShardedBTreeDB<T, Layout>::shard_of(long key) const {
+    return shard_of(key, num_shards());
+}
+
+template <typename T, typename Layout>
+BTreeDB<T, Layout>& ShardedBTreeDB<T, Layout>::shard(unsigned int i) {
+    return *shards_.at(i);
+}
+
+template <typename T, typename Layout>
+template <typename F>
+void ShardedBTreeDB<T, Layout>::for_each_shard(F f) {
+    std::vector<unsigned int> all;
+    for (unsigned int i = 0; i < num_shards(); ++i) {
+        all.push_back(i);
+    }
+    run_shards(all, f);
+}
+
+template <typename T, typename Layout>
+void ShardedBTreeDB<T, Layout>::insert(long key, T& value) {
+    shards_[shard_of(key)]->insert(key, value);
+}
+
+template <typename T, typename Layout>
+T ShardedBTreeDB<T, Layout>::find(long key) {
+    return shards_[shard_of(key)]->find(key);
+}
+
+template <typename T, typename Layout>
+typename ShardedBTreeDB<T, Layout>::View ShardedBTreeDB<T, Layout>::find_view(long key) {
+    return shards_[shard_of(key)]->find_view(key);
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+void ShardedBTreeDB<T, Layout>::bulk_load(Iter begin, Iter end, double fill_factor) {
+    for_each_shard([&](unsigned int i) {
+        shards_[i]->bulk_load(ShardIterator<Iter>(begin, end, i, num_shards()), ShardIterator<Iter>(end, end, i, num_shards()), fill_factor);
+    });
+}
+
+template <typename T, typename Layout>
+std::vector<T> ShardedBTreeDB<T, Layout>::find_many(const std::vector<long>& keys) {
+    // every shard's keys, with where their values go in the result
+    std::vector<std::vector<long>> shard_keys(num_shards());
+    std::vector<std::vector<size_t>> positions(num_shards());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        unsigned int s = shard_of(keys[i]);
+        shard_keys[s].push_back(keys[i]);
+        positions[s].push_back(i);
+    }
+
+    std::vector<unsigned int> todo;
+    for (unsigned int i = 0; i < num_shards(); ++i) {
+        if (!shard_keys[i].empty()) {
+            todo.push_back(i);
+        }
+    }
+
+    std::vector<T> res(keys.size());
+    // each shard writes to different positions of the result, so they don't have to take turns
+    run_shards(todo, [&](unsigned int i) {
+        std::vector<T> found = shards_[i]->find_many(shard_keys[i]);
+        for (size_t j = 0; j < found.size(); ++j) {
+            res[positions[i][j]] = found[j];
+        }
+    });
+    return res;
+}
+
+template <typename T, typename Layout>
+void ShardedBTreeDB<T, Layout>::insert_many(std::vector<std::pair<long, T>>& entries) {
+    // a key always goes to the same shard, so the order of duplicates is kept within it
+    std::vector<std::vector<std::pair<long, T>>> parts(num_shards());
+    for (auto& entry : entries) {
+        parts[shard_of(entry.first)].push_back(entry);
+    }
+
+    std::vector<unsigned int> todo;
+    for (unsigned int i = 0; i < num_shards(); ++i) {
+        if (!parts[i].empty()) {
+            todo.push_back(i);
+        }
+    }
+    run_shards(todo, [&](unsigned int i) {
+        shards_[i]->insert_many(parts[i]);
+    });
+}
+
+template <typename T, typename Layout>
+long ShardedBTreeDB<T, Layout>::get_id_from_name(const T& search_val) {
+    std::vector<long> found(num_shards());
+    for_each_shard([&](unsigned int i) {
+        found[i] = shards_[i]->get_id_from_name(search_val);
+    });
+
+    for (long id : found) {
+        if (id != -1) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+template <typename T, typename Layout>
+std::vector<long> ShardedBTreeDB<T, Layout>::get_ids_from_name(const T& search_val) {
+    std::vector<std::vector<long>> found(num_shards());
+    for_each_shard([&](unsigned int i) {
+        found[i] = shards_[i]->get_ids_from_name(search_val);
+    });
+
+    std::vector<long> res;
+    for (const std::vector<long>& ids : found) {
+        res.insert(res.end(), ids.begin(), ids.end());
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+template <typename T, typename Layout>
+std::vector<long> ShardedBTreeDB<T, Layout>::get_papers(long author_id) {
+    std::vector<std::vector<long>> found(num_shards());
+    for_each_shard([&](unsigned int i) {
+        found[i] = shards_[i]->get_papers(author_id);
+    });
+
+    std::vector<long> res;
+    for (const std::vector<long>& ids : found) {
+        res.insert(res.end(), ids.begin(), ids.end());
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+template <typename T, typename Layout>
+template <typename Callback>
+void ShardedBTreeDB<T, Layout>::scan(long lo, long hi, Callback callback) {
+    // a key is only ever in one shard, so the merge never has to break ties
+    std::vector<typename BTreeDB<T, Layout>::Cursor> cursors;
+    cursors.reserve(num_shards());
+    std::priority_queue<std::pair<long, unsigned int>, std::vector<std::pair<long, unsigned int>>, std::greater<std::pair<long, unsigned int>>> heap;
+    for (unsigned int i = 0; i < num_shards(); ++i) {
+        cursors.push_back(shards_[i]->lower_bound(lo));
+        if (cursors[i].valid() && cursors[i].key() < hi) {
+            heap.push({cursors[i].key(), i});
+        }
+    }
+
+    while (!heap.empty()) {
+        unsigned int i = heap.top().second;
+        heap.pop();
+        callback(cursors[i].key(), cursors[i].value());
+        if (cursors[i].next() && cursors[i].key() < hi) {
+            heap.push({cursors[i].key(), i});
+        }
+    }
+}
+
+template <typename T, typename Layout>
+RecordCacheStats ShardedBTreeDB<T, Layout>::record_cache_stats() const {
+    RecordCacheStats res;
+    for (const auto& shard : shards_) {
+        RecordCacheStats stats = shard->record_cache_stats();
+        res.hits += stats.hits;
+        res.misses += stats.misses;
+        res.evictions += stats.evictions;
+    }
+    return res;
+}
+
+template <typename T, typename Layout>
+BTreeStats ShardedBTreeDB<T, Layout>::stats() {
+    BTreeStats res;
+    for (const auto& shard : shards_) {
+        BTreeStats stats = shard->stats();
+        res.entries += stats.entries;
+        res.height = std::max(res.height, stats.height);
+        res.key_pages += stats.key_pages;
+        res.value_pages += stats.value_pages;
+        for (int type = 0; type < 2; ++type) {
+            res.cache.hits[type] += stats.cache.hits[type];
+            res.cache.misses[type] += stats.cache.misses[type];
+            res.cache.prefetched[type] += stats.cache.prefetched[type];
+        }
+        res.cache.evictions += stats.cache.evictions;
+        res.pages_read += stats.pages_read;
+        res.bytes_read += stats.bytes_read;
+        res.pages_written += stats.pages_written;
+        res.bytes_written += stats.bytes_written;
+        res.writes += stats.writes;
+        res.splits += stats.splits;
+        res.filtered += stats.filtered;
+        res.record_cache.hits += stats.record_cache.hits;
+        res.record_cache.misses += stats.record_cache.misses;
+        res.record_cache.evictions += stats.record_cache.evictions;
+        add_latency(res.find_latency, stats.find_latency);
+        add_latency(res.insert_latency, stats.insert_latency);
+    }
+    return res;
+}
+
+template <typename T, typename Layout>
+void ShardedBTreeDB<T, Layout>::add_latency(LatencySummary& total, const LatencySummary& shard) {
+    uint64_t count = total.count + shard.count;
+    if (count == 0) {
+        return;
+    }
+    total.mean_ns = (total.mean_ns * total.count + shard.mean_ns * shard.count) / count;
+    total.count = count;
+    total.p50_ns = std::max(total.p50_ns, shard.p50_ns);
+    total.p90_ns = std::max(total.p90_ns, shard.p90_ns);
+    total.p99_ns = std::max(total.p99_ns, shard.p99_ns);
+    total.p999_ns = std::max(total.p999_ns, shard.p999_ns);
+    total.max_ns = std::max(total.max_ns, shard.max_ns);
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::ShardIterator(Iter it, Iter end, unsigned int shard, unsigned int shards): it_(it), end_(end), shard_(shard), shards_(shards) {
+    skip();
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+decltype(*std::declval<Iter>()) ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::operator*() const {
+    return *it_;
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+Iter ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::operator->() const {
+    return it_;
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+typename ShardedBTreeDB<T, Layout>::template ShardIterator<Iter>& ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::operator++() {
+    ++it_;
+    skip();
+    return *this;
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+bool ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::operator==(const ShardIterator& other) const {
+    return it_ == other.it_;
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+bool ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::operator!=(const ShardIterator& other) const {
+    return it_ != other.it_;
+}
+
+template <typename T, typename Layout>
+template <typename Iter>
+void ShardedBTreeDB<T, Layout>::ShardIterator<Iter>::skip() {
+    while (it_ != end_ && shard_of((*it_).first, shards_) != shard_) {
+        ++it_;
+    }
+}
+
+template <typename T, typename Layout>
+template <typename F>
+void ShardedBTreeDB<T, Layout>::run_shards(const std::vector<unsigned int>& shards, F f) {
+    // every shard already runs its own writeback threads, so the work is only spread over as many threads as can run at once
+    size_t num_threads = std::min<size_t>({shards.size(), MAX_SHARD_THREADS, std::max(std::thread::hardware_concurrency(), 1u)});
+
+    std::vector<std::exception_ptr> errors(shards.size());
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < shards.size(); i = next++) {
+            try {
+                f(shards[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
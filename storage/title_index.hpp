@@ -0,0 +1,203 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+#include "btree_db_v2.hpp"
+#include "btree_types.cpp"
+#include "posting_index.hpp"
+
+#define TITLE_SEARCH_BATCH 256 // how many candidates are checked against their stored titles at once
+
+/**
+    This class is a trigram index over paper titles, used to search titles by substring or by keywords without scanning every paper.
+
+    Titles are normalized first (lowercased, with everything that isn't a letter or digit turned into a single space), and every run of 3 characters of the normalized title is a trigram. The index is a PostingIndex from each trigram to the ids of the papers whose titles contain it. A query is answered by intersecting the lists of the query's trigrams (shortest list first, so the candidates shrink as fast as possible) and then checking the remaining candidates against their stored titles, since having every trigram doesn't guarantee having the whole string.
+
+    Titles are indexed as they are stored in the paper database: whole with slotted value pages (as build_db writes it), and cut off at 95 characters with fixed ones, in which case only that part of a title can be found.
+*/
+class TitleIndex {
+    public:
+        /**
+            Opens an index previously written with a builder filled by add_title.
+
+            @param filename The file the index is stored in
+        */
+        TitleIndex(const std::string& filename);
+
+        /**
+            Adds the trigrams of a title to an index being built. Titles must be added in increasing id order.
+
+            @param builder The builder of the index
+            @param title The title (null terminated)
+            @param id The id of the paper
+        */
+        static void add_title(PostingIndex::Builder& builder, const char* title, long id);
+
+        /**
+            Searches for papers by title.
+
+            @param db The paper database the index was built from (a BTreeDB or a ShardedBTreeDB); used to check candidates
+            @param query The text to search for
+            @param keywords If false, titles must contain the query as a substring; if true, titles must contain each word of the query (in any order)
+            @param limit The maximum number of results (0 for no limit)
+            @return the ids of matching papers in increasing order
+        */
+        template <typename DB>
+        std::vector<long> search(DB& db, const std::string& query, bool keywords, size_t limit);
+
+        /**
+            Lowercases a string and replaces every run of characters that aren't letters or digits with a single space.
+
+            @param text The text to normalize
+            @return the normalized text
+        */
+        static std::string normalize(const std::string& text);
+
+        /**
+            Returns the distinct trigrams of a normalized string, packed into numbers.
+
+            @param normalized The normalized string
+            @return the trigram codes, sorted
+        */
+        static std::vector<long> trigrams(const std::string& normalized);
+
+    private:
+        /**
+            Returns the ids of the papers that have every one of the passed in trigrams.
+
+            @param codes The trigram codes
+            @return the candidate ids in increasing order
+        */
+        std::vector<long> candidates(const std::vector<long>& codes) const;
+
+        PostingIndex index_;
+};
+
+inline TitleIndex::TitleIndex(const std::string& filename): index_(filename) {}
+
+inline std::string TitleIndex::normalize(const std::string& text) {
+    std::string res;
+    res.reserve(text.size());
+
+    for (char c : text) {
+        if (c >= 'A' && c <= 'Z') {
+            res.push_back(c - 'A' + 'a');
+        } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            res.push_back(c);
+        } else if (!res.empty() && res.back() != ' ') {
+            res.push_back(' ');
+        }
+    }
+
+    if (!res.empty() && res.back() == ' ') {
+        res.pop_back();
+    }
+    return res;
+}
+
+inline std::vector<long> TitleIndex::trigrams(const std::string& normalized) {
+    // normalized strings only have 37 different characters: space, letters, and digits
+    auto code = [](char c) -> long {
+        if (c == ' ') return 0;
+        if (c >= 'a' && c <= 'z') return c - 'a' + 1;
+        return c - '0' + 27;
+    };
+
+    std::vector<long> res;
+    for (size_t i = 0; i + 3 <= normalized.size(); ++i) {
+        res.push_back((code(normalized[i]) * 37 + code(normalized[i + 1])) * 37 + code(normalized[i + 2]));
+    }
+
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+inline void TitleIndex::add_title(PostingIndex::Builder& builder, const char* title, long id) {
+    for (long code : trigrams(normalize(title))) {
+        builder.add(code, id);
+    }
+}
+
+inline std::vector<long> TitleIndex::candidates(const std::vector<long>& codes) const {
+    // intersect the shortest lists first so that the running result is as small as possible
+    std::vector<std::pair<uint64_t, long>> order;
+    for (long code : codes) {
+        order.push_back({index_.count(code), code});
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<long> res;
+    if (order.empty() || order[0].first == 0) {
+        return res;
+    }
+
+    res = index_.get(order[0].second);
+    std::vector<long> merged;
+    for (size_t i = 1; i < order.size() && !res.empty(); ++i) {
+        std::vector<long> list = index_.get(order[i].second);
+        merged.clear();
+        std::set_intersection(res.begin(), res.end(), list.begin(), list.end(), std::back_inserter(merged));
+        res.swap(merged);
+    }
+
+    return res;
+}
+
+template <typename DB>
+std::vector<long> TitleIndex::search(DB& db, const std::string& query, bool keywords, size_t limit) {
+    std::string normalized = normalize(query);
+
+    // the words each title has to contain, and the trigrams that narrow down which titles to check
+    std::vector<std::string> words;
+    std::vector<long> codes;
+    if (keywords) {
+        size_t start = 0;
+        while (start < normalized.size()) {
+            size_t end = normalized.find(' ', start);
+            if (end == std::string::npos) end = normalized.size();
+            words.push_back(normalized.substr(start, end - start));
+            start = end + 1;
+        }
+    } else {
+        words.push_back(normalized);
+    }
+    for (const std::string& word : words) {
+        std::vector<long> word_codes = trigrams(word);
+        codes.insert(codes.end(), word_codes.begin(), word_codes.end());
+    }
+
+    if (codes.empty()) {
+        throw std::runtime_error("title search needs at least 3 letters or digits in a row");
+    }
+
+    std::vector<long> ids = candidates(codes);
+
+    // check the candidates against their titles in batches until there are enough results
+    std::vector<long> res;
+    for (size_t i = 0; i < ids.size() && (limit == 0 || res.size() < limit); i += TITLE_SEARCH_BATCH) {
+        std::vector<long> batch(ids.begin() + i, ids.begin() + std::min(ids.size(), i + TITLE_SEARCH_BATCH));
+        std::vector<paper::Entry> papers = db.find_many(batch);
+
+        for (size_t j = 0; j < batch.size() && (limit == 0 || res.size() < limit); ++j) {
+            std::string title = normalize(papers[j].title);
+            bool match = true;
+            for (const std::string& word : words) {
+                if (title.find(word) == std::string::npos) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match) {
+                res.push_back(batch[j]);
+            }
+        }
+    }
+
+    return res;
+}
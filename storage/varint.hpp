@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+    Helpers for variable length integers (LEB128: 7 bits per byte, high bit set on every byte but the last) and for lists of sorted ids stored as the varint gaps between them. Small numbers take a single byte, so sorted id lists shrink to a byte or two per id when the ids are close together.
+*/
+
+/**
+    Appends a varint to a buffer.
+
+    @param out The buffer to append to
+    @param x The number to encode
+*/
+inline void put_varint(std::vector<char>& out, uint64_t x) {
+    while (x >= 0x80) {
+        out.push_back(static_cast<char>((x & 0x7F) | 0x80));
+        x >>= 7;
+    }
+    out.push_back(static_cast<char>(x));
+}
+
+/**
+    Reads a varint and moves the pointer past it.
+
+    @param data Pointer to the start of the varint; moved to the byte after it
+    @return the decoded number
+*/
+inline uint64_t get_varint(const char*& data) {
+    uint64_t res = 0;
+    unsigned int shift = 0;
+    while (true) {
+        unsigned char byte = static_cast<unsigned char>(*data++);
+        res |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return res;
+        }
+        shift += 7;
+    }
+}
+
+/**
+    Appends a signed number as a varint, zigzag encoded (0, -1, 1, -2, ... become 0, 1, 2, 3, ...) so that small negative numbers stay small.
+
+    @param out The buffer to append to
+    @param x The number to encode
+*/
+inline void put_signed_varint(std::vector<char>& out, int64_t x) {
+    put_varint(out, (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63));
+}
+
+/**
+    Reads a varint written by put_signed_varint and moves the pointer past it.
+
+    @param data Pointer to the start of the varint; moved to the byte after it
+    @return the decoded number
+*/
+inline int64_t get_signed_varint(const char*& data) {
+    uint64_t x = get_varint(data);
+    return static_cast<int64_t>((x >> 1) ^ (~(x & 1) + 1));
+}
+
+/**
+    Appends a list of ids sorted in increasing order, each stored as the gap from the one before it (the first is stored as is). Ids must be non-negative.
+
+    @param out The buffer to append to
+    @param begin Iterator to the first id
+    @param end Iterator past the last id
+*/
+template <typename Iter>
+void put_deltas(std::vector<char>& out, Iter begin, Iter end) {
+    uint64_t prev = 0;
+    for (; begin != end; ++begin) {
+        uint64_t curr = static_cast<uint64_t>(*begin);
+        put_varint(out, curr - prev);
+        prev = curr;
+    }
+}
+
+/**
+    Reads a list of ids written by put_deltas.
+
+    @param data Pointer to the start of the list; moved past it
+    @param count How many ids are in the list
+    @param out The vector to append the ids to
+*/
+inline void get_deltas(const char*& data, uint64_t count, std::vector<long>& out) {
+    uint64_t curr = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        curr += get_varint(data);
+        out.push_back(static_cast<long>(curr));
+    }
+}
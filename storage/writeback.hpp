@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "buffer_pool.hpp"
+
+#define MAX_WRITE_PAGES 256 // most pages merged into a single write by the writeback thread
+#define IO_ALIGN_BYTES 4096 // alignment of the page copies; direct I/O (see BTreeConfig::direct_io) needs every buffer it reads or writes aligned to the disk's blocks
+
+/**
+    This class writes pages back to disk on a background thread, so that writers only pay for copying a page instead of waiting on the disk. Pages are queued as copies; the thread takes everything queued at once, sorts it by file and page number, and merges runs of neighboring pages into single writes.
+
+    The queue holds at most a fixed number of pages; queuing another page waits for the thread to make room, which keeps memory bounded when pages are written faster than the disk can take them. A page that is queued again before it was written just has its copy replaced. Reads of pages that are still queued or being written have to be served from the copies (see read_pending), since the file doesn't have their latest data yet.
+
+    Like BufferPool, this doesn't know anything about the files; the owner provides a function that writes a run of pages. Errors thrown by it on the thread are rethrown by the next enqueue or drain.
+*/
+class Writeback {
+    public:
+        /**
+            This struct frees a page copy allocated with IO_ALIGN_BYTES alignment.
+        */
+        struct AlignedDelete {
+            void operator()(char* data) const {
+                ::operator delete[](data, std::align_val_t(IO_ALIGN_BYTES));
+            }
+        };
+        typedef std::unique_ptr<char[], AlignedDelete> PageCopy;
+
+        /**
+            Function used to write a run of pages. Arguments are the file type, the page number of the first page, and the data of each page of the run (consecutive page numbers).
+        */
+        typedef std::function<void(FileType, unsigned int, const std::vector<const char*>&)> WriteFunction;
+
+        /**
+            Constructor for the writeback queue. Starts the thread.
+
+            @param page_size The size of every page in bytes
+            @param max_pages How many pages may be queued at once (at least 1)
+            @param writer Function used to write runs of pages
+        */
+        Writeback(unsigned int page_size, size_t max_pages, WriteFunction writer);
+
+        /**
+            Destructor. Writes everything that is still queued and stops the thread. Errors are dropped; call drain first to see them.
+        */
+        ~Writeback();
+
+        Writeback(const Writeback& other) = delete;
+        Writeback& operator=(const Writeback& other) = delete;
+
+        /**
+            Queues a copy of a page to be written. Waits for room if the queue is full.
+
+            @param type Which file the page belongs to
+            @param page_num The page number
+            @param data The page data to copy
+        */
+        void enqueue(FileType type, unsigned int page_num, const char* data);
+
+        /**
+            Wakes the thread to start writing what has been queued so far. The thread also wakes by itself once the queue is half full.
+        */
+        void submit();
+
+        /**
+            Copies the latest queued data of a page, if the page hasn't been written yet.
+
+            @param type Which file the page belongs to
+            @param page_num The page number
+            @param dest Where to copy the page data to
+            @return whether the page was pending (and dest was filled)
+        */
+        bool read_pending(FileType type, unsigned int page_num, char* dest);
+
+        /**
+            Waits until every queued page has been written.
+        */
+        void drain();
+
+    private:
+        /**
+            Packs a file type and page number into one key; sorting the keys puts pages in file/page order.
+        */
+        static uint64_t make_tag(FileType type, unsigned int page_num);
+
+        /**
+            Main loop of the thread.
+        */
+        void run();
+
+        /**
+            Writes every page of writing_, merging neighboring pages into runs. Called by the thread without holding the lock.
+        */
+        void write_batch();
+
+        unsigned int page_size_;
+        size_t max_pages_;
+        WriteFunction writer_;
+
+        /**
+            Pages waiting for the thread, by tag.
+        */
+        std::map<uint64_t, PageCopy> queued_;
+        /**
+            Pages the thread is currently writing. Only changed while holding the lock, so readers holding it can look through it.
+        */
+        std::map<uint64_t, PageCopy> writing_;
+        /**
+            Buffers of written pages, reused by enqueue.
+        */
+        std::vector<PageCopy> spare_;
+
+        std::mutex mutex_;
+        /**
+            Signaled when there is something for the thread to do.
+        */
+        std::condition_variable work_ready_;
+        /**
+            Signaled when the thread takes or finishes a batch.
+        */
+        std::condition_variable work_done_;
+        bool stopping_;
+        std::exception_ptr error_;
+
+        /**
+            Declared last so everything it uses is initialized before it starts.
+        */
+        std::thread thread_;
+};
+
+inline Writeback::Writeback(unsigned int page_size, size_t max_pages, WriteFunction writer): page_size_(page_size), max_pages_(std::max<size_t>(max_pages, 1)), writer_(writer), stopping_(false) {
+    thread_ = std::thread(&Writeback::run, this);
+}
+
+inline Writeback::~Writeback() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_one();
+    thread_.join();
+}
+
+inline uint64_t Writeback::make_tag(FileType type, unsigned int page_num) {
+    return (static_cast<uint64_t>(type) << 32) | page_num;
+}
+
+inline void Writeback::enqueue(FileType type, unsigned int page_num, const char* data) {
+    uint64_t tag = make_tag(type, page_num);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto found = queued_.find(tag);
+    if (found == queued_.end()) {
+        // a new page needs room in the queue; make sure the thread is working on it
+        if (queued_.size() >= max_pages_) {
+            work_ready_.notify_one();
+            work_done_.wait(lock, [this] { return queued_.size() < max_pages_ || error_; });
+        }
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+
+        PageCopy buffer;
+        if (spare_.empty()) {
+            buffer.reset(new (std::align_val_t(IO_ALIGN_BYTES)) char[page_size_]);
+        } else {
+            buffer = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        found = queued_.emplace(tag, std::move(buffer)).first;
+    }
+    memcpy(found->second.get(), data, page_size_);
+
+    if (queued_.size() >= max_pages_ / 2) {
+        work_ready_.notify_one();
+    }
+}
+
+inline void Writeback::submit() {
+    work_ready_.notify_one();
+}
+
+inline bool Writeback::read_pending(FileType type, unsigned int page_num, char* dest) {
+    uint64_t tag = make_tag(type, page_num);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // the queued copy is newer than the one being written
+    auto found = queued_.find(tag);
+    if (found == queued_.end()) {
+        found = writing_.find(tag);
+        if (found == writing_.end()) {
+            return false;
+        }
+    }
+    memcpy(dest, found->second.get(), page_size_);
+    return true;
+}
+
+inline void Writeback::drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_ready_.notify_one();
+    work_done_.wait(lock, [this] { return (queued_.empty() && writing_.empty()) || error_; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+inline void Writeback::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_ready_.wait(lock, [this] { return stopping_ || !queued_.empty(); });
+        if (queued_.empty()) {
+            return;
+        }
+
+        // take everything queued so far; the queue has room again
+        writing_.swap(queued_);
+        work_done_.notify_all();
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            write_batch();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error && !error_) {
+            error_ = error;
+        }
+        for (auto& entry : writing_) {
+            spare_.push_back(std::move(entry.second));
+        }
+        writing_.clear();
+        work_done_.notify_all();
+    }
+}
+
+inline void Writeback::write_batch() {
+    // writing_ is sorted by tag, so runs of neighboring pages are next to each other
+    std::vector<const char*> run;
+    FileType run_type = Key;
+    unsigned int run_start = 0;
+
+    for (const auto& entry : writing_) {
+        FileType type = static_cast<FileType>(entry.first >> 32);
+        unsigned int page_num = static_cast<unsigned int>(entry.first);
+
+        if (!run.empty() && (type != run_type || page_num != run_start + run.size() || run.size() == MAX_WRITE_PAGES)) {
+            writer_(run_type, run_start, run);
+            run.clear();
+        }
+        if (run.empty()) {
+            run_type = type;
+            run_start = page_num;
+        }
+        run.push_back(entry.second.get());
+    }
+
+    if (!run.empty()) {
+        writer_(run_type, run_start, run);
+    }
+}